@@ -21,6 +21,15 @@
 
 #include <QLoggingCategory>
 #include <qtconcurrentrun.h>
+#include <QCryptographicHash>
+#include <QFile>
+
+#include <memory>
+#include <vector>
+
+#ifdef ZLIB_FOUND
+#include <zlib.h>
+#endif
 
 /** \file checksums.cpp
  *
@@ -73,6 +82,11 @@
  * - Adler32 (requires zlib)
  * - MD5
  * - SHA1
+ * - SHA256
+ *
+ * When a file's checksum is needed in several types, for example a content
+ * checksum and a different transmission checksum, ComputeChecksum can
+ * compute all of them in a single pass over the file.
  *
  */
 
@@ -94,7 +108,9 @@ QByteArray findBestChecksum(const QByteArray &checksums)
 {
     int i = 0;
     // The order of the searches here defines the preference ordering.
+    // SHA1 stays first as it is the default content checksum type.
     if (-1 != (i = checksums.indexOf("SHA1:"))
+        || -1 != (i = checksums.indexOf("SHA256:"))
         || -1 != (i = checksums.indexOf("MD5:"))
         || -1 != (i = checksums.indexOf("Adler32:"))) {
         // Now i is the start of the best checksum
@@ -169,44 +185,77 @@ QByteArray ComputeChecksum::checksumType() const
     return _checksumType;
 }
 
+void ComputeChecksum::setAdditionalChecksumTypes(const QVector<QByteArray> &types)
+{
+    _additionalChecksumTypes = types;
+}
+
+QByteArray ComputeChecksum::checksum(const QByteArray &type) const
+{
+    if (type.isEmpty())
+        return QByteArray();
+    if (type == _checksumType)
+        return _checksums.value(0);
+    const int i = _additionalChecksumTypes.indexOf(type);
+    return i < 0 ? QByteArray() : _checksums.value(i + 1);
+}
+
 void ComputeChecksum::start(const QString &filePath)
 {
-    qCInfo(lcChecksums) << "Computing" << checksumType() << "checksum of" << filePath << "in a thread";
+    qCInfo(lcChecksums) << "Computing" << checksumType() << _additionalChecksumTypes << "checksum of" << filePath << "in a thread";
 
     // Calculate the checksum in a different thread first.
     connect(&_watcher, &QFutureWatcherBase::finished,
         this, &ComputeChecksum::slotCalculationDone,
         Qt::UniqueConnection);
-    _watcher.setFuture(QtConcurrent::run(ComputeChecksum::computeNow, filePath, checksumType()));
+    _checksums.clear();
+    const auto types = QVector<QByteArray>{ checksumType() } + _additionalChecksumTypes;
+    _watcher.setFuture(QtConcurrent::run([filePath, types]() {
+        return ComputeChecksum::computeNow(filePath, types);
+    }));
 }
 
 QByteArray ComputeChecksum::computeNow(const QString &filePath, const QByteArray &checksumType)
 {
-    if (!checksumComputationEnabled()) {
-        qCWarning(lcChecksums) << "Checksum computation disabled by environment variable";
-        return QByteArray();
+    return computeNow(filePath, QVector<QByteArray>{ checksumType }).first();
+}
+
+QVector<QByteArray> ComputeChecksum::computeNow(const QString &filePath, const QVector<QByteArray> &checksumTypes)
+{
+    QVector<QByteArray> result(checksumTypes.size());
+    IncrementalChecksums checksums(checksumTypes);
+    if (checksums.isEmpty()) {
+        return result;
     }
 
-    if (checksumType == checkSumMD5C) {
-        return FileSystem::calcMd5(filePath);
-    } else if (checksumType == checkSumSHA1C) {
-        return FileSystem::calcSha1(filePath);
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Unbuffered)) {
+        qCWarning(lcChecksums) << "Could not open" << filePath << "for computing checksums:" << file.errorString();
+        return result;
     }
-#ifdef ZLIB_FOUND
-    else if (checksumType == checkSumAdlerC) {
-        return FileSystem::calcAdler32(filePath);
+
+    // Large reads straight into our buffer, every algorithm is fed from it
+    const qint64 bufferSize = 1024 * 1024;
+    QByteArray buffer(static_cast<int>(bufferSize), Qt::Uninitialized);
+    qint64 read = 0;
+    while ((read = file.read(buffer.data(), bufferSize)) > 0) {
+        checksums.addData(buffer.constData(), read);
     }
-#endif
-    // for an unknown checksum or no checksum, we're done right now
-    if (!checksumType.isEmpty()) {
-        qCWarning(lcChecksums) << "Unknown checksum type:" << checksumType;
+    if (read < 0) {
+        qCWarning(lcChecksums) << "Error reading" << filePath << "for computing checksums:" << file.errorString();
+        return result;
     }
-    return QByteArray();
+
+    for (int i = 0; i < checksumTypes.size(); ++i) {
+        result[i] = checksums.result(checksumTypes.at(i));
+    }
+    return result;
 }
 
 void ComputeChecksum::slotCalculationDone()
 {
-    QByteArray checksum = _watcher.future().result();
+    _checksums = _watcher.future().result();
+    QByteArray checksum = _checksums.value(0);
     if (!checksum.isNull()) {
         emit done(_checksumType, checksum);
     } else {
@@ -215,13 +264,77 @@ void ComputeChecksum::slotCalculationDone()
 }
 
 
+IncrementalChecksums::IncrementalChecksums(const QVector<QByteArray> &checksumTypes)
+{
+    if (!checksumComputationEnabled()) {
+        qCWarning(lcChecksums) << "Checksum computation disabled by environment variable";
+        return;
+    }
+
+    for (const auto &checksumType : checksumTypes) {
+        Algorithm algorithm;
+        algorithm.type = checksumType;
+        if (checksumType == checkSumMD5C) {
+            algorithm.hash.reset(new QCryptographicHash(QCryptographicHash::Md5));
+        } else if (checksumType == checkSumSHA1C) {
+            algorithm.hash.reset(new QCryptographicHash(QCryptographicHash::Sha1));
+        } else if (checksumType == checkSumSHA2C) {
+            algorithm.hash.reset(new QCryptographicHash(QCryptographicHash::Sha256));
+        }
+#ifdef ZLIB_FOUND
+        else if (checksumType == checkSumAdlerC) {
+            algorithm.adler = adler32(0L, Z_NULL, 0);
+        }
+#endif
+        else {
+            // for an unknown checksum or no checksum, there is nothing to do
+            if (!checksumType.isEmpty()) {
+                qCWarning(lcChecksums) << "Unknown checksum type:" << checksumType;
+            }
+            continue;
+        }
+        _algorithms.push_back(std::move(algorithm));
+    }
+}
+
+IncrementalChecksums::~IncrementalChecksums() = default;
+
+void IncrementalChecksums::addData(const char *data, qint64 length)
+{
+    for (auto &algorithm : _algorithms) {
+        if (algorithm.hash) {
+            algorithm.hash->addData(data, static_cast<int>(length));
+        }
+#ifdef ZLIB_FOUND
+        else {
+            algorithm.adler = adler32(algorithm.adler, reinterpret_cast<const Bytef *>(data), static_cast<uInt>(length));
+        }
+#endif
+    }
+}
+
+QByteArray IncrementalChecksums::result(const QByteArray &checksumType) const
+{
+    for (const auto &algorithm : _algorithms) {
+        if (algorithm.type != checksumType)
+            continue;
+        if (algorithm.hash)
+            return algorithm.hash->result().toHex();
+        return QByteArray::number(static_cast<quint32>(algorithm.adler), 16);
+    }
+    return QByteArray();
+}
+
 ValidateChecksumHeader::ValidateChecksumHeader(QObject *parent)
     : QObject(parent)
 {
 }
 
-void ValidateChecksumHeader::start(const QString &filePath, const QByteArray &checksumHeader)
+void ValidateChecksumHeader::start(const QString &filePath, const QByteArray &checksumHeader,
+    const IncrementalChecksums *computedChecksums)
 {
+    _additionalChecksum = computedChecksums ? computedChecksums->result(_additionalChecksumType) : QByteArray();
+
     // If the incoming header is empty no validation can happen. Just continue.
     if (checksumHeader.isEmpty()) {
         emit validated(QByteArray(), QByteArray());
@@ -234,15 +347,39 @@ void ValidateChecksumHeader::start(const QString &filePath, const QByteArray &ch
         return;
     }
 
+    if (computedChecksums) {
+        const auto checksum = computedChecksums->result(_expectedChecksumType);
+        if (!checksum.isNull()) {
+            checkChecksum(_expectedChecksumType, checksum);
+            return;
+        }
+    }
+
     auto calculator = new ComputeChecksum(this);
     calculator->setChecksumType(_expectedChecksumType);
+    if (!_additionalChecksumType.isEmpty() && _additionalChecksumType != _expectedChecksumType) {
+        calculator->setAdditionalChecksumTypes({ _additionalChecksumType });
+    }
     connect(calculator, &ComputeChecksum::done,
         this, &ValidateChecksumHeader::slotChecksumCalculated);
     calculator->start(filePath);
 }
 
+void ValidateChecksumHeader::setAdditionalChecksumType(const QByteArray &type)
+{
+    _additionalChecksumType = type;
+}
+
 void ValidateChecksumHeader::slotChecksumCalculated(const QByteArray &checksumType,
     const QByteArray &checksum)
+{
+    if (auto calculator = qobject_cast<ComputeChecksum *>(sender())) {
+        _additionalChecksum = calculator->checksum(_additionalChecksumType);
+    }
+    checkChecksum(checksumType, checksum);
+}
+
+void ValidateChecksumHeader::checkChecksum(const QByteArray &checksumType, const QByteArray &checksum)
 {
     if (checksumType != _expectedChecksumType) {
         emit validationFailed(tr("The checksum header contained an unknown checksum type '%1'").arg(QString::fromLatin1(_expectedChecksumType)));
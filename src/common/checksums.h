@@ -23,6 +23,11 @@
 #include <QObject>
 #include <QByteArray>
 #include <QFutureWatcher>
+#include <QCryptographicHash>
+#include <QVector>
+
+#include <memory>
+#include <vector>
 
 namespace OCC {
 
@@ -32,6 +37,7 @@ namespace OCC {
  */
 static const char checkSumMD5C[] = "MD5";
 static const char checkSumSHA1C[] = "SHA1";
+static const char checkSumSHA2C[] = "SHA256";
 static const char checkSumAdlerC[] = "Adler32";
 
 class SyncJournalDb;
@@ -62,6 +68,36 @@ OCSYNC_EXPORT bool uploadChecksumEnabled();
 OCSYNC_EXPORT QByteArray contentChecksumType();
 
 
+/**
+ * Computes checksums of several types over data that is passed in piece by
+ * piece, for example while it is being transferred.
+ * \ingroup libsync
+ */
+class OCSYNC_EXPORT IncrementalChecksums
+{
+public:
+    /// Types that are empty or unknown are ignored
+    explicit IncrementalChecksums(const QVector<QByteArray> &checksumTypes);
+    ~IncrementalChecksums();
+
+    /// Whether no checksum at all is computed
+    bool isEmpty() const { return _algorithms.empty(); }
+
+    void addData(const char *data, qint64 length);
+
+    /// The checksum of the data added so far, null if the type isn't computed
+    QByteArray result(const QByteArray &checksumType) const;
+
+private:
+    struct Algorithm
+    {
+        QByteArray type;
+        std::unique_ptr<QCryptographicHash> hash;
+        unsigned long adler = 0; // if there is no hash
+    };
+    std::vector<Algorithm> _algorithms;
+};
+
 /**
  * Computes the checksum of a file.
  * \ingroup libsync
@@ -79,6 +115,21 @@ public:
 
     QByteArray checksumType() const;
 
+    /**
+     * Sets checksum types to compute in the same pass over the file, so that
+     * a file whose checksum is needed in several types is only read once.
+     *
+     * done() reports the checksumType() checksum only; the others can be
+     * retrieved with checksum() from a slot connected to it.
+     */
+    void setAdditionalChecksumTypes(const QVector<QByteArray> &types);
+
+    /**
+     * Returns the checksum of the given type computed by the last run,
+     * null if it wasn't computed.
+     */
+    QByteArray checksum(const QByteArray &type) const;
+
     /**
      * Computes the checksum for the given file path.
      *
@@ -91,6 +142,14 @@ public:
      */
     static QByteArray computeNow(const QString &filePath, const QByteArray &checksumType);
 
+    /**
+     * Computes the checksums of several types synchronously, reading the file once.
+     *
+     * The result has one entry per type, null for unknown types and for all
+     * of them if the file couldn't be read.
+     */
+    static QVector<QByteArray> computeNow(const QString &filePath, const QVector<QByteArray> &checksumTypes);
+
 signals:
     void done(const QByteArray &checksumType, const QByteArray &checksum);
 
@@ -99,9 +158,13 @@ private slots:
 
 private:
     QByteArray _checksumType;
+    QVector<QByteArray> _additionalChecksumTypes;
+
+    // Results of the last run: _checksumType first, then the additional ones
+    QVector<QByteArray> _checksums;
 
     // watcher for the checksum calculation thread
-    QFutureWatcher<QByteArray> _watcher;
+    QFutureWatcher<QVector<QByteArray>> _watcher;
 };
 
 /**
@@ -120,8 +183,20 @@ public:
      * If no checksum is there, or if a correct checksum is there, the signal validated()
      * will be emitted. In case of any kind of error, the signal validationFailed() will
      * be emitted.
+     *
+     * If computedChecksums has the needed types, for example because they were
+     * computed while the data was transferred, the file isn't read at all.
      */
-    void start(const QString &filePath, const QByteArray &checksumHeader);
+    void start(const QString &filePath, const QByteArray &checksumHeader,
+        const IncrementalChecksums *computedChecksums = nullptr);
+
+    /**
+     * Also computes a checksum of this type while reading the file for the
+     * validation. Once validated() was emitted, it is available from
+     * additionalChecksum(), null if it wasn't computed.
+     */
+    void setAdditionalChecksumType(const QByteArray &type);
+    QByteArray additionalChecksum() const { return _additionalChecksum; }
 
 signals:
     void validated(const QByteArray &checksumType, const QByteArray &checksum);
@@ -131,8 +206,13 @@ private slots:
     void slotChecksumCalculated(const QByteArray &checksumType, const QByteArray &checksum);
 
 private:
+    // Compares the checksum to the expected one and emits the result
+    void checkChecksum(const QByteArray &checksumType, const QByteArray &checksum);
+
     QByteArray _expectedChecksumType;
     QByteArray _expectedChecksum;
+    QByteArray _additionalChecksumType;
+    QByteArray _additionalChecksum;
 };
 
 /**
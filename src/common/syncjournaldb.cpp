@@ -24,6 +24,7 @@
 #include <QUrl>
 #include <QDir>
 #include <QStandardPaths>
+#include <QThread>
 #include <sqlite3.h>
 
 #include "common/syncjournaldb.h"
@@ -41,6 +42,16 @@
 #define IS_PREFIX_PATH_OR_EQUAL(prefix, path) \
     "(" path " == " prefix " OR " IS_PREFIX_PATH_OF(prefix, path) ")"
 
+// Sorting by this key puts the contents of a directory directly behind it:
+// foo-2, foo, foo/file instead of foo, foo-2, foo/file. The metadata_path_sort
+// index is on this expression.
+#define PATH_SORT_KEY(path) path "||'/'"
+// Same as IS_PREFIX_PATH_OF, but written on PATH_SORT_KEY so the index is used:
+// the keys of path's descendants are the ones between prefix/ and prefix0,
+// excluding prefix/ which is the key of prefix itself.
+#define IS_PREFIX_PATH_OF_SORT_KEY(prefix, path) \
+    "(" PATH_SORT_KEY(path) " > (" prefix "||'/') AND " PATH_SORT_KEY(path) " < (" prefix "||'0'))"
+
 namespace OCC {
 
 Q_LOGGING_CATEGORY(lcDb, "nextcloud.sync.database", QtInfoMsg)
@@ -102,6 +113,14 @@ SyncJournalDb::SyncJournalDb(const QString &dbFilePath, QObject *parent)
     if (_journalMode.isEmpty()) {
         _journalMode = defaultJournalMode(_dbFile);
     }
+
+    _commitBatchTimer.setSingleShot(true);
+    connect(&_commitBatchTimer, &QTimer::timeout, this, [this] {
+        QMutexLocker lock(&_mutex);
+        if (_pendingCommits > 0)
+            commitBatch(QStringLiteral("batch timeout"));
+    });
+    _commitStatisticsTimer.start();
 }
 
 QString SyncJournalDb::makeDbName(const QUrl &remoteUrl,
@@ -416,6 +435,7 @@ bool SyncJournalDb::checkConnect()
                         "size INTEGER(8),"
                         "modtime INTEGER(8),"
                         "contentChecksum TEXT,"
+                        "chunksize INTEGER(8),"
                         "PRIMARY KEY(path)"
                         ");");
 
@@ -605,6 +625,7 @@ void SyncJournalDb::close()
     qCInfo(lcDb) << "Closing DB" << _dbFile;
 
     commitTransaction();
+    _pendingCommits = 0;
 
     _db.close();
     clearEtagStorageFilter();
@@ -745,6 +766,27 @@ bool SyncJournalDb::updateMetadataTableStructure()
         commitInternal("update database structure: add contentChecksum col for uploadinfo");
     }
 
+    if (!tableColumns("uploadinfo").contains("chunksize")) {
+        SqlQuery query(_db);
+        query.prepare("ALTER TABLE uploadinfo ADD COLUMN chunksize INTEGER(8);");
+        if (!query.exec()) {
+            sqlFail("updateMetadataTableStructure: add chunksize column", query);
+            re = false;
+        }
+        commitInternal("update database structure: add chunksize col for uploadinfo");
+    }
+
+    if (true) {
+        // Lets getFilesBelowPath() read subtrees in PATH_SORT_KEY order without sorting
+        SqlQuery query(_db);
+        query.prepare("CREATE INDEX IF NOT EXISTS metadata_path_sort ON metadata(" PATH_SORT_KEY("path") ");");
+        if (!query.exec()) {
+            sqlFail("updateMetadataTableStructure: create index path sort key", query);
+            re = false;
+        }
+        commitInternal("update database structure: add path sort key index");
+    }
+
     if (true) {
         SqlQuery query(_db);
         query.prepare("CREATE INDEX IF NOT EXISTS metadata_e2e_id ON metadata(e2eMangledName);");
@@ -755,6 +797,16 @@ bool SyncJournalDb::updateMetadataTableStructure()
         commitInternal("update database structure: add e2eMangledName index");
     }
 
+    if (true) {
+        SqlQuery query(_db);
+        query.prepare("CREATE INDEX IF NOT EXISTS metadata_content_checksum ON metadata(contentChecksum);");
+        if (!query.exec()) {
+            sqlFail("updateMetadataTableStructure: create index contentChecksum", query);
+            re = false;
+        }
+        commitInternal("update database structure: add contentChecksum index");
+    }
+
     return re;
 }
 
@@ -1093,6 +1145,34 @@ bool SyncJournalDb::getFileRecordsByFileId(const QByteArray &fileId, const std::
     return true;
 }
 
+bool SyncJournalDb::getFileRecordsByChecksum(const QByteArray &checksumType, const QByteArray &checksum, const std::function<void(const SyncJournalFileRecord &)> &rowCallback)
+{
+    QMutexLocker locker(&_mutex);
+
+    if (checksumType.isEmpty() || checksum.isEmpty() || _metadataTableIsEmpty)
+        return true; // no error, yet nothing found
+
+    if (!checkConnect())
+        return false;
+
+    if (!_getFileRecordQueryByChecksum.initOrReset(QByteArrayLiteral(GET_FILE_RECORD_QUERY " WHERE contentChecksum=?1 AND contentchecksumtype.name=?2"), _db))
+        return false;
+
+    _getFileRecordQueryByChecksum.bindValue(1, checksum);
+    _getFileRecordQueryByChecksum.bindValue(2, checksumType);
+
+    if (!_getFileRecordQueryByChecksum.exec())
+        return false;
+
+    while (_getFileRecordQueryByChecksum.next()) {
+        SyncJournalFileRecord rec;
+        fillFileRecordFromGetQuery(rec, _getFileRecordQueryByChecksum);
+        rowCallback(rec);
+    }
+
+    return true;
+}
+
 bool SyncJournalDb::getFilesBelowPath(const QByteArray &path, const std::function<void(const SyncJournalFileRecord&)> &rowCallback)
 {
     QMutexLocker locker(&_mutex);
@@ -1103,7 +1183,15 @@ bool SyncJournalDb::getFilesBelowPath(const QByteArray &path, const std::functio
     if (!checkConnect())
         return false;
 
+    // All queries are ordered by PATH_SORT_KEY. With the trailing /, the
+    // contents of a directory are sorted directly behind the directory itself.
+    // This property is used in fill_tree_from_db(). The metadata_path_sort
+    // index delivers the rows in that order, so they are not sorted in a
+    // temporary b-tree first.
+
     SqlQuery *query = nullptr;
+    // Records below path by mangled name only, in the same order
+    std::vector<SyncJournalFileRecord> mangledRecords;
 
     if(path.isEmpty()) {
         // Since the path column doesn't store the starting /, the getFilesBelowPathQuery
@@ -1111,22 +1199,36 @@ bool SyncJournalDb::getFilesBelowPath(const QByteArray &path, const std::functio
         // and find nothing. So, unfortunately, we have to use a different query for
         // retrieving the whole tree.
 
-        if (!_getAllFilesQuery.initOrReset(QByteArrayLiteral( GET_FILE_RECORD_QUERY " ORDER BY path||'/' ASC"), _db))
+        if (!_getAllFilesQuery.initOrReset(QByteArrayLiteral( GET_FILE_RECORD_QUERY " ORDER BY " PATH_SORT_KEY("path") " ASC"), _db))
             return false;
         query = &_getAllFilesQuery;
     } else {
+        // Entries of encrypted folders can be below path by their mangled
+        // name only. There are few of them, so they are fetched separately
+        // and merged in, instead of OR-ing them into the main query where
+        // they would keep the index from being used.
+        if (!_getFilesBelowMangledPathQuery.initOrReset(QByteArrayLiteral(
+                GET_FILE_RECORD_QUERY
+                " WHERE " IS_PREFIX_PATH_OF("?1", "e2eMangledName")
+                " AND NOT " IS_PREFIX_PATH_OF("?1", "path")
+                " ORDER BY " PATH_SORT_KEY("path") " ASC"), _db)) {
+            return false;
+        }
+        _getFilesBelowMangledPathQuery.bindValue(1, path);
+        if (!_getFilesBelowMangledPathQuery.exec()) {
+            return false;
+        }
+        while (_getFilesBelowMangledPathQuery.next()) {
+            mangledRecords.emplace_back();
+            fillFileRecordFromGetQuery(mangledRecords.back(), _getFilesBelowMangledPathQuery);
+        }
+
         // This query is used to skip discovery and fill the tree from the
         // database instead
         if (!_getFilesBelowPathQuery.initOrReset(QByteArrayLiteral(
                 GET_FILE_RECORD_QUERY
-                " WHERE " IS_PREFIX_PATH_OF("?1", "path")
-                " OR " IS_PREFIX_PATH_OF("?1", "e2eMangledName")
-                // We want to ensure that the contents of a directory are sorted
-                // directly behind the directory itself. Without this ORDER BY
-                // an ordering like foo, foo-2, foo/file would be returned.
-                // With the trailing /, we get foo-2, foo, foo/file. This property
-                // is used in fill_tree_from_db().
-                " ORDER BY path||'/' ASC"), _db)) {
+                " WHERE " IS_PREFIX_PATH_OF_SORT_KEY("?1", "path")
+                " ORDER BY " PATH_SORT_KEY("path") " ASC"), _db)) {
             return false;
         }
         query = &_getFilesBelowPathQuery;
@@ -1137,15 +1239,58 @@ bool SyncJournalDb::getFilesBelowPath(const QByteArray &path, const std::functio
         return false;
     }
 
+    auto sortsBefore = [](const QByteArray &a, const QByteArray &b) {
+        return a + '/' < b + '/';
+    };
+    auto mangledIt = mangledRecords.cbegin();
     while (query->next()) {
         SyncJournalFileRecord rec;
         fillFileRecordFromGetQuery(rec, *query);
+        for (; mangledIt != mangledRecords.cend() && sortsBefore(mangledIt->_path, rec._path); ++mangledIt)
+            rowCallback(*mangledIt);
         rowCallback(rec);
     }
+    for (; mangledIt != mangledRecords.cend(); ++mangledIt)
+        rowCallback(*mangledIt);
 
     return true;
 }
 
+std::unique_ptr<SyncJournalSnapshot> SyncJournalDb::loadSnapshot()
+{
+    QMutexLocker locker(&_mutex);
+
+    std::unique_ptr<SyncJournalSnapshot> snapshot(new SyncJournalSnapshot);
+    if (_metadataTableIsEmpty)
+        return snapshot;
+
+    if (!checkConnect())
+        return nullptr;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // Without ORDER BY this is a plain scan of the table, in rowid order
+    SqlQuery query(_db);
+    if (query.prepare(GET_FILE_RECORD_QUERY) != 0 || !query.exec()) {
+        return nullptr;
+    }
+
+    SyncJournalFileRecord rec;
+    while (query.next()) {
+        fillFileRecordFromGetQuery(rec, query);
+        snapshot->append(rec);
+    }
+    if (query.errorId() != SQLITE_DONE) {
+        qCWarning(lcDb) << "Failed to load the journal snapshot:" << query.error();
+        return nullptr;
+    }
+    snapshot->buildIndexes();
+
+    qCInfo(lcDb) << "Loaded" << snapshot->size() << "file records in" << timer.elapsed() << "ms";
+    return snapshot;
+}
+
 bool SyncJournalDb::postSyncCleanup(const QSet<QString> &filepathsToKeep,
     const QSet<QString> &prefixesToKeep)
 {
@@ -1443,7 +1588,7 @@ SyncJournalDb::UploadInfo SyncJournalDb::getUploadInfo(const QString &file)
 
     if (checkConnect()) {
         if (!_getUploadInfoQuery.initOrReset(QByteArrayLiteral(
-                "SELECT chunk, transferid, errorcount, size, modtime, contentChecksum FROM "
+                "SELECT chunk, transferid, errorcount, size, modtime, contentChecksum, chunksize FROM "
                 "uploadinfo WHERE path=?1"), _db)) {
             return res;
         }
@@ -1461,6 +1606,7 @@ SyncJournalDb::UploadInfo SyncJournalDb::getUploadInfo(const QString &file)
             res._size = _getUploadInfoQuery.int64Value(3);
             res._modtime = _getUploadInfoQuery.int64Value(4);
             res._contentChecksum = _getUploadInfoQuery.baValue(5);
+            res._chunkSize = _getUploadInfoQuery.int64Value(6);
             res._valid = ok;
         }
     }
@@ -1478,8 +1624,8 @@ void SyncJournalDb::setUploadInfo(const QString &file, const SyncJournalDb::Uplo
     if (i._valid) {
         if (!_setUploadInfoQuery.initOrReset(QByteArrayLiteral(
             "INSERT OR REPLACE INTO uploadinfo "
-            "(path, chunk, transferid, errorcount, size, modtime, contentChecksum) "
-            "VALUES ( ?1 , ?2, ?3 , ?4 ,  ?5, ?6 , ?7 )"), _db)) {
+            "(path, chunk, transferid, errorcount, size, modtime, contentChecksum, chunksize) "
+            "VALUES ( ?1 , ?2, ?3 , ?4 ,  ?5, ?6 , ?7, ?8 )"), _db)) {
             return;
         }
 
@@ -1490,6 +1636,7 @@ void SyncJournalDb::setUploadInfo(const QString &file, const SyncJournalDb::Uplo
         _setUploadInfoQuery.bindValue(5, i._size);
         _setUploadInfoQuery.bindValue(6, i._modtime);
         _setUploadInfoQuery.bindValue(7, i._contentChecksum);
+        _setUploadInfoQuery.bindValue(8, i._chunkSize);
 
         if (!_setUploadInfoQuery.exec()) {
             return;
@@ -2059,19 +2206,68 @@ void SyncJournalDb::clearFileTable()
 void SyncJournalDb::commit(const QString &context, bool startTrans)
 {
     QMutexLocker lock(&_mutex);
-    commitInternal(context, startTrans);
+    ++_commitStatistics.requests;
+    ++_pendingCommits;
+    commitBatch(context, startTrans);
 }
 
 void SyncJournalDb::commitIfNeededAndStartNewTransaction(const QString &context)
 {
     QMutexLocker lock(&_mutex);
     if (_transaction == 1) {
-        commitInternal(context, true);
+        commitBatch(context, true);
     } else {
         startTransaction();
     }
 }
 
+void SyncJournalDb::commitBatched(const QString &context)
+{
+    QMutexLocker lock(&_mutex);
+    ++_commitStatistics.requests;
+    ++_pendingCommits;
+    if (_pendingCommits < _maxCommitBatchSize) {
+        // The timer can only be started from its own thread, elsewhere the
+        // batch waits for its size or the next commit.
+        if (_pendingCommits == 1 && QThread::currentThread() == thread())
+            _commitBatchTimer.start();
+        return;
+    }
+    commitBatch(context);
+}
+
+void SyncJournalDb::setCommitBatching(int maxBatchSize, std::chrono::milliseconds maxDelay)
+{
+    QMutexLocker lock(&_mutex);
+    _maxCommitBatchSize = qMax(1, maxBatchSize);
+    _commitBatchTimer.setInterval(maxDelay.count());
+    if (_pendingCommits >= _maxCommitBatchSize)
+        commitBatch(QStringLiteral("batch size changed"));
+}
+
+SyncJournalDb::CommitStatistics SyncJournalDb::takeCommitStatistics()
+{
+    QMutexLocker lock(&_mutex);
+    CommitStatistics statistics = _commitStatistics;
+    auto elapsed = _commitStatisticsTimer.restart();
+    if (elapsed > 0)
+        statistics.commitsPerSecond = statistics.commits * 1000. / elapsed;
+    _commitStatistics = CommitStatistics();
+    return statistics;
+}
+
+void SyncJournalDb::commitBatch(const QString &context, bool startTrans)
+{
+    if (_transaction == 1) {
+        ++_commitStatistics.commits;
+        _commitStatistics.largestBatch = qMax(_commitStatistics.largestBatch, _pendingCommits);
+    }
+    _pendingCommits = 0;
+    if (_commitBatchTimer.isActive() && QThread::currentThread() == thread())
+        _commitBatchTimer.stop();
+    commitInternal(context, startTrans);
+}
+
 
 void SyncJournalDb::commitInternal(const QString &context, bool startTrans)
 {
@@ -2112,7 +2308,8 @@ bool operator==(const SyncJournalDb::UploadInfo &lhs,
         && lhs._valid == rhs._valid
         && lhs._size == rhs._size
         && lhs._transferid == rhs._transferid
-        && lhs._contentChecksum == rhs._contentChecksum;
+        && lhs._contentChecksum == rhs._contentChecksum
+        && lhs._chunkSize == rhs._chunkSize;
 }
 
 } // namespace OCC
@@ -23,11 +23,16 @@
 #include <qmutex.h>
 #include <QDateTime>
 #include <QHash>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <chrono>
 #include <functional>
+#include <memory>
 
 #include "common/utility.h"
 #include "common/ownsql.h"
 #include "common/syncjournalfilerecord.h"
+#include "common/syncjournalsnapshot.h"
 
 namespace OCC {
 class SyncJournalFileRecord;
@@ -59,7 +64,17 @@ public:
     bool getFileRecordByE2eMangledName(const QString &mangledName, SyncJournalFileRecord *rec);
     bool getFileRecordByInode(quint64 inode, SyncJournalFileRecord *rec);
     bool getFileRecordsByFileId(const QByteArray &fileId, const std::function<void(const SyncJournalFileRecord &)> &rowCallback);
+    /// The records whose content checksum is checksumType:checksum, i.e. the local files with that content
+    bool getFileRecordsByChecksum(const QByteArray &checksumType, const QByteArray &checksum, const std::function<void(const SyncJournalFileRecord &)> &rowCallback);
     bool getFilesBelowPath(const QByteArray &path, const std::function<void(const SyncJournalFileRecord&)> &rowCallback);
+
+    /**
+     * Load all file records into memory for fast lookups.
+     *
+     * The snapshot does not see later changes to the journal.
+     * Returns nullptr on error.
+     */
+    std::unique_ptr<SyncJournalSnapshot> loadSnapshot();
     bool setFileRecord(const SyncJournalFileRecord &record);
 
     /// Like setFileRecord, but preserves checksums
@@ -100,6 +115,14 @@ public:
         int _errorCount = 0;
         bool _valid = false;
         QByteArray _contentChecksum;
+        /**
+         * Size of every chunk but the last when the chunks of a chunking-NG
+         * upload are sent in parallel and may complete out of order: chunk n
+         * then starts at n * _chunkSize, so a resume can keep the chunks
+         * that made it to the server past a missing one.
+         * 0 if the chunks are sized dynamically.
+         */
+        quint64 _chunkSize = 0;
         /**
          * Returns true if this entry refers to a chunked upload that can be continued.
          * (As opposed to a small file transfer which is stored in the db so we can detect the case
@@ -192,6 +215,34 @@ public:
     void commit(const QString &context, bool startTrans = true);
     void commitIfNeededAndStartNewTransaction(const QString &context);
 
+    /**
+     * Like commit(), but the commit may be done later, together with the
+     * following ones, see setCommitBatching().
+     *
+     * A crash may then lose the changes of the last few batched commits. The
+     * database is still left as it was at one of the requested commits, so
+     * use this where that only costs redoing some work: the journal entries
+     * written after finishing an item, and the upload and download infos for
+     * resuming (a long transfer is resumable once the timeout passed).
+     */
+    void commitBatched(const QString &context);
+
+    /**
+     * Make commitBatched() commit only every maxBatchSize calls, or maxDelay
+     * after the first call of a batch. A size of 1 disables batching.
+     */
+    void setCommitBatching(int maxBatchSize, std::chrono::milliseconds maxDelay);
+
+    struct CommitStatistics
+    {
+        qint64 commits = 0; ///< transactions written to disk
+        qint64 requests = 0; ///< calls to commit() and commitBatched()
+        int largestBatch = 0; ///< most requests handled by one transaction
+        double commitsPerSecond = 0;
+    };
+    /// Statistics since the previous call
+    CommitStatistics takeCommitStatistics();
+
     void close();
 
     /**
@@ -247,6 +298,8 @@ private:
     bool updateErrorBlacklistTableStructure();
     bool sqlFail(const QString &log, const SqlQuery &query);
     void commitInternal(const QString &context, bool startTrans = true);
+    // Commit the requests that are batched so far
+    void commitBatch(const QString &context, bool startTrans = true);
     void startTransaction();
     void commitTransaction();
     QVector<QByteArray> tableColumns(const QByteArray &table);
@@ -270,7 +323,9 @@ private:
     SqlQuery _getFileRecordQueryByMangledName;
     SqlQuery _getFileRecordQueryByInode;
     SqlQuery _getFileRecordQueryByFileId;
+    SqlQuery _getFileRecordQueryByChecksum;
     SqlQuery _getFilesBelowPathQuery;
+    SqlQuery _getFilesBelowMangledPathQuery;
     SqlQuery _getAllFilesQuery;
     SqlQuery _setFileRecordQuery;
     SqlQuery _setFileRecordChecksumQuery;
@@ -317,6 +372,12 @@ private:
      * variable, for specific filesystems, or when WAL fails in a particular way.
      */
     QByteArray _journalMode;
+
+    int _maxCommitBatchSize = 1;
+    int _pendingCommits = 0; // requested, but not done yet
+    QTimer _commitBatchTimer;
+    CommitStatistics _commitStatistics;
+    QElapsedTimer _commitStatisticsTimer;
 };
 
 bool OCSYNC_EXPORT
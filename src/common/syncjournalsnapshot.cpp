@@ -0,0 +1,155 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include "common/syncjournalsnapshot.h"
+#include "common/syncjournaldb.h"
+
+namespace OCC {
+
+void SyncJournalSnapshot::append(const SyncJournalFileRecord &rec)
+{
+    Row row;
+    row.path = store(rec._path);
+    row.etag = store(rec._etag);
+    row.fileId = store(rec._fileId);
+    row.checksumHeader = store(rec._checksumHeader);
+    row.e2eMangledName = store(rec._e2eMangledName);
+    row.inode = rec._inode;
+    row.modtime = rec._modtime;
+    row.fileSize = rec._fileSize;
+    row.remotePerm = rec._remotePerm;
+    row.type = static_cast<quint8>(rec._type);
+    row.serverHasIgnoredFiles = rec._serverHasIgnoredFiles;
+    row.isE2eEncrypted = rec._isE2eEncrypted;
+    _rows.push_back(row);
+}
+
+void SyncJournalSnapshot::buildIndexes()
+{
+    _byPathHash.reserve(_rows.size());
+    _byInode.reserve(_rows.size());
+    for (quint32 i = 0; i < _rows.size(); ++i) {
+        const Row &row = _rows[i];
+        auto hashOf = [this](String string) {
+            return static_cast<quint64>(SyncJournalDb::getPHash(QByteArray::fromRawData(_strings.data() + string.offset, string.size)));
+        };
+        _byPathHash.push_back({ hashOf(row.path), i });
+        // Like the queries, never find anything for a null inode or an empty id
+        if (row.inode)
+            _byInode.push_back({ row.inode, i });
+        if (row.fileId.size)
+            _byFileId.push_back({ hashOf(row.fileId), i });
+        if (row.e2eMangledName.size)
+            _byMangledName.push_back({ hashOf(row.e2eMangledName), i });
+    }
+    // Stable, so rows with the same key stay in load order
+    for (auto index : { &_byPathHash, &_byInode, &_byFileId, &_byMangledName }) {
+        std::stable_sort(index->begin(), index->end());
+        index->shrink_to_fit();
+    }
+    _strings.shrink_to_fit();
+    _rows.shrink_to_fit();
+}
+
+SyncJournalSnapshot::String SyncJournalSnapshot::store(const QByteArray &data)
+{
+    String string = { static_cast<quint32>(_strings.size()), static_cast<quint32>(data.size()) };
+    _strings.insert(_strings.end(), data.constData(), data.constData() + data.size());
+    return string;
+}
+
+bool SyncJournalSnapshot::equals(String string, const QByteArray &data) const
+{
+    return string.size == static_cast<quint32>(data.size())
+        && std::memcmp(_strings.data() + string.offset, data.constData(), string.size) == 0;
+}
+
+void SyncJournalSnapshot::fill(const Row &row, SyncJournalFileRecord *rec) const
+{
+    auto toByteArray = [this](String string) {
+        return QByteArray(_strings.data() + string.offset, string.size);
+    };
+    rec->_path = toByteArray(row.path);
+    rec->_inode = row.inode;
+    rec->_modtime = row.modtime;
+    rec->_type = static_cast<ItemType>(row.type);
+    rec->_etag = toByteArray(row.etag);
+    rec->_fileId = toByteArray(row.fileId);
+    rec->_fileSize = row.fileSize;
+    rec->_remotePerm = row.remotePerm;
+    rec->_serverHasIgnoredFiles = row.serverHasIgnoredFiles;
+    rec->_checksumHeader = toByteArray(row.checksumHeader);
+    rec->_e2eMangledName = toByteArray(row.e2eMangledName);
+    rec->_isE2eEncrypted = row.isE2eEncrypted;
+}
+
+template <typename Callback>
+void SyncJournalSnapshot::forEachMatch(const Index &index, String Row::*field, const QByteArray &value, Callback callback) const
+{
+    if (value.isEmpty())
+        return;
+    const Key key = { static_cast<quint64>(SyncJournalDb::getPHash(value)), 0 };
+    auto range = std::equal_range(index.begin(), index.end(), key);
+    for (auto it = range.first; it != range.second; ++it) {
+        const Row &row = _rows[it->row];
+        if (equals(row.*field, value) && !callback(row))
+            return;
+    }
+}
+
+void SyncJournalSnapshot::getFileRecord(const QByteArray &filename, SyncJournalFileRecord *rec) const
+{
+    // Reset the output var in case the caller is reusing it.
+    rec->_path.clear();
+    forEachMatch(_byPathHash, &Row::path, filename, [&](const Row &row) {
+        fill(row, rec);
+        return false;
+    });
+}
+
+void SyncJournalSnapshot::getFileRecordByE2eMangledName(const QByteArray &mangledName, SyncJournalFileRecord *rec) const
+{
+    rec->_path.clear();
+    forEachMatch(_byMangledName, &Row::e2eMangledName, mangledName, [&](const Row &row) {
+        fill(row, rec);
+        return false;
+    });
+}
+
+void SyncJournalSnapshot::getFileRecordByInode(quint64 inode, SyncJournalFileRecord *rec) const
+{
+    rec->_path.clear();
+    if (!inode)
+        return;
+    auto it = std::lower_bound(_byInode.begin(), _byInode.end(), Key{ inode, 0 });
+    if (it != _byInode.end() && it->hash == inode)
+        fill(_rows[it->row], rec);
+}
+
+void SyncJournalSnapshot::getFileRecordsByFileId(const QByteArray &fileId, const std::function<void(const SyncJournalFileRecord &)> &rowCallback) const
+{
+    forEachMatch(_byFileId, &Row::fileId, fileId, [&](const Row &row) {
+        SyncJournalFileRecord rec;
+        fill(row, &rec);
+        rowCallback(rec);
+        return true;
+    });
+}
+
+} // namespace OCC
@@ -0,0 +1,103 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef SYNCJOURNALSNAPSHOT_H
+#define SYNCJOURNALSNAPSHOT_H
+
+#include <QByteArray>
+#include <functional>
+#include <vector>
+
+#include "common/syncjournalfilerecord.h"
+
+namespace OCC {
+
+/**
+ * @brief Read-only copy of the file records of a SyncJournalDb
+ *
+ * Loaded with a single query before the update phase, so that the per-file
+ * lookups of the discovery need neither SQL nor the journal's mutex. The
+ * lookups behave like the SyncJournalDb functions of the same name.
+ *
+ * The strings of all records share one buffer and the indexes are sorted
+ * arrays of hashes, which keeps the snapshot compact. Being immutable, it can
+ * be used from several threads at once.
+ *
+ * @ingroup libsync
+ */
+class OCSYNC_EXPORT SyncJournalSnapshot
+{
+public:
+    size_t size() const { return _rows.size(); }
+
+    void getFileRecord(const QByteArray &filename, SyncJournalFileRecord *rec) const;
+    void getFileRecordByE2eMangledName(const QByteArray &mangledName, SyncJournalFileRecord *rec) const;
+    void getFileRecordByInode(quint64 inode, SyncJournalFileRecord *rec) const;
+    void getFileRecordsByFileId(const QByteArray &fileId, const std::function<void(const SyncJournalFileRecord &)> &rowCallback) const;
+
+private:
+    friend class SyncJournalDb;
+
+    // Only used by SyncJournalDb while loading
+    void append(const SyncJournalFileRecord &rec);
+    void buildIndexes();
+
+    struct String
+    {
+        quint32 offset;
+        quint32 size;
+    };
+    struct Row
+    {
+        String path;
+        String etag;
+        String fileId;
+        String checksumHeader;
+        String e2eMangledName;
+        quint64 inode;
+        qint64 modtime;
+        qint64 fileSize;
+        RemotePermissions remotePerm;
+        quint8 type;
+        bool serverHasIgnoredFiles;
+        bool isE2eEncrypted;
+    };
+    struct Key
+    {
+        quint64 hash;
+        quint32 row;
+        bool operator<(const Key &other) const { return hash < other.hash; }
+    };
+    using Index = std::vector<Key>;
+
+    String store(const QByteArray &data);
+    bool equals(String string, const QByteArray &data) const;
+    void fill(const Row &row, SyncJournalFileRecord *rec) const;
+    // Calls the callback with each row whose field matches value, in load order
+    template <typename Callback>
+    void forEachMatch(const Index &index, String Row::*field, const QByteArray &value, Callback callback) const;
+
+    std::vector<char> _strings;
+    std::vector<Row> _rows;
+    Index _byPathHash;
+    Index _byInode;
+    Index _byFileId;
+    Index _byMangledName;
+};
+
+} // namespace OCC
+
+#endif // SYNCJOURNALSNAPSHOT_H
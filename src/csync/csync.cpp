@@ -32,6 +32,8 @@
 #include <ctime>
 #include <sys/types.h>
 
+#include <QtConcurrentRun>
+
 
 #include "c_lib.h"
 #include "csync_private.h"
@@ -44,6 +46,7 @@
 #include "csync_reconcile.h"
 
 #include "vio/csync_vio.h"
+#include "vio/csync_vio_local.h"
 
 #include "csync_rename.h"
 #include "common/c_jhash.h"
@@ -64,6 +67,61 @@ csync_s::csync_s(const char *localUri, OCC::SyncJournalDb *statedb)
   local.uri = c_strndup(localUri, len);
 }
 
+/* Walk one replica. Errors are left in the walk state. */
+static int csync_update_replica(CSYNC *ctx, csync_walk_s *walk)
+{
+  QElapsedTimer timer;
+  timer.start();
+
+  const bool local = walk->replica == LOCAL_REPLICA;
+  qCInfo(lcCSync) << "## Starting" << (local ? "local" : "remote") << "discovery ##";
+
+  if (local) {
+    // Don't list what the walker won't descend into
+    auto shouldList = [ctx](const QByteArray &path) {
+      if (ctx->exclude_traversal_fn && ctx->exclude_traversal_fn(path, ItemTypeDirectory) != CSYNC_NOT_EXCLUDED)
+        return false;
+      if (ctx->ignore_hidden_files && path.mid(path.lastIndexOf('/') + 1).startsWith('.'))
+        return false;
+      return !ctx->should_discover_locally_fn || ctx->should_discover_locally_fn(path);
+    };
+    ctx->local.prefetch = csync_vio_local_prefetch_start(ctx->local.uri, ctx->local_walk_threads, shouldList);
+  }
+  int rc = 0;
+  if (!local && !ctx->remote_discovery_paths.empty()) {
+    qCInfo(lcCSync) << "Listing only" << ctx->remote_discovery_paths.size() << "changed remote directories";
+    rc = csync_ftw_remote_targeted(ctx, walk, csync_walker, MAX_DEPTH);
+  } else {
+    rc = csync_ftw(ctx, walk, local ? ctx->local.uri : "", csync_walker, MAX_DEPTH);
+  }
+  if (local) {
+    csync_vio_local_prefetch_stop(ctx->local.prefetch);
+    ctx->local.prefetch = nullptr;
+  }
+  if (rc < 0) {
+    if (walk->status_code == CSYNC_STATUS_OK) {
+        walk->status_code = csync_errno_to_status(errno, CSYNC_STATUS_UPDATE_ERROR);
+    }
+    return rc;
+  }
+
+  qCInfo(lcCSync) << "Update detection for" << (local ? "local" : "remote") << "replica took" << timer.elapsed() / 1000.
+                  << "seconds walking" << (local ? ctx->local.files : ctx->remote.files).size() << "files";
+  return 0;
+}
+
+/* Move the error of a failed walk to the context */
+static void csync_take_walk_error(CSYNC *ctx, csync_walk_s *walk)
+{
+  ctx->status_code = walk->status_code;
+  if (walk->error_string) {
+    // The remote discovery may have set one directly
+    SAFE_FREE(ctx->error_string);
+    ctx->error_string = walk->error_string;
+    walk->error_string = nullptr;
+  }
+}
+
 int csync_update(CSYNC *ctx) {
   int rc = -1;
 
@@ -73,51 +131,57 @@ int csync_update(CSYNC *ctx) {
   }
   ctx->status_code = CSYNC_STATUS_OK;
 
-  ctx->status_code = CSYNC_STATUS_OK;
-
   csync_memstat_check();
 
   if (!ctx->exclude_traversal_fn) {
       qCInfo(lcCSync, "No exclude file loaded or defined!");
   }
 
-  /* update detection for local replica */
-  QElapsedTimer timer;
-  timer.start();
-  ctx->current = LOCAL_REPLICA;
-
-  qCInfo(lcCSync, "## Starting local discovery ##");
-
-  rc = csync_ftw(ctx, ctx->local.uri, csync_walker, MAX_DEPTH);
-  if (rc < 0) {
-    if(ctx->status_code == CSYNC_STATUS_OK) {
-        ctx->status_code = csync_errno_to_status(errno, CSYNC_STATUS_UPDATE_ERROR);
+  // Answer the per-file journal lookups of both walks from memory
+  std::unique_ptr<OCC::SyncJournalSnapshot> snapshot;
+  if (ctx->statedb) {
+    snapshot = ctx->statedb->loadSnapshot();
+  }
+  ctx->statedb_snapshot = snapshot.get();
+
+  csync_walk_s localWalk(LOCAL_REPLICA);
+  csync_walk_s remoteWalk(REMOTE_REPLICA);
+  int localRc = 0;
+  int remoteRc = 0;
+
+  if (ctx->parallel_update) {
+    // The local walk is bound by the disk and the remote one by the network:
+    // let them overlap. The remote walk stays on this thread since its hooks
+    // wait for the listings from the main thread.
+    QElapsedTimer timer;
+    timer.start();
+    csync_rename_set_local_walk_finished(ctx, false);
+    QFuture<int> localFuture = QtConcurrent::run([ctx, &localWalk] {
+      int rc = csync_update_replica(ctx, &localWalk);
+      csync_rename_set_local_walk_finished(ctx, true);
+      return rc;
+    });
+    remoteRc = csync_update_replica(ctx, &remoteWalk);
+    localRc = localFuture.result();
+    qCInfo(lcCSync) << "Concurrent update detection took" << timer.elapsed() / 1000. << "seconds";
+  } else {
+    localRc = csync_update_replica(ctx, &localWalk);
+    if (localRc >= 0) {
+      remoteRc = csync_update_replica(ctx, &remoteWalk);
     }
-    return rc;
   }
-
-  qCInfo(lcCSync) << "Update detection for local replica took" << timer.elapsed() / 1000.
-                  << "seconds walking" << ctx->local.files.size() << "files";
+  ctx->statedb_snapshot = nullptr;
+  snapshot.reset();
   csync_memstat_check();
 
-  /* update detection for remote replica */
-  timer.restart();
-  ctx->current = REMOTE_REPLICA;
-
-  qCInfo(lcCSync, "## Starting remote discovery ##");
-
-  rc = csync_ftw(ctx, "", csync_walker, MAX_DEPTH);
-  if (rc < 0) {
-      if(ctx->status_code == CSYNC_STATUS_OK) {
-          ctx->status_code = csync_errno_to_status(errno, CSYNC_STATUS_UPDATE_ERROR);
-      }
-      return rc;
+  if (localRc < 0) {
+    csync_take_walk_error(ctx, &localWalk);
+    return localRc;
+  }
+  if (remoteRc < 0) {
+    csync_take_walk_error(ctx, &remoteWalk);
+    return remoteRc;
   }
-
-
-  qCInfo(lcCSync) << "Update detection for remote replica took" << timer.elapsed() / 1000.
-                  << "seconds walking" << ctx->remote.files.size() << "files";
-  csync_memstat_check();
 
   ctx->status |= CSYNC_STATUS_UPDATE;
 
@@ -234,11 +298,16 @@ int csync_s::reinitialize() {
 
   status_code = CSYNC_STATUS_OK;
 
-  remote.read_from_db = false;
   read_remote_from_db = true;
+  remote_discovery_paths.clear();
 
+  // Drops the map memory at once, and sizes the maps for a tree like the last one
+  size_t localCount = local.files.size();
+  size_t remoteCount = remote.files.size();
   local.files.clear();
   remote.files.clear();
+  local.files.reserve(localCount);
+  remote.files.reserve(remoteCount);
 
   renames.folder_renamed_from.clear();
   renames.folder_renamed_to.clear();
@@ -0,0 +1,97 @@
+/*
+ * libcsync -- a library to sync a directory with another
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef _CSYNC_ARENA_H
+#define _CSYNC_ARENA_H
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+/**
+ * @brief Bump allocator for memory that is released all at once
+ *
+ * Memory is handed out from big blocks. Deallocation does nothing,
+ * the blocks are freed together when the arena is destroyed.
+ */
+class CSyncArena
+{
+public:
+    CSyncArena() = default;
+    CSyncArena(const CSyncArena &) = delete;
+    CSyncArena &operator=(const CSyncArena &) = delete;
+
+    void *allocate(size_t size, size_t alignment)
+    {
+        void *p = _current;
+        if (!_current || !std::align(alignment, size, p, _left)) {
+            // Big allocations (e.g. the buckets of a hash table) get their own block
+            size_t blockSize = std::max(size + alignment, size_t(DefaultBlockSize));
+            _blocks.emplace_back(new char[blockSize]);
+            p = _blocks.back().get();
+            _left = blockSize;
+            std::align(alignment, size, p, _left);
+        }
+        _current = static_cast<char *>(p) + size;
+        _left -= size;
+        return p;
+    }
+
+private:
+    enum { DefaultBlockSize = 64 * 1024 };
+
+    std::vector<std::unique_ptr<char[]>> _blocks;
+    void *_current = nullptr;
+    size_t _left = 0;
+};
+
+/**
+ * @brief Standard allocator allocating from a CSyncArena
+ */
+template <typename T>
+struct CSyncArenaAllocator
+{
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    explicit CSyncArenaAllocator(CSyncArena *arena)
+        : arena(arena)
+    {
+    }
+    template <typename U>
+    CSyncArenaAllocator(const CSyncArenaAllocator<U> &other)
+        : arena(other.arena)
+    {
+    }
+
+    T *allocate(size_t n) { return static_cast<T *>(arena->allocate(n * sizeof(T), alignof(T))); }
+    void deallocate(T *, size_t) {}
+
+    CSyncArena *arena;
+};
+
+template <typename T, typename U>
+bool operator==(const CSyncArenaAllocator<T> &a, const CSyncArenaAllocator<U> &b) { return a.arena == b.arena; }
+template <typename T, typename U>
+bool operator!=(const CSyncArenaAllocator<T> &a, const CSyncArenaAllocator<U> &b) { return a.arena != b.arena; }
+
+#endif /* _CSYNC_ARENA_H */
@@ -246,6 +246,7 @@ using namespace OCC;
 
 ExcludedFiles::ExcludedFiles(QString localPath)
     : _localPath(std::move(localPath))
+    , _mutex(QMutex::Recursive)
 {
     Q_ASSERT(_localPath.endsWith("/"));
     // Windows used to use PathMatchSpec which allows *foo to match abc/deffoo.
@@ -265,17 +266,20 @@ ExcludedFiles::~ExcludedFiles() = default;
 
 void ExcludedFiles::addExcludeFilePath(const QString &path)
 {
+    QMutexLocker locker(&_mutex);
     _excludeFiles[_localPath.toUtf8()].append(path);
 }
 
 void ExcludedFiles::addInTreeExcludeFilePath(const QString &path)
 {
+    QMutexLocker locker(&_mutex);
     BasePathByteArray basePath = leftIncludeLast(path.toUtf8(), '/');
     _excludeFiles[basePath].append(path);
 }
 
 void ExcludedFiles::setExcludeConflictFiles(bool onoff)
 {
+    QMutexLocker locker(&_mutex);
     _excludeConflictFiles = onoff;
 }
 
@@ -286,6 +290,7 @@ void ExcludedFiles::addManualExclude(const QByteArray &expr)
 
 void ExcludedFiles::addManualExclude(const QByteArray &expr, const QByteArray &basePath)
 {
+    QMutexLocker locker(&_mutex);
 #if defined(Q_OS_WIN)
     Q_ASSERT(basePath.size() >= 2 && basePath.at(1) == ':');
 #else
@@ -301,18 +306,21 @@ void ExcludedFiles::addManualExclude(const QByteArray &expr, const QByteArray &b
 
 void ExcludedFiles::clearManualExcludes()
 {
+    QMutexLocker locker(&_mutex);
     _manualExcludes.clear();
     reloadExcludeFiles();
 }
 
 void ExcludedFiles::setWildcardsMatchSlash(bool onoff)
 {
+    QMutexLocker locker(&_mutex);
     _wildcardsMatchSlash = onoff;
     prepare();
 }
 
 bool ExcludedFiles::loadExcludeFile(const QByteArray & basePath, const QString & file)
 {
+    QMutexLocker locker(&_mutex);
     QFile f(file);
     if (!f.open(QIODevice::ReadOnly))
         return false;
@@ -334,6 +342,7 @@ bool ExcludedFiles::loadExcludeFile(const QByteArray & basePath, const QString &
 
 bool ExcludedFiles::reloadExcludeFiles()
 {
+    QMutexLocker locker(&_mutex);
     _allExcludes.clear();
     // clear all regex
     _bnameTraversalRegexFile.clear();
@@ -403,6 +412,7 @@ bool ExcludedFiles::isExcluded(
 
 CSYNC_EXCLUDE_TYPE ExcludedFiles::traversalPatternMatch(const char *path, ItemType filetype)
 {
+    QMutexLocker locker(&_mutex);
     auto match = _csync_excluded_common(path, _excludeConflictFiles);
     if (match != CSYNC_NOT_EXCLUDED)
         return match;
@@ -481,6 +491,7 @@ CSYNC_EXCLUDE_TYPE ExcludedFiles::traversalPatternMatch(const char *path, ItemTy
 
 CSYNC_EXCLUDE_TYPE ExcludedFiles::fullPatternMatch(const char *path, ItemType filetype) const
 {
+    QMutexLocker locker(&_mutex);
     auto match = _csync_excluded_common(path, _excludeConflictFiles);
     if (match != CSYNC_NOT_EXCLUDED)
         return match;
@@ -26,6 +26,7 @@
 #include "csync.h"
 
 #include <QObject>
+#include <QMutex>
 #include <QSet>
 #include <QString>
 #include <QRegularExpression>
@@ -247,6 +248,12 @@ private:
      */
     bool _wildcardsMatchSlash = false;
 
+    /// Guards the patterns and regexes: traversalPatternMatch() loads the
+    /// in-tree exclude files from the local and the remote discovery, the
+    /// folder watcher matches on its own thread and the GUI thread reloads.
+    /// Recursive because the matching may load an exclude file.
+    mutable QMutex _mutex;
+
     friend class ExcludedFilesTest;
 };
 
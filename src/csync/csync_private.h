@@ -34,6 +34,8 @@
 
 #include <unordered_map>
 #include <QHash>
+#include <QMutex>
+#include <QWaitCondition>
 #include <cstdint>
 
 #include <map>
@@ -48,6 +50,7 @@
 #include "csync_misc.h"
 #include "csync_exclude.h"
 #include "csync_macros.h"
+#include "csync_arena.h"
 
 /**
  * How deep to scan directories.
@@ -109,28 +112,94 @@ public:
 };
 struct ByteArrayRefHash { uint operator()(const ByteArrayRef &a) const { return qHashBits(a.data(), a.size()); } };
 
+struct csync_vio_local_prefetch_s;
+
 /**
  * @brief csync public structure
  */
 struct OCSYNC_EXPORT csync_s {
 
-  class FileMap : public std::unordered_map<ByteArrayRef, std::unique_ptr<csync_file_stat_t>, ByteArrayRefHash> {
+  /*
+   * Map from the path to the file.
+   *
+   * Also keeps an index of the files by e2eMangledName, so the insertion and
+   * removal of files must go through insertFile(), erase() and clear().
+   *
+   * Only the nodes and buckets of the hash table live in an arena, which
+   * saves one allocation and one free per entry. The csync_file_stat_t
+   * entries and their paths are still allocated and destroyed one by one.
+   */
+  class FileMap {
+      using Map = std::unordered_map<ByteArrayRef, std::unique_ptr<csync_file_stat_t>, ByteArrayRefHash,
+          std::equal_to<ByteArrayRef>, CSyncArenaAllocator<std::pair<const ByteArrayRef, std::unique_ptr<csync_file_stat_t>>>>;
+
   public:
+      using iterator = Map::iterator;
+      using const_iterator = Map::const_iterator;
+      using value_type = Map::value_type;
+
+      FileMap()
+          : _arena(new CSyncArena)
+          , _map(0, ByteArrayRefHash(), std::equal_to<ByteArrayRef>(), Map::allocator_type(_arena.get()))
+      {
+      }
+
+      iterator begin() { return _map.begin(); }
+      iterator end() { return _map.end(); }
+      const_iterator begin() const { return _map.begin(); }
+      const_iterator end() const { return _map.end(); }
+      iterator find(const ByteArrayRef &key) { return _map.find(key); }
+      const_iterator find(const ByteArrayRef &key) const { return _map.find(key); }
+      size_t size() const { return _map.size(); }
+      bool empty() const { return _map.empty(); }
+      void reserve(size_t count) { _map.reserve(count); }
+
       csync_file_stat_t *findFile(const ByteArrayRef &key) const {
           auto it = find(key);
           return it != end() ? it->second.get() : nullptr;
       }
       csync_file_stat_t *findFileMangledName(const ByteArrayRef &key) const {
-          auto it = begin();
-          while (it != end()) {
-              csync_file_stat_t *fs = it->second.get();
-              if (fs->e2eMangledName == key) {
-                  return fs;
-              }
-              ++it;
-          }
-          return nullptr;
+          auto it = _mangledNames.find(key);
+          return it != _mangledNames.end() ? it->second : nullptr;
+      }
+
+      /* Insert the file, replacing the one that had the same key */
+      void insertFile(const ByteArrayRef &key, std::unique_ptr<csync_file_stat_t> fs) {
+          auto &slot = _map[key];
+          if (slot)
+              removeMangledName(slot.get());
+          addMangledName(fs.get());
+          slot = std::move(fs);
+      }
+      iterator erase(const_iterator it) {
+          removeMangledName(it->second.get());
+          return _map.erase(it);
+      }
+      /* Remove all the files: destroys each entry, then drops the arena of the nodes in one go */
+      void clear() {
+          _mangledNames.clear();
+          std::unique_ptr<CSyncArena> arena(new CSyncArena);
+          _map = Map(0, ByteArrayRefHash(), std::equal_to<ByteArrayRef>(), Map::allocator_type(arena.get()));
+          _arena = std::move(arena);
       }
+
+  private:
+      void addMangledName(csync_file_stat_t *fs) {
+          // Like a lookup by scanning the map, the first file with that name wins
+          if (fs && !fs->e2eMangledName.isEmpty())
+              _mangledNames.emplace(fs->e2eMangledName, fs);
+      }
+      void removeMangledName(csync_file_stat_t *fs) {
+          if (fs->e2eMangledName.isEmpty())
+              return;
+          auto it = _mangledNames.find(fs->e2eMangledName);
+          if (it != _mangledNames.end() && it->second == fs)
+              _mangledNames.erase(it);
+      }
+
+      std::unique_ptr<CSyncArena> _arena; // must outlive _map
+      Map _map;
+      std::unordered_map<ByteArrayRef, csync_file_stat_t *, ByteArrayRefHash> _mangledNames;
   };
 
   struct {
@@ -157,6 +226,9 @@ struct OCSYNC_EXPORT csync_s {
 
   OCC::SyncJournalDb *statedb;
 
+  /* In-memory copy of the file records of statedb, only set during the update phase */
+  const OCC::SyncJournalSnapshot *statedb_snapshot = nullptr;
+
   /**
    * Function used to determine whether an item is excluded
    * during the update phase.
@@ -166,6 +238,9 @@ struct OCSYNC_EXPORT csync_s {
   std::function<CSYNC_EXCLUDE_TYPE(const char *path, ItemType filetype)> exclude_traversal_fn;
 
   struct {
+    QMutex mutex; // the local and the remote walk may record renames at the same time
+    QWaitCondition local_walk_finished_changed;
+    bool local_walk_finished = true; // see csync_rename_wait_for_local_walk()
     std::unordered_map<ByteArrayRef, QByteArray, ByteArrayRefHash> folder_renamed_to; // map from->to
     std::unordered_map<ByteArrayRef, QByteArray, ByteArrayRefHash> folder_renamed_from; // map to->from
   } renames;
@@ -173,21 +248,17 @@ struct OCSYNC_EXPORT csync_s {
   struct {
     char *uri = nullptr;
     FileMap files;
+    csync_vio_local_prefetch_s *prefetch = nullptr; /* only set during the local walk */
   } local;
 
   struct {
     FileMap files;
-    bool read_from_db = false;
     OCC::RemotePermissions root_perms; /* Permission of the root folder. (Since the root folder is not in the db tree, we need to keep a separate entry.) */
   } remote;
 
-  /* replica we are currently walking */
+  /* replica we are currently reconciling or walking with csync_walk_*_tree() */
   enum csync_replica_e current = LOCAL_REPLICA;
 
-  /* Used in the update phase so changes in the sub directories can be notified to
-     parent directories */
-  csync_file_stat_t *current_fs = nullptr;
-
   /* csync error code */
   enum CSYNC_STATUS status_code = CSYNC_STATUS_OK;
 
@@ -201,8 +272,24 @@ struct OCSYNC_EXPORT csync_s {
    */
   bool read_remote_from_db = false;
 
+  /**
+   * Walk the local tree on a worker thread while the remote tree is discovered
+   */
+  bool parallel_update = false;
+
+  /**
+   * Number of threads listing local directories ahead of the walker, 0 to disable
+   */
+  int local_walk_threads = 0;
+
   std::function<bool(const QByteArray &)> should_discover_locally_fn;
 
+  /**
+   * Remote directories known to have changed. When not empty, only these are
+   * listed on the server and the rest of the remote tree is read from the db.
+   */
+  std::set<QByteArray> remote_discovery_paths;
+
   bool ignore_hidden_files = true;
 
   bool upload_conflict_files = false;
@@ -219,6 +306,36 @@ struct OCSYNC_EXPORT csync_s {
   csync_s &operator=(const csync_s &) = delete;
 };
 
+/**
+ * @brief State of one tree walk of the update phase
+ *
+ * The local and the remote walk each have their own, so they can run at the same time.
+ */
+struct csync_walk_s {
+  explicit csync_walk_s(enum csync_replica_e replica)
+    : replica(replica)
+  {
+  }
+  ~csync_walk_s() { SAFE_FREE(error_string); }
+
+  csync_walk_s(const csync_walk_s &) = delete;
+  csync_walk_s &operator=(const csync_walk_s &) = delete;
+
+  /* replica this walk discovers */
+  const enum csync_replica_e replica;
+
+  /* Used in the update phase so changes in the sub directories can be notified to
+     parent directories */
+  csync_file_stat_t *current_fs = nullptr;
+
+  /* Whether the remote directory currently walked is read from the db */
+  bool read_from_db = false;
+
+  /* Error of this walk, csync_update() moves it to the context */
+  enum CSYNC_STATUS status_code = CSYNC_STATUS_OK;
+  char *error_string = nullptr;
+};
+
 void set_errno_from_http_errcode( int err );
 
 /**
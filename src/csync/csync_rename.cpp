@@ -32,12 +32,38 @@ static ByteArrayRef _parentDir(const ByteArrayRef &path) {
 
 void csync_rename_record(CSYNC* ctx, const QByteArray &from, const QByteArray &to)
 {
+    QMutexLocker locker(&ctx->renames.mutex);
     ctx->renames.folder_renamed_to[from] = to;
     ctx->renames.folder_renamed_from[to] = from;
 }
 
+bool csync_rename_record_unless_renamed(CSYNC *ctx, const QByteArray &from, const QByteArray &to)
+{
+    QMutexLocker locker(&ctx->renames.mutex);
+    if (ctx->renames.folder_renamed_to.count(from) > 0)
+        return false;
+    ctx->renames.folder_renamed_to[from] = to;
+    ctx->renames.folder_renamed_from[to] = from;
+    return true;
+}
+
+void csync_rename_set_local_walk_finished(CSYNC *ctx, bool finished)
+{
+    QMutexLocker locker(&ctx->renames.mutex);
+    ctx->renames.local_walk_finished = finished;
+    ctx->renames.local_walk_finished_changed.wakeAll();
+}
+
+void csync_rename_wait_for_local_walk(CSYNC *ctx)
+{
+    QMutexLocker locker(&ctx->renames.mutex);
+    while (!ctx->renames.local_walk_finished)
+        ctx->renames.local_walk_finished_changed.wait(&ctx->renames.mutex);
+}
+
 QByteArray csync_rename_adjust_parent_path(CSYNC *ctx, const QByteArray &path)
 {
+    QMutexLocker locker(&ctx->renames.mutex);
     if (ctx->renames.folder_renamed_to.empty())
         return path;
     for (auto p = _parentDir(path); !p.isEmpty(); p = _parentDir(p)) {
@@ -52,6 +78,7 @@ QByteArray csync_rename_adjust_parent_path(CSYNC *ctx, const QByteArray &path)
 
 QByteArray csync_rename_adjust_parent_path_source(CSYNC *ctx, const QByteArray &path)
 {
+    QMutexLocker locker(&ctx->renames.mutex);
     if (ctx->renames.folder_renamed_from.empty())
         return path;
     for (ByteArrayRef p = _parentDir(path); !p.isEmpty(); p = _parentDir(p)) {
@@ -66,6 +93,7 @@ QByteArray csync_rename_adjust_parent_path_source(CSYNC *ctx, const QByteArray &
 
 QByteArray csync_rename_adjust_full_path_source(CSYNC *ctx, const QByteArray &path)
 {
+    QMutexLocker locker(&ctx->renames.mutex);
     if (ctx->renames.folder_renamed_from.empty())
         return path;
     for (ByteArrayRef p = path; !p.isEmpty(); p = _parentDir(p)) {
@@ -79,5 +107,6 @@ QByteArray csync_rename_adjust_full_path_source(CSYNC *ctx, const QByteArray &pa
 }
 
 bool csync_rename_count(CSYNC *ctx) {
+    QMutexLocker locker(&ctx->renames.mutex);
     return ctx->renames.folder_renamed_from.size();
 }
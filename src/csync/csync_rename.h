@@ -36,5 +36,12 @@ QByteArray OCSYNC_EXPORT csync_rename_adjust_parent_path_source(CSYNC *ctx, cons
 QByteArray OCSYNC_EXPORT csync_rename_adjust_full_path_source(CSYNC *ctx, const QByteArray &path);
 
 void OCSYNC_EXPORT csync_rename_record(CSYNC *ctx, const QByteArray &from, const QByteArray &to);
+/* Like csync_rename_record, but returns false without recording if from already has a rename */
+bool OCSYNC_EXPORT csync_rename_record_unless_renamed(CSYNC *ctx, const QByteArray &from, const QByteArray &to);
+
+/* Whether the local walk, which runs alongside the remote one, is done recording renames */
+void OCSYNC_EXPORT csync_rename_set_local_walk_finished(CSYNC *ctx, bool finished);
+/* Blocks until all local renames are recorded, so that the remote walk sees the same renames as when the walks run one after the other */
+void OCSYNC_EXPORT csync_rename_wait_for_local_walk(CSYNC *ctx);
 /*  Return the amount of renamed item recorded */
 bool OCSYNC_EXPORT csync_rename_count(CSYNC *ctx);
@@ -94,6 +94,44 @@ static bool _csync_mtime_equal(time_t a, time_t b)
     return false;
 }
 
+/* Journal lookups, answered from the snapshot while there is one */
+static bool _csync_get_file_record(CSYNC *ctx, const QByteArray &path, OCC::SyncJournalFileRecord *rec)
+{
+    if (ctx->statedb_snapshot) {
+        ctx->statedb_snapshot->getFileRecord(path, rec);
+        return true;
+    }
+    return ctx->statedb->getFileRecord(path, rec);
+}
+
+static bool _csync_get_file_record_by_mangled_name(CSYNC *ctx, const QByteArray &mangledName, OCC::SyncJournalFileRecord *rec)
+{
+    if (ctx->statedb_snapshot) {
+        ctx->statedb_snapshot->getFileRecordByE2eMangledName(mangledName, rec);
+        return true;
+    }
+    return ctx->statedb->getFileRecordByE2eMangledName(mangledName, rec);
+}
+
+static bool _csync_get_file_record_by_inode(CSYNC *ctx, quint64 inode, OCC::SyncJournalFileRecord *rec)
+{
+    if (ctx->statedb_snapshot) {
+        ctx->statedb_snapshot->getFileRecordByInode(inode, rec);
+        return true;
+    }
+    return ctx->statedb->getFileRecordByInode(inode, rec);
+}
+
+static bool _csync_get_file_records_by_file_id(CSYNC *ctx, const QByteArray &fileId,
+    const std::function<void(const OCC::SyncJournalFileRecord &)> &rowCallback)
+{
+    if (ctx->statedb_snapshot) {
+        ctx->statedb_snapshot->getFileRecordsByFileId(fileId, rowCallback);
+        return true;
+    }
+    return ctx->statedb->getFileRecordsByFileId(fileId, rowCallback);
+}
+
 /**
  * The main function of the discovery/update pass.
  *
@@ -107,7 +145,7 @@ static bool _csync_mtime_equal(time_t a, time_t b)
  *
  * See doc/dev/sync-algorithm.md for an overview.
  */
-static int _csync_detect_update(CSYNC *ctx, std::unique_ptr<csync_file_stat_t> fs) {
+static int _csync_detect_update(CSYNC *ctx, csync_walk_s *walk, std::unique_ptr<csync_file_stat_t> fs) {
   Q_ASSERT(fs);
   OCC::SyncJournalFileRecord base;
   CSYNC_EXCLUDE_TYPE excluded = CSYNC_NOT_EXCLUDED;
@@ -141,14 +179,14 @@ static int _csync_detect_update(CSYNC *ctx, std::unique_ptr<csync_file_stat_t> f
       }
   }
 
-  if (ctx->current == REMOTE_REPLICA && ctx->callbacks.checkSelectiveSyncBlackListHook) {
+  if (walk->replica == REMOTE_REPLICA && ctx->callbacks.checkSelectiveSyncBlackListHook) {
       if (ctx->callbacks.checkSelectiveSyncBlackListHook(ctx->callbacks.update_callback_userdata, fs->path)) {
           return 1;
       }
   }
 
   auto localCodec = QTextCodec::codecForLocale();
-  if (ctx->current == REMOTE_REPLICA && localCodec->mibEnum() != 106) {
+  if (walk->replica == REMOTE_REPLICA && localCodec->mibEnum() != 106) {
       /* If the locale codec is not UTF-8, we must check that the filename from the server can
        * be encoded in the local file system.
        *
@@ -171,8 +209,8 @@ static int _csync_detect_update(CSYNC *ctx, std::unique_ptr<csync_file_stat_t> f
 
   if (excluded > CSYNC_NOT_EXCLUDED || fs->type == ItemTypeSoftLink) {
       fs->instruction = CSYNC_INSTRUCTION_IGNORE;
-      if (ctx->current_fs) {
-          ctx->current_fs->has_ignored_files = true;
+      if (walk->current_fs) {
+          walk->current_fs->has_ignored_files = true;
       }
 
       goto out;
@@ -183,8 +221,8 @@ static int _csync_detect_update(CSYNC *ctx, std::unique_ptr<csync_file_stat_t> f
    * renamed, the db gets queried by the inode of the file as that one
    * does not change on rename.
    */
-  if(!ctx->statedb->getFileRecord(fs->path, &base)) {
-      ctx->status_code = CSYNC_STATUS_UNSUCCESSFUL;
+  if(!_csync_get_file_record(ctx, fs->path, &base)) {
+      walk->status_code = CSYNC_STATUS_UNSUCCESSFUL;
       return -1;
   }
 
@@ -195,8 +233,8 @@ static int _csync_detect_update(CSYNC *ctx, std::unique_ptr<csync_file_stat_t> f
    * not UNIQUE at the moment.
    */
   if (!base.isValid()) {
-      if(!ctx->statedb->getFileRecordByE2eMangledName(fs->path, &base)) {
-          ctx->status_code = CSYNC_STATUS_UNSUCCESSFUL;
+      if(!_csync_get_file_record_by_mangled_name(ctx, fs->path, &base)) {
+          walk->status_code = CSYNC_STATUS_UNSUCCESSFUL;
           return -1;
       }
   }
@@ -219,7 +257,7 @@ static int _csync_detect_update(CSYNC *ctx, std::unique_ptr<csync_file_stat_t> f
                 fs->etag.constData(), base._etag.constData(), (uint64_t) fs->inode, (uint64_t) base._inode,
                 (uint64_t) fs->size, (uint64_t) base._fileSize, *reinterpret_cast<short*>(&fs->remotePerm), *reinterpret_cast<short*>(&base._remotePerm),
                 fs->checksumHeader.constData(), base._checksumHeader.constData(), base._serverHasIgnoredFiles, base._e2eMangledName.constData());
-      if (ctx->current == REMOTE_REPLICA && fs->etag != base._etag) {
+      if (walk->replica == REMOTE_REPLICA && fs->etag != base._etag) {
           fs->instruction = CSYNC_INSTRUCTION_EVAL;
 
           // Preserve the EVAL flag later on if the type has changed.
@@ -229,7 +267,7 @@ static int _csync_detect_update(CSYNC *ctx, std::unique_ptr<csync_file_stat_t> f
 
           goto out;
       }
-      if (ctx->current == LOCAL_REPLICA &&
+      if (walk->replica == LOCAL_REPLICA &&
               (!_csync_mtime_equal(fs->modtime, base._modtime)
                // zero size in statedb can happen during migration
                || (base._fileSize != 0 && fs->size != base._fileSize))) {
@@ -262,10 +300,10 @@ static int _csync_detect_update(CSYNC *ctx, std::unique_ptr<csync_file_stat_t> f
           fs->instruction = CSYNC_INSTRUCTION_EVAL;
           goto out;
       }
-      bool metadata_differ = (ctx->current == REMOTE_REPLICA && (fs->file_id != base._fileId
+      bool metadata_differ = (walk->replica == REMOTE_REPLICA && (fs->file_id != base._fileId
                                                           || fs->remotePerm != base._remotePerm))
-                           || (ctx->current == LOCAL_REPLICA && fs->inode != base._inode);
-      if (fs->type == ItemTypeDirectory && ctx->current == REMOTE_REPLICA
+                           || (walk->replica == LOCAL_REPLICA && fs->inode != base._inode);
+      if (fs->type == ItemTypeDirectory && walk->replica == REMOTE_REPLICA
               && !metadata_differ && ctx->read_remote_from_db) {
           /* If both etag and file id are equal for a directory, read all contents from
            * the database.
@@ -273,12 +311,12 @@ static int _csync_detect_update(CSYNC *ctx, std::unique_ptr<csync_file_stat_t> f
            * upgrading owncloud
            */
           qCInfo(lcUpdate, "Reading from database: %s", fs->path.constData());
-          ctx->remote.read_from_db = true;
+          walk->read_from_db = true;
       }
       /* If it was remembered in the db that the remote dir has ignored files, store
        * that so that the reconciler can make advantage of.
        */
-      if( ctx->current == REMOTE_REPLICA ) {
+      if( walk->replica == REMOTE_REPLICA ) {
           fs->has_ignored_files = base._serverHasIgnoredFiles;
       }
       if (metadata_differ) {
@@ -290,12 +328,12 @@ static int _csync_detect_update(CSYNC *ctx, std::unique_ptr<csync_file_stat_t> f
       }
   } else {
       /* check if it's a file and has been renamed */
-      if (ctx->current == LOCAL_REPLICA) {
+      if (walk->replica == LOCAL_REPLICA) {
           qCInfo(lcUpdate, "Checking for rename based on inode # %" PRId64 "", (uint64_t) fs->inode);
 
           OCC::SyncJournalFileRecord base;
-          if(!ctx->statedb->getFileRecordByInode(fs->inode, &base)) {
-              ctx->status_code = CSYNC_STATUS_UNSUCCESSFUL;
+          if(!_csync_get_file_record_by_inode(ctx, fs->inode, &base)) {
+              walk->status_code = CSYNC_STATUS_UNSUCCESSFUL;
               return -1;
           }
 
@@ -364,12 +402,12 @@ static int _csync_detect_update(CSYNC *ctx, std::unique_ptr<csync_file_stat_t> f
               // Record directory renames
               if (fs->type == ItemTypeDirectory) {
                   // If the same folder was already renamed by a different entry,
-                  // skip to the next candidate
-                  if (ctx->renames.folder_renamed_to.count(base._path) > 0) {
+                  // skip to the next candidate. Local renames take precedence.
+                  csync_rename_wait_for_local_walk(ctx);
+                  if (!csync_rename_record_unless_renamed(ctx, base._path, fs->path)) {
                       qCWarning(lcUpdate, "folder already has a rename entry, skipping");
                       return;
                   }
-                  csync_rename_record(ctx, base._path, fs->path);
               }
 
               /* A remote rename can also mean Encryption Mangled Name.
@@ -387,14 +425,14 @@ static int _csync_detect_update(CSYNC *ctx, std::unique_ptr<csync_file_stat_t> f
               done = true;
           };
 
-          if (!ctx->statedb->getFileRecordsByFileId(fs->file_id, renameCandidateProcessing)) {
-              ctx->status_code = CSYNC_STATUS_UNSUCCESSFUL;
+          if (!_csync_get_file_records_by_file_id(ctx, fs->file_id, renameCandidateProcessing)) {
+              walk->status_code = CSYNC_STATUS_UNSUCCESSFUL;
               return -1;
           }
 
           if (fs->instruction == CSYNC_INSTRUCTION_NEW
               && fs->type == ItemTypeDirectory
-              && ctx->current == REMOTE_REPLICA
+              && walk->replica == REMOTE_REPLICA
               && ctx->callbacks.checkSelectiveSyncNewFolderHook) {
               if (ctx->callbacks.checkSelectiveSyncNewFolderHook(ctx->callbacks.update_callback_userdata, fs->path, fs->remotePerm)) {
                   return 1;
@@ -445,18 +483,18 @@ out:
       }
   }
 
-  ctx->current_fs = fs.get();
+  walk->current_fs = fs.get();
 
   qCInfo(lcUpdate, "file: %s, instruction: %s <<=", fs->path.constData(),
       csync_instruction_str(fs->instruction));
 
   QByteArray path = fs->path;
-  switch (ctx->current) {
+  switch (walk->replica) {
     case LOCAL_REPLICA:
-      ctx->local.files[path] = std::move(fs);
+      ctx->local.files.insertFile(path, std::move(fs));
       break;
     case REMOTE_REPLICA:
-      ctx->remote.files[path] = std::move(fs);
+      ctx->remote.files.insertFile(path, std::move(fs));
       break;
     default:
       break;
@@ -465,25 +503,25 @@ out:
   return 0;
 }
 
-int csync_walker(CSYNC *ctx, std::unique_ptr<csync_file_stat_t> fs) {
+int csync_walker(CSYNC *ctx, csync_walk_s *walk, std::unique_ptr<csync_file_stat_t> fs) {
   int rc = -1;
 
   if (ctx->abort) {
     qCDebug(lcUpdate, "Aborted!");
-    ctx->status_code = CSYNC_STATUS_ABORTED;
+    walk->status_code = CSYNC_STATUS_ABORTED;
     return -1;
   }
 
   switch (fs->type) {
     case ItemTypeFile:
-      if (ctx->current == REMOTE_REPLICA) {
+      if (walk->replica == REMOTE_REPLICA) {
           qCDebug(lcUpdate, "file: %s [file_id=%s size=%" PRIu64 "]", fs->path.constData(), fs->file_id.constData(), fs->size);
       } else {
           qCDebug(lcUpdate, "file: %s [inode=%" PRIu64 " size=%" PRIu64 "]", fs->path.constData(), fs->inode, fs->size);
       }
       break;
   case ItemTypeDirectory: /* enter directory */
-      if (ctx->current == REMOTE_REPLICA) {
+      if (walk->replica == REMOTE_REPLICA) {
           qCDebug(lcUpdate, "directory: %s [file_id=%s]", fs->path.constData(), fs->file_id.constData());
       } else {
           qCDebug(lcUpdate, "directory: %s [inode=%" PRIu64 "]", fs->path.constData(), fs->inode);
@@ -497,18 +535,45 @@ int csync_walker(CSYNC *ctx, std::unique_ptr<csync_file_stat_t> fs) {
     return 0;
   }
 
-  rc = _csync_detect_update(ctx, std::move(fs));
+  rc = _csync_detect_update(ctx, walk, std::move(fs));
 
   return rc;
 }
 
-static bool fill_tree_from_db(CSYNC *ctx, const char *uri)
+/* Add a file of the db to the tree, unless it is excluded. */
+static bool insert_file_from_db(CSYNC *ctx, csync_s::FileMap &files, const OCC::SyncJournalFileRecord &rec)
+{
+    std::unique_ptr<csync_file_stat_t> st = csync_file_stat_t::fromSyncJournalFileRecord(rec);
+
+    /* Check for exclusion from the tree.
+     * Note that this is only a safety net in case the ignore list changes
+     * without a full remote discovery being triggered. */
+    CSYNC_EXCLUDE_TYPE excluded = CSYNC_NOT_EXCLUDED;
+    if (ctx->exclude_traversal_fn)
+        excluded = ctx->exclude_traversal_fn(st->path, st->type);
+    if (excluded != CSYNC_NOT_EXCLUDED) {
+        qInfo(lcUpdate, "%s excluded from db read (%d)", st->path.constData(), excluded);
+
+        if (excluded == CSYNC_FILE_EXCLUDE_AND_REMOVE
+                || excluded == CSYNC_FILE_SILENTLY_EXCLUDED) {
+            return false;
+        }
+
+        st->instruction = CSYNC_INSTRUCTION_IGNORE;
+    }
+
+    /* store into result list. */
+    files.insertFile(rec._path, std::move(st));
+    return true;
+}
+
+static bool fill_tree_from_db(CSYNC *ctx, csync_walk_s *walk, const char *uri)
 {
     int64_t count = 0;
     QByteArray skipbase;
-    auto &files = ctx->current == LOCAL_REPLICA ? ctx->local.files : ctx->remote.files;
-    auto rowCallback = [ctx, &count, &skipbase, &files](const OCC::SyncJournalFileRecord &rec) {
-        if (ctx->current == REMOTE_REPLICA) {
+    auto &files = walk->replica == LOCAL_REPLICA ? ctx->local.files : ctx->remote.files;
+    auto rowCallback = [ctx, walk, &count, &skipbase, &files](const OCC::SyncJournalFileRecord &rec) {
+        if (walk->replica == REMOTE_REPLICA) {
             /* When selective sync is used, the database may have subtrees with a parent
              * whose etag is _invalid_. These are ignored and shall not appear in the
              * remote tree.
@@ -533,32 +598,12 @@ static bool fill_tree_from_db(CSYNC *ctx, const char *uri)
             }
         }
 
-        std::unique_ptr<csync_file_stat_t> st = csync_file_stat_t::fromSyncJournalFileRecord(rec);
-
-        /* Check for exclusion from the tree.
-         * Note that this is only a safety net in case the ignore list changes
-         * without a full remote discovery being triggered. */
-        CSYNC_EXCLUDE_TYPE excluded = CSYNC_NOT_EXCLUDED;
-        if (ctx->exclude_traversal_fn)
-            excluded = ctx->exclude_traversal_fn(st->path, st->type);
-        if (excluded != CSYNC_NOT_EXCLUDED) {
-            qInfo(lcUpdate, "%s excluded from db read (%d)", st->path.constData(), excluded);
-
-            if (excluded == CSYNC_FILE_EXCLUDE_AND_REMOVE
-                    || excluded == CSYNC_FILE_SILENTLY_EXCLUDED) {
-                return;
-            }
-
-            st->instruction = CSYNC_INSTRUCTION_IGNORE;
-        }
-
-        /* store into result list. */
-        files[rec._path] = std::move(st);
-        ++count;
+        if (insert_file_from_db(ctx, files, rec))
+            ++count;
     };
 
     if (!ctx->statedb->getFilesBelowPath(uri, rowCallback)) {
-        ctx->status_code = CSYNC_STATUS_STATEDB_LOAD_ERROR;
+        walk->status_code = CSYNC_STATUS_STATEDB_LOAD_ERROR;
         return false;
     }
     qInfo(lcUpdate, "%" PRId64 " entries read below path %s from db.", count, uri);
@@ -568,15 +613,15 @@ static bool fill_tree_from_db(CSYNC *ctx, const char *uri)
 
 /* set the current item to an ignored state.
  * If the item is set to ignored, the update phase continues, ie. its not a hard error */
-static bool mark_current_item_ignored( CSYNC *ctx, csync_file_stat_t *previous_fs, CSYNC_STATUS status )
+static bool mark_current_item_ignored( CSYNC *ctx, csync_walk_s *walk, csync_file_stat_t *previous_fs, CSYNC_STATUS status )
 {
     if(!ctx) {
         return false;
     }
 
-    if (ctx->current_fs) {
-        ctx->current_fs->instruction = CSYNC_INSTRUCTION_IGNORE;
-        ctx->current_fs->error_status = status;
+    if (walk->current_fs) {
+        walk->current_fs->instruction = CSYNC_INSTRUCTION_IGNORE;
+        walk->current_fs->error_status = status;
         /* If a directory has ignored files, put the flag on the parent directory as well */
         if( previous_fs ) {
             previous_fs->has_ignored_files = true;
@@ -586,8 +631,19 @@ static bool mark_current_item_ignored( CSYNC *ctx, csync_file_stat_t *previous_f
     return false;
 }
 
+/* Whether the remote directory uri is one of ctx->remote_discovery_paths or contains one */
+static bool leads_to_remote_discovery_path(CSYNC *ctx, const QByteArray &uri)
+{
+    const auto &paths = ctx->remote_discovery_paths;
+    if (paths.count(uri))
+        return true;
+    const QByteArray prefix = uri + '/';
+    auto it = paths.lower_bound(prefix);
+    return it != paths.end() && it->startsWith(prefix);
+}
+
 /* File tree walker */
-int csync_ftw(CSYNC *ctx, const char *uri, csync_walker_fn fn,
+int csync_ftw(CSYNC *ctx, csync_walk_s *walk, const char *uri, csync_walker_fn fn,
     unsigned int depth) {
   QByteArray filename;
   QByteArray fullpath;
@@ -597,10 +653,16 @@ int csync_ftw(CSYNC *ctx, const char *uri, csync_walker_fn fn,
   int read_from_db = 0;
   int rc = 0;
 
-  bool do_read_from_db = (ctx->current == REMOTE_REPLICA && ctx->remote.read_from_db);
+  bool do_read_from_db = (walk->replica == REMOTE_REPLICA && walk->read_from_db);
   const char *db_uri = uri;
 
-  if (ctx->current == LOCAL_REPLICA && ctx->should_discover_locally_fn) {
+  /* The server reported changes in there, whatever the etag says */
+  if (do_read_from_db && !ctx->remote_discovery_paths.empty()
+      && leads_to_remote_discovery_path(ctx, QByteArray(uri))) {
+      do_read_from_db = false;
+  }
+
+  if (walk->replica == LOCAL_REPLICA && ctx->should_discover_locally_fn) {
       const char *local_uri = uri + strlen(ctx->local.uri);
       if (*local_uri == '/')
           ++local_uri;
@@ -609,46 +671,46 @@ int csync_ftw(CSYNC *ctx, const char *uri, csync_walker_fn fn,
   }
 
   if (!depth) {
-    mark_current_item_ignored(ctx, previous_fs, CSYNC_STATUS_INDIVIDUAL_TOO_DEEP);
+    mark_current_item_ignored(ctx, walk, previous_fs, CSYNC_STATUS_INDIVIDUAL_TOO_DEEP);
     return 0;
   }
 
-  read_from_db = ctx->remote.read_from_db;
+  read_from_db = walk->read_from_db;
 
   // if the etag of this dir is still the same, its content is restored from the
   // database.
   if( do_read_from_db ) {
-      if(!fill_tree_from_db(ctx, db_uri)) {
+      if(!fill_tree_from_db(ctx, walk, db_uri)) {
         errno = ENOENT;
-        ctx->status_code = CSYNC_STATUS_OPENDIR_ERROR;
+        walk->status_code = CSYNC_STATUS_OPENDIR_ERROR;
         goto error;
       }
       return 0;
   }
 
-  if (!(dh = csync_vio_opendir(ctx, uri))) {
+  if (!(dh = csync_vio_opendir(ctx, walk->replica, uri))) {
       if (ctx->abort) {
           qCDebug(lcUpdate, "Aborted!");
-          ctx->status_code = CSYNC_STATUS_ABORTED;
+          walk->status_code = CSYNC_STATUS_ABORTED;
           goto error;
       }
       int asp = 0;
       /* permission denied */
-      ctx->status_code = csync_errno_to_status(errno, CSYNC_STATUS_OPENDIR_ERROR);
+      walk->status_code = csync_errno_to_status(errno, CSYNC_STATUS_OPENDIR_ERROR);
       if (errno == EACCES) {
           qCWarning(lcUpdate, "Permission denied.");
-          if (mark_current_item_ignored(ctx, previous_fs, CSYNC_STATUS_PERMISSION_DENIED)) {
+          if (mark_current_item_ignored(ctx, walk, previous_fs, CSYNC_STATUS_PERMISSION_DENIED)) {
               return 0;
           }
       } else if(errno == ENOENT) {
-          asp = asprintf( &ctx->error_string, "%s", uri);
+          asp = asprintf( &walk->error_string, "%s", uri);
           ASSERT(asp >= 0);
       }
       // 403 Forbidden can be sent by the server if the file firewall is active.
       // A file or directory should be ignored and sync must continue. See #3490
       else if(errno == ERRNO_FORBIDDEN) {
           qCWarning(lcUpdate, "Directory access Forbidden (File Firewall?)");
-          if( mark_current_item_ignored(ctx, previous_fs, CSYNC_STATUS_FORBIDDEN) ) {
+          if( mark_current_item_ignored(ctx, walk, previous_fs, CSYNC_STATUS_FORBIDDEN) ) {
               return 0;
           }
           /* if current_fs is not defined here, better throw an error */
@@ -659,7 +721,7 @@ int csync_ftw(CSYNC *ctx, const char *uri, csync_walker_fn fn,
       // 503 as request to ignore the folder. See #3113 #2884.
       else if(errno == ERRNO_STORAGE_UNAVAILABLE || errno == ERRNO_SERVICE_UNAVAILABLE) {
           qCWarning(lcUpdate, "Storage was not available!");
-          if( mark_current_item_ignored(ctx, previous_fs, CSYNC_STATUS_STORAGE_UNAVAILABLE ) ) {
+          if( mark_current_item_ignored(ctx, walk, previous_fs, CSYNC_STATUS_STORAGE_UNAVAILABLE ) ) {
               return 0;
           }
           /* if current_fs is not defined here, better throw an error */
@@ -672,7 +734,7 @@ int csync_ftw(CSYNC *ctx, const char *uri, csync_walker_fn fn,
   while (true) {
     // Get the next item in the directory
     errno = 0;
-    dirent = csync_vio_readdir(ctx, dh);
+    dirent = csync_vio_readdir(ctx, walk->replica, dh);
     if (!dirent) {
         if (errno != 0) {
             // Note: Windows vio converts any error into EACCES
@@ -686,8 +748,8 @@ int csync_ftw(CSYNC *ctx, const char *uri, csync_walker_fn fn,
 
     /* Conversion error */
     if (dirent->path.isEmpty() && !dirent->original_path.isEmpty()) {
-        ctx->status_code = CSYNC_STATUS_INVALID_CHARACTERS;
-        ctx->error_string = c_strdup(dirent->original_path);
+        walk->status_code = CSYNC_STATUS_INVALID_CHARACTERS;
+        walk->error_string = c_strdup(dirent->original_path);
         dirent->original_path.clear();
         goto error;
     }
@@ -695,7 +757,7 @@ int csync_ftw(CSYNC *ctx, const char *uri, csync_walker_fn fn,
     // At this point dirent->path only contains the file name.
     filename = dirent->path;
     if (filename.isEmpty()) {
-      ctx->status_code = CSYNC_STATUS_READDIR_ERROR;
+      walk->status_code = CSYNC_STATUS_READDIR_ERROR;
       goto error;
     }
 
@@ -722,72 +784,160 @@ int csync_ftw(CSYNC *ctx, const char *uri, csync_walker_fn fn,
 
     // Now process to have a relative path to the sync root for the local replica, or to the data root on the remote.
     dirent->path = fullpath;
-    if (ctx->current == LOCAL_REPLICA) {
+    if (walk->replica == LOCAL_REPLICA) {
         ASSERT(dirent->path.startsWith(ctx->local.uri)); // path is relative to uri
         // "len + 1" to include the slash in-between.
         size_t uriLength = strlen(ctx->local.uri);
         dirent->path = dirent->path.mid(OCC::Utility::convertSizeToInt(uriLength) + 1);
     }
 
-    previous_fs = ctx->current_fs;
+    previous_fs = walk->current_fs;
     bool recurse = dirent->type == ItemTypeDirectory;
 
     /* Call walker function for each file */
-    rc = fn(ctx, std::move(dirent));
-    /* this function may update ctx->current and ctx->read_from_db */
+    rc = fn(ctx, walk, std::move(dirent));
+    /* this function may update walk->current_fs and walk->read_from_db */
 
     if (rc < 0) {
-      if (CSYNC_STATUS_IS_OK(ctx->status_code)) {
-          ctx->status_code = CSYNC_STATUS_UPDATE_ERROR;
+      if (CSYNC_STATUS_IS_OK(walk->status_code)) {
+          walk->status_code = CSYNC_STATUS_UPDATE_ERROR;
       }
 
-      ctx->current_fs = previous_fs;
+      walk->current_fs = previous_fs;
       goto error;
     }
 
     if (recurse && rc == 0
-        && (!ctx->current_fs || ctx->current_fs->instruction != CSYNC_INSTRUCTION_IGNORE)) {
-      rc = csync_ftw(ctx, fullpath, fn, depth - 1);
+        && (!walk->current_fs || walk->current_fs->instruction != CSYNC_INSTRUCTION_IGNORE)) {
+      rc = csync_ftw(ctx, walk, fullpath, fn, depth - 1);
       if (rc < 0) {
-        ctx->current_fs = previous_fs;
+        walk->current_fs = previous_fs;
         goto error;
       }
 
-      if (ctx->current_fs && !ctx->current_fs->child_modified
-          && ctx->current_fs->instruction == CSYNC_INSTRUCTION_EVAL) {
-          if (ctx->current == REMOTE_REPLICA) {
-              ctx->current_fs->instruction = CSYNC_INSTRUCTION_UPDATE_METADATA;
+      if (walk->current_fs && !walk->current_fs->child_modified
+          && walk->current_fs->instruction == CSYNC_INSTRUCTION_EVAL) {
+          if (walk->replica == REMOTE_REPLICA) {
+              walk->current_fs->instruction = CSYNC_INSTRUCTION_UPDATE_METADATA;
           } else {
-              ctx->current_fs->instruction = CSYNC_INSTRUCTION_NONE;
+              walk->current_fs->instruction = CSYNC_INSTRUCTION_NONE;
           }
       }
 
-      if (ctx->current_fs && previous_fs && ctx->current_fs->has_ignored_files) {
+      if (walk->current_fs && previous_fs && walk->current_fs->has_ignored_files) {
           /* If a directory has ignored files, put the flag on the parent directory as well */
-          previous_fs->has_ignored_files = ctx->current_fs->has_ignored_files;
+          previous_fs->has_ignored_files = walk->current_fs->has_ignored_files;
       }
     }
 
-    if (ctx->current_fs && previous_fs && ctx->current_fs->child_modified) {
+    if (walk->current_fs && previous_fs && walk->current_fs->child_modified) {
         /* If a directory has modified files, put the flag on the parent directory as well */
-        previous_fs->child_modified = ctx->current_fs->child_modified;
+        previous_fs->child_modified = walk->current_fs->child_modified;
     }
 
-    ctx->current_fs = previous_fs;
-    ctx->remote.read_from_db = read_from_db;
+    walk->current_fs = previous_fs;
+    walk->read_from_db = read_from_db;
   }
 
-  csync_vio_closedir(ctx, dh);
+  csync_vio_closedir(ctx, walk->replica, dh);
   qCInfo(lcUpdate, " <= Closing walk for %s with read_from_db %d", uri, read_from_db);
 
   return rc;
 
 error:
-  ctx->remote.read_from_db = read_from_db;
+  walk->read_from_db = read_from_db;
   if (dh) {
-    csync_vio_closedir(ctx, dh);
+    csync_vio_closedir(ctx, walk->replica, dh);
   }
   return -1;
 }
 
+/* Walk the remote directory uri for a targeted discovery: its contents are read
+ * from the db, except for the subtrees leading to ctx->remote_discovery_paths,
+ * which are walked further. The listed directories themselves are discovered
+ * as usual. Sets *incomplete if the db can't stand in for the server. */
+static int csync_ftw_targeted(CSYNC *ctx, csync_walk_s *walk, const QByteArray &uri, csync_walker_fn fn,
+    unsigned int depth, bool *incomplete)
+{
+    if (!depth) {
+        mark_current_item_ignored(ctx, walk, nullptr, CSYNC_STATUS_INDIVIDUAL_TOO_DEEP);
+        return 0;
+    }
+
+    const QByteArray prefix = uri.isEmpty() ? uri : uri + '/';
+
+    /* The entries of uri through which the listed directories are reached */
+    std::set<QByteArray> children;
+    for (auto it = ctx->remote_discovery_paths.lower_bound(prefix);
+         it != ctx->remote_discovery_paths.end() && it->startsWith(prefix); ++it) {
+        const int slash = it->indexOf('/', prefix.size());
+        children.insert(slash < 0 ? *it : it->left(slash));
+    }
+
+    int64_t count = 0;
+    auto &files = ctx->remote.files;
+    auto rowCallback = [&](const OCC::SyncJournalFileRecord &rec) {
+        if (*incomplete) {
+            return;
+        }
+        /* Directories that are being rediscovered or were not completely
+         * propagated: only a full discovery finds out what is below them. */
+        if (rec._etag == "_invalid_") {
+            qCInfo(lcUpdate, "%s has no valid etag in the db", rec._path.constData());
+            *incomplete = true;
+            return;
+        }
+        const int slash = rec._path.startsWith(prefix) ? rec._path.indexOf('/', prefix.size()) : -1;
+        if (slash >= 0 && children.count(rec._path.left(slash))) {
+            return;
+        }
+        if (insert_file_from_db(ctx, files, rec))
+            ++count;
+    };
+
+    if (!ctx->statedb->getFilesBelowPath(uri, rowCallback)) {
+        walk->status_code = CSYNC_STATUS_STATEDB_LOAD_ERROR;
+        return -1;
+    }
+    qInfo(lcUpdate, "%" PRId64 " entries read below path %s from db.", count, uri.constData());
+    if (*incomplete) {
+        return 0;
+    }
+
+    for (const QByteArray &child : children) {
+        csync_file_stat_t *fs = files.findFile(child);
+        if (!fs || fs->type != ItemTypeDirectory || fs->instruction == CSYNC_INSTRUCTION_IGNORE) {
+            /* Excluded, or not a directory we know */
+            continue;
+        }
+
+        csync_file_stat_t *previous_fs = walk->current_fs;
+        walk->current_fs = fs;
+        int rc = 0;
+        if (ctx->remote_discovery_paths.count(child)) {
+            qCInfo(lcUpdate, "Listing changed directory %s", child.constData());
+            rc = csync_ftw(ctx, walk, child.constData(), fn, depth - 1);
+        } else {
+            rc = csync_ftw_targeted(ctx, walk, child, fn, depth - 1, incomplete);
+        }
+        walk->current_fs = previous_fs;
+        if (rc < 0 || *incomplete) {
+            return rc;
+        }
+    }
+    return 0;
+}
+
+int csync_ftw_remote_targeted(CSYNC *ctx, csync_walk_s *walk, csync_walker_fn fn, unsigned int depth)
+{
+    bool incomplete = false;
+    int rc = csync_ftw_targeted(ctx, walk, QByteArray(), fn, depth, &incomplete);
+    if (rc == 0 && incomplete) {
+        qCInfo(lcUpdate, "The db is missing etags, falling back to a full remote discovery");
+        ctx->remote.files.clear();
+        rc = csync_ftw(ctx, walk, "", fn, depth);
+    }
+    return rc;
+}
+
 /* vim: set ts=8 sw=2 et cindent: */
@@ -37,13 +37,17 @@
  * @{
  */
 
-using csync_walker_fn = int (*)(CSYNC *ctx, std::unique_ptr<csync_file_stat_t> fs);
+struct csync_walk_s;
+
+using csync_walker_fn = int (*)(CSYNC *ctx, csync_walk_s *walk, std::unique_ptr<csync_file_stat_t> fs);
 
 /**
  * @brief The walker function to use in the file tree walker.
  *
  * @param  ctx          The used csync context.
  *
+ * @param  walk         The state of the walk, it tells which replica is walked.
+ *
  * @param  file         The file we are researching.
  *
  * @param  fs           The stat information we got.
@@ -52,7 +56,7 @@ using csync_walker_fn = int (*)(CSYNC *ctx, std::unique_ptr<csync_file_stat_t> f
  *
  * @return 0 on success, < 0 on error.
  */
-int csync_walker(CSYNC *ctx, std::unique_ptr<csync_file_stat_t> fs);
+int csync_walker(CSYNC *ctx, csync_walk_s *walk, std::unique_ptr<csync_file_stat_t> fs);
 
 /**
  * @brief The file tree walker.
@@ -64,6 +68,8 @@ int csync_walker(CSYNC *ctx, std::unique_ptr<csync_file_stat_t> fs);
  *
  * @param  ctx          The csync context to use.
  *
+ * @param  walk         The state of the walk, it tells which replica is walked.
+ *
  * @param  uri          The uri/path to the directory tree to walk.
  *
  * @param  fn           The walker function to call once for each entry.
@@ -74,7 +80,19 @@ int csync_walker(CSYNC *ctx, std::unique_ptr<csync_file_stat_t> fs);
  *         walk is terminated and the value returned by fn() is returned as the
  *         result.
  */
-int csync_ftw(CSYNC *ctx, const char *uri, csync_walker_fn fn,
+int csync_ftw(CSYNC *ctx, csync_walk_s *walk, const char *uri, csync_walker_fn fn,
+    unsigned int depth);
+
+/**
+ * @brief Walk the remote tree, listing only the changed directories.
+ *
+ * Only the directories in ctx->remote_discovery_paths are listed on the
+ * server, everything else is read from the database. Falls back to a full
+ * csync_ftw() of the remote tree if the database is missing etags.
+ *
+ * @return 0 on success, < 0 on error.
+ */
+int csync_ftw_remote_targeted(CSYNC *ctx, csync_walk_s *walk, csync_walker_fn fn,
     unsigned int depth);
 
 #endif /* _CSYNC_UPDATE_H */
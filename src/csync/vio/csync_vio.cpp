@@ -32,17 +32,16 @@
 #include "vio/csync_vio_local.h"
 #include "common/c_jhash.h"
 
-csync_vio_handle_t *csync_vio_opendir(CSYNC *ctx, const char *name) {
-  switch(ctx->current) {
+csync_vio_handle_t *csync_vio_opendir(CSYNC *ctx, enum csync_replica_e replica, const char *name) {
+  switch(replica) {
     case REMOTE_REPLICA:
-      ASSERT(!ctx->remote.read_from_db);
       return ctx->callbacks.remote_opendir_hook(name, ctx->callbacks.vio_userdata);
       break;
     case LOCAL_REPLICA:
 	if( ctx->callbacks.update_callback ) {
         ctx->callbacks.update_callback(/*local=*/true, name, ctx->callbacks.update_callback_userdata);
 	}
-      return csync_vio_local_opendir(name);
+      return csync_vio_local_opendir(name, ctx->local.prefetch);
       break;
     default:
       ASSERT(false);
@@ -50,7 +49,7 @@ csync_vio_handle_t *csync_vio_opendir(CSYNC *ctx, const char *name) {
   return nullptr;
 }
 
-int csync_vio_closedir(CSYNC *ctx, csync_vio_handle_t *dhandle) {
+int csync_vio_closedir(CSYNC *ctx, enum csync_replica_e replica, csync_vio_handle_t *dhandle) {
   int rc = -1;
 
   if (!dhandle) {
@@ -58,9 +57,8 @@ int csync_vio_closedir(CSYNC *ctx, csync_vio_handle_t *dhandle) {
     return -1;
   }
 
-  switch(ctx->current) {
+  switch(replica) {
   case REMOTE_REPLICA:
-      ASSERT(!ctx->remote.read_from_db);
       ctx->callbacks.remote_closedir_hook(dhandle, ctx->callbacks.vio_userdata);
       rc = 0;
       break;
@@ -74,10 +72,9 @@ int csync_vio_closedir(CSYNC *ctx, csync_vio_handle_t *dhandle) {
   return rc;
 }
 
-std::unique_ptr<csync_file_stat_t> csync_vio_readdir(CSYNC *ctx, csync_vio_handle_t *dhandle) {
-  switch(ctx->current) {
+std::unique_ptr<csync_file_stat_t> csync_vio_readdir(CSYNC *ctx, enum csync_replica_e replica, csync_vio_handle_t *dhandle) {
+  switch(replica) {
     case REMOTE_REPLICA:
-      ASSERT(!ctx->remote.read_from_db);
       return ctx->callbacks.remote_readdir_hook(dhandle, ctx->callbacks.vio_userdata);
       break;
     case LOCAL_REPLICA:
@@ -32,9 +32,9 @@ struct fhandle_t {
   int fd;
 };
 
-csync_vio_handle_t *csync_vio_opendir(CSYNC *ctx, const char *name);
-int csync_vio_closedir(CSYNC *ctx, csync_vio_handle_t *dhandle);
-std::unique_ptr<csync_file_stat_t> csync_vio_readdir(CSYNC *ctx, csync_vio_handle_t *dhandle);
+csync_vio_handle_t *csync_vio_opendir(CSYNC *ctx, enum csync_replica_e replica, const char *name);
+int csync_vio_closedir(CSYNC *ctx, enum csync_replica_e replica, csync_vio_handle_t *dhandle);
+std::unique_ptr<csync_file_stat_t> csync_vio_readdir(CSYNC *ctx, enum csync_replica_e replica, csync_vio_handle_t *dhandle);
 
 char *csync_vio_get_status_string(CSYNC *ctx);
 
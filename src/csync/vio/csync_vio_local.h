@@ -21,7 +21,24 @@
 #ifndef _CSYNC_VIO_LOCAL_H
 #define _CSYNC_VIO_LOCAL_H
 
-csync_vio_handle_t OCSYNC_EXPORT *csync_vio_local_opendir(const char *name);
+#include <functional>
+
+/**
+ * Lists the directories of a local tree ahead of the walker on a pool of
+ * threads. Only implemented on Unix, elsewhere starting it returns nullptr.
+ */
+struct csync_vio_local_prefetch_s;
+
+/**
+ * Start listing the tree below root with the given number of threads.
+ * Directories for which should_list returns false (it gets the path relative
+ * to root) are not listed in advance.
+ */
+csync_vio_local_prefetch_s OCSYNC_EXPORT *csync_vio_local_prefetch_start(const char *root, int threads,
+    std::function<bool(const QByteArray &)> should_list);
+void OCSYNC_EXPORT csync_vio_local_prefetch_stop(csync_vio_local_prefetch_s *prefetch);
+
+csync_vio_handle_t OCSYNC_EXPORT *csync_vio_local_opendir(const char *name, csync_vio_local_prefetch_s *prefetch = nullptr);
 int OCSYNC_EXPORT csync_vio_local_closedir(csync_vio_handle_t *dhandle);
 std::unique_ptr<csync_file_stat_t> OCSYNC_EXPORT csync_vio_local_readdir(csync_vio_handle_t *dhandle);
 
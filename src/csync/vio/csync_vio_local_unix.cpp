@@ -24,9 +24,18 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <dirent.h>
+#include <unistd.h>
 #include <cstdio>
 
+#include <atomic>
+#include <deque>
+#include <map>
 #include <memory>
+#include <vector>
+
+#include <QMutex>
+#include <QThread>
+#include <QWaitCondition>
 
 #include "c_private.h"
 #include "c_lib.h"
@@ -39,76 +48,40 @@
 
 Q_LOGGING_CATEGORY(lcCSyncVIOLocal, "nextcloud.sync.csync.vio_local", QtInfoMsg)
 
+using csync_listing_t = std::deque<std::unique_ptr<csync_file_stat_t>>;
+
 /*
  * directory functions
  */
 
 struct dhandle_t {
-  DIR *dh;
-  char *path;
+  DIR *dh = nullptr;
+  QByteArray path;
+  csync_listing_t prefetched; // used instead of dh when the listing was done in advance
+  csync_vio_local_prefetch_s *prefetch = nullptr;
 };
 
+static void _csync_vio_local_fill_stat(const struct stat &sb, csync_file_stat_t *buf);
 static int _csync_vio_local_stat_mb(const mbchar_t *wuri, csync_file_stat_t *buf);
 
-csync_vio_handle_t *csync_vio_local_opendir(const char *name) {
-  dhandle_t *handle = nullptr;
-  mbchar_t *dirname = nullptr;
-
-  handle = (dhandle_t*)c_malloc(sizeof(dhandle_t));
-
-  dirname = c_utf8_path_to_locale(name);
-
-  handle->dh = _topendir( dirname );
-  if (!handle->dh) {
-    c_free_locale_string(dirname);
-    SAFE_FREE(handle);
-    return nullptr;
-  }
-
-  handle->path = c_strdup(name);
-  c_free_locale_string(dirname);
-
-  return (csync_vio_handle_t *) handle;
-}
-
-int csync_vio_local_closedir(csync_vio_handle_t *dhandle) {
-  dhandle_t *handle = nullptr;
-  int rc = -1;
-
-  if (!dhandle) {
-    errno = EBADF;
-    return -1;
-  }
-
-  handle = (dhandle_t *) dhandle;
-  rc = _tclosedir(handle->dh);
-
-  SAFE_FREE(handle->path);
-  SAFE_FREE(handle);
-
-  return rc;
-}
-
-std::unique_ptr<csync_file_stat_t> csync_vio_local_readdir(csync_vio_handle_t *dhandle) {
-
-  dhandle_t *handle = nullptr;
-
-  handle = (dhandle_t *) dhandle;
+/* Read the next entry of dh, a listing of path. Returns nullptr at the end or on error (errno is set then). */
+static std::unique_ptr<csync_file_stat_t> _csync_vio_local_read_entry(DIR *dh, const QByteArray &path)
+{
   struct _tdirent *dirent = nullptr;
   std::unique_ptr<csync_file_stat_t> file_stat;
 
   do {
-      dirent = _treaddir(handle->dh);
+      errno = 0;
+      dirent = _treaddir(dh);
       if (!dirent)
           return {};
   } while (qstrcmp(dirent->d_name, ".") == 0 || qstrcmp(dirent->d_name, "..") == 0);
 
   file_stat = std::make_unique<csync_file_stat_t>();
   file_stat->path = c_utf8_from_locale(dirent->d_name);
-  QByteArray fullPath = QByteArray() % const_cast<const char *>(handle->path) % '/' % QByteArray() % const_cast<const char *>(dirent->d_name);
   if (file_stat->path.isNull()) {
-      file_stat->original_path = fullPath;
-      qCWarning(lcCSyncVIOLocal) << "Invalid characters in file/directory name, please rename:" << dirent->d_name << handle->path;
+      file_stat->original_path = path % '/' % QByteArray(dirent->d_name);
+      qCWarning(lcCSyncVIOLocal) << "Invalid characters in file/directory name, please rename:" << dirent->d_name << path;
   }
 
   /* Check for availability of d_type, see manpage. */
@@ -135,13 +108,386 @@ std::unique_ptr<csync_file_stat_t> csync_vio_local_readdir(csync_vio_handle_t *d
   if (file_stat->path.isNull())
       return file_stat;
 
-  if (_csync_vio_local_stat_mb(fullPath.constData(), file_stat.get()) < 0) {
+  // Stat relative to the open directory: the kernel does not have to resolve
+  // the whole path again for every entry.
+  struct stat sb;
+  if (fstatat(dirfd(dh), dirent->d_name, &sb, AT_SYMLINK_NOFOLLOW) < 0) {
       // Will get excluded by _csync_detect_update.
       file_stat->type = ItemTypeSkip;
+  } else {
+      _csync_vio_local_fill_stat(sb, file_stat.get());
   }
+  errno = 0;
   return file_stat;
 }
 
+/* List a whole directory. Returns false if it can't be opened or read.
+ *
+ * If parentFd is valid the directory is opened relative to it, the last
+ * component of path being its name. If keepFd is set it gets a duplicate
+ * of the descriptor of the directory if it has subdirectories, or -1. */
+static bool _csync_vio_local_list(const QByteArray &path, csync_listing_t *listing, int parentFd = -1, int *keepFd = nullptr)
+{
+  int fd = parentFd >= 0
+      ? openat(parentFd, path.constData() + path.lastIndexOf('/') + 1, O_RDONLY | O_DIRECTORY | O_CLOEXEC)
+      : open(path.constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0)
+      return false;
+  DIR *dh = fdopendir(fd);
+  if (!dh) {
+      close(fd);
+      return false;
+  }
+  bool hasDirectories = false;
+  while (auto file_stat = _csync_vio_local_read_entry(dh, path)) {
+      hasDirectories = hasDirectories || file_stat->type == ItemTypeDirectory;
+      listing->push_back(std::move(file_stat));
+  }
+  bool ok = errno == 0;
+  if (keepFd)
+      *keepFd = ok && hasDirectories ? fcntl(dirfd(dh), F_DUPFD_CLOEXEC, 0) : -1;
+  closedir(dh);
+  return ok;
+}
+
+/*
+ * Listing ahead of the walker
+ *
+ * The walker visits the tree depth first and only ever has one directory open.
+ * On a cold cache nearly all of that time is spent waiting for the disk, so a
+ * few threads list the directories below the one being walked in advance.
+ * Each thread has its own queue: it takes the most recently found directory
+ * from the back of its own queue (so it stays close to where the walker is
+ * going next) and steals from the front of the other queues when it runs out.
+ *
+ * The walker still consumes the listings in its own order, so what it sees
+ * does not depend on the scheduling of the threads.
+ */
+struct csync_vio_local_prefetch_s
+{
+    csync_vio_local_prefetch_s(const char *root, int threads, std::function<bool(const QByteArray &)> shouldList);
+    ~csync_vio_local_prefetch_s();
+
+    /* Get the listing of path, waiting for it or doing it here if needed */
+    bool take(const QByteArray &path, csync_listing_t *listing);
+    /* The walker is done with everything below path */
+    void release(const QByteArray &path);
+
+private:
+    enum State { Queued, Listing, Listed };
+    struct Directory
+    {
+        State state = Queued;
+        bool dropped = false; // released while being listed
+        csync_listing_t listing;
+    };
+    // An open directory that its queued subdirectories are opened relative to
+    struct DirectoryFd
+    {
+        explicit DirectoryFd(int fd, std::atomic<int> *count)
+            : fd(fd)
+            , count(count)
+        {
+            ++*count;
+        }
+        ~DirectoryFd()
+        {
+            close(fd);
+            --*count;
+        }
+        const int fd;
+        std::atomic<int> *count;
+    };
+    struct Work
+    {
+        QByteArray path;
+        std::shared_ptr<DirectoryFd> parent; // may be null, then path is opened as a whole
+    };
+    struct Worker
+    {
+        QMutex mutex;
+        std::deque<Work> queue;
+    };
+
+    // Don't let the threads run arbitrarily far ahead of the walker
+    enum { MaxBufferedEntries = 100000 };
+    // Past that many parents kept open, subdirectories are opened by their full path
+    enum { MaxOpenDirectoryFds = 128 };
+
+    void run(size_t index);
+    bool popWork(size_t index, Work *work);
+    bool list(const QByteArray &path, const std::shared_ptr<DirectoryFd> &parent, csync_listing_t *listing, std::shared_ptr<DirectoryFd> *fd);
+    void queueSubdirectories(size_t index, const QByteArray &path, const csync_listing_t &listing, const std::shared_ptr<DirectoryFd> &fd);
+
+    QByteArray _root;
+    std::function<bool(const QByteArray &)> _shouldList;
+    std::vector<std::unique_ptr<Worker>> _workers;
+    std::vector<std::unique_ptr<QThread>> _threads;
+    size_t _nextWorker = 0; // where the walker queues what it found itself
+    std::atomic<int> _openDirectoryFds{ 0 };
+
+    QMutex _mutex; // protects the members below
+    QWaitCondition _changed;
+    std::map<QByteArray, Directory> _directories;
+    size_t _bufferedEntries = 0;
+    bool _stop = false;
+};
+
+csync_vio_local_prefetch_s::csync_vio_local_prefetch_s(const char *root, int threads, std::function<bool(const QByteArray &)> shouldList)
+    : _root(root)
+    , _shouldList(std::move(shouldList))
+{
+    for (int i = 0; i < threads; ++i) {
+        _workers.push_back(std::make_unique<Worker>());
+    }
+    _directories[_root];
+    _workers[0]->queue.push_back({ _root, nullptr });
+    for (size_t i = 0; i < _workers.size(); ++i) {
+        _threads.emplace_back(QThread::create([this, i] { run(i); }));
+        _threads.back()->start();
+    }
+}
+
+csync_vio_local_prefetch_s::~csync_vio_local_prefetch_s()
+{
+    {
+        QMutexLocker locker(&_mutex);
+        _stop = true;
+        _changed.wakeAll();
+    }
+    for (auto &thread : _threads) {
+        thread->wait();
+    }
+    // Close the directories still queued while _openDirectoryFds is alive
+    _workers.clear();
+}
+
+bool csync_vio_local_prefetch_s::popWork(size_t index, Work *work)
+{
+    {
+        Worker &own = *_workers[index];
+        QMutexLocker locker(&own.mutex);
+        if (!own.queue.empty()) {
+            *work = std::move(own.queue.back());
+            own.queue.pop_back();
+            return true;
+        }
+    }
+    for (size_t i = 1; i < _workers.size(); ++i) {
+        Worker &victim = *_workers[(index + i) % _workers.size()];
+        QMutexLocker locker(&victim.mutex);
+        if (!victim.queue.empty()) {
+            *work = std::move(victim.queue.front());
+            victim.queue.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+/* List path, relative to parent if there is one. Sets fd for the subdirectories if it can keep one open. */
+bool csync_vio_local_prefetch_s::list(const QByteArray &path, const std::shared_ptr<DirectoryFd> &parent,
+    csync_listing_t *listing, std::shared_ptr<DirectoryFd> *fd)
+{
+    int keepFd = -1;
+    const bool keep = _openDirectoryFds < MaxOpenDirectoryFds;
+    if (!_csync_vio_local_list(path, listing, parent ? parent->fd : -1, keep ? &keepFd : nullptr))
+        return false;
+    if (keepFd >= 0)
+        fd->reset(new DirectoryFd(keepFd, &_openDirectoryFds));
+    return true;
+}
+
+/* Must be called with _mutex held */
+void csync_vio_local_prefetch_s::queueSubdirectories(size_t index, const QByteArray &path, const csync_listing_t &listing,
+    const std::shared_ptr<DirectoryFd> &fd)
+{
+    std::vector<Work> subdirectories;
+    for (const auto &file_stat : listing) {
+        if (file_stat->type != ItemTypeDirectory || file_stat->path.isNull())
+            continue;
+        QByteArray subdirectory = path % '/' % file_stat->path;
+        if (_shouldList && !_shouldList(subdirectory.mid(_root.size() + 1)))
+            continue;
+        _directories[subdirectory];
+        subdirectories.push_back({ std::move(subdirectory), fd });
+    }
+    if (subdirectories.empty())
+        return;
+
+    // Reversed, so the first entry is taken first from the back of the queue
+    Worker &worker = *_workers[index];
+    QMutexLocker locker(&worker.mutex);
+    worker.queue.insert(worker.queue.end(), subdirectories.rbegin(), subdirectories.rend());
+    _changed.wakeAll();
+}
+
+void csync_vio_local_prefetch_s::run(size_t index)
+{
+    while (true) {
+        Work work;
+        {
+            // Work is only queued with _mutex held, so checking for it under
+            // _mutex can't miss the wakeup of what is queued meanwhile
+            QMutexLocker locker(&_mutex);
+            while (!_stop && !popWork(index, &work)) {
+                _changed.wait(&_mutex);
+            }
+            while (!_stop && _bufferedEntries >= MaxBufferedEntries) {
+                _changed.wait(&_mutex);
+            }
+            if (_stop)
+                return;
+            auto it = _directories.find(work.path);
+            if (it == _directories.end() || it->second.state != Queued) {
+                // The walker took or released it in the meantime
+                continue;
+            }
+            it->second.state = Listing;
+        }
+
+        const QByteArray &path = work.path;
+        csync_listing_t listing;
+        std::shared_ptr<DirectoryFd> fd;
+        bool ok = list(path, work.parent, &listing, &fd);
+        work.parent.reset();
+
+        QMutexLocker locker(&_mutex);
+        auto it = _directories.find(path);
+        if (!ok || it->second.dropped) {
+            // Let the walker list it again and report the error itself
+            _directories.erase(it);
+            _changed.wakeAll();
+            continue;
+        }
+        queueSubdirectories(index, path, listing, fd);
+        _bufferedEntries += listing.size();
+        it->second.listing = std::move(listing);
+        it->second.state = Listed;
+        _changed.wakeAll();
+    }
+}
+
+bool csync_vio_local_prefetch_s::take(const QByteArray &path, csync_listing_t *listing)
+{
+    QMutexLocker locker(&_mutex);
+    auto it = _directories.find(path);
+    while (it != _directories.end() && it->second.state == Listing) {
+        _changed.wait(&_mutex);
+        it = _directories.find(path);
+    }
+    if (it != _directories.end() && it->second.state == Listed) {
+        *listing = std::move(it->second.listing);
+        _bufferedEntries -= listing->size();
+        _directories.erase(it);
+        _changed.wakeAll();
+        return true;
+    }
+
+    // Not reached yet: list it here rather than waiting, but let the
+    // threads continue below it.
+    if (it != _directories.end())
+        _directories.erase(it);
+    locker.unlock();
+    std::shared_ptr<DirectoryFd> fd;
+    if (!list(path, nullptr, listing, &fd)) {
+        listing->clear();
+        return false;
+    }
+    locker.relock();
+    queueSubdirectories(_nextWorker++ % _workers.size(), path, *listing, fd);
+    return true;
+}
+
+void csync_vio_local_prefetch_s::release(const QByteArray &path)
+{
+    QMutexLocker locker(&_mutex);
+    // All the paths below path sort between "path/" and "path0"
+    auto it = _directories.lower_bound(path + '/');
+    const auto end = _directories.lower_bound(path + char('/' + 1));
+    while (it != end) {
+        if (it->second.state == Listing) {
+            it->second.dropped = true;
+            ++it;
+            continue;
+        }
+        _bufferedEntries -= it->second.listing.size();
+        it = _directories.erase(it);
+    }
+    _changed.wakeAll();
+}
+
+csync_vio_local_prefetch_s *csync_vio_local_prefetch_start(const char *root, int threads, std::function<bool(const QByteArray &)> should_list)
+{
+    if (threads <= 0)
+        return nullptr;
+    return new csync_vio_local_prefetch_s(root, threads, std::move(should_list));
+}
+
+void csync_vio_local_prefetch_stop(csync_vio_local_prefetch_s *prefetch)
+{
+    delete prefetch;
+}
+
+csync_vio_handle_t *csync_vio_local_opendir(const char *name, csync_vio_local_prefetch_s *prefetch) {
+  auto handle = std::make_unique<dhandle_t>();
+  handle->path = name;
+
+  if (prefetch && prefetch->take(handle->path, &handle->prefetched)) {
+    handle->prefetch = prefetch;
+    return (csync_vio_handle_t *) handle.release();
+  }
+
+  mbchar_t *dirname = c_utf8_path_to_locale(name);
+  handle->dh = _topendir( dirname );
+  c_free_locale_string(dirname);
+  if (!handle->dh) {
+    return nullptr;
+  }
+  handle->prefetch = prefetch;
+
+  return (csync_vio_handle_t *) handle.release();
+}
+
+int csync_vio_local_closedir(csync_vio_handle_t *dhandle) {
+  dhandle_t *handle = nullptr;
+  int rc = 0;
+
+  if (!dhandle) {
+    errno = EBADF;
+    return -1;
+  }
+
+  handle = (dhandle_t *) dhandle;
+  if (handle->dh) {
+    rc = _tclosedir(handle->dh);
+  }
+  if (handle->prefetch) {
+    handle->prefetch->release(handle->path);
+  }
+
+  delete handle;
+
+  return rc;
+}
+
+std::unique_ptr<csync_file_stat_t> csync_vio_local_readdir(csync_vio_handle_t *dhandle) {
+
+  dhandle_t *handle = nullptr;
+
+  handle = (dhandle_t *) dhandle;
+  if (!handle->dh) {
+    errno = 0;
+    if (handle->prefetched.empty())
+      return {};
+    auto file_stat = std::move(handle->prefetched.front());
+    handle->prefetched.pop_front();
+    return file_stat;
+  }
+
+  return _csync_vio_local_read_entry(handle->dh, handle->path);
+}
+
 
 int csync_vio_local_stat(const char *uri, csync_file_stat_t *buf)
 {
@@ -159,7 +505,12 @@ static int _csync_vio_local_stat_mb(const mbchar_t *wuri, csync_file_stat_t *buf
     if (_tstat(wuri, &sb) < 0) {
         return -1;
     }
+    _csync_vio_local_fill_stat(sb, buf);
+    return 0;
+}
 
+static void _csync_vio_local_fill_stat(const struct stat &sb, csync_file_stat_t *buf)
+{
     switch (sb.st_mode & S_IFMT) {
     case S_IFDIR:
       buf->type = ItemTypeDirectory;
@@ -185,5 +536,4 @@ static int _csync_vio_local_stat_mb(const mbchar_t *wuri, csync_file_stat_t *buf
   buf->inode = sb.st_ino;
   buf->modtime = sb.st_mtime;
   buf->size = sb.st_size;
-  return 0;
 }
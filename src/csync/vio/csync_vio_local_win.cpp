@@ -52,7 +52,17 @@ struct dhandle_t {
 
 static int _csync_vio_local_stat_mb(const mbchar_t *uri, csync_file_stat_t *buf);
 
-csync_vio_handle_t *csync_vio_local_opendir(const char *name) {
+csync_vio_local_prefetch_s *csync_vio_local_prefetch_start(const char *, int, std::function<bool(const QByteArray &)>)
+{
+    // FindFirstFile already returns the metadata with the listing
+    return nullptr;
+}
+
+void csync_vio_local_prefetch_stop(csync_vio_local_prefetch_s *)
+{
+}
+
+csync_vio_handle_t *csync_vio_local_opendir(const char *name, csync_vio_local_prefetch_s *) {
   dhandle_t *handle = nullptr;
   mbchar_t *dirname = nullptr;
 
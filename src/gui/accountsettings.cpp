@@ -431,7 +431,7 @@ void AccountSettings::slotCustomContextMenuRequested(const QPoint &pos)
 
     if (!folderPaused) {
         ac = menu->addAction(tr("Force sync now"));
-        if (folderMan->currentSyncFolder() == folderMan->folder(alias)) {
+        if (folderMan->currentSyncFolders().contains(folderMan->folder(alias))) {
             ac->setText(tr("Restart sync"));
         }
         ac->setEnabled(folderConnected);
@@ -706,9 +706,9 @@ void AccountSettings::slotForceSyncCurrentFolder()
 {
     FolderMan *folderMan = FolderMan::instance();
     if (auto selectedFolder = folderMan->folder(selectedFolderAlias())) {
-        // Terminate and reschedule any running sync
-        if (Folder *current = folderMan->currentSyncFolder()) {
-            folderMan->terminateSyncProcess();
+        // Terminate and reschedule the running sync it would wait for
+        if (Folder *current = folderMan->syncBlocking(selectedFolder)) {
+            folderMan->terminateSyncProcess(current);
             folderMan->scheduleFolder(current);
         }
 
@@ -21,6 +21,7 @@
 #include "logger.h"
 #include "configfile.h"
 #include "ocsnavigationappsjob.h"
+#include "pushchannel.h"
 
 #include <QSettings>
 #include <QTimer>
@@ -111,6 +112,7 @@ void AccountState::setState(State state)
             checkConnectivity();
         }
         if (oldState == Connected || _state == Connected) {
+            updatePushChannel();
             emit isConnectedChanged();
         }
     }
@@ -119,6 +121,31 @@ void AccountState::setState(State state)
     emit stateChanged(_state);
 }
 
+void AccountState::updatePushChannel()
+{
+    const QUrl endpoint = _account->capabilities().pushEndpoint();
+    if (_state != Connected || endpoint.isEmpty()) {
+        if (_pushChannel) {
+            // Reports the channel as disconnected if it was
+            _pushChannel->stop();
+            delete _pushChannel;
+        }
+        return;
+    }
+    if (_pushChannel)
+        return;
+
+    _pushChannel = new PushChannel(_account, endpoint, this);
+    connect(_pushChannel.data(), &PushChannel::connectedChanged, this, &AccountState::pushChannelConnectedChanged);
+    connect(_pushChannel.data(), &PushChannel::filesChanged, this, &AccountState::remoteFilesChanged);
+    _pushChannel->start();
+}
+
+bool AccountState::isPushChannelConnected() const
+{
+    return _pushChannel && _pushChannel->isConnected();
+}
+
 QString AccountState::stateString(State state)
 {
     switch (state) {
@@ -31,6 +31,7 @@ class AccountState;
 class Account;
 class AccountApp;
 class RemoteWipe;
+class PushChannel;
 
 using AccountStatePtr = QExplicitlySharedDataPointer<AccountState>;
 using AccountAppList = QList<AccountApp *>;
@@ -125,6 +126,13 @@ public:
 
     bool isConnected() const;
 
+    /** Whether remote changes are pushed, so that polling for them is unnecessary.
+     *
+     * The push channel runs while the account is connected and the server
+     * advertises one, see Capabilities::pushEndpoint().
+     */
+    bool isPushChannelConnected() const;
+
     /** Returns a new settings object for this account, already in the right groups. */
     std::unique_ptr<QSettings> settings();
 
@@ -167,12 +175,19 @@ public slots:
 private:
     void setState(State state);
     void fetchNavigationApps();
+    void updatePushChannel();
 
 signals:
     void stateChanged(int state);
     void isConnectedChanged();
     void hasFetchedNavigationApps();
 
+    /** The push channel connected or dropped, see isPushChannelConnected() */
+    void pushChannelConnectedChanged();
+
+    /** The push channel reported changes at or below these remote paths */
+    void remoteFilesChanged(const QStringList &paths);
+
 protected Q_SLOTS:
     void slotConnectionValidatorResult(ConnectionValidator::Status status, const QStringList &errors);
 
@@ -195,6 +210,7 @@ private:
     bool _waitingForNewCredentials;
     QElapsedTimer _timeSinceLastETagCheck;
     QPointer<ConnectionValidator> _connectionValidator;
+    QPointer<PushChannel> _pushChannel;
     QByteArray _notificationsEtagResponseHeader;
     QByteArray _navigationAppsEtagResponseHeader;
 
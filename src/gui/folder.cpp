@@ -82,6 +82,9 @@ Folder::Folder(const FolderDefinition &definition,
         qCWarning(lcFolder, "Could not read system exclude file");
 
     connect(_accountState.data(), &AccountState::isConnectedChanged, this, &Folder::canSyncChanged);
+    connect(_accountState.data(), &AccountState::remoteFilesChanged, this, &Folder::slotRemoteFilesChanged);
+    // Catch up with changes that were neither pushed nor polled for while the push channel switched
+    connect(_accountState.data(), &AccountState::pushChannelConnectedChanged, this, &Folder::slotRunEtagJob);
     connect(_engine.data(), &SyncEngine::rootEtag, this, &Folder::etagRetrievedFromSyncEngine);
 
     connect(_engine.data(), &SyncEngine::started, this, &Folder::slotSyncStarted, Qt::QueuedConnection);
@@ -216,6 +219,11 @@ bool Folder::isBusy() const
     return _engine->isSyncRunning();
 }
 
+bool Folder::hasLocalChanges() const
+{
+    return !_localDiscoveryPaths.empty();
+}
+
 QString Folder::remotePath() const
 {
     return _definition.targetPath;
@@ -306,12 +314,43 @@ void Folder::etagRetrieved(const QString &etag)
     if (_lastEtag != etag) {
         qCInfo(lcFolder) << "Compare etag with previous etag: last:" << _lastEtag << ", received:" << etag << "-> CHANGED";
         _lastEtag = etag;
+        // We don't know what changed
+        _fullRemoteDiscovery = true;
         slotScheduleThisFolder();
     }
 
     _accountState->tagLastSuccessfullETagRequest();
 }
 
+void Folder::slotRemoteFilesChanged(const QStringList &paths)
+{
+    QString root = remotePath();
+    if (!root.endsWith(QLatin1Char('/')))
+        root.append(QLatin1Char('/'));
+
+    bool changed = false;
+    for (auto path : paths) {
+        if (!path.startsWith(QLatin1Char('/')))
+            path.prepend(QLatin1Char('/'));
+        if (!path.endsWith(QLatin1Char('/')))
+            path.append(QLatin1Char('/'));
+        // Something below the sync root changed
+        if (path.startsWith(root) && path != root) {
+            qCInfo(lcFolder) << "Pushed remote change of" << path << "affects" << remoteUrl().toString();
+            path.chop(1);
+            _remoteDiscoveryPaths.insert(path.mid(root.size()).toUtf8());
+            changed = true;
+        } else if (root.startsWith(path)) {
+            // The sync root itself or one of its parents
+            qCInfo(lcFolder) << "Pushed remote change of" << path << "affects" << remoteUrl().toString();
+            _fullRemoteDiscovery = true;
+            changed = true;
+        }
+    }
+    if (changed)
+        slotScheduleThisFolder();
+}
+
 void Folder::etagRetrievedFromSyncEngine(const QString &etag)
 {
     qCInfo(lcFolder) << "Root etag from during sync:" << etag;
@@ -514,6 +553,29 @@ void Folder::slotWatchedPathChanged(const QString &path)
     scheduleThisFolderSoon();
 }
 
+void Folder::slotWatchedSubtreeChanged(const QString &path)
+{
+    if (!path.startsWith(this->path())) {
+        qCDebug(lcFolder) << "Changed subtree is not contained in folder, ignoring:" << path;
+        return;
+    }
+
+    // With the trailing slash, everything below it is discovered
+    auto relativePathBytes = path.midRef(this->path().size()).toUtf8() + '/';
+    _localDiscoveryPaths.insert(relativePathBytes);
+    qCDebug(lcFolder) << "local discovery: inserted subtree" << relativePathBytes << "due to file watcher";
+
+#ifndef Q_OS_MAC
+    if (_engine->wasFileTouched(path)) {
+        qCDebug(lcFolder) << "Changed subtree was touched by SyncEngine, ignoring:" << path;
+        return;
+    }
+#endif
+
+    emit watchedFileChangedExternally(path);
+    scheduleThisFolderSoon();
+}
+
 void Folder::saveToSettings() const
 {
     // Remove first to make sure we don't get duplicates
@@ -678,6 +740,15 @@ void Folder::startSync(const QStringList &pathList)
     }
     _localDiscoveryPaths.clear();
 
+    if (!_fullRemoteDiscovery && !_remoteDiscoveryPaths.empty()) {
+        qCInfo(lcFolder) << "Limiting remote discovery to" << _remoteDiscoveryPaths.size() << "pushed changes";
+        _engine->setRemoteDiscoveryPaths(_remoteDiscoveryPaths);
+    } else {
+        _engine->setRemoteDiscoveryPaths({});
+    }
+    _fullRemoteDiscovery = false;
+    _remoteDiscoveryPaths.clear();
+
     _engine->setIgnoreHiddenFiles(_definition.ignoreHiddenFiles);
 
     QMetaObject::invokeMethod(_engine.data(), "startSync", Qt::QueuedConnection);
@@ -728,6 +799,25 @@ void Folder::setSyncOptions()
         opt._targetChunkUploadDuration = cfgFile.targetChunkUploadDuration();
     }
 
+    QByteArray maxParallelDiscoveryEnv = qgetenv("OWNCLOUD_MAX_PARALLEL_DISCOVERY");
+    if (!maxParallelDiscoveryEnv.isEmpty()) {
+        opt._maxParallelDiscoveryJobs = maxParallelDiscoveryEnv.toInt();
+    }
+    if (qgetenv("OWNCLOUD_SERIAL_UPDATE_DETECTION") == "1") {
+        opt._parallelUpdateDetection = false;
+    }
+    QByteArray localDiscoveryThreadsEnv = qgetenv("OWNCLOUD_LOCAL_DISCOVERY_THREADS");
+    if (!localDiscoveryThreadsEnv.isEmpty()) {
+        opt._localDiscoveryThreads = localDiscoveryThreadsEnv.toInt();
+    }
+    QByteArray journalCommitBatchSizeEnv = qgetenv("OWNCLOUD_JOURNAL_COMMIT_BATCH_SIZE");
+    if (!journalCommitBatchSizeEnv.isEmpty()) {
+        opt._journalCommitBatchSize = journalCommitBatchSizeEnv.toInt();
+    }
+    if (qgetenv("OWNCLOUD_PREALLOCATE_DOWNLOADS") == "0") {
+        opt._preallocateDownloads = false;
+    }
+
     _engine->setSyncOptions(opt);
 }
 
@@ -832,6 +922,7 @@ void Folder::slotSyncFinished(bool success)
         _localDiscoveryPaths.insert(
             _previousLocalDiscoveryPaths.begin(), _previousLocalDiscoveryPaths.end());
         qCDebug(lcFolder) << "Sync failed, keeping last sync's local discovery path list";
+        _fullRemoteDiscovery = true;
     }
     _previousLocalDiscoveryPaths.clear();
 
@@ -1072,8 +1163,12 @@ void Folder::registerFolderWatcher()
     _folderWatcher.reset(new FolderWatcher(this));
     connect(_folderWatcher.data(), &FolderWatcher::pathChanged,
         this, &Folder::slotWatchedPathChanged);
-    connect(_folderWatcher.data(), &FolderWatcher::lostChanges,
-        this, &Folder::slotNextSyncFullLocalDiscovery);
+    connect(_folderWatcher.data(), &FolderWatcher::subtreeChanged,
+        this, &Folder::slotWatchedSubtreeChanged);
+    connect(_folderWatcher.data(), &FolderWatcher::lostChanges, this, [this] {
+        slotNextSyncFullLocalDiscovery();
+        scheduleThisFolderSoon();
+    });
     connect(_folderWatcher.data(), &FolderWatcher::becameUnreliable,
         this, &Folder::slotWatcherUnreliable);
     _folderWatcher->init(path());
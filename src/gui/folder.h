@@ -160,6 +160,12 @@ public:
      */
     virtual bool isBusy() const;
 
+    /**
+     * True if the file watcher reported local changes that no sync
+     * has picked up yet
+     */
+    bool hasLocalChanges() const;
+
     /**
      * return the last sync result with error message and status
      */
@@ -276,6 +282,12 @@ public slots:
        */
     void slotWatchedPathChanged(const QString &path);
 
+    /**
+     * Like slotWatchedPathChanged(), for a directory whose whole contents
+     * need to be discovered again.
+     */
+    void slotWatchedSubtreeChanged(const QString &path);
+
 private slots:
     void slotSyncStarted();
     void slotSyncFinished(bool);
@@ -291,6 +303,9 @@ private slots:
 
     void slotRunEtagJob();
     void etagRetrieved(const QString &);
+
+    /** Schedules this folder if the pushed remote changes affect it */
+    void slotRemoteFilesChanged(const QStringList &paths);
     void etagRetrievedFromSyncEngine(const QString &);
 
     void slotEmitFinishedDelayed();
@@ -385,6 +400,7 @@ private:
      * Watches this folder's local directory for changes.
      *
      * Created by registerFolderWatcher(), triggers slotWatchedPathChanged()
+     * and slotWatchedSubtreeChanged()
      */
     QScopedPointer<FolderWatcher> _folderWatcher;
 
@@ -403,6 +419,21 @@ private:
      * again when the sync is done to make sure everything is retried.
      */
     std::set<QByteArray> _previousLocalDiscoveryPaths;
+
+    /**
+     * The remote paths the server pushed as changed since the last sync started.
+     *
+     * Unless _fullRemoteDiscovery is set, the next sync lists only the remote
+     * directories containing them.
+     */
+    std::set<QByteArray> _remoteDiscoveryPaths;
+
+    /**
+     * Whether the remote changes since the last sync started are not all in
+     * _remoteDiscoveryPaths, like when the etag poll noticed them or the sync
+     * failed. Then the next sync discovers the whole remote tree.
+     */
+    bool _fullRemoteDiscovery = true;
 };
 }
 
@@ -56,6 +56,8 @@ FolderMan::FolderMan(QObject *parent)
     _socketApi.reset(new SocketApi);
 
     ConfigFile cfg;
+    _maxConcurrentSyncs = cfg.maxConcurrentSyncs();
+    _maxConcurrentSyncsPerAccount = cfg.maxConcurrentSyncsPerAccount();
     std::chrono::milliseconds polltime = cfg.remotePollInterval();
     qCInfo(lcFolderMan) << "setting remote poll timer interval to" << polltime.count() << "msec";
     _etagPollTimer.setInterval(polltime.count());
@@ -135,7 +137,7 @@ int FolderMan::unloadAndDeleteAllFolders()
     ASSERT(_folderMap.isEmpty());
 
     _lastSyncFolder = nullptr;
-    _currentSyncFolder = nullptr;
+    _currentSyncFolders.clear();
     _scheduledFolders.clear();
     emit folderListChanged(_folderMap);
     emit scheduleQueueChanged();
@@ -486,12 +488,11 @@ void FolderMan::slotFolderCanSyncChanged()
 // this really terminates the current sync process
 // ie. no questions, no prisoners
 // csync still remains in a stable state, regardless of that.
-void FolderMan::terminateSyncProcess()
+void FolderMan::terminateSyncProcess(Folder *f)
 {
-    Folder *f = _currentSyncFolder;
-    if (f) {
+    if (f && _currentSyncFolders.contains(f)) {
         // This will, indirectly and eventually, call slotFolderSyncFinished
-        // and thereby clear _currentSyncFolder.
+        // and thereby remove it from _currentSyncFolders.
         f->slotTerminateSync();
     }
 }
@@ -580,39 +581,54 @@ void FolderMan::scheduleFolderNext(Folder *f)
 void FolderMan::slotScheduleETagJob(const QString & /*alias*/, RequestEtagJob *job)
 {
     QObject::connect(job, &QObject::destroyed, this, &FolderMan::slotEtagJobDestroyed);
-    QMetaObject::invokeMethod(this, "slotRunOneEtagJob", Qt::QueuedConnection);
-    // maybe: add to queue
+    QMetaObject::invokeMethod(this, "slotRunEtagJobs", Qt::QueuedConnection);
 }
 
 void FolderMan::slotEtagJobDestroyed(QObject * /*o*/)
 {
-    // _currentEtagJob is automatically cleared
-    // maybe: remove from queue
-    QMetaObject::invokeMethod(this, "slotRunOneEtagJob", Qt::QueuedConnection);
+    // The QPointer in _runningEtagJobs is automatically cleared
+    QMetaObject::invokeMethod(this, "slotRunEtagJobs", Qt::QueuedConnection);
 }
 
-void FolderMan::slotRunOneEtagJob()
+int FolderMan::maxEtagJobsPerAccount(const AccountPtr &account)
 {
-    if (_currentEtagJob.isNull()) {
-        Folder *folder = nullptr;
-        for (Folder *f : qAsConst(_folderMap)) {
-            if (f->etagJob()) {
-                // Caveat: always grabs the first folder with a job, but we think this is Ok for now and avoids us having a seperate queue.
-                _currentEtagJob = f->etagJob();
-                folder = f;
-                break;
-            }
+    // Over HTTP2 the queries share one connection, otherwise leave
+    // connections for the running syncs
+    return account->isHttp2Supported() ? 10 : 2;
+}
+
+void FolderMan::slotRunEtagJobs()
+{
+    _runningEtagJobs.removeAll(QPointer<RequestEtagJob>());
+
+    bool anyPending = false;
+    for (Folder *f : qAsConst(_folderMap)) {
+        RequestEtagJob *job = f->etagJob();
+        if (!job) {
+            continue;
+        }
+        anyPending = true;
+        if (_runningEtagJobs.contains(job)) {
+            continue;
         }
-        if (_currentEtagJob.isNull()) {
-            //qCDebug(lcFolderMan) << "No more remote ETag check jobs to schedule.";
 
-            /* now it might be a good time to check for restarting... */
-            if (!_currentSyncFolder && _appRestartRequired) {
-                restartApplication();
-            }
-        } else {
-            qCDebug(lcFolderMan) << "Scheduling" << folder->remoteUrl().toString() << "to check remote ETag";
-            _currentEtagJob->start(); // on destroy/end it will continue the queue via slotEtagJobDestroyed
+        // Start the queries of all folders at once, within the account's limit
+        AccountPtr account = f->accountState()->account();
+        int runningForAccount = std::count_if(_runningEtagJobs.cbegin(), _runningEtagJobs.cend(),
+            [&](const QPointer<RequestEtagJob> &running) { return running->account() == account; });
+        if (runningForAccount >= maxEtagJobsPerAccount(account)) {
+            continue;
+        }
+
+        qCDebug(lcFolderMan) << "Scheduling" << f->remoteUrl().toString() << "to check remote ETag";
+        _runningEtagJobs.append(job);
+        job->start(); // on destroy/end it will continue the queue via slotEtagJobDestroyed
+    }
+
+    if (!anyPending) {
+        /* now it might be a good time to check for restarting... */
+        if (_currentSyncFolders.isEmpty() && _appRestartRequired) {
+            restartApplication();
         }
     }
 }
@@ -639,9 +655,10 @@ void FolderMan::slotAccountStateChanged()
         qCInfo(lcFolderMan) << "Account" << accountName << "disconnected or paused, "
                                                            "terminating or descheduling sync folders";
 
-        if (_currentSyncFolder
-            && _currentSyncFolder->accountState() == accountState) {
-            _currentSyncFolder->slotTerminateSync();
+        for (Folder *f : qAsConst(_currentSyncFolders)) {
+            if (f->accountState() == accountState) {
+                f->slotTerminateSync();
+            }
         }
 
         QMutableListIterator<Folder *> it(_scheduledFolders);
@@ -676,7 +693,8 @@ void FolderMan::startScheduledSyncSoon()
     if (_scheduledFolders.empty()) {
         return;
     }
-    if (_currentSyncFolder) {
+    if (!nextFolderToSync()) {
+        // Starts once a running sync finishes
         return;
     }
 
@@ -707,6 +725,47 @@ void FolderMan::startScheduledSyncSoon()
     _startScheduledSyncTimer.start(msDelay);
 }
 
+Folder *FolderMan::syncBlocking(Folder *f) const
+{
+    if (_currentSyncFolders.contains(f)) {
+        return f;
+    }
+
+    Folder *sameAccount = nullptr;
+    int sameAccountCount = 0;
+    for (Folder *running : _currentSyncFolders) {
+        if (running->accountState() == f->accountState()) {
+            if (!sameAccount)
+                sameAccount = running;
+            ++sameAccountCount;
+        }
+    }
+    if (sameAccountCount >= _maxConcurrentSyncsPerAccount) {
+        return sameAccount;
+    }
+    if (_currentSyncFolders.count() >= _maxConcurrentSyncs) {
+        return _currentSyncFolders.first();
+    }
+    return nullptr;
+}
+
+Folder *FolderMan::nextFolderToSync() const
+{
+    Folder *next = nullptr;
+    for (Folder *f : _scheduledFolders) {
+        if (syncBlocking(f)) {
+            continue;
+        }
+        if (f->hasLocalChanges()) {
+            return f;
+        }
+        if (!next) {
+            next = f;
+        }
+    }
+    return next;
+}
+
 /*
   * slot to start folder syncs.
   * It is either called from the slot where folders enqueue themselves for
@@ -714,11 +773,6 @@ void FolderMan::startScheduledSyncSoon()
   */
 void FolderMan::slotStartScheduledFolderSync()
 {
-    if (_currentSyncFolder) {
-        qCInfo(lcFolderMan) << "Currently folder " << _currentSyncFolder->remoteUrl().toString() << " is running, wait for finish!";
-        return;
-    }
-
     if (!_syncEnabled) {
         qCInfo(lcFolderMan) << "FolderMan: Syncing is disabled, no scheduling.";
         return;
@@ -729,28 +783,32 @@ void FolderMan::slotStartScheduledFolderSync()
         return;
     }
 
-    // Find the first folder in the queue that can be synced.
-    Folder *folder = nullptr;
-    while (!_scheduledFolders.isEmpty()) {
-        Folder *g = _scheduledFolders.dequeue();
-        if (g->canSync()) {
-            folder = g;
-            break;
+    // Drop the folders that can't be synced.
+    QMutableListIterator<Folder *> it(_scheduledFolders);
+    while (it.hasNext()) {
+        if (!it.next()->canSync()) {
+            it.remove();
         }
     }
 
-    emit scheduleQueueChanged();
+    // Start as many folders as the limits on concurrent syncs allow.
+    while (Folder *folder = nextFolderToSync()) {
+        _scheduledFolders.removeOne(folder);
 
-    // Start syncing this folder!
-    if (folder) {
         // Safe to call several times, and necessary to try again if
         // the folder path didn't exist previously.
         folder->registerFolderWatcher();
         registerFolderWithSocketApi(folder);
 
-        _currentSyncFolder = folder;
+        _currentSyncFolders.append(folder);
         folder->startSync(QStringList());
     }
+
+    if (!_scheduledFolders.isEmpty()) {
+        qCInfo(lcFolderMan) << _scheduledFolders.count() << "scheduled folders wait for" << _currentSyncFolders.count() << "running syncs to finish";
+    }
+
+    emit scheduleQueueChanged();
 }
 
 void FolderMan::slotEtagPollTimerTimeout()
@@ -762,7 +820,7 @@ void FolderMan::slotEtagPollTimerTimeout()
         if (!f) {
             continue;
         }
-        if (_currentSyncFolder == f) {
+        if (_currentSyncFolders.contains(f)) {
             continue;
         }
         if (_scheduledFolders.contains(f)) {
@@ -774,6 +832,10 @@ void FolderMan::slotEtagPollTimerTimeout()
         if (f->etagJob() || f->isBusy() || !f->canSync()) {
             continue;
         }
+        if (f->accountState()->isPushChannelConnected()) {
+            // Changes are pushed, no need to ask
+            continue;
+        }
         if (f->msecSinceLastSync() < polltime) {
             continue;
         }
@@ -874,10 +936,12 @@ void FolderMan::slotScheduleFolderByTime()
 
 void FolderMan::slotFolderSyncStarted()
 {
+    auto f = qobject_cast<Folder *>(sender());
+    ASSERT(f);
     qCInfo(lcFolderMan, ">========== Sync started for folder [%s] of account [%s] with remote [%s]",
-        qPrintable(_currentSyncFolder->shortGuiLocalPath()),
-        qPrintable(_currentSyncFolder->accountState()->account()->displayName()),
-        qPrintable(_currentSyncFolder->remoteUrl().toString()));
+        qPrintable(f->shortGuiLocalPath()),
+        qPrintable(f->accountState()->account()->displayName()),
+        qPrintable(f->remoteUrl().toString()));
 }
 
 /*
@@ -888,13 +952,15 @@ void FolderMan::slotFolderSyncStarted()
   */
 void FolderMan::slotFolderSyncFinished(const SyncResult &)
 {
+    auto f = qobject_cast<Folder *>(sender());
+    ASSERT(f);
     qCInfo(lcFolderMan, "<========== Sync finished for folder [%s] of account [%s] with remote [%s]",
-        qPrintable(_currentSyncFolder->shortGuiLocalPath()),
-        qPrintable(_currentSyncFolder->accountState()->account()->displayName()),
-        qPrintable(_currentSyncFolder->remoteUrl().toString()));
+        qPrintable(f->shortGuiLocalPath()),
+        qPrintable(f->accountState()->account()->displayName()),
+        qPrintable(f->remoteUrl().toString()));
 
-    _lastSyncFolder = _currentSyncFolder;
-    _currentSyncFolder = nullptr;
+    _lastSyncFolder = f;
+    _currentSyncFolders.removeAll(f);
 
     startScheduledSyncSoon();
 }
@@ -1013,10 +1079,10 @@ void FolderMan::removeFolder(Folder *f)
 
     qCInfo(lcFolderMan) << "Removing " << f->alias();
 
-    const bool currentlyRunning = (_currentSyncFolder == f);
+    const bool currentlyRunning = _currentSyncFolders.contains(f);
     if (currentlyRunning) {
         // abort the sync now
-        terminateSyncProcess();
+        terminateSyncProcess(f);
     }
 
     if (_scheduledFolders.removeAll(f) > 0) {
@@ -1138,10 +1204,10 @@ void FolderMan::slotWipeFolderForAccount(AccountState *accountState)
 
         qCInfo(lcFolderMan) << "Removing " << f->alias();
 
-        const bool currentlyRunning = (_currentSyncFolder == f);
+        const bool currentlyRunning = _currentSyncFolders.contains(f);
         if (currentlyRunning) {
             // abort the sync now
-            terminateSyncProcess();
+            terminateSyncProcess(f);
         }
 
         if (_scheduledFolders.removeAll(f) > 0) {
@@ -1485,9 +1551,14 @@ QQueue<Folder *> FolderMan::scheduleQueue() const
     return _scheduledFolders;
 }
 
-Folder *FolderMan::currentSyncFolder() const
+QList<Folder *> FolderMan::currentSyncFolders() const
+{
+    return _currentSyncFolders;
+}
+
+bool FolderMan::isAnySyncRunning() const
 {
-    return _currentSyncFolder;
+    return !_currentSyncFolders.isEmpty();
 }
 
 void FolderMan::restartApplication()
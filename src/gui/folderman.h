@@ -157,16 +157,28 @@ public:
     QQueue<Folder *> scheduleQueue() const;
 
     /**
-     * Access to the currently syncing folder.
+     * Access to the currently syncing folders.
      */
-    Folder *currentSyncFolder() const;
+    QList<Folder *> currentSyncFolders() const;
+
+    /** True if any folder is syncing. */
+    bool isAnySyncRunning() const;
+
+    /**
+     * The running sync that keeps a folder from starting to sync now.
+     *
+     * That is the folder itself if it is syncing already, or a sync that
+     * takes the slot it would need when the limit of concurrent syncs of
+     * its account or of all accounts is reached. nullptr if it can start.
+     */
+    Folder *syncBlocking(Folder *f) const;
 
     /** Removes all folders */
     int unloadAndDeleteAllFolders();
 
     /**
      * If enabled is set to false, no new folders will start to sync.
-     * The current one will finish.
+     * The running ones will finish.
      */
     void setSyncEnabled(bool);
 
@@ -183,11 +195,11 @@ public:
     void setDirtyNetworkLimits();
 
     /**
-     * Terminates the current folder sync.
+     * Terminates the sync of the given folder, if it is running.
      *
      * It does not switch the folder to paused state.
      */
-    void terminateSyncProcess();
+    void terminateSyncProcess(Folder *f);
 
 signals:
     /**
@@ -245,7 +257,7 @@ private slots:
     void slotFolderSyncStarted();
     void slotFolderSyncFinished(const SyncResult &);
 
-    void slotRunOneEtagJob();
+    void slotRunEtagJobs();
     void slotEtagJobDestroyed(QObject *);
 
     // slot to take the next folder from queue and start syncing.
@@ -289,6 +301,17 @@ private:
     /** Will start a sync after a bit of delay. */
     void startScheduledSyncSoon();
 
+    /** How many etag queries may run at the same time for an account */
+    static int maxEtagJobsPerAccount(const AccountPtr &account);
+
+    /**
+     * The scheduled folder that should start to sync next, if any can.
+     *
+     * Folders with local changes reported by the file watcher go before
+     * the ones that were scheduled because of a remote poll or a timer.
+     */
+    Folder *nextFolderToSync() const;
+
     // finds all folder configuration files
     // and create the folders
     QString getBackupName(QString fullPathName) const;
@@ -304,14 +327,17 @@ private:
     QSet<Folder *> _disabledFolders;
     Folder::Map _folderMap;
     QString _folderConfigPath;
-    Folder *_currentSyncFolder = nullptr;
+    QList<Folder *> _currentSyncFolders;
     QPointer<Folder> _lastSyncFolder;
     bool _syncEnabled = true;
+    /// Limits on the syncs running at the same time, read from the config at startup
+    int _maxConcurrentSyncs = 1;
+    int _maxConcurrentSyncsPerAccount = 1;
 
     /// Starts regular etag query jobs
     QTimer _etagPollTimer;
-    /// The currently running etag query
-    QPointer<RequestEtagJob> _currentEtagJob;
+    /// The currently running etag queries
+    QList<QPointer<RequestEtagJob>> _runningEtagJobs;
 
     /// Watches files that couldn't be synced due to locks
     QScopedPointer<LockWatcher> _lockWatcher;
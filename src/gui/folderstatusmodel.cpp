@@ -1076,8 +1076,8 @@ void FolderStatusModel::slotFolderSyncStateChange(Folder *f)
     } else if (state == SyncResult::NotYetStarted) {
         FolderMan *folderMan = FolderMan::instance();
         int pos = folderMan->scheduleQueue().indexOf(f);
-        if (folderMan->currentSyncFolder()
-            && folderMan->currentSyncFolder() != f) {
+        Folder *blocking = folderMan->syncBlocking(f);
+        if (blocking && blocking != f) {
             pos += 1;
         }
         QString message;
@@ -38,10 +38,16 @@ namespace OCC {
 
 Q_LOGGING_CATEGORY(lcFolderWatcher, "nextcloud.gui.folderwatcher", QtInfoMsg)
 
+// How long notifications are collected before they are reported
+static const int flushIntervalMs = 100;
+
 FolderWatcher::FolderWatcher(Folder *folder)
     : QObject(folder)
     , _folder(folder)
 {
+    _flushTimer.setSingleShot(true);
+    _flushTimer.setInterval(flushIntervalMs);
+    connect(&_flushTimer, &QTimer::timeout, this, &FolderWatcher::flushChanges);
 }
 
 FolderWatcher::~FolderWatcher() = default;
@@ -49,7 +55,6 @@ FolderWatcher::~FolderWatcher() = default;
 void FolderWatcher::init(const QString &root)
 {
     _d.reset(new FolderWatcherPrivate(this, root));
-    _timer.start();
 }
 
 bool FolderWatcher::pathIsIgnored(const QString &path)
@@ -73,63 +78,81 @@ bool FolderWatcher::isReliable() const
     return _isReliable;
 }
 
-void FolderWatcher::appendSubPaths(QDir dir, QStringList& subPaths) {
-    QStringList newSubPaths = dir.entryList(QDir::NoDotAndDotDot | QDir::Dirs | QDir::Files);
-    for (int i = 0; i < newSubPaths.size(); i++) {
-        QString path = dir.path() + "/" + newSubPaths[i];
-        QFileInfo fileInfo(path);
-        subPaths.append(path);
-        if (fileInfo.isDir()) {
-            QDir dir(path);
-            appendSubPaths(dir, subPaths);
-        }
+void FolderWatcher::changeDetected(const QString &path)
+{
+    // Without more details from the backend, any directory could have new contents
+    addChange(path, QFileInfo(path).isDir());
+}
+
+void FolderWatcher::changeDetected(const QStringList &paths)
+{
+    for (const auto &path : paths) {
+        changeDetected(path);
     }
 }
 
-void FolderWatcher::changeDetected(const QString &path)
+void FolderWatcher::addChange(const QString &path, bool subtree)
 {
-    QFileInfo fileInfo(path);
-    QStringList paths(path);
-    if (fileInfo.isDir()) {
-        QDir dir(path);
-        appendSubPaths(dir, paths);
+    if (subtree) {
+        _pendingSubtrees.insert(path);
+    } else {
+        _pendingPaths.insert(path);
     }
-    changeDetected(paths);
+    // Not restarted by later changes, so that a flood is still reported regularly
+    if (!_flushTimer.isActive())
+        _flushTimer.start();
 }
 
-void FolderWatcher::changeDetected(const QStringList &paths)
+void FolderWatcher::addLostChanges()
 {
-    // TODO: this shortcut doesn't look very reliable:
-    //   - why is the timeout only 1 second?
-    //   - what if there is more than one file being updated frequently?
-    //   - why do we skip the file altogether instead of e.g. reducing the upload frequency?
-
-    // Check if the same path was reported within the last second.
-    QSet<QString> pathsSet = paths.toSet();
-    if (pathsSet == _lastPaths && _timer.elapsed() < 1000) {
-        // the same path was reported within the last second. Skip.
+    _pendingLostChanges = true;
+    if (!_flushTimer.isActive())
+        _flushTimer.start();
+}
+
+void FolderWatcher::flushChanges()
+{
+    if (_pendingLostChanges) {
+        // All of it will be discovered again anyway
+        qCInfo(lcFolderWatcher) << "Lost changes, dropping" << _pendingPaths.size() + _pendingSubtrees.size()
+                                << "collected paths";
+        _pendingPaths.clear();
+        _pendingSubtrees.clear();
+        _pendingLostChanges = false;
+        emit lostChanges();
         return;
     }
-    _lastPaths = pathsSet;
-    _timer.restart();
-
-    QSet<QString> changedPaths;
 
-    // ------- handle ignores:
-    for (int i = 0; i < paths.size(); ++i) {
-        QString path = paths[i];
-        if (pathIsIgnored(path)) {
-            continue;
+    auto isBelowSubtree = [this](const QString &path) {
+        for (int i = path.lastIndexOf(QLatin1Char('/')); i > 0; i = path.lastIndexOf(QLatin1Char('/'), i - 1)) {
+            if (_pendingSubtrees.contains(path.left(i)))
+                return true;
         }
+        return false;
+    };
 
-        changedPaths.insert(path);
+    QStringList changedSubtrees;
+    for (const auto &path : qAsConst(_pendingSubtrees)) {
+        if (!isBelowSubtree(path) && !pathIsIgnored(path))
+            changedSubtrees.append(path);
+    }
+    QStringList changedPaths;
+    for (const auto &path : qAsConst(_pendingPaths)) {
+        if (!_pendingSubtrees.contains(path) && !isBelowSubtree(path) && !pathIsIgnored(path))
+            changedPaths.append(path);
     }
-    if (changedPaths.isEmpty()) {
+    _pendingPaths.clear();
+    _pendingSubtrees.clear();
+
+    if (changedPaths.isEmpty() && changedSubtrees.isEmpty()) {
         return;
     }
 
-    qCInfo(lcFolderWatcher) << "Detected changes in paths:" << changedPaths;
-    foreach (const QString &path, changedPaths) {
+    qCInfo(lcFolderWatcher) << "Detected changes in paths:" << changedPaths << "and subtrees:" << changedSubtrees;
+    for (const auto &path : qAsConst(changedSubtrees)) {
+        emit subtreeChanged(path);
+    }
+    for (const auto &path : qAsConst(changedPaths)) {
         emit pathChanged(path);
     }
 }
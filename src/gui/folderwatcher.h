@@ -27,8 +27,7 @@
 #include <QScopedPointer>
 #include <QSet>
 #include <QDir>
-
-class QTimer;
+#include <QTimer>
 
 namespace OCC {
 
@@ -42,7 +41,8 @@ class Folder;
  *
  * Folder Watcher monitors a directory and its sub directories
  * for changes in the local file system. Changes are signalled
- * through the pathChanged() signal.
+ * through the pathChanged() and subtreeChanged() signals, once
+ * per path for all the notifications of a short window.
  *
  * Note that if new folders are created, this folderwatcher class
  * does not automatically add them to the list of monitored
@@ -90,6 +90,13 @@ signals:
      *  of the contained files is changed. */
     void pathChanged(const QString &path);
 
+    /**
+     * Emitted instead of pathChanged() for a directory whose whole
+     * contents may have changed, like one that was created or moved in.
+     * Nothing is reported separately for the paths below it.
+     */
+    void subtreeChanged(const QString &path);
+
     /**
      * Emitted if some notifications were lost.
      *
@@ -106,6 +113,13 @@ signals:
      */
     void becameUnreliable(const QString &message);
 
+    /**
+     * Emitted when the directories below a path given to init() or
+     * addPath() are all watched. Only for backends that register them in
+     * the background, which is the inotify one.
+     */
+    void registrationFinished(const QString &path);
+
 protected slots:
     // called from the implementations to indicate a change in path
     void changeDetected(const QString &path);
@@ -116,12 +130,19 @@ protected:
 
 private:
     QScopedPointer<FolderWatcherPrivate> _d;
-    QTime _timer;
-    QSet<QString> _lastPaths;
     Folder *_folder;
     bool _isReliable = true;
 
-    void appendSubPaths(QDir dir, QStringList& subPaths);
+    // Collect a change for the next flushChanges()
+    void addChange(const QString &path, bool subtree);
+    void addLostChanges();
+    // Reports the collected changes, each path once, nothing below a changed subtree
+    void flushChanges();
+
+    QSet<QString> _pendingPaths;
+    QSet<QString> _pendingSubtrees;
+    bool _pendingLostChanges = false;
+    QTimer _flushTimer;
 
     friend class FolderWatcherPrivate;
 };
@@ -15,14 +15,20 @@
 #include "config.h"
 
 #include <sys/inotify.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "folder.h"
 #include "folderwatcher_linux.h"
 
 #include <cerrno>
+#include <QElapsedTimer>
+#include <QMutexLocker>
 #include <QStringList>
 #include <QObject>
-#include <QVarLengthArray>
+#include <QtConcurrentRun>
 
 namespace OCC {
 
@@ -31,154 +37,242 @@ FolderWatcherPrivate::FolderWatcherPrivate(FolderWatcher *p, const QString &path
     , _parent(p)
     , _folder(path)
 {
-    _fd = inotify_init();
+    _fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
     if (_fd != -1) {
         _socket.reset(new QSocketNotifier(_fd, QSocketNotifier::Read));
         connect(_socket.data(), &QSocketNotifier::activated, this, &FolderWatcherPrivate::slotReceivedNotification);
     } else {
         qCWarning(lcFolderWatcher) << "notify_init() failed: " << strerror(errno);
     }
+    _registrationThread.setMaxThreadCount(1);
 
     QMetaObject::invokeMethod(this, "slotAddFolderRecursive", Q_ARG(QString, path));
 }
 
-FolderWatcherPrivate::~FolderWatcherPrivate() = default;
+FolderWatcherPrivate::~FolderWatcherPrivate()
+{
+    _abortRegistration = true;
+    _registrationThread.waitForDone();
+}
 
-// attention: result list passed by reference!
-bool FolderWatcherPrivate::findFoldersBelow(const QDir &dir, QStringList &fullList)
+// Walks the directory open as fd, which it takes ownership of. path is its
+// path and is used as buffer for the paths of the subdirectories.
+static bool walkFoldersAt(int fd, QByteArray &path, const std::function<bool(const QByteArray &)> &visit,
+    const std::atomic<bool> &abort)
 {
+    DIR *dir = fdopendir(fd);
+    if (!dir) {
+        close(fd);
+        return false;
+    }
+
     bool ok = true;
-    if (!(dir.exists() && dir.isReadable())) {
-        qCDebug(lcFolderWatcher) << "Non existing path coming in: " << dir.absolutePath();
-        ok = false;
-    } else {
-        QStringList nameFilter;
-        nameFilter << QLatin1String("*");
-        QDir::Filters filter = QDir::Dirs | QDir::NoDotAndDotDot | QDir::NoSymLinks | QDir::Hidden;
-        const QStringList pathes = dir.entryList(nameFilter, filter);
-
-        QStringList::const_iterator constIterator;
-        for (constIterator = pathes.constBegin(); constIterator != pathes.constEnd();
-             ++constIterator) {
-            const QString fullPath(dir.path() + QLatin1String("/") + (*constIterator));
-            fullList.append(fullPath);
-            ok = findFoldersBelow(QDir(fullPath), fullList);
+    const int pathSize = path.size();
+    while (!abort) {
+        errno = 0;
+        struct dirent *entry = readdir(dir);
+        if (!entry) {
+            ok = ok && errno == 0;
+            break;
+        }
+        const char *name = entry->d_name;
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+            continue;
+        if (entry->d_type != DT_DIR) {
+            // Not all file systems fill in the type
+            struct stat st;
+            if (entry->d_type != DT_UNKNOWN
+                || fstatat(dirfd(dir), name, &st, AT_SYMLINK_NOFOLLOW) != 0
+                || !S_ISDIR(st.st_mode)) {
+                continue;
+            }
         }
-    }
 
+        path.append('/').append(name);
+        if (visit(path)) {
+            // Relative to the open parent: no path lookup from the root for each level
+            int childFd = openat(dirfd(dir), name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+            if (childFd == -1 || !walkFoldersAt(childFd, path, visit, abort))
+                ok = false;
+        }
+        path.truncate(pathSize);
+    }
+    closedir(dir);
     return ok;
 }
 
-void FolderWatcherPrivate::inotifyRegisterPath(const QString &path)
+bool FolderWatcherPrivate::walkFoldersBelow(const QByteArray &path, const std::function<bool(const QByteArray &)> &visit,
+    const std::atomic<bool> &abort)
 {
-    if (!path.isEmpty()) {
-        int wd = inotify_add_watch(_fd, path.toUtf8().constData(),
-            IN_CLOSE_WRITE | IN_ATTRIB | IN_MOVE | IN_CREATE | IN_DELETE | IN_DELETE_SELF | IN_MOVE_SELF | IN_UNMOUNT | IN_ONLYDIR);
-        if (wd > -1) {
-            _watches.insert(wd, path);
+    int fd = open(path.constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1) {
+        qCDebug(lcFolderWatcher) << "Non existing path coming in: " << path;
+        return false;
+    }
+    QByteArray buffer = path;
+    return walkFoldersAt(fd, buffer, visit, abort);
+}
+
+// attention: result list passed by reference!
+bool FolderWatcherPrivate::findFoldersBelow(const QDir &dir, QStringList &fullList)
+{
+    const std::atomic<bool> abort{ false };
+    return walkFoldersBelow(dir.path().toUtf8(), [&fullList](const QByteArray &path) {
+        fullList.append(QString::fromUtf8(path));
+        return true;
+    }, abort);
+}
+
+bool FolderWatcherPrivate::inotifyRegisterPath(const QString &path)
+{
+    if (path.isEmpty())
+        return false;
+
+    // Hold the lock until the watch is in the maps, so that its events find it
+    QMutexLocker locker(&_watchesMutex);
+    if (_pathToWatch.contains(path))
+        return true;
+
+    int wd = inotify_add_watch(_fd, path.toUtf8().constData(),
+        IN_CLOSE_WRITE | IN_ATTRIB | IN_MOVE | IN_CREATE | IN_DELETE | IN_DELETE_SELF | IN_MOVE_SELF | IN_UNMOUNT | IN_ONLYDIR);
+    if (wd > -1) {
+        // A directory that was renamed keeps its watch
+        auto it = _watches.find(wd);
+        if (it != _watches.end()) {
+            _pathToWatch.remove(*it);
+            *it = path;
         } else {
-            // If we're running out of memory or inotify watches, become
-            // unreliable.
-            if (_parent->_isReliable && (errno == ENOMEM || errno == ENOSPC)) {
+            _watches.insert(wd, path);
+        }
+        _pathToWatch.insert(path, wd);
+        return true;
+    }
+
+    // If we're running out of memory or inotify watches, become
+    // unreliable.
+    if (errno == ENOMEM || errno == ENOSPC) {
+        // This may run on the registration thread
+        QMetaObject::invokeMethod(this, [this] {
+            if (_parent->_isReliable) {
                 _parent->_isReliable = false;
                 emit _parent->becameUnreliable(
                     tr("This problem usually happens when the inotify watches are exhausted. "
                        "Check the FAQ for details."));
             }
-        }
+        }, Qt::QueuedConnection);
     }
+    return false;
 }
 
-void FolderWatcherPrivate::slotAddFolderRecursive(const QString &path)
+void FolderWatcherPrivate::registerFoldersBelow(const QString &path)
 {
+    QElapsedTimer timer;
+    timer.start();
     int subdirs = 0;
-    qCDebug(lcFolderWatcher) << "(+) Watcher:" << path;
-
-    QDir inPath(path);
-    inotifyRegisterPath(inPath.absolutePath());
 
-    const QStringList watchedFolders = _watches.values();
+    bool ok = walkFoldersBelow(path.toUtf8(), [&](const QByteArray &subfolderPath) {
+        const QString subfolder = QString::fromUtf8(subfolderPath);
+        if (++subdirs % 10000 == 0) {
+            qCInfo(lcFolderWatcher) << "    `-> registering, at" << subdirs << "subdirectories";
+        }
+        // ExcludedFiles locks against the GUI thread reloading the excludes
+        if (_parent->pathIsIgnored(subfolder)) {
+            qCDebug(lcFolderWatcher) << "* Not adding" << subfolder;
+            return false;
+        }
+        return inotifyRegisterPath(subfolder);
+    }, _abortRegistration);
 
-    QStringList allSubfolders;
-    if (!findFoldersBelow(QDir(path), allSubfolders)) {
+    if (!ok && !_abortRegistration) {
         qCWarning(lcFolderWatcher) << "Could not traverse all sub folders";
     }
-    QStringListIterator subfoldersIt(allSubfolders);
-    while (subfoldersIt.hasNext()) {
-        QString subfolder = subfoldersIt.next();
-        QDir folder(subfolder);
-        if (folder.exists() && !watchedFolders.contains(folder.absolutePath())) {
-            subdirs++;
-            if (_parent->pathIsIgnored(subfolder)) {
-                qCDebug(lcFolderWatcher) << "* Not adding" << folder.path();
-                continue;
-            }
-            inotifyRegisterPath(folder.absolutePath());
-        } else {
-            qCDebug(lcFolderWatcher) << "    `-> discarded:" << folder.path();
-        }
-    }
-
     if (subdirs > 0) {
-        qCDebug(lcFolderWatcher) << "    `-> and" << subdirs << "subdirectories";
+        qCInfo(lcFolderWatcher) << "    `-> and" << subdirs << "subdirectories in" << timer.elapsed() << "ms";
     }
 }
 
+void FolderWatcherPrivate::slotAddFolderRecursive(const QString &path)
+{
+    qCDebug(lcFolderWatcher) << "(+) Watcher:" << path;
+
+    // The folder itself right away, so that no change directly in it is missed
+    const QString absolutePath = QDir(path).absolutePath();
+    if (!inotifyRegisterPath(absolutePath))
+        return;
+
+    // There can be a lot of sub folders, don't block the GUI while registering them
+    QtConcurrent::run(&_registrationThread, [this, absolutePath] {
+        registerFoldersBelow(absolutePath);
+        QMetaObject::invokeMethod(_parent, [parent = _parent, absolutePath] {
+            emit parent->registrationFinished(absolutePath);
+        }, Qt::QueuedConnection);
+    });
+}
+
 void FolderWatcherPrivate::slotReceivedNotification(int fd)
 {
-    int len = 0;
-    struct inotify_event *event = nullptr;
-    size_t i = 0;
-    int error = 0;
-    QVarLengthArray<char, 2048> buffer(2048);
-
-    len = read(fd, buffer.data(), buffer.size());
-    error = errno;
-    /**
-      * From inotify documentation:
-      *
-      * The behavior when the buffer given to read(2) is too
-      * small to return information about the next event
-      * depends on the kernel version: in kernels  before 2.6.21,
-      * read(2) returns 0; since kernel 2.6.21, read(2) fails with
-      * the error EINVAL.
-      */
-    while (len < 0 && error == EINVAL) {
-        // double the buffer size
-        buffer.resize(buffer.size() * 2);
-
-        /* and try again ... */
-        len = read(fd, buffer.data(), buffer.size());
-        error = errno;
-    }
+    // Room for hundreds of events, so that a flood is read with few calls.
+    // Any single event fits, its name is at most NAME_MAX long.
+    static const int bufferSize = 64 * 1024;
+    alignas(struct inotify_event) char buffer[bufferSize];
 
-    // reset counter
-    i = 0;
-    // while there are enough events in the buffer
-    while (i + sizeof(struct inotify_event) < static_cast<unsigned int>(len)) {
-        // cast an inotify_event
-        event = (struct inotify_event *)&buffer[i];
-        if (!event) {
-            qCDebug(lcFolderWatcher) << "NULL event";
-            i += sizeof(struct inotify_event);
-            continue;
+    // The fd is non-blocking: read everything that is queued
+    forever {
+        const ssize_t len = read(fd, buffer, bufferSize);
+        if (len <= 0) {
+            if (len < 0 && errno != EAGAIN && errno != EINTR) {
+                qCWarning(lcFolderWatcher) << "Reading inotify events failed:" << strerror(errno);
+            }
+            break;
         }
 
-        // Fire event for the path that was changed.
-        if (event->len > 0 && event->wd > -1) {
-            QByteArray fileName(event->name);
+        for (ssize_t i = 0; i + static_cast<ssize_t>(sizeof(struct inotify_event)) <= len;) {
+            const auto *event = reinterpret_cast<const struct inotify_event *>(buffer + i);
+            i += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                // The kernel queue was full and dropped events
+                qCWarning(lcFolderWatcher) << "inotify event queue overflow";
+                _parent->addLostChanges();
+                continue;
+            }
+
+            if (event->mask & IN_IGNORED) {
+                // The watch is gone, along with its directory
+                QMutexLocker locker(&_watchesMutex);
+                auto it = _watches.find(event->wd);
+                if (it != _watches.end()) {
+                    // The path may already have a new watch, for a directory created in its place
+                    if (_pathToWatch.value(*it) == event->wd)
+                        _pathToWatch.remove(*it);
+                    _watches.erase(it);
+                }
+                continue;
+            }
+
+            // Fire event for the path that was changed.
+            if (event->len == 0 || event->wd < 0)
+                continue;
+            const QByteArray fileName(event->name);
             if (fileName.startsWith("._sync_")
                 || fileName.startsWith(".csync_journal.db")
                 || fileName.startsWith(".owncloudsync.log")
                 || fileName.startsWith(".sync_")) {
-            } else {
-                const QString p = _watches[event->wd] + '/' + fileName;
-                _parent->changeDetected(p);
+                continue;
             }
-        }
 
-        // increment counter
-        i += sizeof(struct inotify_event) + event->len;
+            QString dir;
+            {
+                QMutexLocker locker(&_watchesMutex);
+                dir = _watches.value(event->wd);
+            }
+            if (dir.isEmpty())
+                continue;
+
+            // A directory that appeared comes with contents nobody reported
+            const bool subtree = (event->mask & IN_ISDIR) && (event->mask & (IN_CREATE | IN_MOVED_TO));
+            _parent->addChange(dir + '/' + QString::fromUtf8(fileName), subtree);
+        }
     }
 }
 
@@ -189,21 +283,14 @@ void FolderWatcherPrivate::addPath(const QString &path)
 
 void FolderWatcherPrivate::removePath(const QString &path)
 {
-    int wid = -1;
     // Remove the inotify watch.
-    QHash<int, QString>::const_iterator i = _watches.constBegin();
-
-    while (i != _watches.constEnd()) {
-        if (i.value() == path) {
-            wid = i.key();
-            break;
-        }
-        ++i;
-    }
-    if (wid > -1) {
-        inotify_rm_watch(_fd, wid);
-        _watches.remove(wid);
-    }
+    QMutexLocker locker(&_watchesMutex);
+    auto it = _pathToWatch.find(path);
+    if (it == _pathToWatch.end())
+        return;
+    inotify_rm_watch(_fd, *it);
+    _watches.remove(*it);
+    _pathToWatch.erase(it);
 }
 
 } // ns mirall
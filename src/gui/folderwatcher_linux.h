@@ -20,6 +20,11 @@
 #include <QSocketNotifier>
 #include <QHash>
 #include <QDir>
+#include <QMutex>
+#include <QThreadPool>
+
+#include <atomic>
+#include <functional>
 
 #include "folderwatcher.h"
 
@@ -46,15 +51,37 @@ protected slots:
 
 protected:
     bool findFoldersBelow(const QDir &dir, QStringList &fullList);
-    void inotifyRegisterPath(const QString &path);
+    // Returns whether the path is watched now
+    bool inotifyRegisterPath(const QString &path);
+
+    /**
+     * Calls visit() with the path of each directory below path, parents
+     * first. Symlinks are not followed and the directories for which visit()
+     * returns false are not entered. Returns false if some directory could
+     * not be read.
+     */
+    static bool walkFoldersBelow(const QByteArray &path, const std::function<bool(const QByteArray &)> &visit,
+        const std::atomic<bool> &abort);
 
 private:
+    // Runs on _registrationThread
+    void registerFoldersBelow(const QString &path);
+
     FolderWatcher *_parent;
 
     QString _folder;
+
+    // Guards the watch maps, the registration thread fills them
+    QMutex _watchesMutex;
     QHash<int, QString> _watches;
+    QHash<QString, int> _pathToWatch;
+
     QScopedPointer<QSocketNotifier> _socket;
     int _fd;
+
+    // Registers the watches below newly added paths off the GUI thread, one path at a time
+    QThreadPool _registrationThread;
+    std::atomic<bool> _abortRegistration{ false };
 };
 }
 
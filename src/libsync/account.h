@@ -227,6 +227,12 @@ public:
     bool isHttp2Supported() { return _http2Supported; }
     void setHttp2Supported(bool value) { _http2Supported = value; }
 
+    /** Number of sync runs that currently propagate with this account.
+     *
+     * They share its connections, see OwncloudPropagator::hardMaximumActiveJob().
+     */
+    int activePropagationCount() const { return _activePropagationCount; }
+
     void clearCookieJar();
     void lendCookieJarTo(QNetworkAccessManager *guest);
     QString cookieJarPath();
@@ -313,6 +319,7 @@ private:
     QSharedPointer<QNetworkAccessManager> _am;
     QScopedPointer<AbstractCredentials> _credentials;
     bool _http2Supported = false;
+    int _activePropagationCount = 0;
 
     /// Certificates that were explicitly rejected by the user
     QList<QSslCertificate> _rejectedCertificates;
@@ -326,6 +333,7 @@ private:
     bool _wroteAppPassword = false;
 
     friend class AccountManager;
+    friend class OwncloudPropagator;
 
     // Direct Editing
     QString _lastDirectEditingETag;
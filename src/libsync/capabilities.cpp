@@ -179,6 +179,34 @@ bool Capabilities::chunkingParallelUploadDisabled() const
     return _capabilities["dav"].toMap()["chunkingParallelUploadDisabled"].toBool();
 }
 
+bool Capabilities::propfindDepthInfinity() const
+{
+    static const auto depthInfinity = qgetenv("OWNCLOUD_PROPFIND_DEPTH_INFINITY");
+    if (depthInfinity == "0")
+        return false;
+    if (depthInfinity == "1")
+        return true;
+    return _capabilities["dav"].toMap()["propfind"].toMap()["depth_infinity"].toBool();
+}
+
+bool Capabilities::bulkUpload() const
+{
+    static const auto bulkUpload = qgetenv("OWNCLOUD_BULK_UPLOAD");
+    if (bulkUpload == "0")
+        return false;
+    if (bulkUpload == "1")
+        return true;
+    return _capabilities["dav"].toMap()["bulkupload"].toByteArray() >= "1.0";
+}
+
+QUrl Capabilities::pushEndpoint() const
+{
+    static const auto pushChannel = qgetenv("OWNCLOUD_PUSH_CHANNEL");
+    if (pushChannel == "0")
+        return QUrl();
+    return QUrl(_capabilities["notify_push"].toMap()["endpoints"].toMap()["longpoll"].toString());
+}
+
 bool Capabilities::privateLinkPropertyAvailable() const
 {
     return _capabilities["files"].toMap()["privateLinks"].toBool();
@@ -21,6 +21,7 @@
 #include <QVariantMap>
 #include <QStringList>
 #include <QMimeDatabase>
+#include <QUrl>
 
 namespace OCC {
 
@@ -51,6 +52,37 @@ public:
     /// disable parallel upload in chunking
     bool chunkingParallelUploadDisabled() const;
 
+    /**
+     * Whether the server answers PROPFIND requests with "Depth: infinity".
+     *
+     * The discovery uses it to list whole new subtrees in one request.
+     *
+     * Path: dav/propfind/depth_infinity
+     * Default: false
+     */
+    bool propfindDepthInfinity() const;
+
+    /**
+     * Whether the server accepts many small files in one multipart/related
+     * POST, see PropagateUploadBulk.
+     *
+     * Setting OWNCLOUD_BULK_UPLOAD=0 or 1 overrides it.
+     *
+     * Path: dav/bulkupload
+     * Default: false
+     */
+    bool bulkUpload() const;
+
+    /**
+     * The long-poll endpoint that pushes remote file changes, see PushChannel.
+     *
+     * Setting OWNCLOUD_PUSH_CHANNEL=0 ignores it and keeps polling.
+     *
+     * Path: notify_push/endpoints/longpoll
+     * Default: empty, no push channel
+     */
+    QUrl pushEndpoint() const;
+
     /// Whether the "privatelink" DAV property is available
     bool privateLinkPropertyAvailable() const;
 
@@ -73,6 +73,8 @@ static const char chunkSizeC[] = "chunkSize";
 static const char minChunkSizeC[] = "minChunkSize";
 static const char maxChunkSizeC[] = "maxChunkSize";
 static const char targetChunkUploadDurationC[] = "targetChunkUploadDuration";
+static const char maxConcurrentSyncsC[] = "maxConcurrentSyncs";
+static const char maxConcurrentSyncsPerAccountC[] = "maxConcurrentSyncsPerAccount";
 static const char automaticLogDirC[] = "logToTemporaryLogDir";
 static const char logDirC[] = "logDir";
 static const char logDebugC[] = "logDebug";
@@ -237,6 +239,18 @@ chrono::milliseconds ConfigFile::targetChunkUploadDuration() const
     return millisecondsValue(settings, targetChunkUploadDurationC, chrono::minutes(1));
 }
 
+int ConfigFile::maxConcurrentSyncs() const
+{
+    QSettings settings(configFile(), QSettings::IniFormat);
+    return qMax(1, settings.value(QLatin1String(maxConcurrentSyncsC), 4).toInt());
+}
+
+int ConfigFile::maxConcurrentSyncsPerAccount() const
+{
+    QSettings settings(configFile(), QSettings::IniFormat);
+    return qMax(1, settings.value(QLatin1String(maxConcurrentSyncsPerAccountC), 2).toInt());
+}
+
 void ConfigFile::setOptionalServerNotifications(bool show)
 {
     QSettings settings(configFile(), QSettings::IniFormat);
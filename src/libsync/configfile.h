@@ -152,6 +152,10 @@ public:
     quint64 minChunkSize() const;
     std::chrono::milliseconds targetChunkUploadDuration() const;
 
+    /** How many folders may sync at the same time, in total and per account */
+    int maxConcurrentSyncs() const;
+    int maxConcurrentSyncsPerAccount() const;
+
     void saveGeometry(QWidget *w);
     void restoreGeometry(QWidget *w);
 
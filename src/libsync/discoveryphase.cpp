@@ -17,14 +17,17 @@
 #include "account.h"
 #include "common/asserts.h"
 #include "common/checksums.h"
+#include "common/syncjournaldb.h"
 
 #include <csync_private.h>
 #include <csync_rename.h>
 #include <csync_exclude.h>
 
+#include <QHash>
 #include <QLoggingCategory>
 #include <QUrl>
 #include <QFileInfo>
+#include <algorithm>
 #include <cstring>
 
 
@@ -72,7 +75,8 @@ bool DiscoveryJob::isInSelectiveSyncBlackList(const QByteArray &path) const
         return true;
     }
 
-    // Also try to adjust the path if there was renames
+    // Also try to adjust the path if there was renames, all the local ones included
+    csync_rename_wait_for_local_walk(_csync_ctx);
     if (csync_rename_count(_csync_ctx)) {
         QByteArray adjusted = csync_rename_adjust_parent_path_source(_csync_ctx, path);
         if (adjusted != path) {
@@ -94,7 +98,7 @@ bool DiscoveryJob::checkSelectiveSyncNewFolder(const QString &path, RemotePermis
         && remotePerm.hasPermission(RemotePermissions::IsMounted)) {
         // external storage.
 
-        /* Note: DiscoverySingleDirectoryJob::directoryListingIteratedSlot make sure that only the
+        /* Note: DiscoverySingleDirectoryJob::directoryListingEntry makes sure that only the
          * root of a mounted storage has 'M', all sub entries have 'm' */
 
         // Only allow it if the white list contains exactly this path (not parents)
@@ -159,12 +163,14 @@ void DiscoveryJob::update_job_update_callback(bool local,
     auto *updateJob = static_cast<DiscoveryJob *>(userdata);
     if (updateJob) {
         // Don't wanna overload the UI
+        QMutexLocker locker(&updateJob->_lastUpdateProgressCallbackMutex);
         if (!updateJob->_lastUpdateProgressCallbackCall.isValid()
          || updateJob->_lastUpdateProgressCallbackCall.elapsed() >= 200) {
             updateJob->_lastUpdateProgressCallbackCall.start();
         } else {
             return;
         }
+        locker.unlock();
 
         QByteArray pPath(dirUrl);
         int indx = pPath.lastIndexOf('/');
@@ -282,9 +288,10 @@ void DiscoverySingleDirectoryJob::start()
     }
 
     lsColJob->setProperties(props);
+    if (_depthInfinity)
+        lsColJob->setDepth("infinity");
 
-    QObject::connect(lsColJob, &LsColJob::directoryListingIterated,
-        this, &DiscoverySingleDirectoryJob::directoryListingIteratedSlot);
+    lsColJob->setParser(createParser());
     QObject::connect(lsColJob, &LsColJob::finishedWithError, this, &DiscoverySingleDirectoryJob::lsJobFinishedWithErrorSlot);
     QObject::connect(lsColJob, &LsColJob::finishedWithoutError, this, &DiscoverySingleDirectoryJob::lsJobFinishedWithoutErrorSlot);
     lsColJob->start();
@@ -299,42 +306,175 @@ void DiscoverySingleDirectoryJob::abort()
     }
 }
 
-static void propertyMapToFileStat(const QMap<QString, QString> &map, csync_file_stat_t *file_stat)
+/**
+ * Converts the responses of the PROPFIND directly into csync_file_stat_t while the
+ * reply is arriving, instead of going through a QMap of properties for every entry.
+ */
+class DiscoveryPropfindParser : public LsColXMLParser
 {
-    for (auto it = map.constBegin(); it != map.constEnd(); ++it) {
-        QString property = it.key();
-        QString value = it.value();
-        if (property == "resourcetype") {
-            if (value.contains("collection")) {
-                file_stat->type = ItemTypeDirectory;
-            } else {
-                file_stat->type = ItemTypeFile;
+public:
+    explicit DiscoveryPropfindParser(DiscoverySingleDirectoryJob *job)
+        : _job(job)
+    {
+        resetEntry();
+    }
+
+protected:
+    void propertyParsed(const QStringRef &name, const QString &value) override
+    {
+        Property property = propertyFromName(name);
+        if (property != UnknownProperty)
+            _propstat.append(qMakePair(property, value));
+    }
+
+    void propstatFinished(bool http200) override
+    {
+        if (http200)
+            applyPropstat();
+        _propstat.clear();
+    }
+
+    void responseFinished(const QString &href) override
+    {
+        _job->directoryListingEntry(href, _entry);
+        resetEntry();
+    }
+
+    void parsingStarted() override
+    {
+        _propstat.clear();
+        resetEntry();
+        _job->listingStarted(expectedPath());
+    }
+
+private:
+    enum Property {
+        UnknownProperty,
+        ResourceType,
+        LastModified,
+        ContentLength,
+        ETag,
+        Id,
+        DownloadUrl,
+        DDC,
+        Permissions,
+        Checksums,
+        ShareTypes,
+        DataFingerprint
+    };
+
+    // Called for every property of every entry: the length of the name
+    // leaves at most three candidates to compare
+    static Property propertyFromName(const QStringRef &name)
+    {
+        switch (name.size()) {
+        case 2:
+            if (name == QLatin1String("id"))
+                return Id;
+            break;
+        case 3:
+            if (name == QLatin1String("dDC"))
+                return DDC;
+            break;
+        case 7:
+            if (name == QLatin1String("getetag"))
+                return ETag;
+            break;
+        case 9:
+            if (name == QLatin1String("checksums"))
+                return Checksums;
+            break;
+        case 11:
+            if (name == QLatin1String("permissions"))
+                return Permissions;
+            if (name == QLatin1String("share-types"))
+                return ShareTypes;
+            if (name == QLatin1String("downloadURL"))
+                return DownloadUrl;
+            break;
+        case 12:
+            if (name == QLatin1String("resourcetype"))
+                return ResourceType;
+            break;
+        case 15:
+            if (name == QLatin1String("getlastmodified"))
+                return LastModified;
+            break;
+        case 16:
+            if (name == QLatin1String("getcontentlength"))
+                return ContentLength;
+            if (name == QLatin1String("data-fingerprint"))
+                return DataFingerprint;
+            break;
+        }
+        return UnknownProperty;
+    }
+
+    void resetEntry()
+    {
+        _entry.stat.reset(new csync_file_stat_t);
+        _entry.stat->size = -1;
+        _entry.etag.clear();
+        _entry.dataFingerprint.clear();
+        _entry.hasEtag = false;
+        _entry.hasPermissions = false;
+        _entry.hasDataFingerprint = false;
+    }
+
+    void applyPropstat()
+    {
+        csync_file_stat_t *file_stat = _entry.stat.get();
+        bool isShared = false;
+        for (const auto &prop : _propstat) {
+            const QString &value = prop.second;
+            switch (prop.first) {
+            case ResourceType:
+                file_stat->type = value.contains("collection") ? ItemTypeDirectory : ItemTypeFile;
+                break;
+            case LastModified:
+                file_stat->modtime = oc_httpdate_parse(value.toUtf8());
+                break;
+            case ContentLength: {
+                // See #4573, sometimes negative size values are returned
+                bool ok = false;
+                qlonglong ll = value.toLongLong(&ok);
+                file_stat->size = (ok && ll >= 0) ? ll : 0;
+                break;
             }
-        } else if (property == "getlastmodified") {
-            file_stat->modtime = oc_httpdate_parse(value.toUtf8());
-        } else if (property == "getcontentlength") {
-            // See #4573, sometimes negative size values are returned
-            bool ok = false;
-            qlonglong ll = value.toLongLong(&ok);
-            if (ok && ll >= 0) {
-                file_stat->size = ll;
-            } else {
-                file_stat->size = 0;
+            case ETag:
+                file_stat->etag = Utility::normalizeEtag(value.toUtf8());
+                _entry.etag = value;
+                _entry.hasEtag = true;
+                break;
+            case Id:
+                file_stat->file_id = value.toUtf8();
+                break;
+            case DownloadUrl:
+                file_stat->directDownloadUrl = value.toUtf8();
+                break;
+            case DDC:
+                file_stat->directDownloadCookies = value.toUtf8();
+                break;
+            case Permissions:
+                file_stat->remotePerm = RemotePermissions(value);
+                _entry.hasPermissions = true;
+                break;
+            case Checksums:
+                file_stat->checksumHeader = findBestChecksum(value.toUtf8());
+                break;
+            case ShareTypes:
+                isShared = isShared || !value.isEmpty();
+                break;
+            case DataFingerprint:
+                _entry.dataFingerprint = value.toUtf8();
+                _entry.hasDataFingerprint = true;
+                break;
+            case UnknownProperty:
+                break;
             }
-        } else if (property == "getetag") {
-            file_stat->etag = Utility::normalizeEtag(value.toUtf8());
-        } else if (property == "id") {
-            file_stat->file_id = value.toUtf8();
-        } else if (property == "downloadURL") {
-            file_stat->directDownloadUrl = value.toUtf8();
-        } else if (property == "dDC") {
-            file_stat->directDownloadCookies = value.toUtf8();
-        } else if (property == "permissions") {
-            file_stat->remotePerm = RemotePermissions(value);
-        } else if (property == "checksums") {
-            file_stat->checksumHeader = findBestChecksum(value.toUtf8());
-        } else if (property == "share-types" && !value.isEmpty()) {
-            // Since QMap is sorted, "share-types" is always after "permissions".
+        }
+        // Needs the permissions, which may come later in the propstat
+        if (isShared) {
             if (file_stat->remotePerm.isNull()) {
                 qWarning() << "Server returned a share type, but no permissions?";
             } else {
@@ -346,20 +486,45 @@ static void propertyMapToFileStat(const QMap<QString, QString> &map, csync_file_
             }
         }
     }
+
+    DiscoverySingleDirectoryJob *_job;
+    QVector<QPair<Property, QString>> _propstat; // properties of the current propstat
+    DiscoverySingleDirectoryJob::ListingEntry _entry;
+};
+
+LsColXMLParser *DiscoverySingleDirectoryJob::createParser()
+{
+    return new DiscoveryPropfindParser(this);
+}
+
+void DiscoverySingleDirectoryJob::listingStarted(const QString &path)
+{
+    // A redirected or resent request is parsed from the beginning again
+    _listingPath = path;
+    _results.clear();
+    _etagConcatenation.clear();
+    _firstEtag.clear();
+    _ignoredFirst = false;
+    _isExternalStorage = false;
+    _mountedSubDirectories.clear();
+    _error.clear();
+    _dataFingerprint.clear();
 }
 
-void DiscoverySingleDirectoryJob::directoryListingIteratedSlot(QString file, const QMap<QString, QString> &map)
+void DiscoverySingleDirectoryJob::directoryListingEntry(QString file, ListingEntry &entry)
 {
+    // Only the directory itself and its direct children are part of the etag concatenation
+    bool isDirectChild = true;
     if (!_ignoredFirst) {
         // The first entry is for the folder itself, we should process it differently.
         _ignoredFirst = true;
-        if (map.contains("permissions")) {
-            RemotePermissions perm(map.value("permissions"));
+        if (entry.hasPermissions) {
+            RemotePermissions perm = entry.stat->remotePerm;
             emit firstDirectoryPermissions(perm);
             _isExternalStorage = perm.hasPermission(RemotePermissions::IsMounted);
         }
-        if (map.contains("data-fingerprint")) {
-            _dataFingerprint = map.value("data-fingerprint").toUtf8();
+        if (entry.hasDataFingerprint) {
+            _dataFingerprint = entry.dataFingerprint;
             if (_dataFingerprint.isEmpty()) {
                 // Placeholder that means that the server supports the feature even if it did not set one.
                 _dataFingerprint = "[empty]";
@@ -367,7 +532,7 @@ void DiscoverySingleDirectoryJob::directoryListingIteratedSlot(QString file, con
         }
     } else {
         // Remove <webDAV-Url>/folder/ from <webDAV-Url>/folder/subfile.txt
-        file.remove(0, _lsColJob->reply()->request().url().path().length());
+        file.remove(0, _listingPath.length());
         // remove trailing slash
         while (file.endsWith('/')) {
             file.chop(1);
@@ -377,10 +542,8 @@ void DiscoverySingleDirectoryJob::directoryListingIteratedSlot(QString file, con
             file = file.remove(0, 1);
         }
 
-        std::unique_ptr<csync_file_stat_t> file_stat(new csync_file_stat_t);
+        std::unique_ptr<csync_file_stat_t> file_stat = std::move(entry.stat);
         file_stat->path = file.toUtf8();
-        file_stat->size = -1;
-        propertyMapToFileStat(map, file_stat.get());
         if (file_stat->type == ItemTypeDirectory)
             file_stat->size = 0;
         if (file_stat->remotePerm.hasPermission(RemotePermissions::IsShared) && file_stat->etag.isEmpty()) {
@@ -402,12 +565,24 @@ void DiscoverySingleDirectoryJob::directoryListingIteratedSlot(QString file, con
                 << file_stat->etag << file_stat->file_id;
         }
 
-        if (_isExternalStorage && file_stat->remotePerm.hasPermission(RemotePermissions::IsMounted)) {
+        bool insideExternalStorage = _isExternalStorage;
+        if (_depthInfinity) {
+            isDirectChild = !file.contains(QLatin1Char('/'));
+            // Parents come before their children in the listing
+            for (int slashPos = file.lastIndexOf(QLatin1Char('/')); slashPos > 0 && !insideExternalStorage;
+                 slashPos = file.lastIndexOf(QLatin1Char('/'), slashPos - 1)) {
+                insideExternalStorage = _mountedSubDirectories.contains(file.left(slashPos));
+            }
+        }
+
+        if (insideExternalStorage && file_stat->remotePerm.hasPermission(RemotePermissions::IsMounted)) {
             /* All the entries in a external storage have 'M' in their permission. However, for all
                purposes in the desktop client, we only need to know about the mount points.
                So replace the 'M' by a 'm' for every sub entries in an external storage */
             file_stat->remotePerm.unsetPermission(RemotePermissions::IsMounted);
             file_stat->remotePerm.setPermission(RemotePermissions::IsMountedSub);
+        } else if (_depthInfinity && file_stat->remotePerm.hasPermission(RemotePermissions::IsMounted)) {
+            _mountedSubDirectories.insert(file);
         }
 
         QStringRef fileRef(&file);
@@ -419,11 +594,11 @@ void DiscoverySingleDirectoryJob::directoryListingIteratedSlot(QString file, con
     }
 
     //This works in concerto with the RequestEtagJob and the Folder object to check if the remote folder changed.
-    if (map.contains("getetag")) {
-        _etagConcatenation += map.value("getetag");
+    if (isDirectChild && entry.hasEtag) {
+        _etagConcatenation += entry.etag;
 
         if (_firstEtag.isEmpty()) {
-            _firstEtag = map.value("getetag"); // for directory itself
+            _firstEtag = entry.etag; // for directory itself
         }
     }
 }
@@ -474,6 +649,9 @@ void DiscoveryMainThread::setupHooks(DiscoveryJob *discoveryJob, const QString &
 {
     _discoveryJob = discoveryJob;
     _pathPrefix = pathPrefix;
+    _useDepthInfinity = _account->capabilities().propfindDepthInfinity();
+    _selectiveSyncBlackList = discoveryJob->_selectiveSyncBlackList;
+    _selectiveSyncBlackList.sort();
 
     connect(discoveryJob, &DiscoveryJob::doOpendirSignal,
         this, &DiscoveryMainThread::doOpendirSlot,
@@ -483,8 +661,7 @@ void DiscoveryMainThread::setupHooks(DiscoveryJob *discoveryJob, const QString &
         Qt::QueuedConnection);
 }
 
-// Coming from owncloud_opendir -> DiscoveryJob::vio_opendir_hook -> doOpendirSignal
-void DiscoveryMainThread::doOpendirSlot(const QString &subPath, DiscoveryDirectoryResult *r)
+QString DiscoveryMainThread::fullPath(const QString &subPath) const
 {
     QString fullPath = _pathPrefix;
     if (!_pathPrefix.endsWith('/')) {
@@ -495,71 +672,310 @@ void DiscoveryMainThread::doOpendirSlot(const QString &subPath, DiscoveryDirecto
     while (fullPath.endsWith('/')) {
         fullPath.chop(1);
     }
+    return fullPath;
+}
+
+// Bound the memory held by listings the sync thread did not consume yet
+static const size_t maxBufferedListings = 500;
+
+/* Whether a failed "Depth: infinity" listing may work with "Depth: 1".
+ *
+ * A missing directory or missing permissions are the same either way. */
+static bool depthInfinityMaybeUnsupported(int csyncErrnoCode)
+{
+    switch (csyncErrnoCode) {
+    case EINVAL: // 400, 412, 501 and the like
+    case EIO: // 500, timeouts, a broken or truncated reply
+    case ERRNO_WRONG_CONTENT:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/* The maximum number of directory listings in flight, including the one the sync thread waits for */
+int DiscoveryMainThread::maximumParallelListings() const
+{
+    if (!_syncOptions._parallelNetworkJobs)
+        return 1;
+    if (_syncOptions._maxParallelDiscoveryJobs > 0)
+        return _syncOptions._maxParallelDiscoveryJobs;
+    if (_account->isHttp2Supported())
+        return 20;
+    return 6; // (Qt cannot do more anyway)
+}
 
+// Coming from owncloud_opendir -> DiscoveryJob::vio_opendir_hook -> doOpendirSignal
+void DiscoveryMainThread::doOpendirSlot(const QString &subPath, DiscoveryDirectoryResult *r)
+{
     _discoveryJob->update_job_update_callback(/*local=*/false, subPath.toUtf8(), _discoveryJob);
 
     // Result gets written in there
     _currentDiscoveryDirectoryResult = r;
-    _currentDiscoveryDirectoryResult->path = fullPath;
+    _currentDiscoveryDirectoryResult->path = fullPath(subPath);
+    _currentSubPath = subPath;
+    leaveDirectoriesFor(subPath);
+
+    auto it = _listings.find(subPath);
+    if (it == _listings.end()) {
+        // Not prefetched (yet): the sync thread needs it now, regardless of the limit
+        _startedListings.insert(subPath);
+        startListing(subPath);
+    } else if (it->second->finished) {
+        qCDebug(lcDiscovery) << "Using prefetched listing for" << subPath;
+        deliverListing(it);
+    }
+    // Otherwise the prefetch is still running and listingFinished() delivers it
+}
+
+/* The sync thread walks depth first: when it opens subPath it is done with every
+ * directory it opened before that is not a parent of subPath. The listings below
+ * them that it did not consume are for directories it skipped, they are dropped
+ * so that they don't take the place of useful prefetches. */
+void DiscoveryMainThread::leaveDirectoriesFor(const QString &subPath)
+{
+    bool evicted = false;
+    while (!_openedDirectories.isEmpty()) {
+        const QString &last = _openedDirectories.last();
+        if (last.isEmpty() || subPath.startsWith(last + QLatin1Char('/'))) {
+            break;
+        }
+        const QString prefix = last + QLatin1Char('/');
+        for (auto it = _listings.lower_bound(prefix); it != _listings.end() && it->first.startsWith(prefix);) {
+            if (auto job = it->second->job) {
+                if (!it->second->finished) {
+                    disconnect(job.data(), nullptr, this, nullptr);
+                    job->abort();
+                    --_runningListings;
+                }
+            }
+            qCDebug(lcDiscovery) << "Dropping the unused listing of" << it->first;
+            it = _listings.erase(it);
+            evicted = true;
+        }
+        _prefetchQueue.erase(std::remove_if(_prefetchQueue.begin(), _prefetchQueue.end(),
+                                 [&prefix](const QString &path) { return path.startsWith(prefix); }),
+            _prefetchQueue.end());
+        _openedDirectories.removeLast();
+    }
+    _openedDirectories.append(subPath);
+    if (evicted) {
+        startPrefetchJobs();
+    }
+}
+
+void DiscoveryMainThread::startListing(const QString &subPath)
+{
+    auto &listing = _listings[subPath];
+    listing.reset(new DirectoryListing);
 
     // Schedule the DiscoverySingleDirectoryJob
-    _singleDirJob = new DiscoverySingleDirectoryJob(_account, fullPath, this);
-    QObject::connect(_singleDirJob.data(), &DiscoverySingleDirectoryJob::finishedWithResult,
-        this, &DiscoveryMainThread::singleDirectoryJobResultSlot);
-    QObject::connect(_singleDirJob.data(), &DiscoverySingleDirectoryJob::finishedWithError,
-        this, &DiscoveryMainThread::singleDirectoryJobFinishedWithErrorSlot);
-    QObject::connect(_singleDirJob.data(), &DiscoverySingleDirectoryJob::firstDirectoryPermissions,
-        this, &DiscoveryMainThread::singleDirectoryJobFirstDirectoryPermissionsSlot);
-    QObject::connect(_singleDirJob.data(), &DiscoverySingleDirectoryJob::etagConcatenation,
-        this, &DiscoveryMainThread::etagConcatenation);
-    QObject::connect(_singleDirJob.data(), &DiscoverySingleDirectoryJob::etag,
-        this, &DiscoveryMainThread::etag);
+    auto *job = new DiscoverySingleDirectoryJob(_account, fullPath(subPath), this);
+    listing->job = job;
+    ++_runningListings;
+    if (shouldListSubtree(subPath)) {
+        qCInfo(lcDiscovery) << "Listing the whole subtree of" << subPath;
+        job->setDepthInfinity();
+    }
 
-    if (!_firstFolderProcessed) {
-        _singleDirJob->setIsRootPath();
+    QObject::connect(job, &DiscoverySingleDirectoryJob::finishedWithResult, this, [this, subPath, job] {
+        listingFinished(subPath, 0, QString(), job);
+    });
+    QObject::connect(job, &DiscoverySingleDirectoryJob::finishedWithError, this, [this, subPath](int csyncErrnoCode, const QString &msg) {
+        listingFinished(subPath, csyncErrnoCode, msg, nullptr);
+    });
+
+    if (subPath.isEmpty()) {
+        job->setIsRootPath();
+        QObject::connect(job, &DiscoverySingleDirectoryJob::firstDirectoryPermissions,
+            this, &DiscoveryMainThread::singleDirectoryJobFirstDirectoryPermissionsSlot);
+        QObject::connect(job, &DiscoverySingleDirectoryJob::etagConcatenation,
+            this, &DiscoveryMainThread::etagConcatenation);
+        QObject::connect(job, &DiscoverySingleDirectoryJob::etag,
+            this, &DiscoveryMainThread::etag);
     }
 
-    _singleDirJob->start();
+    job->start();
 }
 
-
-void DiscoveryMainThread::singleDirectoryJobResultSlot()
+void DiscoveryMainThread::listingFinished(const QString &subPath, int csyncErrnoCode, const QString &msg, DiscoverySingleDirectoryJob *job)
 {
-    if (!_currentDiscoveryDirectoryResult) {
+    auto it = _listings.find(subPath);
+    if (it == _listings.end()) {
         return; // possibly aborted
     }
+    --_runningListings;
+
+    auto &listing = *it->second;
+    if (!job && listing.job && listing.job->isDepthInfinity() && depthInfinityMaybeUnsupported(csyncErrnoCode)) {
+        // Servers may refuse "Depth: infinity" even if they advertised it, list it normally
+        qCWarning(lcDiscovery) << "Subtree listing of" << subPath << "failed, falling back to single directories" << csyncErrnoCode << msg;
+        _useDepthInfinity = false;
+        startListing(subPath);
+        return;
+    }
 
-    _currentDiscoveryDirectoryResult->list = _singleDirJob->takeResults();
-    _currentDiscoveryDirectoryResult->code = 0;
+    listing.finished = true;
+    listing.code = csyncErrnoCode;
+    listing.msg = msg;
+    if (job && job->isDepthInfinity()) {
+        distributeSubtreeListing(subPath, job->takeResults());
+    } else if (job) {
+        listing.list = job->takeResults();
+        if (subPath.isEmpty()) {
+            _dataFingerprint = job->_dataFingerprint;
+        }
+        queuePrefetch(subPath, listing.list);
+    } else {
+        qCDebug(lcDiscovery) << csyncErrnoCode << msg;
+    }
 
-    qCDebug(lcDiscovery) << "Have" << _currentDiscoveryDirectoryResult->list.size() << "results for " << _currentDiscoveryDirectoryResult->path;
+    if (_currentDiscoveryDirectoryResult && _currentSubPath == subPath) {
+        deliverListing(it);
+    }
+    startPrefetchJobs();
+}
 
-    _currentDiscoveryDirectoryResult = nullptr; // the sync thread owns it now
+/* Whether the directory is unknown to the journal, so that every directory below it will be listed anyway. */
+bool DiscoveryMainThread::shouldListSubtree(const QString &subPath) const
+{
+    // The root is always listed on its own, it carries the root etag and the data-fingerprint
+    if (!_useDepthInfinity || subPath.isEmpty() || _listSingleDirectories.contains(subPath)) {
+        return false;
+    }
+    if (!_discoveryJob->_csync_ctx->read_remote_from_db || !_journal) {
+        return true;
+    }
+    SyncJournalFileRecord rec;
+    return _journal->getFileRecord(subPath.toUtf8(), &rec) && !rec.isValid();
+}
 
-    if (!_firstFolderProcessed) {
-        _firstFolderProcessed = true;
-        _dataFingerprint = _singleDirJob->_dataFingerprint;
+/* Split the result of a "Depth: infinity" listing into one listing per directory.
+ *
+ * The sync thread then finds the directories of the subtree as already finished
+ * listings. Selective sync blacklisted directories are never opened, what is
+ * below them is dropped. So are the directories beyond maxBufferedListings,
+ * the sync thread lists them one at a time when it gets there. */
+void DiscoveryMainThread::distributeSubtreeListing(const QString &subPath, std::deque<std::unique_ptr<csync_file_stat_t>> &&list)
+{
+    auto join = [](const QString &parent, const QString &name) {
+        return parent.isEmpty() ? name : parent + QLatin1Char('/') + name;
+    };
+
+    // The listings filled here, parents come before their children in the listing
+    QHash<QString, DirectoryListing *> distributed;
+    distributed.insert(subPath, _listings[subPath].get());
+
+    int directories = 0;
+    size_t dropped = 0;
+    const size_t entries = list.size();
+    for (auto &fs : list) {
+        QString relativePath = QString::fromUtf8(fs->path);
+        int slashPos = relativePath.lastIndexOf(QLatin1Char('/'));
+        DirectoryListing *parent = distributed.value(join(subPath, relativePath.left(qMax(slashPos, 0))));
+        if (!parent) {
+            ++dropped;
+            continue;
+        }
+        if (fs->type == ItemTypeDirectory) {
+            const QString path = join(subPath, relativePath);
+            if (!_selectiveSyncBlackList.isEmpty() && findPathInList(_selectiveSyncBlackList, path)) {
+                // never opened
+            } else if (_listings.size() < maxBufferedListings) {
+                // Empty directories get a listing as well
+                auto &listing = _listings[path];
+                listing.reset(new DirectoryListing);
+                listing->finished = true;
+                listing->code = 0;
+                _startedListings.insert(path);
+                distributed.insert(path, listing.get());
+                ++directories;
+            } else {
+                _listSingleDirectories.insert(path);
+            }
+        }
+        if (slashPos >= 0) {
+            fs->path = relativePath.mid(slashPos + 1).toUtf8();
+        }
+        parent->list.push_back(std::move(fs));
     }
+    qCDebug(lcDiscovery) << "Subtree listing of" << subPath << "has" << entries << "entries in" << directories << "directories,"
+                         << dropped << "entries dropped";
+}
+
+void DiscoveryMainThread::deliverListing(std::map<QString, std::unique_ptr<DirectoryListing>>::iterator it)
+{
+    _currentDiscoveryDirectoryResult->code = it->second->code;
+    _currentDiscoveryDirectoryResult->msg = it->second->msg;
+    _currentDiscoveryDirectoryResult->list = std::move(it->second->list);
+    _listings.erase(it);
+
+    qCDebug(lcDiscovery) << "Have" << _currentDiscoveryDirectoryResult->list.size() << "results for " << _currentDiscoveryDirectoryResult->path;
+
+    _currentDiscoveryDirectoryResult = nullptr; // the sync thread owns it now
 
     _discoveryJob->_vioMutex.lock();
     _discoveryJob->_vioWaitCondition.wakeAll();
     _discoveryJob->_vioMutex.unlock();
 }
 
-void DiscoveryMainThread::singleDirectoryJobFinishedWithErrorSlot(int csyncErrnoCode, const QString &msg)
+/* Remember the sub directories of a listing that the sync thread will most likely open.
+ *
+ * Directories whose etag matches the database are read from the db by csync_ftw, and
+ * blacklisted ones are never opened, so there is no point in fetching them. */
+void DiscoveryMainThread::queuePrefetch(const QString &subPath, const std::deque<std::unique_ptr<csync_file_stat_t>> &list)
 {
-    if (!_currentDiscoveryDirectoryResult) {
-        return; // possibly aborted
+    if (maximumParallelListings() <= 1) {
+        return;
     }
-    qCDebug(lcDiscovery) << csyncErrnoCode << msg;
 
-    _currentDiscoveryDirectoryResult->code = csyncErrnoCode;
-    _currentDiscoveryDirectoryResult->msg = msg;
-    _currentDiscoveryDirectoryResult = nullptr; // the sync thread owns it now
+    const bool readFromDb = _discoveryJob->_csync_ctx->read_remote_from_db;
+    QStringList children;
+    for (const auto &fs : list) {
+        if (fs->type != ItemTypeDirectory) {
+            continue;
+        }
+        QString childPath = QString::fromUtf8(fs->path);
+        if (!subPath.isEmpty()) {
+            childPath = subPath + QLatin1Char('/') + childPath;
+        }
+        if (!_selectiveSyncBlackList.isEmpty() && findPathInList(_selectiveSyncBlackList, childPath)) {
+            continue;
+        }
+        if (readFromDb && _journal) {
+            SyncJournalFileRecord rec;
+            if (_journal->getFileRecord(childPath.toUtf8(), &rec) && rec.isValid()
+                && rec._type == ItemTypeDirectory
+                && rec._etag == fs->etag
+                && rec._fileId == fs->file_id
+                && rec._remotePerm == fs->remotePerm) {
+                continue;
+            }
+        }
+        children.append(childPath);
+    }
 
-    _discoveryJob->_vioMutex.lock();
-    _discoveryJob->_vioWaitCondition.wakeAll();
-    _discoveryJob->_vioMutex.unlock();
+    // The sync thread walks depth first in listing order: put the children of the
+    // most recent listing in front of the queue, keeping their relative order.
+    for (auto it = children.crbegin(); it != children.crend(); ++it) {
+        _prefetchQueue.push_front(*it);
+    }
+}
+
+void DiscoveryMainThread::startPrefetchJobs()
+{
+    while (_runningListings < maximumParallelListings()
+        && _listings.size() < maxBufferedListings
+        && !_prefetchQueue.empty()) {
+        QString subPath = _prefetchQueue.front();
+        _prefetchQueue.pop_front();
+        if (_startedListings.contains(subPath)) {
+            continue;
+        }
+        _startedListings.insert(subPath);
+        qCDebug(lcDiscovery) << "Prefetching" << subPath;
+        startListing(subPath);
+    }
 }
 
 void DiscoveryMainThread::singleDirectoryJobFirstDirectoryPermissionsSlot(RemotePermissions p)
@@ -573,20 +989,10 @@ void DiscoveryMainThread::singleDirectoryJobFirstDirectoryPermissionsSlot(Remote
 
 void DiscoveryMainThread::doGetSizeSlot(const QString &path, qint64 *result)
 {
-    QString fullPath = _pathPrefix;
-    if (!_pathPrefix.endsWith('/')) {
-        fullPath += '/';
-    }
-    fullPath += path;
-    // remove trailing slash
-    while (fullPath.endsWith('/')) {
-        fullPath.chop(1);
-    }
-
     _currentGetSizeResult = result;
 
     // Schedule the DiscoverySingleDirectoryJob
-    auto propfindJob = new PropfindJob(_account, fullPath, this);
+    auto propfindJob = new PropfindJob(_account, fullPath(path), this);
     propfindJob->setProperties(QList<QByteArray>() << "resourcetype"
                                                    << "http://owncloud.org/ns:size");
     QObject::connect(propfindJob, &PropfindJob::finishedWithError,
@@ -626,12 +1032,15 @@ void DiscoveryMainThread::slotGetSizeResult(const QVariantMap &map)
 // called from SyncEngine
 void DiscoveryMainThread::abort()
 {
-    if (_singleDirJob) {
-        disconnect(_singleDirJob.data(), &DiscoverySingleDirectoryJob::finishedWithError, this, nullptr);
-        disconnect(_singleDirJob.data(), &DiscoverySingleDirectoryJob::firstDirectoryPermissions, this, nullptr);
-        disconnect(_singleDirJob.data(), &DiscoverySingleDirectoryJob::finishedWithResult, this, nullptr);
-        _singleDirJob->abort();
+    for (auto &listing : _listings) {
+        if (auto job = listing.second->job) {
+            disconnect(job.data(), nullptr, this, nullptr);
+            job->abort();
+        }
     }
+    _listings.clear();
+    _prefetchQueue.clear();
+    _runningListings = 0;
     if (_currentDiscoveryDirectoryResult) {
         if (_discoveryJob->_vioMutex.tryLock()) {
             _currentDiscoveryDirectoryResult->msg = tr("Aborted by the user"); // Actually also created somewhere else by sync engine
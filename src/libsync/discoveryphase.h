@@ -22,12 +22,15 @@
 #include "networkjobs.h"
 #include <QMutex>
 #include <QWaitCondition>
+#include <QSet>
 #include <deque>
+#include <map>
 #include "syncoptions.h"
 
 namespace OCC {
 
 class Account;
+class SyncJournalDb;
 
 /**
  * The Discovery Phase was once called "update" phase in csync terms.
@@ -50,17 +53,37 @@ struct DiscoveryDirectoryResult
  *
  * @ingroup libsync
  */
-class DiscoverySingleDirectoryJob : public QObject
+class OWNCLOUDSYNC_EXPORT DiscoverySingleDirectoryJob : public QObject
 {
     Q_OBJECT
 public:
     explicit DiscoverySingleDirectoryJob(const AccountPtr &account, const QString &path, QObject *parent = nullptr);
     // Specify thgat this is the root and we need to check the data-fingerprint
     void setIsRootPath() { _isRootPath = true; }
+    // List the whole subtree with "Depth: infinity", result paths are then relative to this directory
+    void setDepthInfinity() { _depthInfinity = true; }
+    bool isDepthInfinity() const { return _depthInfinity; }
     void start();
     void abort();
     std::deque<std::unique_ptr<csync_file_stat_t>> &&takeResults() { return std::move(_results); }
 
+    /** One response of the PROPFIND, as converted by the parser */
+    struct ListingEntry
+    {
+        std::unique_ptr<csync_file_stat_t> stat;
+        QString etag; // as sent by the server, for the etag concatenation
+        QByteArray dataFingerprint;
+        bool hasEtag = false;
+        bool hasPermissions = false;
+        bool hasDataFingerprint = false;
+    };
+    void directoryListingEntry(QString file, ListingEntry &entry);
+    /** Forgets what an earlier reply delivered, the listing of path starts over */
+    void listingStarted(const QString &path);
+
+    /** The parser that turns the PROPFIND reply into the results, owned by the caller */
+    LsColXMLParser *createParser();
+
     // This is not actually a network job, it is just a job
 signals:
     void firstDirectoryPermissions(RemotePermissions);
@@ -69,7 +92,6 @@ signals:
     void finishedWithResult();
     void finishedWithError(int csyncErrnoCode, const QString &msg);
 private slots:
-    void directoryListingIteratedSlot(QString, const QMap<QString, QString> &);
     void lsJobFinishedWithoutErrorSlot();
     void lsJobFinishedWithErrorSlot(QNetworkReply *);
 
@@ -86,6 +108,12 @@ private:
     bool _isRootPath;
     // If this directory is an external storage (The first item has 'M' in its permission)
     bool _isExternalStorage;
+    // Set to true if the whole subtree is listed
+    bool _depthInfinity = false;
+    // Mount points found within a subtree listing, relative to this directory
+    QSet<QString> _mountedSubDirectories;
+    // The path of the listed directory as the server reports it
+    QString _listingPath;
     // If set, the discovery will finish with an error
     QString _error;
     QPointer<LsColJob> _lsColJob;
@@ -100,21 +128,59 @@ class DiscoveryMainThread : public QObject
 {
     Q_OBJECT
 
+    /** A directory listing that was started, either on request of the sync thread or as a prefetch */
+    struct DirectoryListing
+    {
+        QPointer<DiscoverySingleDirectoryJob> job;
+        bool finished = false;
+        int code = EIO;
+        QString msg;
+        std::deque<std::unique_ptr<csync_file_stat_t>> list;
+    };
+
     QPointer<DiscoveryJob> _discoveryJob;
-    QPointer<DiscoverySingleDirectoryJob> _singleDirJob;
     QString _pathPrefix; // remote path
     AccountPtr _account;
+    SyncJournalDb *_journal;
+    SyncOptions _syncOptions;
+    QStringList _selectiveSyncBlackList;
     DiscoveryDirectoryResult *_currentDiscoveryDirectoryResult;
+    QString _currentSubPath; // The directory the sync thread is waiting for
     qint64 *_currentGetSizeResult;
-    bool _firstFolderProcessed;
+
+    // Listings that are running or not yet picked up by the sync thread, by sub path
+    std::map<QString, std::unique_ptr<DirectoryListing>> _listings;
+    // Directories that will be prefetched as soon as there is a free slot
+    std::deque<QString> _prefetchQueue;
+    // Every sub path a listing was started for, so that nothing is fetched twice
+    QSet<QString> _startedListings;
+    int _runningListings = 0;
+    // Whether new subtrees are listed with one "Depth: infinity" request
+    bool _useDepthInfinity = false;
+    // Directories of a subtree listing that were dropped to bound the memory, see distributeSubtreeListing()
+    QSet<QString> _listSingleDirectories;
+    // The directory the sync thread opened last and those of its parents it opened, see leaveDirectoriesFor()
+    QStringList _openedDirectories;
+
+    QString fullPath(const QString &subPath) const;
+    int maximumParallelListings() const;
+    bool shouldListSubtree(const QString &subPath) const;
+    void leaveDirectoriesFor(const QString &subPath);
+    void startListing(const QString &subPath);
+    void distributeSubtreeListing(const QString &subPath, std::deque<std::unique_ptr<csync_file_stat_t>> &&list);
+    void listingFinished(const QString &subPath, int csyncErrnoCode, const QString &msg, DiscoverySingleDirectoryJob *job);
+    void deliverListing(std::map<QString, std::unique_ptr<DirectoryListing>>::iterator it);
+    void queuePrefetch(const QString &subPath, const std::deque<std::unique_ptr<csync_file_stat_t>> &list);
+    void startPrefetchJobs();
 
 public:
-    DiscoveryMainThread(AccountPtr account)
+    DiscoveryMainThread(AccountPtr account, SyncJournalDb *journal, const SyncOptions &syncOptions)
         : QObject()
         , _account(account)
+        , _journal(journal)
+        , _syncOptions(syncOptions)
         , _currentDiscoveryDirectoryResult(nullptr)
         , _currentGetSizeResult(nullptr)
-        , _firstFolderProcessed(false)
     {
     }
     void abort();
@@ -128,8 +194,6 @@ public slots:
     void doGetSizeSlot(const QString &path, qint64 *result);
 
     // From Job:
-    void singleDirectoryJobResultSlot();
-    void singleDirectoryJobFinishedWithErrorSlot(int csyncErrnoCode, const QString &msg);
     void singleDirectoryJobFirstDirectoryPermissionsSlot(RemotePermissions);
 
     void slotGetSizeFinishedWithError();
@@ -155,6 +219,7 @@ class DiscoveryJob : public QObject
     friend class DiscoveryMainThread;
     CSYNC *_csync_ctx;
     QElapsedTimer _lastUpdateProgressCallbackCall;
+    QMutex _lastUpdateProgressCallbackMutex; // the local and remote discovery report from different threads
 
     /**
      * return true if the given path should be ignored,
@@ -21,6 +21,14 @@
 #include <QDirIterator>
 #include <QCoreApplication>
 
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/falloc.h>
+#include <linux/fs.h>
+#endif
+
 // We use some internals of csync:
 extern "C" int c_utimes(const char *, const struct timeval *);
 
@@ -31,6 +39,80 @@ extern "C" int c_utimes(const char *, const struct timeval *);
 
 namespace OCC {
 
+bool FileSystem::preallocate(QFile &file, qint64 offset, qint64 length)
+{
+#ifdef Q_OS_LINUX
+    // Unlike posix_fallocate(), FALLOC_FL_KEEP_SIZE leaves the file size alone,
+    // which is how partial downloads are resumed
+    return length > 0 && fallocate(file.handle(), FALLOC_FL_KEEP_SIZE, offset, length) == 0;
+#else
+    Q_UNUSED(file);
+    Q_UNUSED(offset);
+    Q_UNUSED(length);
+    return false;
+#endif
+}
+
+bool FileSystem::deallocate(QFile &file, qint64 offset, qint64 length)
+{
+#ifdef Q_OS_LINUX
+    return length > 0 && fallocate(file.handle(), FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, length) == 0;
+#else
+    Q_UNUSED(file);
+    Q_UNUSED(offset);
+    Q_UNUSED(length);
+    return false;
+#endif
+}
+
+bool FileSystem::copyFileContents(const QString &source, const QString &destination)
+{
+    QFile in(source);
+    QFile out(destination);
+    if (!in.open(QIODevice::ReadOnly) || !out.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Unbuffered)) {
+        qCWarning(lcFileSystem) << "copyFileContents: Failed to open" << source << "or" << destination;
+        return false;
+    }
+    const qint64 size = in.size();
+
+#ifdef Q_OS_LINUX
+#ifdef FICLONE
+    // btrfs, xfs and others can share the blocks until either file changes
+    if (ioctl(out.handle(), FICLONE, in.handle()) == 0) {
+        return true;
+    }
+#endif
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 27))
+    // Copy without passing the data through user space; fails with EXDEV
+    // and the like on older kernels, then copy the remainder below
+    qint64 copied = 0;
+    while (copied < size) {
+        const auto n = copy_file_range(in.handle(), nullptr, out.handle(), nullptr, static_cast<size_t>(size - copied), 0);
+        if (n <= 0)
+            break;
+        copied += n;
+    }
+    if (copied == size) {
+        return true;
+    }
+    if (!in.seek(copied) || !out.seek(copied)) {
+        return false;
+    }
+#endif
+#endif
+
+    const int BufferSize = 256 * 1024;
+    QByteArray buffer(BufferSize, Qt::Uninitialized);
+    while (!in.atEnd()) {
+        const qint64 n = in.read(buffer.data(), BufferSize);
+        if (n < 0 || out.write(buffer.constData(), n) != n) {
+            qCWarning(lcFileSystem) << "copyFileContents: Failed to copy" << source << "to" << destination << out.errorString();
+            return false;
+        }
+    }
+    return out.size() == size;
+}
+
 bool FileSystem::fileEquals(const QString &fn1, const QString &fn2)
 {
     // compare two files with given filename and return true if they have the same content
@@ -91,6 +91,31 @@ namespace FileSystem {
     bool OWNCLOUDSYNC_EXPORT removeRecursively(const QString &path,
         const std::function<void(const QString &path, bool isDir)> &onDeleted = nullptr,
         QStringList *errors = nullptr);
+
+    /**
+     * Reserves disk space for the range [offset, offset+length) of an open
+     * file without changing its size, so that a file that is written
+     * sequentially ends up less fragmented.
+     *
+     * Only a hint: returns false if the platform or file system doesn't support it.
+     */
+    bool OWNCLOUDSYNC_EXPORT preallocate(QFile &file, qint64 offset, qint64 length);
+
+    /**
+     * Frees the disk space of the range [offset, offset+length) of an open file
+     * without changing its size, e.g. what preallocate() reserved past the end
+     * of the file.
+     */
+    bool OWNCLOUDSYNC_EXPORT deallocate(QFile &file, qint64 offset, qint64 length);
+
+    /**
+     * Replaces the content of destination with the content of source.
+     *
+     * Where the file system allows it the data blocks are shared (reflink)
+     * or copied by the kernel, otherwise the data is read and written.
+     * Returns false on error, destination may then hold part of the data.
+     */
+    bool OWNCLOUDSYNC_EXPORT copyFileContents(const QString &source, const QString &destination);
 }
 
 /** @} */
@@ -23,6 +23,7 @@
 #include <QSslCipher>
 #include <QBuffer>
 #include <QXmlStreamReader>
+#include <cctype>
 #include <QStringList>
 #include <QStack>
 #include <QTimer>
@@ -189,109 +190,205 @@ static QString readContentsAsString(QXmlStreamReader &reader)
 }
 
 
+/* Returns the position right after the last complete "</response>" end tag, whatever the
+ * namespace prefix is, or -1 if there is none. A "</" can't be part of character data. */
+static int lastCompleteResponseEnd(const QByteArray &data)
+{
+    static const char responseEndTag[] = "response>";
+    int pos = data.lastIndexOf(responseEndTag);
+    while (pos > 0) {
+        int start = pos;
+        if (data.at(start - 1) == ':') {
+            --start;
+            while (start > 0 && (isalnum(static_cast<unsigned char>(data.at(start - 1))) || data.at(start - 1) == '_' || data.at(start - 1) == '-' || data.at(start - 1) == '.')) {
+                --start;
+            }
+        }
+        if (start >= 2 && data.at(start - 1) == '/' && data.at(start - 2) == '<') {
+            return pos + int(sizeof(responseEndTag)) - 1;
+        }
+        pos = data.lastIndexOf(responseEndTag, pos - 1);
+    }
+    return -1;
+}
+
 LsColXMLParser::LsColXMLParser() = default;
 
 bool LsColXMLParser::parse(const QByteArray &xml, QHash<QString, ExtraFolderInfo> *fileInfo, const QString &expectedPath)
 {
-    // Parse DAV response
-    QXmlStreamReader reader(xml);
-    reader.addExtraNamespaceDeclaration(QXmlStreamNamespaceDeclaration("d", "DAV:"));
+    start(fileInfo, expectedPath);
+    return addData(xml) && finish();
+}
 
-    QStringList folders;
-    QString currentHref;
-    QMap<QString, QString> currentTmpProperties;
-    QMap<QString, QString> currentHttp200Properties;
-    bool currentPropsHaveHttp200 = false;
-    bool insidePropstat = false;
-    bool insideProp = false;
-    bool insideMultiStatus = false;
+void LsColXMLParser::start(QHash<QString, ExtraFolderInfo> *fileInfo, const QString &expectedPath)
+{
+    _reader.clear();
+    _reader.addExtraNamespaceDeclaration(QXmlStreamNamespaceDeclaration("d", "DAV:"));
+    _pending.clear();
+    _folderInfos = fileInfo;
+    _expectedPath = expectedPath;
+    _folders.clear();
+    _currentHref.clear();
+    _currentTmpProperties.clear();
+    _currentHttp200Properties.clear();
+    _currentPropsHaveHttp200 = false;
+    _insidePropstat = false;
+    _insideProp = false;
+    _insideMultiStatus = false;
+    _failed = false;
+    parsingStarted();
+}
 
-    while (!reader.atEnd()) {
-        QXmlStreamReader::TokenType type = reader.readNext();
-        QString name = reader.name().toString();
+bool LsColXMLParser::addData(const QByteArray &data)
+{
+    if (_failed) {
+        return false;
+    }
+
+    // Only hand complete responses to the reader: QXmlStreamReader can continue after
+    // a PrematureEndOfDocumentError between two tokens, but not within an element text.
+    _pending += data;
+    int end = lastCompleteResponseEnd(_pending);
+    if (end < 0) {
+        return true;
+    }
+    _reader.addData(_pending.left(end));
+    _pending.remove(0, end);
+    return parseAvailable();
+}
+
+bool LsColXMLParser::finish()
+{
+    if (_failed) {
+        return false;
+    }
+    if (!_pending.isEmpty()) {
+        _reader.addData(_pending);
+        _pending.clear();
+    }
+    if (!parseAvailable()) {
+        return false;
+    }
+
+    if (_reader.hasError()) {
+        // Truncated XML. Whatever had been emitted before came as directoryListingIterated
+        qCWarning(lcLsColJob) << "ERROR" << _reader.errorString();
+        return false;
+    } else if (!_insideMultiStatus) {
+        qCWarning(lcLsColJob) << "ERROR no WebDAV response?";
+        return false;
+    }
+    emit directoryListingSubfolders(_folders);
+    emit finishedWithoutError();
+    return true;
+}
+
+void LsColXMLParser::propertyParsed(const QStringRef &name, const QString &value)
+{
+    _currentTmpProperties.insert(name.toString(), value);
+}
+
+void LsColXMLParser::propstatFinished(bool http200)
+{
+    if (http200) {
+        _currentHttp200Properties = QMap<QString, QString>(_currentTmpProperties);
+    }
+    _currentTmpProperties.clear();
+}
+
+void LsColXMLParser::responseFinished(const QString &href)
+{
+    emit directoryListingIterated(href, _currentHttp200Properties);
+    _currentHttp200Properties.clear();
+}
+
+bool LsColXMLParser::parseAvailable()
+{
+    // After a PrematureEndOfDocumentError, readNext() continues with the data added since
+    while (!_reader.atEnd() || _reader.error() == QXmlStreamReader::PrematureEndOfDocumentError) {
+        QXmlStreamReader::TokenType type = _reader.readNext();
+        if (type == QXmlStreamReader::Invalid) {
+            break;
+        }
+        const QStringRef name = _reader.name();
         // Start elements with DAV:
-        if (type == QXmlStreamReader::StartElement && reader.namespaceUri() == QLatin1String("DAV:")) {
+        if (type == QXmlStreamReader::StartElement && _reader.namespaceUri() == QLatin1String("DAV:")) {
             if (name == QLatin1String("href")) {
                 // We don't use URL encoding in our request URL (which is the expected path) (QNAM will do it for us)
                 // but the result will have URL encoding..
-                QString hrefString = QUrl::fromLocalFile(QUrl::fromPercentEncoding(reader.readElementText().toUtf8()))
+                QString hrefString = QUrl::fromLocalFile(QUrl::fromPercentEncoding(_reader.readElementText().toUtf8()))
                         .adjusted(QUrl::NormalizePathSegments)
                         .path();
-                if (!hrefString.startsWith(expectedPath)) {
-                    qCWarning(lcLsColJob) << "Invalid href" << hrefString << "expected starting with" << expectedPath;
+                if (!hrefString.startsWith(_expectedPath)) {
+                    qCWarning(lcLsColJob) << "Invalid href" << hrefString << "expected starting with" << _expectedPath;
+                    _failed = true;
                     return false;
                 }
-                currentHref = hrefString;
+                _currentHref = hrefString;
             } else if (name == QLatin1String("response")) {
             } else if (name == QLatin1String("propstat")) {
-                insidePropstat = true;
-            } else if (name == QLatin1String("status") && insidePropstat) {
-                QString httpStatus = reader.readElementText();
+                _insidePropstat = true;
+            } else if (name == QLatin1String("status") && _insidePropstat) {
+                QString httpStatus = _reader.readElementText();
                 if (httpStatus.startsWith("HTTP/1.1 200")) {
-                    currentPropsHaveHttp200 = true;
+                    _currentPropsHaveHttp200 = true;
                 } else {
-                    currentPropsHaveHttp200 = false;
+                    _currentPropsHaveHttp200 = false;
                 }
             } else if (name == QLatin1String("prop")) {
-                insideProp = true;
+                _insideProp = true;
                 continue;
             } else if (name == QLatin1String("multistatus")) {
-                insideMultiStatus = true;
+                _insideMultiStatus = true;
                 continue;
             }
         }
 
-        if (type == QXmlStreamReader::StartElement && insidePropstat && insideProp) {
+        if (type == QXmlStreamReader::StartElement && _insidePropstat && _insideProp) {
             // All those elements are properties
-            QString propertyContent = readContentsAsString(reader);
-            if (name == QLatin1String("resourcetype") && propertyContent.contains("collection")) {
-                folders.append(currentHref);
-            } else if (name == QLatin1String("size")) {
+            const QString propertyName = name.toString();
+            QString propertyContent = readContentsAsString(_reader);
+            if (propertyName == QLatin1String("resourcetype") && propertyContent.contains("collection")) {
+                _folders.append(_currentHref);
+            } else if (propertyName == QLatin1String("size")) {
                 bool ok = false;
                 auto s = propertyContent.toLongLong(&ok);
-                if (ok && fileInfo) {
-                    (*fileInfo)[currentHref].size = s;
+                if (ok && _folderInfos) {
+                    (*_folderInfos)[_currentHref].size = s;
+                }
+            } else if (propertyName == QLatin1String("fileid")) {
+                if (_folderInfos) {
+                    (*_folderInfos)[_currentHref].fileId = propertyContent.toUtf8();
                 }
-            } else if (name == QLatin1String("fileid")) {
-                (*fileInfo)[currentHref].fileId = propertyContent.toUtf8();
             }
-            currentTmpProperties.insert(reader.name().toString(), propertyContent);
+            propertyParsed(QStringRef(&propertyName), propertyContent);
         }
 
         // End elements with DAV:
         if (type == QXmlStreamReader::EndElement) {
-            if (reader.namespaceUri() == QLatin1String("DAV:")) {
-                if (reader.name() == "response") {
-                    if (currentHref.endsWith('/')) {
-                        currentHref.chop(1);
+            if (_reader.namespaceUri() == QLatin1String("DAV:")) {
+                if (name == QLatin1String("response")) {
+                    if (_currentHref.endsWith('/')) {
+                        _currentHref.chop(1);
                     }
-                    emit directoryListingIterated(currentHref, currentHttp200Properties);
-                    currentHref.clear();
-                    currentHttp200Properties.clear();
-                } else if (reader.name() == "propstat") {
-                    insidePropstat = false;
-                    if (currentPropsHaveHttp200) {
-                        currentHttp200Properties = QMap<QString, QString>(currentTmpProperties);
-                    }
-                    currentTmpProperties.clear();
-                    currentPropsHaveHttp200 = false;
-                } else if (reader.name() == "prop") {
-                    insideProp = false;
+                    responseFinished(_currentHref);
+                    _currentHref.clear();
+                } else if (name == QLatin1String("propstat")) {
+                    _insidePropstat = false;
+                    propstatFinished(_currentPropsHaveHttp200);
+                    _currentPropsHaveHttp200 = false;
+                } else if (name == QLatin1String("prop")) {
+                    _insideProp = false;
                 }
             }
         }
     }
 
-    if (reader.hasError()) {
+    if (_reader.hasError() && _reader.error() != QXmlStreamReader::PrematureEndOfDocumentError) {
         // XML Parser error? Whatever had been emitted before will come as directoryListingIterated
-        qCWarning(lcLsColJob) << "ERROR" << reader.errorString() << xml;
-        return false;
-    } else if (!insideMultiStatus) {
-        qCWarning(lcLsColJob) << "ERROR no WebDAV response?" << xml;
+        qCWarning(lcLsColJob) << "ERROR" << _reader.errorString() << _pending;
+        _failed = true;
         return false;
-    } else {
-        emit directoryListingSubfolders(folders);
-        emit finishedWithoutError();
     }
     return true;
 }
@@ -301,12 +398,29 @@ bool LsColXMLParser::parse(const QByteArray &xml, QHash<QString, ExtraFolderInfo
 LsColJob::LsColJob(AccountPtr account, const QString &path, QObject *parent)
     : AbstractNetworkJob(account, path, parent)
 {
+    setParser(new LsColXMLParser);
 }
 
 LsColJob::LsColJob(AccountPtr account, const QUrl &url, QObject *parent)
     : AbstractNetworkJob(account, QString(), parent)
     , _url(url)
 {
+    setParser(new LsColXMLParser);
+}
+
+void LsColJob::setParser(LsColXMLParser *parser)
+{
+    delete _parser;
+    _parser = parser;
+    _parser->setParent(this);
+    connect(_parser, &LsColXMLParser::directoryListingSubfolders,
+        this, &LsColJob::directoryListingSubfolders);
+    connect(_parser, &LsColXMLParser::directoryListingIterated,
+        this, &LsColJob::directoryListingIterated);
+    connect(_parser, &LsColXMLParser::finishedWithError,
+        this, &LsColJob::finishedWithError);
+    connect(_parser, &LsColXMLParser::finishedWithoutError,
+        this, &LsColJob::finishedWithoutError);
 }
 
 void LsColJob::setProperties(QList<QByteArray> properties)
@@ -342,7 +456,7 @@ void LsColJob::start()
     }
 
     QNetworkRequest req;
-    req.setRawHeader("Depth", "1");
+    req.setRawHeader("Depth", _depth);
     QByteArray xml("<?xml version=\"1.0\" ?>\n"
                    "<d:propfind xmlns:d=\"DAV:\" xmlns:oc=\"http://owncloud.org/ns\">\n"
                    "  <d:prop>\n"
@@ -359,29 +473,48 @@ void LsColJob::start()
     AbstractNetworkJob::start();
 }
 
-// TODO: Instead of doing all in this slot, we should iteratively parse in readyRead(). This
-// would allow us to be more asynchronous in processing while data is coming from the network,
-// not all in one big blob at the end.
-bool LsColJob::finished()
+void LsColJob::newReplyHook(QNetworkReply *reply)
 {
-    qCInfo(lcLsColJob) << "LSCOL of" << reply()->request().url() << "FINISHED WITH STATUS"
-                       << replyStatusString();
+    // Redirects and HTTP2 resends get a new reply
+    _streaming = false;
+    connect(reply, &QNetworkReply::readyRead, this, &LsColJob::slotReadyRead);
+}
 
+bool LsColJob::isMultiStatusReply() const
+{
     QString contentType = reply()->header(QNetworkRequest::ContentTypeHeader).toString();
     int httpCode = reply()->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
-    if (httpCode == 207 && contentType.contains("application/xml; charset=utf-8")) {
-        LsColXMLParser parser;
-        connect(&parser, &LsColXMLParser::directoryListingSubfolders,
-            this, &LsColJob::directoryListingSubfolders);
-        connect(&parser, &LsColXMLParser::directoryListingIterated,
-            this, &LsColJob::directoryListingIterated);
-        connect(&parser, &LsColXMLParser::finishedWithError,
-            this, &LsColJob::finishedWithError);
-        connect(&parser, &LsColXMLParser::finishedWithoutError,
-            this, &LsColJob::finishedWithoutError);
+    return httpCode == 207 && contentType.contains("application/xml; charset=utf-8");
+}
 
+// Parse the listing while it is still downloading, so that neither the whole
+// XML needs to be kept in memory nor the consumers wait for the end of the reply.
+void LsColJob::slotReadyRead()
+{
+    if (!_streaming) {
+        if (!isMultiStatusReply()) {
+            return; // left for finished() to report
+        }
         QString expectedPath = reply()->request().url().path(); // something like "/owncloud/remote.php/webdav/folder"
-        if (!parser.parse(reply()->readAll(), &_folderInfos, expectedPath)) {
+        _parser->start(&_folderInfos, expectedPath);
+        _streaming = true;
+    }
+    // Errors are remembered by the parser and reported in finished()
+    _parser->addData(reply()->readAll());
+}
+
+bool LsColJob::finished()
+{
+    qCInfo(lcLsColJob) << "LSCOL of" << reply()->request().url() << "FINISHED WITH STATUS"
+                       << replyStatusString();
+
+    if (isMultiStatusReply()) {
+        if (!_streaming) {
+            QString expectedPath = reply()->request().url().path(); // something like "/owncloud/remote.php/webdav/folder"
+            _parser->start(&_folderInfos, expectedPath);
+            _streaming = true;
+        }
+        if (!_parser->addData(reply()->readAll()) || !_parser->finish()) {
             // XML parse error
             emit finishedWithError(reply());
         }
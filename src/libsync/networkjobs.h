@@ -19,6 +19,7 @@
 #include "abstractnetworkjob.h"
 
 #include <QBuffer>
+#include <QXmlStreamReader>
 #include <QUrlQuery>
 #include <functional>
 
@@ -85,11 +86,52 @@ public:
                QHash<QString, ExtraFolderInfo> *sizes,
                const QString &expectedPath);
 
+    /**
+     * Incremental parsing: call start(), then addData() whenever data arrives
+     * and finish() once the reply is complete.
+     *
+     * Every response is reported as soon as it was received completely.
+     * addData() and finish() return false on errors.
+     */
+    void start(QHash<QString, ExtraFolderInfo> *sizes, const QString &expectedPath);
+    bool addData(const QByteArray &data);
+    bool finish();
+
 signals:
     void directoryListingSubfolders(const QStringList &items);
     void directoryListingIterated(const QString &name, const QMap<QString, QString> &properties);
     void finishedWithError(QNetworkReply *reply);
     void finishedWithoutError();
+
+    /** The path of the requested directory, as given to start() */
+    QString expectedPath() const { return _expectedPath; }
+
+protected:
+    /** Called by start(): the data of a new reply follows, for example after a resend */
+    virtual void parsingStarted() {}
+    /** Called for every property of a propstat. The default implementation collects them in a map. */
+    virtual void propertyParsed(const QStringRef &name, const QString &value);
+    /** Called at the end of a propstat. Only the properties of successful propstats must be used. */
+    virtual void propstatFinished(bool http200);
+    /** Called at the end of a response. The default implementation emits directoryListingIterated(). */
+    virtual void responseFinished(const QString &href);
+
+private:
+    bool parseAvailable();
+
+    QXmlStreamReader _reader;
+    QByteArray _pending; // Received data that does not end with a complete response yet
+    QHash<QString, ExtraFolderInfo> *_folderInfos = nullptr;
+    QString _expectedPath;
+    QStringList _folders;
+    QString _currentHref;
+    QMap<QString, QString> _currentTmpProperties;
+    QMap<QString, QString> _currentHttp200Properties;
+    bool _currentPropsHaveHttp200 = false;
+    bool _insidePropstat = false;
+    bool _insideProp = false;
+    bool _insideMultiStatus = false;
+    bool _failed = false;
 };
 
 class OWNCLOUDSYNC_EXPORT LsColJob : public AbstractNetworkJob
@@ -112,6 +154,20 @@ public:
     void setProperties(QList<QByteArray> properties);
     QList<QByteArray> properties() const;
 
+    /**
+     * The value of the Depth header, "1" by default.
+     *
+     * Use "infinity" to list the whole subtree, if the server allows it.
+     */
+    void setDepth(const QByteArray &depth) { _depth = depth; }
+
+    /**
+     * Replace the parser, for example by one that converts the properties itself.
+     *
+     * The job takes ownership. Must be called before start().
+     */
+    void setParser(LsColXMLParser *parser);
+
 signals:
     void directoryListingSubfolders(const QStringList &items);
     void directoryListingIterated(const QString &name, const QMap<QString, QString> &properties);
@@ -120,10 +176,19 @@ signals:
 
 private slots:
     bool finished() override;
+    void slotReadyRead();
+
+protected:
+    void newReplyHook(QNetworkReply *reply) override;
 
 private:
+    bool isMultiStatusReply() const;
+
     QList<QByteArray> _properties;
+    QByteArray _depth = "1";
     QUrl _url; // Used instead of path() if the url is specified in the constructor
+    LsColXMLParser *_parser = nullptr;
+    bool _streaming = false; // The parser was started on the data of the current reply
 };
 
 /**
@@ -18,6 +18,7 @@
 #include "common/syncjournalfilerecord.h"
 #include "propagatedownload.h"
 #include "propagateupload.h"
+#include "propagateuploadbulk.h"
 #include "propagateremotedelete.h"
 #include "propagateremotemove.h"
 #include "propagateremotemkdir.h"
@@ -25,6 +26,7 @@
 #include "filesystem.h"
 #include "common/utility.h"
 #include "account.h"
+#include "clientsideencryption.h"
 #include "common/asserts.h"
 
 #ifdef Q_OS_WIN
@@ -41,6 +43,8 @@
 #include <QTimerEvent>
 #include <qmath.h>
 
+#include <algorithm>
+
 namespace OCC {
 
 Q_LOGGING_CATEGORY(lcPropagator, "nextcloud.sync.propagator", QtInfoMsg)
@@ -73,7 +77,45 @@ qint64 freeSpaceLimit()
     return value;
 }
 
-OwncloudPropagator::~OwncloudPropagator() = default;
+// The propagators of all folders that sync at the same time, on the main thread
+static int runningPropagators = 0;
+
+OwncloudPropagator::OwncloudPropagator(AccountPtr account, const QString &localDir,
+    const QString &remoteFolder, SyncJournalDb *progressDb)
+    : _localDir((localDir.endsWith(QChar('/'))) ? localDir : localDir + '/')
+    , _remoteFolder((remoteFolder.endsWith(QChar('/'))) ? remoteFolder : remoteFolder + '/')
+    , _journal(progressDb)
+    , _finishedEmited(false)
+    , _bandwidthManager(this)
+    , _anotherSyncNeeded(false)
+    , _chunkSize(10 * 1000 * 1000) // 10 MB, overridden in setSyncOptions
+    , _account(account)
+{
+    qRegisterMetaType<PropagatorJob::AbortType>("PropagatorJob::AbortType");
+    ++_account->_activePropagationCount;
+    ++runningPropagators;
+}
+
+OwncloudPropagator::~OwncloudPropagator()
+{
+    --_account->_activePropagationCount;
+    --runningPropagators;
+}
+
+static int shareLimit(int limit)
+{
+    return limit > 0 ? qMax(1, limit / qMax(1, runningPropagators)) : limit;
+}
+
+int OwncloudPropagator::effectiveDownloadLimit() const
+{
+    return shareLimit(_downloadLimit.load());
+}
+
+int OwncloudPropagator::effectiveUploadLimit() const
+{
+    return shareLimit(_uploadLimit.load());
+}
 
 
 int OwncloudPropagator::maximumActiveTransferJob()
@@ -93,11 +135,167 @@ int OwncloudPropagator::hardMaximumActiveJob()
     if (!_syncOptions._parallelNetworkJobs)
         return 1;
     static int max = qgetenv("OWNCLOUD_MAX_PARALLEL").toUInt();
-    if (max)
-        return max;
-    if (_account->isHttp2Supported())
-        return 20;
-    return 6; // (Qt cannot do more anyway)
+    int accountMax = max;
+    if (!accountMax)
+        accountMax = _account->isHttp2Supported() ? 20 : 6; // (Qt cannot do more anyway)
+
+    // Folders of the same account syncing at the same time split its connections
+    return qMax(1, accountMax / qMax(1, _account->activePropagationCount()));
+}
+
+int OwncloudPropagator::maximumActiveJob()
+{
+    const int hardMaximum = hardMaximumActiveJob();
+    // With a bandwidth limit, one transfer and one quick job beside it
+    return maximumActiveTransferJob() == 1 ? qMin(2, hardMaximum) : hardMaximum;
+}
+
+PropagatorJob::JobLane OwncloudPropagator::laneForItem(const SyncFileItem &item)
+{
+    switch (item._instruction) {
+    case CSYNC_INSTRUCTION_NEW:
+    case CSYNC_INSTRUCTION_SYNC:
+    case CSYNC_INSTRUCTION_CONFLICT:
+    case CSYNC_INSTRUCTION_TYPE_CHANGE:
+        if (!item.isDirectory()) {
+            return item._size < smallFileSize() ? PropagatorJob::SmallFileLane : PropagatorJob::LargeFileLane;
+        }
+        break;
+    default:
+        break;
+    }
+    return PropagatorJob::MetadataLane;
+}
+
+int OwncloudPropagator::smallFileLaneSlots()
+{
+    const int maximum = maximumActiveJob();
+    if (_averageRoundTripMsecs <= 0 || _averageSmallFileSize <= 0 || _averageThroughput <= 0) {
+        return maximum;
+    }
+    // While one small file is on the wire the others wait for their round trip,
+    // this many in flight keep the connection busy (Little's law)
+    const int slots = 1 + qCeil(_averageRoundTripMsecs * _averageThroughput / _averageSmallFileSize);
+    return qBound(qMin(maximumActiveTransferJob(), maximum), slots, maximum);
+}
+
+bool OwncloudPropagator::laneHasCapacity(PropagatorJob::JobLane lane)
+{
+    if (lane == PropagatorJob::NoLane) {
+        return true;
+    }
+    const int maximum = maximumActiveJob();
+    if (lane == PropagatorJob::MetadataLane) {
+        // One more, so that the directories of a deep tree are created level
+        // after level while the transfers keep all other slots busy
+        return _activeJobList.count() < maximum + (_syncOptions._parallelNetworkJobs ? 1 : 0);
+    }
+    if (_activeJobList.count() >= maximum) {
+        return false;
+    }
+
+    int active = 0;
+    for (auto job : qAsConst(_activeJobList)) {
+        if (job->lane() == lane) {
+            ++active;
+        }
+    }
+    switch (lane) {
+    case PropagatorJob::LargeFileLane:
+        // Leave a slot to the small and metadata jobs
+        return active < (maximum > 1 ? qMin(maximumActiveTransferJob(), maximum - 1) : 1);
+    case PropagatorJob::SmallFileLane:
+        return active < smallFileLaneSlots();
+    default:
+        return true;
+    }
+}
+
+/* Calls f with path and each of its parent directories */
+template <typename F>
+static void forEachParentPath(const QString &path, F f)
+{
+    for (int slash = path.indexOf(QLatin1Char('/')); slash > 0; slash = path.indexOf(QLatin1Char('/'), slash + 1)) {
+        f(path.left(slash));
+    }
+    f(path);
+}
+
+bool OwncloudPropagator::waitsForRename(const SyncFileItem &item) const
+{
+    if (_pendingRenames.isEmpty()) {
+        return false;
+    }
+    for (auto it = _renameDependencies.constFind(&item);
+         it != _renameDependencies.constEnd() && it.key() == &item; ++it) {
+        if (_pendingRenames.contains(it.value())) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void OwncloudPropagator::renameFinished(const SyncFileItem &item)
+{
+    _pendingRenames.remove(&item);
+}
+
+void OwncloudPropagator::renamesAbandoned(const SyncFileItem &directory)
+{
+    const QString prefix = directory.destination() + QLatin1Char('/');
+    for (auto it = _pendingRenames.begin(); it != _pendingRenames.end();) {
+        if ((*it)->destination().startsWith(prefix)) {
+            qCInfo(lcPropagator) << "Rename of" << (*it)->_file << "abandoned with" << directory._file;
+            it = _pendingRenames.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void OwncloudPropagator::recordJobTiming(PropagatorJob::JobLane lane, qint64 bytes, qint64 msecs)
+{
+    // Exponential moving averages, so that they follow changing network conditions
+    static const double weight = 0.2;
+    auto update = [](double &average, double sample) {
+        average = average > 0 ? (1 - weight) * average + weight * sample : sample;
+    };
+
+    msecs = qMax<qint64>(msecs, 1);
+    switch (lane) {
+    case PropagatorJob::MetadataLane:
+        update(_averageRoundTripMsecs, msecs);
+        break;
+    case PropagatorJob::SmallFileLane:
+        // Dominated by the round trip, too
+        update(_averageRoundTripMsecs, msecs);
+        if (bytes > 0) {
+            update(_averageSmallFileSize, bytes);
+        }
+        break;
+    case PropagatorJob::LargeFileLane:
+        update(_averageThroughput, double(bytes) / msecs);
+        break;
+    case PropagatorJob::NoLane:
+        return;
+    }
+    qCDebug(lcPropagator) << "Round trip" << _averageRoundTripMsecs << "ms, throughput" << _averageThroughput
+                          << "bytes/ms, small file lane slots" << smallFileLaneSlots();
+}
+
+bool OwncloudPropagator::isRecentlyTouched(const SyncFileItem &item)
+{
+    static const qint64 recentSecs = 10 * 60;
+    if (laneForItem(item) == PropagatorJob::MetadataLane) {
+        return false;
+    }
+    const qint64 now = Utility::qDateTimeToTime_t(QDateTime::currentDateTimeUtc());
+    return now - item._modtime < recentSecs;
+}
+
+PropagatorJob::JobLane PropagateItemJob::lane() const
+{
+    return propagator()->laneForItem(*_item);
 }
 
 PropagateItemJob::~PropagateItemJob()
@@ -219,47 +417,47 @@ static void blacklistUpdate(SyncJournalDb *journal, SyncFileItem &item)
     }
 }
 
-void PropagateItemJob::done(SyncFileItem::Status statusArg, const QString &errorString)
+void PropagateItemJob::completeItem(OwncloudPropagator *propagator, const SyncFileItemPtr &item,
+    SyncFileItem::Status statusArg, const QString &errorString, const QObject *by)
 {
-    _item->_status = statusArg;
+    item->_status = statusArg;
 
-    _state = Finished;
-    if (_item->_isRestoration) {
-        if (_item->_status == SyncFileItem::Success
-            || _item->_status == SyncFileItem::Conflict) {
-            _item->_status = SyncFileItem::Restoration;
+    if (item->_isRestoration) {
+        if (item->_status == SyncFileItem::Success
+            || item->_status == SyncFileItem::Conflict) {
+            item->_status = SyncFileItem::Restoration;
         } else {
-            _item->_errorString += tr("; Restoration Failed: %1").arg(errorString);
+            item->_errorString += tr("; Restoration Failed: %1").arg(errorString);
         }
     } else {
-        if (_item->_errorString.isEmpty()) {
-            _item->_errorString = errorString;
+        if (item->_errorString.isEmpty()) {
+            item->_errorString = errorString;
         }
     }
 
-    if (propagator()->_abortRequested.fetchAndAddRelaxed(0) && (_item->_status == SyncFileItem::NormalError
-                                                                   || _item->_status == SyncFileItem::FatalError)) {
+    if (propagator->_abortRequested.fetchAndAddRelaxed(0) && (item->_status == SyncFileItem::NormalError
+                                                                 || item->_status == SyncFileItem::FatalError)) {
         // an abort request is ongoing. Change the status to Soft-Error
-        _item->_status = SyncFileItem::SoftError;
+        item->_status = SyncFileItem::SoftError;
     }
 
     // Blacklist handling
-    switch (_item->_status) {
+    switch (item->_status) {
     case SyncFileItem::SoftError:
     case SyncFileItem::FatalError:
     case SyncFileItem::NormalError:
     case SyncFileItem::DetailError:
         // Check the blacklist, possibly adjusting the item (including its status)
-        blacklistUpdate(propagator()->_journal, *_item);
+        blacklistUpdate(propagator->_journal, *item);
         break;
     case SyncFileItem::Success:
     case SyncFileItem::Restoration:
-        if (_item->_hasBlacklistEntry) {
+        if (item->_hasBlacklistEntry) {
             // wipe blacklist entry.
-            propagator()->_journal->wipeErrorBlacklistEntry(_item->_file);
+            propagator->_journal->wipeErrorBlacklistEntry(item->_file);
             // remove a blacklist entry in case the file was moved.
-            if (_item->_originalFile != _item->_file) {
-                propagator()->_journal->wipeErrorBlacklistEntry(_item->_originalFile);
+            if (item->_originalFile != item->_file) {
+                propagator->_journal->wipeErrorBlacklistEntry(item->_originalFile);
             }
         }
         break;
@@ -272,11 +470,27 @@ void PropagateItemJob::done(SyncFileItem::Status statusArg, const QString &error
         break;
     }
 
-    if (_item->hasErrorStatus())
-        qCWarning(lcPropagator) << "Could not complete propagation of" << _item->destination() << "by" << this << "with status" << _item->_status << "and error:" << _item->_errorString;
+    if (item->hasErrorStatus())
+        qCWarning(lcPropagator) << "Could not complete propagation of" << item->destination() << "by" << by << "with status" << item->_status << "and error:" << item->_errorString;
     else
-        qCInfo(lcPropagator) << "Completed propagation of" << _item->destination() << "by" << this << "with status" << _item->_status;
-    emit propagator()->itemCompleted(_item);
+        qCInfo(lcPropagator) << "Completed propagation of" << item->destination() << "by" << by << "with status" << item->_status;
+    emit propagator->itemCompleted(item);
+}
+
+void PropagateItemJob::done(SyncFileItem::Status statusArg, const QString &errorString)
+{
+    _state = Finished;
+    if (_item->_instruction == CSYNC_INSTRUCTION_RENAME) {
+        propagator()->renameFinished(*_item);
+    }
+    if (statusArg == SyncFileItem::Success && _runTimer.isValid()) {
+        // Local operations tell nothing about the network
+        const auto jobLane = lane();
+        if (jobLane != MetadataLane || _item->_direction == SyncFileItem::Up) {
+            propagator()->recordJobTiming(jobLane, _item->_size, _runTimer.elapsed());
+        }
+    }
+    completeItem(propagator(), _item, statusArg, errorString, this);
     emit finished(_item->_status);
 
     if (_item->_status == SyncFileItem::FatalError) {
@@ -364,6 +578,44 @@ quint64 OwncloudPropagator::smallFileSize()
     return smallFileSize;
 }
 
+bool OwncloudPropagator::isBulkUploadCandidate(const SyncFileItem &item)
+{
+    if (_bulkUploadFailed || !account()->capabilities().bulkUpload())
+        return false;
+
+    // Only new files: the request has no If-Match and no OC-Conflict headers per file
+    if (item._direction != SyncFileItem::Up
+        || item._instruction != CSYNC_INSTRUCTION_NEW
+        || item.isDirectory()
+        || item._size >= smallFileSize()
+        || item._file.contains(".sys.admin#recall#")) {
+        return false;
+    }
+
+    // The bandwidth limit is enforced per upload device
+    if (_uploadLimit.fetchAndAddAcquire(0) != 0)
+        return false;
+
+    // The rest does not change during the sync but costs lookups and a query
+    auto cached = _bulkUploadCandidates.constFind(&item);
+    if (cached != _bulkUploadCandidates.constEnd())
+        return cached.value();
+
+    bool candidate = true;
+    if (account()->capabilities().clientSideEncryptionAvailable()) {
+        const QString rootPath = _remoteFolder.startsWith('/') ? _remoteFolder.mid(1) : _remoteFolder;
+        const auto slashPosition = item._file.lastIndexOf('/');
+        const QString parentPath = slashPosition >= 0 ? QString(rootPath + item._file.left(slashPosition) + '/') : rootPath;
+        if (account()->e2e()->isFolderEncrypted(parentPath) || account()->e2e()->isAnyParentFolderEncrypted(parentPath))
+            candidate = false;
+    }
+    if (candidate)
+        candidate = !_journal->conflictRecord(item._file.toUtf8()).isValid();
+
+    _bulkUploadCandidates.insert(&item, candidate);
+    return candidate;
+}
+
 void OwncloudPropagator::start(const SyncFileItemVector &items,
                                 const bool &hasChange,
                                 const int &lastChangeInstruction,
@@ -397,6 +649,12 @@ void OwncloudPropagator::start(const SyncFileItemVector &items,
     QStack<QPair<QString /* directory name */, PropagateDirectory * /* job */>> directories;
     directories.push(qMakePair(QString(), _rootJob.data()));
     QVector<PropagatorJob *> directoriesToRemove;
+    QVector<PropagateDirectory *> directoryJobs{ _rootJob.data() };
+    // The sources and targets of the directory renames so far, by path
+    QMultiHash<QString, const SyncFileItem *> directoryRenames;
+    SyncFileItemVector renames;
+    // The directories that are deleted or replaced by a file, by path
+    QHash<QString, const SyncFileItem *> removedDirectories;
     QString removedDirectory;
     QString maybeConflictDirectory;
     foreach (const SyncFileItemPtr &item, items) {
@@ -422,7 +680,7 @@ void OwncloudPropagator::start(const SyncFileItemVector &items,
             } else if (item->_instruction == CSYNC_INSTRUCTION_IGNORE) {
                 continue;
             } else if (item->_instruction == CSYNC_INSTRUCTION_RENAME) {
-                // all is good, the rename will be executed before the directory deletion
+                // all is good, the directory deletion waits for the rename, see below
             } else {
                 qCWarning(lcPropagator) << "WARNING:  Job within a removed directory?  This should not happen!"
                                         << item->_file << item->_instruction;
@@ -443,12 +701,39 @@ void OwncloudPropagator::start(const SyncFileItemVector &items,
             }
         }
 
+        // Only what is below a renamed directory depends on the rename, and only
+        // when it comes after it, so that the dependencies never form a cycle
+        if (!directoryRenames.isEmpty()) {
+            auto dependOnRenamesOf = [&](const QString &path) {
+                forEachParentPath(path, [&](const QString &parent) {
+                    for (auto it = directoryRenames.constFind(parent); it != directoryRenames.constEnd() && it.key() == parent; ++it) {
+                        if (!_renameDependencies.contains(item.data(), it.value())) {
+                            _renameDependencies.insert(item.data(), it.value());
+                        }
+                    }
+                });
+            };
+            dependOnRenamesOf(item->_file);
+            if (item->destination() != item->_file) {
+                dependOnRenamesOf(item->destination());
+            }
+        }
+        if (item->_instruction == CSYNC_INSTRUCTION_RENAME) {
+            renames.append(item);
+        }
+
         while (!item->destination().startsWith(directories.top().first)) {
             directories.pop();
         }
 
         if (item->isDirectory()) {
             auto *dir = new PropagateDirectory(this, item);
+            directoryJobs.append(dir);
+            if (item->_instruction == CSYNC_INSTRUCTION_RENAME) {
+                directoryRenames.insert(item->_file, item.data());
+                directoryRenames.insert(item->_renameTarget, item.data());
+                _pendingRenames.insert(item.data());
+            }
 
             if (item->_instruction == CSYNC_INSTRUCTION_TYPE_CHANGE
                 && item->_direction == SyncFileItem::Up) {
@@ -469,6 +754,7 @@ void OwncloudPropagator::start(const SyncFileItemVector &items,
                 // We do the removal of directories at the end, because there might be moves from
                 // these directories that will happen later.
                 directoriesToRemove.prepend(dir);
+                removedDirectories.insert(item->_file, item.data());
                 removedDirectory = item->_file + "/";
 
                 // We should not update the etag of parent directories of the removed directory
@@ -488,6 +774,7 @@ void OwncloudPropagator::start(const SyncFileItemVector &items,
             if (item->_instruction == CSYNC_INSTRUCTION_TYPE_CHANGE) {
                 // will delete directories, so defer execution
                 directoriesToRemove.prepend(createJob(item));
+                removedDirectories.insert(item->_file, item.data());
                 removedDirectory = item->_file + "/";
             } else {
                 directories.top().second->appendTask(item);
@@ -501,10 +788,29 @@ void OwncloudPropagator::start(const SyncFileItemVector &items,
         }
     }
 
+    // A directory is removed only once what is moved out of it is gone
+    if (!removedDirectories.isEmpty()) {
+        for (const auto &rename : qAsConst(renames)) {
+            forEachParentPath(rename->_file, [&](const QString &parent) {
+                if (auto removed = removedDirectories.value(parent)) {
+                    if (removed != rename.data()) {
+                        _renameDependencies.insert(removed, rename.data());
+                        _pendingRenames.insert(rename.data());
+                    }
+                }
+            });
+        }
+    }
+
     foreach (PropagatorJob *it, directoriesToRemove) {
         _rootJob->appendJob(it);
     }
 
+    // Propagate what the user is working on first
+    for (auto dir : qAsConst(directoryJobs)) {
+        dir->_subJobs.prioritizeRecentlyTouched();
+    }
+
     connect(_rootJob.data(), &PropagatorJob::finished, this, &OwncloudPropagator::emitFinished);
 
     scheduleNextJob();
@@ -612,32 +918,13 @@ void OwncloudPropagator::scheduleNextJob()
 
 void OwncloudPropagator::scheduleNextJobImpl()
 {
-    // TODO: If we see that the automatic up-scaling has a bad impact we
-    // need to check how to avoid this.
-    // Down-scaling on slow networks? https://github.com/owncloud/client/issues/3382
-    // Making sure we do up/down at same time? https://github.com/owncloud/client/issues/1633
-
-    if (_activeJobList.count() < maximumActiveTransferJob()) {
+    // The composite jobs only start jobs of lanes that have a free slot,
+    // see laneHasCapacity(). Here we only stop once all of them are in use,
+    // the metadata lane has the most.
+    if (laneHasCapacity(PropagatorJob::MetadataLane)) {
         if (_rootJob->scheduleSelfOrChild()) {
             scheduleNextJob();
         }
-    } else if (_activeJobList.count() < hardMaximumActiveJob()) {
-        int likelyFinishedQuicklyCount = 0;
-        // NOTE: Only counts the first 3 jobs! Then for each
-        // one that is likely finished quickly, we can launch another one.
-        // When a job finishes another one will "move up" to be one of the first 3 and then
-        // be counted too.
-        for (int i = 0; i < maximumActiveTransferJob() && i < _activeJobList.count(); i++) {
-            if (_activeJobList.at(i)->isLikelyFinishedQuickly()) {
-                likelyFinishedQuicklyCount++;
-            }
-        }
-        if (_activeJobList.count() < maximumActiveTransferJob() + likelyFinishedQuicklyCount) {
-            qCDebug(lcPropagator) << "Can pump in another request! activeJobs =" << _activeJobList.count();
-            if (_rootJob->scheduleSelfOrChild()) {
-                scheduleNextJob();
-            }
-        }
     }
 }
 
@@ -753,17 +1040,6 @@ OwncloudPropagator *PropagatorJob::propagator() const
 
 // ================================================================================
 
-PropagatorJob::JobParallelism PropagatorCompositeJob::parallelism()
-{
-    // If any of the running sub jobs is not parallel, we have to wait
-    for (int i = 0; i < _runningJobs.count(); ++i) {
-        if (_runningJobs.at(i)->parallelism() != FullParallelism) {
-            return _runningJobs.at(i)->parallelism();
-        }
-    }
-    return FullParallelism;
-}
-
 void PropagatorCompositeJob::slotSubJobAbortFinished()
 {
     // Count that job has been finished
@@ -793,6 +1069,9 @@ bool PropagatorCompositeJob::scheduleSelfOrChild()
     }
 
     // Ask all the running composite jobs if they have something new to schedule.
+    // They are independent of each other: a directory only waits for its own
+    // first job, and for the directory renames it depends on.
+    bool waitForFinished = false;
     for (auto runningJob : qAsConst(_runningJobs)) {
         ASSERT(runningJob->_state == Running);
 
@@ -800,20 +1079,28 @@ bool PropagatorCompositeJob::scheduleSelfOrChild()
             return true;
         }
 
-        // If any of the running sub jobs is not parallel, we have to cancel the scheduling
-        // of the rest of the list and wait for the blocking job to finish and schedule the next one.
-        auto paral = runningJob->parallelism();
-        if (paral == WaitForFinished) {
-            return false;
+        // If any of the running sub jobs is not parallel, we have to wait for it to
+        // finish before we start anything else in this directory.
+        if (runningJob->parallelism() == WaitForFinished) {
+            waitForFinished = true;
         }
     }
+    if (waitForFinished) {
+        return false;
+    }
 
     // Now it's our turn, check if we have something left to do.
     // First, convert a task to a job if necessary
     while (_jobsToDo.isEmpty() && !_tasksToDo.isEmpty()) {
-        SyncFileItemPtr nextTask = _tasksToDo.first();
-        _tasksToDo.remove(0);
-        PropagatorJob *job = propagator()->createJob(nextTask);
+        const int index = nextTaskIndex();
+        if (index < 0) {
+            return false;
+        }
+        SyncFileItemPtr nextTask = _tasksToDo.at(index);
+        _tasksToDo.remove(index);
+        PropagatorJob *job = propagator()->isBulkUploadCandidate(*nextTask)
+            ? createBulkUploadJob(nextTask)
+            : propagator()->createJob(nextTask);
         if (!job) {
             qCWarning(lcDirectory) << "Useless task found for file" << nextTask->destination() << "instruction" << nextTask->_instruction;
             continue;
@@ -824,9 +1111,19 @@ bool PropagatorCompositeJob::scheduleSelfOrChild()
     // Then run the next job
     if (!_jobsToDo.isEmpty()) {
         PropagatorJob *nextJob = _jobsToDo.first();
+        if (!propagator()->laneHasCapacity(nextJob->lane())) {
+            return false;
+        }
+        // Directories check this themselves before their first job
+        auto itemJob = qobject_cast<PropagateItemJob *>(nextJob);
+        if (itemJob && propagator()->waitsForRename(*itemJob->_item)) {
+            return false;
+        }
         _jobsToDo.remove(0);
         _runningJobs.append(nextJob);
-        return possiblyRunNextJob(nextJob);
+        // A directory counts as started even if all its jobs wait for a slot,
+        // so that the propagator goes on with the next one
+        return possiblyRunNextJob(nextJob) || nextJob->lane() == NoLane;
     }
 
     // If neither us or our children had stuff left to do we could hang. Make sure
@@ -839,6 +1136,78 @@ bool PropagatorCompositeJob::scheduleSelfOrChild()
     return false;
 }
 
+// How far the scheduling looks past the first task of a directory.
+// Only look a bit ahead, directories can have many thousand files.
+static const int taskLookahead = 64;
+
+int PropagatorCompositeJob::nextTaskIndex()
+{
+    // Tasks of a full lane wait and later ones of another lane may pass them.
+
+    auto propagator = this->propagator();
+    const bool hasCapacity[] = {
+        true,
+        propagator->laneHasCapacity(MetadataLane),
+        propagator->laneHasCapacity(SmallFileLane),
+        propagator->laneHasCapacity(LargeFileLane),
+    };
+    for (int i = 0; i < _tasksToDo.size() && i < taskLookahead; ++i) {
+        const auto &task = *_tasksToDo.at(i);
+        if (hasCapacity[propagator->laneForItem(task)] && !propagator->waitsForRename(task)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void PropagatorCompositeJob::prioritizeRecentlyTouched()
+{
+    auto propagator = this->propagator();
+    auto isMetadata = [propagator](const SyncFileItemPtr &item) {
+        return propagator->laneForItem(*item) == MetadataLane;
+    };
+    auto isRecent = [propagator](const SyncFileItemPtr &item) {
+        return propagator->isRecentlyTouched(*item);
+    };
+
+    // Reorder each run of transfers between metadata tasks
+    auto runBegin = _tasksToDo.begin();
+    while (runBegin != _tasksToDo.end()) {
+        auto runEnd = std::find_if(runBegin, _tasksToDo.end(), isMetadata);
+        std::stable_partition(runBegin, runEnd, isRecent);
+        runBegin = runEnd == _tasksToDo.end() ? runEnd : runEnd + 1;
+    }
+}
+
+PropagatorJob *PropagatorCompositeJob::createBulkUploadJob(const SyncFileItemPtr &first)
+{
+    // Bound a request like a chunk of a large file
+    static const int maximumFiles = 100;
+    const quint64 maximumSize = propagator()->syncOptions()._initialChunkSize;
+
+    // Don't rescan a long list of tasks for every request, see nextTaskIndex()
+    const int scanEnd = qMin(_tasksToDo.size(), maximumFiles + taskLookahead);
+
+    QVector<SyncFileItemPtr> items{ first };
+    quint64 size = first->_size;
+    int kept = 0;
+    for (int i = 0; i < scanEnd; ++i) {
+        auto &item = _tasksToDo[i];
+        if (items.size() < maximumFiles && size + item->_size <= maximumSize
+            && propagator()->isBulkUploadCandidate(*item)) {
+            size += item->_size;
+            items.append(item);
+        } else {
+            _tasksToDo[kept++] = std::move(item);
+        }
+    }
+    _tasksToDo.erase(_tasksToDo.begin() + kept, _tasksToDo.begin() + scanEnd);
+
+    if (items.size() == 1)
+        return propagator()->createJob(first);
+    return new PropagateUploadBulk(propagator(), items);
+}
+
 void PropagatorCompositeJob::slotSubJobFinished(SyncFileItem::Status status)
 {
     auto *subJob = static_cast<PropagatorJob *>(sender());
@@ -904,13 +1273,11 @@ PropagateDirectory::PropagateDirectory(OwncloudPropagator *propagator, const Syn
 
 PropagatorJob::JobParallelism PropagateDirectory::parallelism()
 {
-    // If any of the non-finished sub jobs is not parallel, we have to wait
+    // Only our own first job can hold up the other jobs of the parent directory,
+    // the jobs below us wait for each other within our _subJobs
     if (_firstJob && _firstJob->parallelism() != FullParallelism) {
         return WaitForFinished;
     }
-    if (_subJobs.parallelism() != FullParallelism) {
-        return WaitForFinished;
-    }
     return FullParallelism;
 }
 
@@ -926,11 +1293,16 @@ bool PropagateDirectory::scheduleSelfOrChild()
     }
 
     if (_firstJob && _firstJob->_state == NotYetStarted) {
+        if (!propagator()->laneHasCapacity(_firstJob->lane())
+            || propagator()->waitsForRename(*_item)) {
+            return false;
+        }
         return _firstJob->scheduleSelfOrChild();
     }
 
     if (_firstJob && _firstJob->_state == Running) {
-        // Don't schedule any more job until this is done.
+        // Everything below needs the directory to be created or moved first.
+        // The other directories go on meanwhile.
         return false;
     }
 
@@ -940,11 +1312,14 @@ bool PropagateDirectory::scheduleSelfOrChild()
 void PropagateDirectory::slotFirstJobFinished(SyncFileItem::Status status)
 {
     _firstJob.take()->deleteLater();
+    propagator()->renameFinished(*_item);
 
     if (status != SyncFileItem::Success
         && status != SyncFileItem::Restoration
         && status != SyncFileItem::Conflict) {
         if (_state != Finished) {
+            // The renames below will not run, let what waits for them go on
+            propagator()->renamesAbandoned(*_item);
             // Synchronously abort
             abort(AbortType::Synchronous);
             _state = Finished;
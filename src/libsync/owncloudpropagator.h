@@ -16,6 +16,7 @@
 #define OWNCLOUDPROPAGATOR_H
 
 #include <QHash>
+#include <QSet>
 #include <QObject>
 #include <QMap>
 #include <QElapsedTimer>
@@ -82,9 +83,10 @@ public:
         /** Jobs can be run in parallel to this job */
         FullParallelism,
 
-        /** No other job shall be started until this one has finished.
-            So this job is guaranteed to finish before any jobs below it
-            are executed. */
+        /** No other job of the same directory shall be started until this
+            one has finished. So this job is guaranteed to finish before any
+            jobs below it in that directory are executed. Other directories
+            don't wait for it. */
         WaitForFinished,
     };
 
@@ -92,9 +94,30 @@ public:
 
     /**
      * For "small" jobs
+     *
+     * The scheduler doesn't look at it, the lanes do that now. Downloads use it
+     * to warn about an unexpectedly slow connection.
      */
     virtual bool isLikelyFinishedQuickly() { return false; }
 
+    /** The lanes the propagator hands out its connections by
+     *
+     * Each lane has its own number of slots, see OwncloudPropagator::laneHasCapacity(),
+     * so that a few large transfers don't hold up many small ones.
+     */
+    enum JobLane {
+        /** Does not use a connection itself, like a composite job */
+        NoLane,
+        /** Creating, moving and removing things */
+        MetadataLane,
+        /** Transfers of files below OwncloudPropagator::smallFileSize() */
+        SmallFileLane,
+        /** All other transfers */
+        LargeFileLane
+    };
+
+    virtual JobLane lane() const { return NoLane; }
+
     /** The space that the running jobs need to complete but don't actually use yet.
      *
      * Note that this does *not* include the disk space that's already
@@ -174,6 +197,11 @@ protected:
 protected slots:
     void slotRestoreJobFinished(SyncFileItem::Status status);
 
+protected:
+    // Started with the job, tells the propagator how long the item took.
+    // Invalidated by jobs that did not use the network after all.
+    QElapsedTimer _runTimer;
+
 private:
     QScopedPointer<PropagateItemJob> _restoreJob;
 
@@ -194,12 +222,24 @@ public:
         qCInfo(lcPropagator) << "Starting" << instruction_str << "propagation of" << _item->_file << "by" << this;
 
         _state = Running;
+        _runTimer.start();
         QMetaObject::invokeMethod(this, "start"); // We could be in a different thread (neon jobs)
         return true;
     }
 
+    JobLane lane() const override;
+
     SyncFileItemPtr _item;
 
+    /** Records the outcome of the propagation of an item
+     *
+     * Adjusts the status, updates the blacklist and emits
+     * OwncloudPropagator::itemCompleted. done() uses it for _item, jobs that
+     * propagate several items at once use it for each of them.
+     */
+    static void completeItem(OwncloudPropagator *propagator, const SyncFileItemPtr &item,
+        SyncFileItem::Status status, const QString &errorString, const QObject *by);
+
 public slots:
     virtual void start() = 0;
 };
@@ -235,8 +275,14 @@ public:
         _tasksToDo.append(item);
     }
 
+    /** Moves the tasks of recently touched files ahead of the other transfers
+     *
+     * A transfer never moves ahead of a metadata task, which may be what
+     * makes room for it.
+     */
+    void prioritizeRecentlyTouched();
+
     bool scheduleSelfOrChild() override;
-    JobParallelism parallelism() override;
 
     /*
      * Abort synchronously or asynchronously - some jobs
@@ -273,6 +319,15 @@ private slots:
 
     void slotSubJobFinished(SyncFileItem::Status status);
     void finalize();
+
+private:
+    /** The index of the next task in _tasksToDo whose lane has a free slot, or -1 */
+    int nextTaskIndex();
+
+    /** Creates a job uploading the first task together with the other tasks
+     * that can be part of the same bulk upload, taking them out of _tasksToDo.
+     */
+    PropagatorJob *createBulkUploadJob(const SyncFileItemPtr &first);
 };
 
 /**
@@ -354,7 +409,7 @@ public:
     }
 };
 
-class OwncloudPropagator : public QObject
+class OWNCLOUDSYNC_EXPORT OwncloudPropagator : public QObject
 {
     Q_OBJECT
 public:
@@ -366,18 +421,7 @@ public:
 
 public:
     OwncloudPropagator(AccountPtr account, const QString &localDir,
-        const QString &remoteFolder, SyncJournalDb *progressDb)
-        : _localDir((localDir.endsWith(QChar('/'))) ? localDir : localDir + '/')
-        , _remoteFolder((remoteFolder.endsWith(QChar('/'))) ? remoteFolder : remoteFolder + '/')
-        , _journal(progressDb)
-        , _finishedEmited(false)
-        , _bandwidthManager(this)
-        , _anotherSyncNeeded(false)
-        , _chunkSize(10 * 1000 * 1000) // 10 MB, overridden in setSyncOptions
-        , _account(account)
-    {
-        qRegisterMetaType<PropagatorJob::AbortType>("PropagatorJob::AbortType");
-    }
+        const QString &remoteFolder, SyncJournalDb *progressDb);
 
     ~OwncloudPropagator();
 
@@ -394,6 +438,15 @@ public:
     QAtomicInt _uploadLimit;
     BandwidthManager _bandwidthManager;
 
+    /** The limits for the BandwidthManager
+     *
+     * An absolute limit (positive) is configured for all syncs together, the
+     * syncs running at the same time share it. A relative limit (negative,
+     * in percent) applies to each of them as it is.
+     */
+    int effectiveDownloadLimit() const;
+    int effectiveUploadLimit() const;
+
     QAtomicInt _abortRequested; // boolean set by the main thread to abort.
 
     /** The list of currently active jobs.
@@ -402,7 +455,7 @@ public:
         Jobs add themself to the list when they do an assynchronous operation.
         Jobs can be several time on the list (example, when several chunks are uploaded in parallel)
      */
-    QList<PropagateItemJob *> _activeJobList;
+    QList<PropagatorJob *> _activeJobList;
 
     /** We detected that another sync is required after this one */
     bool _anotherSyncNeeded;
@@ -432,9 +485,67 @@ public:
     quint64 _chunkSize;
     quint64 smallFileSize();
 
+    /** Whether the item may be uploaded together with others in a
+     * PropagateUploadBulk job rather than with a PUT of its own.
+     */
+    bool isBulkUploadCandidate(const SyncFileItem &item);
+
+    /** Set when the server rejected a bulk upload request as a whole.
+     *
+     * The remaining small files of this sync are then uploaded one by one.
+     */
+    bool _bulkUploadFailed = false;
+
+    /// What isBulkUploadCandidate() found out about an item beyond the settings
+    QHash<const SyncFileItem *, bool> _bulkUploadCandidates;
+
     /* The maximum number of active jobs in parallel  */
     int hardMaximumActiveJob();
 
+    /* The number of active jobs the lanes share, see laneHasCapacity() */
+    int maximumActiveJob();
+
+    /** The lane of the job propagating the item */
+    PropagatorJob::JobLane laneForItem(const SyncFileItem &item);
+
+    /** Whether a job of the lane may be started now
+     *
+     * All lanes together run at most maximumActiveJob() jobs. Large transfers
+     * get at most maximumActiveTransferJob() of them and leave at least one to
+     * the others. Small transfers get as many as keep the connection busy for
+     * the observed round trip time and throughput, see recordJobTiming().
+     */
+    bool laneHasCapacity(PropagatorJob::JobLane lane);
+
+    /** Records how long a network operation of the lane took, for laneHasCapacity() */
+    void recordJobTiming(PropagatorJob::JobLane lane, qint64 bytes, qint64 msecs);
+
+    /** Whether the job for the item has to wait for a rename
+     *
+     * The paths of the items are those after the renames, so anything that
+     * comes after a directory rename under its new or old name can only be
+     * propagated once the rename is done. The removal of a directory waits
+     * for the renames that move something out of it. Everything else is
+     * independent of them.
+     */
+    bool waitsForRename(const SyncFileItem &item) const;
+
+    /** Lets the jobs waiting for the rename of the item run */
+    void renameFinished(const SyncFileItem &item);
+
+    /** Lets the jobs waiting for renames below the directory run
+     *
+     * For a directory whose jobs are aborted without running: the renames
+     * below it will not happen, what depends on them must not wait forever.
+     */
+    void renamesAbandoned(const SyncFileItem &directory);
+
+    /** Whether the item is a transfer of a file changed in the last few minutes
+     *
+     * These are likely what the user is working on and are propagated first.
+     */
+    bool isRecentlyTouched(const SyncFileItem &item);
+
     /** Check whether a download would clash with an existing file
      * in filesystems that are only case-preserving.
      */
@@ -549,6 +660,19 @@ private:
     AccountPtr _account;
     QScopedPointer<PropagateDirectory> _rootJob;
     SyncOptions _syncOptions;
+
+    /* The number of slots of the small file lane */
+    int smallFileLaneSlots();
+
+    // The renames that have not finished yet, and for each item the renames
+    // it depends on, see waitsForRename()
+    QSet<const SyncFileItem *> _pendingRenames;
+    QMultiHash<const SyncFileItem *, const SyncFileItem *> _renameDependencies;
+
+    // Moving averages of recordJobTiming() samples, 0 until there is one
+    double _averageRoundTripMsecs = 0;
+    double _averageSmallFileSize = 0;
+    double _averageThroughput = 0; // bytes per msec, of large transfers
 };
 
 
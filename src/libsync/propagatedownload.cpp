@@ -31,6 +31,8 @@
 #include <QNetworkAccessManager>
 #include <QFileInfo>
 #include <QDir>
+#include <QFutureWatcher>
+#include <QtConcurrentRun>
 #include <cmath>
 
 #ifdef Q_OS_UNIX
@@ -141,7 +143,7 @@ void GETFileJob::start()
 
 void GETFileJob::newReplyHook(QNetworkReply *reply)
 {
-    reply->setReadBufferSize(16 * 1024); // keep low so we can easier limit the bandwidth
+    reply->setReadBufferSize(readBufferSize());
 
     connect(reply, &QNetworkReply::metaDataChanged, this, &GETFileJob::slotMetaDataChanged);
     connect(reply, &QIODevice::readyRead, this, &GETFileJob::slotReadyRead);
@@ -153,7 +155,7 @@ void GETFileJob::slotMetaDataChanged()
 {
     // For some reason setting the read buffer in GETFileJob::start doesn't seem to go
     // through the HTTP layer thread(?)
-    reply()->setReadBufferSize(16 * 1024);
+    reply()->setReadBufferSize(readBufferSize());
 
     int httpStatus = reply()->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
 
@@ -169,6 +171,7 @@ void GETFileJob::slotMetaDataChanged()
     if (reply()->error() != QNetworkReply::NoError) {
         return;
     }
+    _checksums.reset();
     _etag = getEtagFromReply(reply());
 
     if (!_directDownloadUrl.isEmpty() && !_etag.isEmpty()) {
@@ -224,9 +227,34 @@ void GETFileJob::slotMetaDataChanged()
         _lastModified = Utility::qDateTimeToTime_t(lastModified.toDateTime());
     }
 
+    // Hash the body as it arrives, then it needn't be read back for the checksums
+    if (_resumeStart == 0) {
+        _checksums.reset(new IncrementalChecksums(
+            QVector<QByteArray>{ parseChecksumHeaderType(transmissionChecksumHeader()) } + _additionalChecksumTypes));
+    }
+
     _saveBodyToFile = true;
 }
 
+QByteArray GETFileJob::transmissionChecksumHeader() const
+{
+    if (!reply())
+        return QByteArray();
+    auto checksumHeader = findBestChecksum(reply()->rawHeader(checkSumHeaderC));
+    auto contentMd5Header = reply()->rawHeader(contentMd5HeaderC);
+    if (checksumHeader.isEmpty() && !contentMd5Header.isEmpty())
+        checksumHeader = "MD5:" + contentMd5Header;
+    return checksumHeader;
+}
+
+qint64 GETFileJob::readBufferSize() const
+{
+    if (!_largeBuffers || _bandwidthLimited || _bandwidthChoked) {
+        return 16 * 1024; // keep low so we can easier limit the bandwidth
+    }
+    return 4 * 1024 * 1024;
+}
+
 void GETFileJob::setBandwidthManager(BandwidthManager *bwm)
 {
     _bandwidthManager = bwm;
@@ -235,12 +263,16 @@ void GETFileJob::setBandwidthManager(BandwidthManager *bwm)
 void GETFileJob::setChoked(bool c)
 {
     _bandwidthChoked = c;
+    if (reply())
+        reply()->setReadBufferSize(readBufferSize());
     QMetaObject::invokeMethod(this, "slotReadyRead", Qt::QueuedConnection);
 }
 
 void GETFileJob::setBandwidthLimited(bool b)
 {
     _bandwidthLimited = b;
+    if (reply())
+        reply()->setReadBufferSize(readBufferSize());
     QMetaObject::invokeMethod(this, "slotReadyRead", Qt::QueuedConnection);
 }
 
@@ -263,7 +295,9 @@ void GETFileJob::slotReadyRead()
 {
     if (!reply())
         return;
-    int bufferSize = qMin(1024 * 8ll, reply()->bytesAvailable());
+    // Take all that is there at once: one write per read keeps the writes large
+    const qint64 maxRead = readBufferSize() > 16 * 1024 ? 1024 * 1024 : 8 * 1024;
+    int bufferSize = qMin(maxRead, reply()->bytesAvailable());
     QByteArray buffer(bufferSize, Qt::Uninitialized);
 
     while (reply()->bytesAvailable() > 0) {
@@ -298,6 +332,9 @@ void GETFileJob::slotReadyRead()
             reply()->abort();
             return;
         }
+        if (_checksums) {
+            _checksums->addData(buffer.constData(), r);
+        }
     }
 
     if (reply()->isFinished() && reply()->bytesAvailable() == 0) {
@@ -510,13 +547,23 @@ void PropagateDownloadFile::startDownload()
         return;
     }
 
+    if (_resumeStart == 0 && copyFromLocalDuplicate(tmpFileName)) {
+        // Continues in slotLocalCopyFinished()
+        return;
+    }
+
+    if (propagator()->syncOptions()._preallocateDownloads
+        && FileSystem::preallocate(_tmpFile, _resumeStart, _item->_size - _resumeStart)) {
+        _preallocatedEnd = _item->_size;
+    }
+
     {
         SyncJournalDb::DownloadInfo pi;
         pi._etag = _item->_etag;
         pi._tmpfile = tmpFileName;
         pi._valid = true;
         propagator()->_journal->setDownloadInfo(_item->_file, pi);
-        propagator()->_journal->commit("download file start");
+        propagator()->_journal->commitBatched("download file start");
     }
 
     QMap<QByteArray, QByteArray> headers;
@@ -540,6 +587,8 @@ void PropagateDownloadFile::startDownload()
             &_tmpFile, headers, expectedEtagForResume, _resumeStart, this);
     }
     _job->setBandwidthManager(&propagator()->_bandwidthManager);
+    _job->setLargeBuffers(propagator()->syncOptions()._largeDownloadBuffers);
+    _job->setAdditionalChecksumTypes({ contentChecksumType() });
     connect(_job.data(), &GETFileJob::finishedSignal, this, &PropagateDownloadFile::slotGetFinished);
     connect(_job.data(), &GETFileJob::downloadProgress, this, &PropagateDownloadFile::slotDownloadProgress);
     propagator()->_activeJobList.append(this);
@@ -567,6 +616,12 @@ void PropagateDownloadFile::slotGetFinished()
     GETFileJob *job = _job;
     ASSERT(job);
 
+    // The reply may be shorter than the size the discovery saw
+    if (_preallocatedEnd > _tmpFile.size()) {
+        FileSystem::deallocate(_tmpFile, _tmpFile.size(), _preallocatedEnd - _tmpFile.size());
+    }
+    _preallocatedEnd = 0;
+
     QNetworkReply::NetworkError err = job->reply()->error();
     if (err != QNetworkReply::NoError) {
         _item->_httpErrorCode = job->reply()->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
@@ -708,15 +763,14 @@ void PropagateDownloadFile::slotGetFinished()
     // will also emit the validated() signal to continue the flow in slot transmissionChecksumValidated()
     // as this is (still) also correct.
     auto *validator = new ValidateChecksumHeader(this);
+    // Compute the content checksum while reading the file anyway
+    validator->setAdditionalChecksumType(contentChecksumType());
     connect(validator, &ValidateChecksumHeader::validated,
         this, &PropagateDownloadFile::transmissionChecksumValidated);
     connect(validator, &ValidateChecksumHeader::validationFailed,
         this, &PropagateDownloadFile::slotChecksumFail);
-    auto checksumHeader = findBestChecksum(job->reply()->rawHeader(checkSumHeaderC));
-    auto contentMd5Header = job->reply()->rawHeader(contentMd5HeaderC);
-    if (checksumHeader.isEmpty() && !contentMd5Header.isEmpty())
-        checksumHeader = "MD5:" + contentMd5Header;
-    validator->start(_tmpFile.fileName(), checksumHeader);
+    // The job computed the checksums while receiving unless it resumed
+    validator->start(_tmpFile.fileName(), job->transmissionChecksumHeader(), job->checksums());
 }
 
 void PropagateDownloadFile::slotChecksumFail(const QString &errMsg)
@@ -726,6 +780,94 @@ void PropagateDownloadFile::slotChecksumFail(const QString &errMsg)
     done(SyncFileItem::SoftError, errMsg); // tr("The file downloaded with a broken checksum, will be redownloaded."));
 }
 
+bool PropagateDownloadFile::copyFromLocalDuplicate(const QString &tmpFileName)
+{
+    // Only trust a strong checksum to say that the content is the same
+    if (_localCopyFailed || _isEncrypted || !_item->_directDownloadUrl.isEmpty() || _item->_size == 0
+        || !csync_is_collision_safe_hash(_item->_checksumHeader)) {
+        return false;
+    }
+    QByteArray checksumType;
+    QByteArray checksum;
+    if (!parseChecksumHeader(_item->_checksumHeader, &checksumType, &checksum)) {
+        return false;
+    }
+
+    // The journal knows the content checksum of every synced file; one that
+    // was not touched since has that content still
+    QString source;
+    const auto ownPath = _item->_file.toUtf8();
+    propagator()->_journal->getFileRecordsByChecksum(checksumType, checksum, [&](const SyncJournalFileRecord &rec) {
+        if (!source.isEmpty() || rec._type != ItemTypeFile || rec._path == ownPath || rec._fileSize != _item->_size) {
+            return;
+        }
+        const QString path = propagator()->getFilePath(QString::fromUtf8(rec._path));
+        if (!FileSystem::fileChanged(path, rec._fileSize, rec._modtime)) {
+            source = path;
+        }
+    });
+    if (source.isEmpty()) {
+        return false;
+    }
+
+    qCInfo(lcPropagateDownload) << "Copying" << _item->_file << "from" << source << "which has the same content";
+    _tmpFile.close();
+
+    // Like a download, so that the temporary file is known if the client stops meanwhile
+    {
+        SyncJournalDb::DownloadInfo pi;
+        pi._etag = _item->_etag;
+        pi._tmpfile = tmpFileName;
+        pi._valid = true;
+        propagator()->_journal->setDownloadInfo(_item->_file, pi);
+        propagator()->_journal->commitBatched("download file start");
+    }
+
+    // Copying a large file takes a while unless the file system can share the blocks
+    propagator()->_activeJobList.append(this);
+    auto watcher = new QFutureWatcher<bool>(this);
+    connect(watcher, &QFutureWatcherBase::finished, this, &PropagateDownloadFile::slotLocalCopyFinished);
+    watcher->setFuture(QtConcurrent::run(FileSystem::copyFileContents, source, _tmpFile.fileName()));
+    return true;
+}
+
+void PropagateDownloadFile::slotLocalCopyFinished()
+{
+    auto *watcher = static_cast<QFutureWatcher<bool> *>(sender());
+    watcher->deleteLater();
+
+    propagator()->_activeJobList.removeOne(this);
+    if (propagator()->_abortRequested.fetchAndAddRelaxed(0)) {
+        return;
+    }
+    if (!watcher->result()) {
+        slotLocalCopyChecksumFail(tr("Could not copy the local file"));
+        return;
+    }
+
+    // A local copy says nothing about the network
+    _runTimer.invalidate();
+
+    // The file may have changed while it was copied, the copy must have the
+    // content the server announced
+    auto *validator = new ValidateChecksumHeader(this);
+    validator->setAdditionalChecksumType(contentChecksumType());
+    connect(validator, &ValidateChecksumHeader::validated,
+        this, &PropagateDownloadFile::transmissionChecksumValidated);
+    connect(validator, &ValidateChecksumHeader::validationFailed,
+        this, &PropagateDownloadFile::slotLocalCopyChecksumFail);
+    validator->start(_tmpFile.fileName(), _item->_checksumHeader);
+}
+
+void PropagateDownloadFile::slotLocalCopyChecksumFail(const QString &errMsg)
+{
+    qCInfo(lcPropagateDownload) << "Local copy of" << _item->_file << "failed, downloading it:" << errMsg;
+    FileSystem::remove(_tmpFile.fileName());
+    propagator()->_journal->setDownloadInfo(_item->_file, SyncJournalDb::DownloadInfo());
+    _localCopyFailed = true;
+    startDownload();
+}
+
 void PropagateDownloadFile::deleteExistingFolder()
 {
     QString existingDir = propagator()->getFilePath(_item->_file);
@@ -836,6 +978,14 @@ void PropagateDownloadFile::transmissionChecksumValidated(const QByteArray &chec
         return contentChecksumComputed(checksumType, checksum);
     }
 
+    // The validation computed it already if it had to read the file
+    if (auto validator = qobject_cast<ValidateChecksumHeader *>(sender())) {
+        const auto contentChecksum = validator->additionalChecksum();
+        if (!contentChecksum.isNull()) {
+            return contentChecksumComputed(theContentChecksumType, contentChecksum);
+        }
+    }
+
     // Compute the content checksum.
     auto computeChecksum = new ComputeChecksum(this);
     computeChecksum->setChecksumType(theContentChecksumType);
@@ -969,7 +1119,7 @@ void PropagateDownloadFile::updateMetadata(bool isConflict)
         propagator()->_journal->setDownloadInfo(_item->_encryptedFileName, SyncJournalDb::DownloadInfo());
     }
 
-    propagator()->_journal->commit("download file start2");
+    propagator()->_journal->commitBatched("download file start2");
     done(isConflict ? SyncFileItem::Conflict : SyncFileItem::Success);
 
     // handle the special recall file
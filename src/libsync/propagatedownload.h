@@ -16,10 +16,13 @@
 #include "owncloudpropagator.h"
 #include "networkjobs.h"
 #include "clientsideencryption.h"
+#include "common/checksums.h"
 
 #include <QBuffer>
 #include <QFile>
 
+#include <memory>
+
 namespace OCC {
 class PropagateDownloadEncrypted;
 
@@ -27,7 +30,7 @@ class PropagateDownloadEncrypted;
  * @brief The GETFileJob class
  * @ingroup libsync
  */
-class GETFileJob : public AbstractNetworkJob
+class OWNCLOUDSYNC_EXPORT GETFileJob : public AbstractNetworkJob
 {
     Q_OBJECT
     QFile *_device;
@@ -40,6 +43,7 @@ class GETFileJob : public AbstractNetworkJob
     QByteArray _etag;
     bool _bandwidthLimited; // if _bandwidthQuota will be used
     bool _bandwidthChoked; // if download is paused (won't read on readyRead())
+    bool _largeBuffers = true; // see setLargeBuffers()
     qint64 _bandwidthQuota;
     QPointer<BandwidthManager> _bandwidthManager;
     bool _hasEmittedFinishedSignal;
@@ -48,6 +52,10 @@ class GETFileJob : public AbstractNetworkJob
     /// Will be set to true once we've seen a 2xx response header
     bool _saveBodyToFile = false;
 
+    /// Checksum types to compute while receiving, see setAdditionalChecksumTypes()
+    QVector<QByteArray> _additionalChecksumTypes;
+    std::unique_ptr<IncrementalChecksums> _checksums;
+
 public:
     // DOES NOT take ownership of the device.
     explicit GETFileJob(AccountPtr account, const QString &path, QFile *device,
@@ -83,6 +91,22 @@ public:
 
     void newReplyHook(QNetworkReply *reply) override;
 
+    /**
+     * The size of the reply's read buffer and of the reads from it.
+     *
+     * Small while the BandwidthManager limits the download, since the network
+     * stack reads ahead that much regardless of the quota. Large otherwise, so
+     * that fast downloads are written in few large writes.
+     */
+    qint64 readBufferSize() const;
+
+    /**
+     * Whether the job may use large buffers when it isn't bandwidth limited.
+     *
+     * Defaults to true, see SyncOptions::_largeDownloadBuffers.
+     */
+    void setLargeBuffers(bool enabled) { _largeBuffers = enabled; }
+
     void setBandwidthManager(BandwidthManager *bwm);
     void setChoked(bool c);
     void setBandwidthLimited(bool b);
@@ -101,6 +125,21 @@ public:
     quint64 resumeStart() { return _resumeStart; }
     time_t lastModified() { return _lastModified; }
 
+    /// The transmission checksum header of the reply, empty if the server sent none
+    QByteArray transmissionChecksumHeader() const;
+
+    /**
+     * Checksum types to compute while the body is received, in addition to the
+     * type of transmissionChecksumHeader().
+     *
+     * That only happens if the download starts at the beginning of the file:
+     * the job doesn't see the data of the part a resumed download already had.
+     */
+    void setAdditionalChecksumTypes(const QVector<QByteArray> &types) { _additionalChecksumTypes = types; }
+
+    /// The checksums of the received body, null if they weren't computed
+    const IncrementalChecksums *checksums() const { return _checksums.get(); }
+
 
 signals:
     void finishedSignal();
@@ -128,6 +167,9 @@ private slots:
     |                         checksum differs?    |
     +-> startDownload() <--------------------------+
           |                                        |
+          +-> copy a local file with the same      |
+          |   content, if any, and validate its    |
+          |   checksum, else                       |
           +-> run a GETFileJob                     | checksum identical?
                                                    |
       done?-> slotGetFinished()                    |
@@ -195,10 +237,17 @@ private slots:
     void abort(PropagatorJob::AbortType abortType) override;
     void slotDownloadProgress(qint64, qint64);
     void slotChecksumFail(const QString &errMsg);
+    /// Called when the copy of a local file with the same content is written
+    void slotLocalCopyFinished();
+    /// Called when the copy of a local file with the same content did not work out
+    void slotLocalCopyChecksumFail(const QString &errMsg);
 
 private:
     void startAfterIsEncryptedIsChecked();
     void deleteExistingFolder();
+    /// Starts copying a synced local file with the same content checksum
+    /// instead of downloading. Returns false if there is none.
+    bool copyFromLocalDuplicate(const QString &tmpFileName);
 
     quint64 _resumeStart;
     qint64 _downloadProgress;
@@ -206,6 +255,8 @@ private:
     QFile _tmpFile;
     bool _deleteExisting;
     bool _isEncrypted = false;
+    bool _localCopyFailed = false;
+    qint64 _preallocatedEnd = 0; // the end of the space reserved in _tmpFile, see FileSystem::preallocate()
     EncryptedFile _encryptedInfo;
     ConflictRecord _conflictRecord;
 
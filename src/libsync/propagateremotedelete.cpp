@@ -156,7 +156,7 @@ void PropagateRemoteDelete::slotDeleteJobFinished()
     }
 
     propagator()->_journal->deleteFileRecord(_item->_originalFile, _item->isDirectory());
-    propagator()->_journal->commit("Remote Remove");
+    propagator()->_journal->commitBatched("Remote Remove");
 
     if (_deleteEncryptedHelper && !_job->folderToken().isEmpty()) {
         propagator()->_activeJobList.append(this);
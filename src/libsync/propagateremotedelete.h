@@ -65,8 +65,6 @@ public:
     void createDeleteJob(const QString &filename);
     void abort(PropagatorJob::AbortType abortType) override;
 
-    bool isLikelyFinishedQuickly() override { return !_item->isDirectory(); }
-
 private slots:
     void slotDeleteJobFinished();
 };
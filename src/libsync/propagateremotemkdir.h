@@ -40,9 +40,6 @@ public:
     void start() override;
     void abort(PropagatorJob::AbortType abortType) override;
 
-    // Creating a directory should be fast.
-    bool isLikelyFinishedQuickly() override { return true; }
-
     /**
      * Whether an existing entity with the same name may be deleted before
      * creating the directory.
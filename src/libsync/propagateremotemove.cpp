@@ -174,7 +174,7 @@ void PropagateRemoteMove::finalize()
         }
     }
 
-    propagator()->_journal->commit("Remote Rename");
+    propagator()->_journal->commitBatched("Remote Rename");
     done(SyncFileItem::Success);
 }
 
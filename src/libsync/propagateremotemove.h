@@ -57,7 +57,6 @@ public:
     }
     void start() override;
     void abort(PropagatorJob::AbortType abortType) override;
-    JobParallelism parallelism() override { return _item->isDirectory() ? WaitForFinished : FullParallelism; }
 
     /**
      * Rename the directory in the selective sync list
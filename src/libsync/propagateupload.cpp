@@ -47,16 +47,7 @@ Q_LOGGING_CATEGORY(lcPutJob, "nextcloud.sync.networkjob.put", QtInfoMsg)
 Q_LOGGING_CATEGORY(lcPollJob, "nextcloud.sync.networkjob.poll", QtInfoMsg)
 Q_LOGGING_CATEGORY(lcPropagateUpload, "nextcloud.sync.propagator.upload", QtInfoMsg)
 
-/**
- * We do not want to upload files that are currently being modified.
- * To avoid that, we don't upload files that have a modification time
- * that is too close to the current time.
- *
- * This interacts with the msBetweenRequestAndSync delay in the folder
- * manager. If that delay between file-change notification and sync
- * has passed, we should accept the file for upload here.
- */
-static bool fileIsStillChanging(const SyncFileItem &item)
+bool fileIsStillChanging(const SyncFileItem &item)
 {
     const QDateTime modtime = Utility::qDateTimeFromTime_t(item._modtime);
     const qint64 msSinceMod = modtime.msecsTo(QDateTime::currentDateTimeUtc());
@@ -339,9 +330,18 @@ void PropagateUploadFileCommon::slotComputeContentChecksum()
         return;
     }
 
-    // Compute the content checksum.
+    // Compute the content checksum, and the transmission checksum in the same
+    // pass if the server can't take the content checksum for the upload.
     auto computeChecksum = new ComputeChecksum(this);
     computeChecksum->setChecksumType(checksumType);
+    const auto supportedTransmissionChecksums =
+        propagator()->account()->capabilities().supportedChecksumTypes();
+    const QByteArray transmissionChecksumType = uploadChecksumEnabled()
+        ? propagator()->account()->capabilities().uploadChecksumType()
+        : QByteArray();
+    if (!supportedTransmissionChecksums.contains(checksumType) && !transmissionChecksumType.isEmpty()) {
+        computeChecksum->setAdditionalChecksumTypes({ transmissionChecksumType });
+    }
 
     connect(computeChecksum, &ComputeChecksum::done,
         this, &PropagateUploadFileCommon::slotComputeTransmissionChecksum);
@@ -362,13 +362,22 @@ void PropagateUploadFileCommon::slotComputeTransmissionChecksum(const QByteArray
         return;
     }
 
+    const QByteArray transmissionChecksumType = uploadChecksumEnabled()
+        ? propagator()->account()->capabilities().uploadChecksumType()
+        : QByteArray();
+
+    // Maybe it was computed along with the content checksum?
+    if (auto contentChecksumJob = qobject_cast<ComputeChecksum *>(sender())) {
+        const auto transmissionChecksum = contentChecksumJob->checksum(transmissionChecksumType);
+        if (!transmissionChecksum.isNull()) {
+            slotStartUpload(transmissionChecksumType, transmissionChecksum);
+            return;
+        }
+    }
+
     // Compute the transmission checksum.
     auto computeChecksum = new ComputeChecksum(this);
-    if (uploadChecksumEnabled()) {
-        computeChecksum->setChecksumType(propagator()->account()->capabilities().uploadChecksumType());
-    } else {
-        computeChecksum->setChecksumType(QByteArray());
-    }
+    computeChecksum->setChecksumType(transmissionChecksumType);
 
     connect(computeChecksum, &ComputeChecksum::done,
         this, &PropagateUploadFileCommon::slotStartUpload);
@@ -455,27 +464,55 @@ UploadDevice::~UploadDevice()
 
 bool UploadDevice::prepareAndOpen(const QString &fileName, qint64 start, qint64 size)
 {
-    _data.clear();
+    _buffer.clear();
+    _bufferStart = 0;
     _read = 0;
 
-    QFile file(fileName);
+    if (_file.isOpen()) {
+        _file.close();
+    }
+    _file.setFileName(fileName);
     QString openError;
-    if (!FileSystem::openAndSeekFileSharedRead(&file, &openError, start)) {
+    if (!FileSystem::openAndSeekFileSharedRead(&_file, &openError, start)) {
         setErrorString(openError);
         return false;
     }
 
-    size = qBound(0ll, size, FileSystem::getSize(fileName) - start);
-    _data.resize(size);
-    auto read = file.read(_data.data(), size);
-    if (read != size) {
-        setErrorString(file.errorString());
+    _start = start;
+    _size = qBound(0ll, size, FileSystem::getSize(fileName) - start);
+
+    // Read the first block already, so that a file that can't be read
+    // fails here rather than in the middle of the request
+    if (_size > 0 && !fillBuffer()) {
         return false;
     }
 
     return QIODevice::open(QIODevice::ReadOnly);
 }
 
+bool UploadDevice::fillBuffer()
+{
+    // Large enough for the network stack to never wait on the disk, and the
+    // bound on the memory each running upload needs
+    static const qint64 readAheadSize = 1024 * 1024;
+
+    const qint64 length = qMin(readAheadSize, _size - _read);
+    if (_file.pos() != _start + _read && !_file.seek(_start + _read)) {
+        setErrorString(_file.errorString());
+        return false;
+    }
+    _buffer.resize(static_cast<int>(length));
+    auto read = _file.read(_buffer.data(), length);
+    if (read != length) {
+        // Either an error or the file got shorter since the upload started
+        setErrorString(read < 0 ? _file.errorString() : tr("The file changed while it was being uploaded"));
+        _buffer.clear();
+        return false;
+    }
+    _bufferStart = _read;
+    return true;
+}
+
 
 qint64 UploadDevice::writeData(const char *, qint64)
 {
@@ -485,14 +522,14 @@ qint64 UploadDevice::writeData(const char *, qint64)
 
 qint64 UploadDevice::readData(char *data, qint64 maxlen)
 {
-    if (_data.size() - _read <= 0) {
+    if (_size - _read <= 0) {
         // at end
         if (_bandwidthManager) {
             _bandwidthManager->unregisterUploadDevice(this);
         }
         return -1;
     }
-    maxlen = qMin(maxlen, _data.size() - _read);
+    maxlen = qMin(maxlen, _size - _read);
     if (maxlen == 0) {
         return 0;
     }
@@ -504,9 +541,17 @@ qint64 UploadDevice::readData(char *data, qint64 maxlen)
         if (maxlen <= 0) { // no quota
             return 0;
         }
+    }
+    if (_read < _bufferStart || _read >= _bufferStart + _buffer.size()) {
+        if (!fillBuffer()) {
+            return -1;
+        }
+    }
+    maxlen = qMin(maxlen, _bufferStart + _buffer.size() - _read);
+    if (isBandwidthLimited()) {
         _bandwidthQuota -= maxlen;
     }
-    std::memcpy(data, _data.data() + _read, maxlen);
+    std::memcpy(data, _buffer.constData() + (_read - _bufferStart), maxlen);
     _read += maxlen;
     return maxlen;
 }
@@ -521,17 +566,17 @@ void UploadDevice::slotJobUploadProgress(qint64 sent, qint64 t)
 
 bool UploadDevice::atEnd() const
 {
-    return _read >= _data.size();
+    return _read >= _size;
 }
 
 qint64 UploadDevice::size() const
 {
-    return _data.size();
+    return _size;
 }
 
 qint64 UploadDevice::bytesAvailable() const
 {
-    return _data.size() - _read + QIODevice::bytesAvailable();
+    return _size - _read + QIODevice::bytesAvailable();
 }
 
 // random access, we can seek
@@ -545,9 +590,10 @@ bool UploadDevice::seek(qint64 pos)
     if (!QIODevice::seek(pos)) {
         return false;
     }
-    if (pos < 0 || pos > _data.size()) {
+    if (pos < 0 || pos > _size) {
         return false;
     }
+    // The read-ahead buffer is kept, it is refilled if pos is outside of it
     _read = pos;
     return true;
 }
@@ -626,7 +672,7 @@ void PropagateUploadFileCommon::checkResettingErrors()
                                       << "is" << uploadInfo._errorCount;
         }
         propagator()->_journal->setUploadInfo(_item->_file, uploadInfo);
-        propagator()->_journal->commit("Upload info");
+        propagator()->_journal->commitBatched("Upload info");
     }
 }
 
@@ -686,6 +732,21 @@ void PropagateUploadFileCommon::adjustLastJobTimeout(AbstractNetworkJob *job, qu
         static_cast<qint64>(30 * 60 * 1000)));
 }
 
+bool PropagateUploadFileCommon::parallelChunkUploadEnabled() const
+{
+    if (propagator()->account()->capabilities().chunkingParallelUploadDisabled()) {
+        // Server may also disable parallel chunked upload for any higher version
+        return false;
+    }
+    QByteArray env = qgetenv("OWNCLOUD_PARALLEL_CHUNK");
+    if (!env.isEmpty()) {
+        return env != "false" && env != "0";
+    }
+    // Disable parallel chunk upload severs older than 8.0.3 to avoid too many
+    // internal sever errors (#2743, #2938)
+    return propagator()->account()->serverVersionInt() >= Account::makeServerVersion(8, 0, 3);
+}
+
 void PropagateUploadFileCommon::slotJobDestroyed(QObject *job)
 {
     _jobs.erase(std::remove(_jobs.begin(), _jobs.end(), job), _jobs.end());
@@ -761,7 +822,7 @@ void PropagateUploadFileCommon::finalize()
 
     // Remove from the progress database:
     propagator()->_journal->setUploadInfo(_item->_file, SyncJournalDb::UploadInfo());
-    propagator()->_journal->commit("upload file start");
+    propagator()->_journal->commitBatched("upload file start");
 
     if (_uploadingEncrypted) {
       _uploadEncryptedHelper->unlockFolder();
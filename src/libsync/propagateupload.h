@@ -28,18 +28,35 @@ Q_DECLARE_LOGGING_CATEGORY(lcPropagateUpload)
 
 class BandwidthManager;
 
+/**
+ * We do not want to upload files that are currently being modified.
+ * To avoid that, we don't upload files that have a modification time
+ * that is too close to the current time.
+ *
+ * This interacts with the msBetweenRequestAndSync delay in the folder
+ * manager. If that delay between file-change notification and sync
+ * has passed, we should accept the file for upload here.
+ */
+bool fileIsStillChanging(const SyncFileItem &item);
+
 /**
  * @brief The UploadDevice class
  * @ingroup libsync
  */
-class UploadDevice : public QIODevice
+class OWNCLOUDSYNC_EXPORT UploadDevice : public QIODevice
 {
     Q_OBJECT
 public:
     UploadDevice(BandwidthManager *bwm);
     ~UploadDevice();
 
-    /** Reads the data from the file and opens the device */
+    /**
+     * Opens the file and the device for the range [start, start+size)
+     *
+     * The data is not read up front but streamed from the file through a small
+     * read-ahead buffer, so that the memory used does not grow with the size
+     * of the range.
+     */
     bool prepareAndOpen(const QString &fileName, qint64 start, qint64 size);
 
     qint64 writeData(const char *, qint64) override;
@@ -59,8 +76,17 @@ public:
 signals:
 
 private:
-    // The file data
-    QByteArray _data;
+    // Reads the data at the current position into the read-ahead buffer
+    bool fillBuffer();
+
+    // The file, kept open so that the device can seek back for a retry
+    QFile _file;
+    // Range of the file this device reads
+    qint64 _start = 0;
+    qint64 _size = 0;
+    // Read-ahead buffer, holding the data from position _bufferStart on
+    QByteArray _buffer;
+    qint64 _bufferStart = 0;
     // Position in the data
     qint64 _read;
 
@@ -247,7 +273,6 @@ public:
     void setupUnencryptedFile();
     void startUploadFile();
     void callUnlockFolder();
-    bool isLikelyFinishedQuickly() override { return _item->_size < propagator()->smallFileSize(); }
 
 private slots:
     void slotComputeContentChecksum();
@@ -303,6 +328,14 @@ protected:
      */
     static void adjustLastJobTimeout(AbstractNetworkJob *job, quint64 fileSize);
 
+    /**
+     * Whether several chunks of the same file may be uploaded at once.
+     *
+     * Can be disabled by the server capabilities or OWNCLOUD_PARALLEL_CHUNK,
+     * and is off for servers older than 8.0.3 (#2743, #2938).
+     */
+    bool parallelChunkUploadEnabled() const;
+
     // Bases headers that need to be sent with every chunk
     QMap<QByteArray, QByteArray> headers();
 private:
@@ -368,11 +401,25 @@ class PropagateUploadFileNG : public PropagateUploadFileCommon
     Q_OBJECT
 private:
     quint64 _sent = 0; /// amount of data (bytes) that was already sent
+    quint64 _confirmed = 0; /// amount of data (bytes) the server has acknowledged
     uint _transferId = 0; /// transfer id (part of the url)
     int _currentChunk = 0; /// Id of the next chunk that will be sent
     quint64 _currentChunkSize = 0; /// current chunk size
+    quint64 _fixedChunkSize = 0; /// size of the chunks when uploading in parallel, see UploadInfo::_chunkSize
     bool _removeJobError = false; /// If not null, there was an error removing the job
 
+    // The chunks whose PUT is running, with their size and the bytes sent so far
+    struct ChunkInFlight
+    {
+        quint64 size;
+        qint64 sent;
+    };
+    QMap<int, ChunkInFlight> _chunksInFlight;
+
+    // Chunks past _currentChunk that are already on the server because a previous
+    // parallel upload completed them out of order. They are skipped.
+    QSet<int> _chunksOnServer;
+
     // Map chunk number with its size  from the PROPFIND on resume.
     // (Only used from slotPropfindIterate/slotPropfindFinished because the LsColJob use signals to report data.)
     struct ServerChunkInfo
@@ -388,6 +435,13 @@ private:
      */
     QUrl chunkUrl(int chunk = -1);
 
+    /** Whether several chunks are uploaded at once.
+     *
+     * Only if parallelChunkUploadEnabled() and the chunk size is fixed by the
+     * configuration rather than adjusted to the upload speed.
+     */
+    bool parallelChunksEnabled() const;
+
 public:
     PropagateUploadFileNG(OwncloudPropagator *propagator, const SyncFileItemPtr &item)
         : PropagateUploadFileCommon(propagator, item)
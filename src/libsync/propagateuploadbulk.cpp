@@ -0,0 +1,446 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#include "propagateuploadbulk.h"
+#include "propagateupload.h"
+#include "owncloudpropagator_p.h"
+#include "propagatorjobs.h"
+#include "account.h"
+#include "filesystem.h"
+#include "common/checksums.h"
+#include "common/syncjournaldb.h"
+#include "common/utility.h"
+#include "common/asserts.h"
+
+#include <QBuffer>
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFileInfo>
+#include <QFutureWatcher>
+#include <QJsonDocument>
+#include <QUuid>
+#include <QtConcurrentRun>
+
+namespace OCC {
+
+Q_LOGGING_CATEGORY(lcPutMultiFileJob, "nextcloud.sync.networkjob.put.multi", QtInfoMsg)
+Q_LOGGING_CATEGORY(lcPropagateUploadBulk, "nextcloud.sync.propagator.upload.bulk", QtInfoMsg)
+
+PutMultiFileJob::PutMultiFileJob(AccountPtr account, const QUrl &url, QVector<File> files, QObject *parent)
+    : AbstractNetworkJob(account, QString(), parent)
+    , _url(url)
+    , _files(std::move(files))
+{
+}
+
+void PutMultiFileJob::start()
+{
+    const QByteArray boundary = "bulk-" + QUuid::createUuid().toRfc4122().toHex();
+
+    int size = 0;
+    for (const auto &file : qAsConst(_files))
+        size += file.data.size() + 256;
+    QByteArray body;
+    body.reserve(size);
+    for (const auto &file : qAsConst(_files)) {
+        body += "--" + boundary + "\r\n";
+        body += "X-File-Path: " + file.remotePath + "\r\n";
+        for (auto it = file.headers.begin(); it != file.headers.end(); ++it)
+            body += it.key() + ": " + it.value() + "\r\n";
+        body += "Content-Length: " + QByteArray::number(file.data.size()) + "\r\n\r\n";
+        body += file.data + "\r\n";
+    }
+    body += "--" + boundary + "--\r\n";
+    _files.clear();
+
+    auto device = new QBuffer;
+    device->setData(body);
+    device->open(QIODevice::ReadOnly);
+
+    QNetworkRequest req;
+    req.setHeader(QNetworkRequest::ContentTypeHeader, QByteArray("multipart/related; boundary=" + boundary));
+    req.setPriority(QNetworkRequest::LowPriority); // Long uploads must not block non-propagation jobs.
+
+    sendRequest("POST", _url, req, device);
+
+    connect(reply(), &QNetworkReply::uploadProgress, this, &PutMultiFileJob::uploadProgress);
+    connect(this, &AbstractNetworkJob::networkActivity, account().data(), &Account::propagatorNetworkActivity);
+    AbstractNetworkJob::start();
+}
+
+bool PutMultiFileJob::finished()
+{
+    qCInfo(lcPutMultiFileJob) << "POST of" << reply()->request().url().toString() << "FINISHED WITH STATUS"
+                              << replyStatusString()
+                              << reply()->attribute(QNetworkRequest::HttpStatusCodeAttribute)
+                              << reply()->attribute(QNetworkRequest::HttpReasonPhraseAttribute);
+
+    if (reply()->error() == QNetworkReply::NoError) {
+        QJsonParseError error;
+        const auto json = QJsonDocument::fromJson(reply()->readAll(), &error);
+        if (error.error == QJsonParseError::NoError && json.isObject()) {
+            _results = json.object();
+        } else {
+            qCWarning(lcPutMultiFileJob) << "Invalid JSON reply:" << error.errorString();
+        }
+    }
+
+    emit finishedSignal();
+    return true;
+}
+
+// Runs on a worker thread
+static QVector<PropagateUploadBulk::FileContent> readFiles(const QStringList &paths, const QVector<QByteArray> &checksumTypes)
+{
+    QVector<PropagateUploadBulk::FileContent> contents;
+    contents.reserve(paths.size());
+    for (const auto &path : paths) {
+        PropagateUploadBulk::FileContent content;
+        QFile file(path);
+        if (FileSystem::openAndSeekFileSharedRead(&file, &content.error, 0)) {
+            content.data = file.readAll();
+            if (file.error() != QFile::NoError)
+                content.error = file.errorString();
+
+            IncrementalChecksums checksums(checksumTypes);
+            checksums.addData(content.data.constData(), content.data.size());
+            for (const auto &type : checksumTypes)
+                content.checksums.append(checksums.result(type));
+
+            // The server needs this one even if checksums are disabled by environment variable
+            content.md5 = QCryptographicHash::hash(content.data, QCryptographicHash::Md5).toHex();
+        }
+        contents.append(content);
+    }
+    return contents;
+}
+
+PropagateUploadBulk::PropagateUploadBulk(OwncloudPropagator *propagator, const QVector<SyncFileItemPtr> &items)
+    : PropagatorJob(propagator)
+    , _items(items)
+{
+}
+
+PropagateUploadBulk::~PropagateUploadBulk()
+{
+    if (auto p = propagator()) {
+        p->_activeJobList.removeAll(this);
+    }
+}
+
+bool PropagateUploadBulk::scheduleSelfOrChild()
+{
+    if (_state != NotYetStarted) {
+        return false;
+    }
+    qCInfo(lcPropagator) << "Starting bulk upload of" << _items.size() << "files by" << this;
+
+    _state = Running;
+    QMetaObject::invokeMethod(this, "start");
+    return true;
+}
+
+QByteArray PropagateUploadBulk::remotePath(const SyncFileItem &item) const
+{
+    const QString path = propagator()->_remoteFolder + item._file;
+    return (path.startsWith('/') ? path : QString('/' + path)).toUtf8();
+}
+
+void PropagateUploadBulk::start()
+{
+    if (propagator()->_abortRequested.fetchAndAddRelaxed(0)) {
+        return;
+    }
+
+    QStringList paths;
+    for (const auto &item : qAsConst(_items)) {
+        // Same checks as PropagateUploadFileCommon::startUploadFile()
+        if (propagator()->hasCaseClashAccessibilityProblem(item->_file)) {
+            itemDone(item, SyncFileItem::NormalError,
+                PropagateUploadFileCommon::tr("File %1 cannot be uploaded because another file with the same name, differing only in case, exists")
+                    .arg(QDir::toNativeSeparators(item->_file)));
+            continue;
+        }
+
+        const quint64 quotaGuess = propagator()->_folderQuota.value(
+            QFileInfo(item->_file).path(), std::numeric_limits<quint64>::max());
+        if (item->_size > quotaGuess) {
+            // Necessary for blacklisting logic
+            item->_httpErrorCode = 507;
+            emit propagator()->insufficientRemoteStorage();
+            itemDone(item, SyncFileItem::DetailError,
+                PropagateUploadFileCommon::tr("Upload of %1 exceeds the quota for the folder").arg(Utility::octetsToString(item->_size)));
+            continue;
+        }
+
+        _uploading.append(item);
+        paths.append(propagator()->getFilePath(item->_file));
+    }
+    if (_uploading.isEmpty()) {
+        done();
+        return;
+    }
+
+    const auto &capabilities = propagator()->account()->capabilities();
+    _checksumTypes = { contentChecksumType(), uploadChecksumEnabled() ? capabilities.uploadChecksumType() : QByteArray() };
+
+    propagator()->_activeJobList.append(this);
+    auto watcher = new QFutureWatcher<QVector<FileContent>>(this);
+    connect(watcher, &QFutureWatcherBase::finished, this, &PropagateUploadBulk::slotFilesRead);
+    watcher->setFuture(QtConcurrent::run(readFiles, paths, _checksumTypes));
+}
+
+void PropagateUploadBulk::slotFilesRead()
+{
+    auto *watcher = static_cast<QFutureWatcher<QVector<FileContent>> *>(sender());
+    watcher->deleteLater();
+
+    propagator()->_activeJobList.removeOne(this);
+    if (propagator()->_abortRequested.fetchAndAddRelaxed(0)) {
+        return;
+    }
+
+    const auto contents = watcher->result();
+    ASSERT(contents.size() == _uploading.size());
+    const auto supportedTransmissionChecksums = propagator()->account()->capabilities().supportedChecksumTypes();
+
+    QVector<PutMultiFileJob::File> files;
+    QVector<SyncFileItemPtr> uploading;
+    for (int i = 0; i < _uploading.size(); ++i) {
+        const auto &item = _uploading.at(i);
+        const auto &content = contents.at(i);
+        const QString filePath = propagator()->getFilePath(item->_file);
+
+        if (!content.error.isEmpty()) {
+            qCWarning(lcPropagateUploadBulk) << "Could not read" << filePath << content.error;
+
+            // If the file is currently locked, we want to retry the sync
+            // when it becomes available again.
+            if (FileSystem::isFileLocked(filePath)) {
+                emit propagator()->seenLockedFile(filePath);
+            }
+            // Soft error because this is likely caused by the user modifying his files while syncing
+            itemDone(item, SyncFileItem::SoftError, content.error);
+            continue;
+        }
+
+        // What was read must be what the discovery saw
+        if (quint64(content.data.size()) != item->_size
+            || !FileSystem::verifyFileUnchanged(filePath, item->_size, item->_modtime)) {
+            propagator()->_anotherSyncNeeded = true;
+            itemDone(item, SyncFileItem::SoftError, PropagateUploadFileCommon::tr("Local file changed during syncing. It will be resumed."));
+            continue;
+        }
+        if (fileIsStillChanging(*item)) {
+            propagator()->_anotherSyncNeeded = true;
+            itemDone(item, SyncFileItem::SoftError, PropagateUploadFileCommon::tr("Local file changed during sync."));
+            continue;
+        }
+
+        item->_checksumHeader = makeChecksumHeader(_checksumTypes.at(0), content.checksums.at(0));
+
+        // Reuse the content checksum as the transmission checksum if possible
+        QByteArray transmissionChecksumHeader;
+        if (supportedTransmissionChecksums.contains(_checksumTypes.at(0))) {
+            transmissionChecksumHeader = item->_checksumHeader;
+        } else if (!_checksumTypes.at(1).isEmpty()) {
+            transmissionChecksumHeader = makeChecksumHeader(_checksumTypes.at(1), content.checksums.at(1));
+        }
+        if (item->_checksumHeader.isEmpty()) {
+            item->_checksumHeader = transmissionChecksumHeader;
+        }
+
+        PutMultiFileJob::File file;
+        file.remotePath = remotePath(*item);
+        file.data = content.data;
+        file.headers["Content-Type"] = "application/octet-stream";
+        file.headers["X-File-Mtime"] = QByteArray::number(qint64(item->_modtime));
+        file.headers["X-File-MD5"] = content.md5;
+        if (!transmissionChecksumHeader.isEmpty()) {
+            file.headers[checkSumHeaderC] = transmissionChecksumHeader;
+        }
+        files.append(file);
+        uploading.append(item);
+        _transmissionChecksumHeaders.append(transmissionChecksumHeader);
+    }
+    _uploading = uploading;
+
+    if (_uploading.isEmpty()) {
+        done();
+        return;
+    }
+
+    qCInfo(lcPropagateUploadBulk) << "Uploading" << _uploading.size() << "files in one request";
+    for (const auto &item : qAsConst(_uploading)) {
+        propagator()->reportProgress(*item, 0);
+    }
+
+    const auto url = Utility::concatUrlPath(propagator()->account()->url(), QStringLiteral("remote.php/dav/bulk"));
+    _job = new PutMultiFileJob(propagator()->account(), url, std::move(files), this);
+    connect(_job.data(), &PutMultiFileJob::finishedSignal, this, &PropagateUploadBulk::slotPutFinished);
+    connect(_job.data(), &PutMultiFileJob::uploadProgress, this, &PropagateUploadBulk::slotUploadProgress);
+    propagator()->_activeJobList.append(this);
+    _job->start();
+}
+
+void PropagateUploadBulk::slotPutFinished()
+{
+    auto *job = qobject_cast<PutMultiFileJob *>(sender());
+    ASSERT(job);
+
+    propagator()->_activeJobList.removeOne(this);
+
+    const auto results = job->results();
+    if (job->reply()->error() != QNetworkReply::NoError || results.isEmpty()) {
+        if (propagator()->_abortRequested.fetchAndAddRelaxed(0)) {
+            for (const auto &item : qAsConst(_uploading)) {
+                itemDone(item, SyncFileItem::SoftError, job->errorString());
+            }
+            done();
+            return;
+        }
+
+        // Typically a server that announces the capability but can't take the
+        // request. Don't try again during this sync, the PUTs report real errors.
+        qCWarning(lcPropagateUploadBulk) << "Bulk upload failed, uploading the files one by one:"
+                                         << job->reply()->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt()
+                                         << job->errorString();
+        propagator()->_bulkUploadFailed = true;
+        for (const auto &item : qAsConst(_uploading)) {
+            uploadOneByOne(item);
+        }
+        done();
+        return;
+    }
+
+    for (int i = 0; i < _uploading.size(); ++i) {
+        const auto &item = _uploading.at(i);
+        const auto result = results.value(QString::fromUtf8(remotePath(*item))).toObject();
+
+        if (result.isEmpty() || result.value(QStringLiteral("error")).toBool()
+            || result.value(QStringLiteral("etag")).toString().isEmpty()) {
+            qCInfo(lcPropagateUploadBulk) << "The server did not accept" << item->_file << "in the bulk upload:"
+                                          << result.value(QStringLiteral("message")).toString();
+            uploadOneByOne(item);
+            continue;
+        }
+
+        // A checksum of the same type as the one sent must match it
+        const auto checksum = result.value(QStringLiteral("checksum")).toString().toUtf8();
+        const auto &sentChecksum = _transmissionChecksumHeaders.at(i);
+        if (!checksum.isEmpty() && !sentChecksum.isEmpty()
+            && parseChecksumHeaderType(checksum) == parseChecksumHeaderType(sentChecksum)
+            && checksum != sentChecksum) {
+            qCWarning(lcPropagateUploadBulk) << "Checksum mismatch for" << item->_file << checksum << sentChecksum;
+            uploadOneByOne(item);
+            continue;
+        }
+
+        finalizeItem(item, result, job->responseTimestamp());
+    }
+    propagator()->_journal->commitBatched("bulk upload");
+
+    done();
+}
+
+void PropagateUploadBulk::slotUploadProgress(qint64 sent, qint64 total)
+{
+    // Completion is signaled with sent=0, total=0, see PropagateUploadFileV1::slotUploadProgress
+    if (sent == 0 && total == 0) {
+        return;
+    }
+
+    // The parts are sent in order, ignore the size of their headers
+    qint64 start = 0;
+    for (const auto &item : qAsConst(_uploading)) {
+        if (sent <= start) {
+            break;
+        }
+        propagator()->reportProgress(*item, qMin<qint64>(sent - start, item->_size));
+        start += item->_size;
+    }
+}
+
+void PropagateUploadBulk::finalizeItem(const SyncFileItemPtr &item, const QJsonObject &result, const QByteArray &responseTimestamp)
+{
+    // the file id should only be empty for new files up- or downloaded
+    const auto fileId = result.value(QStringLiteral("fileid")).toVariant().toString().toUtf8();
+    if (!fileId.isEmpty()) {
+        item->_fileId = fileId;
+    }
+    const auto etag = result.value(QStringLiteral("etag")).toString().toUtf8();
+    item->_etag = parseEtag(etag.constData());
+    item->_responseTimeStamp = responseTimestamp;
+
+    // A change after the data was read is uploaded by the next sync
+    const QString filePath = propagator()->getFilePath(item->_file);
+    if (!FileSystem::verifyFileUnchanged(filePath, item->_size, item->_modtime)) {
+        propagator()->_anotherSyncNeeded = true;
+    }
+
+    // Update the quota, if known
+    auto quotaIt = propagator()->_folderQuota.find(QFileInfo(item->_file).path());
+    if (quotaIt != propagator()->_folderQuota.end())
+        quotaIt.value() -= item->_size;
+
+    if (!propagator()->_journal->setFileRecord(item->toSyncJournalFileRecordWithInode(filePath))) {
+        itemDone(item, SyncFileItem::FatalError, PropagateUploadFileCommon::tr("Error writing metadata to the database"));
+        return;
+    }
+    itemDone(item, SyncFileItem::Success);
+}
+
+void PropagateUploadBulk::uploadOneByOne(const SyncFileItemPtr &item)
+{
+    ASSERT(_associatedComposite);
+    _associatedComposite->appendJob(propagator()->createJob(item));
+}
+
+void PropagateUploadBulk::itemDone(const SyncFileItemPtr &item, SyncFileItem::Status status, const QString &errorString)
+{
+    PropagateItemJob::completeItem(propagator(), item, status, errorString, this);
+    // Like the error of a sub job in PropagatorCompositeJob
+    const auto itemStatus = item->_status;
+    if ((itemStatus == SyncFileItem::FatalError
+            || itemStatus == SyncFileItem::NormalError
+            || itemStatus == SyncFileItem::SoftError
+            || itemStatus == SyncFileItem::DetailError
+            || itemStatus == SyncFileItem::BlacklistedError)
+        && _hasError != SyncFileItem::FatalError) {
+        _hasError = itemStatus;
+    }
+}
+
+void PropagateUploadBulk::done()
+{
+    _state = Finished;
+    emit finished(_hasError == SyncFileItem::NoStatus ? SyncFileItem::Success : _hasError);
+
+    if (_hasError == SyncFileItem::FatalError) {
+        // Abort all remaining jobs.
+        propagator()->abort();
+    }
+}
+
+void PropagateUploadBulk::abort(PropagatorJob::AbortType abortType)
+{
+    auto reply = _job ? _job->reply() : nullptr;
+    if (reply && reply->isRunning()) {
+        if (abortType == AbortType::Asynchronous) {
+            connect(reply, &QNetworkReply::finished, this, [this] { emit abortFinished(); });
+        }
+        reply->abort();
+    } else if (abortType == AbortType::Asynchronous) {
+        emit abortFinished();
+    }
+}
+}
@@ -0,0 +1,128 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+#pragma once
+
+#include "owncloudpropagator.h"
+#include "abstractnetworkjob.h"
+
+#include <QJsonObject>
+
+namespace OCC {
+
+Q_DECLARE_LOGGING_CATEGORY(lcPutMultiFileJob)
+Q_DECLARE_LOGGING_CATEGORY(lcPropagateUploadBulk)
+
+/**
+ * @brief Uploads several files in one multipart/related POST
+ *
+ * Every part holds the content of one file, with the X-File-Path, X-File-Mtime
+ * and OC-Checksum headers a PUT would have. The server replies with a JSON
+ * object mapping each X-File-Path to the outcome for that file:
+ *
+ *   { "/A/a1": { "error": false, "etag": "...", "fileid": "...", "checksum": "SHA1:..." },
+ *     "/A/a2": { "error": true, "message": "..." } }
+ *
+ * @ingroup libsync
+ */
+class PutMultiFileJob : public AbstractNetworkJob
+{
+    Q_OBJECT
+public:
+    struct File
+    {
+        QByteArray remotePath; // absolute, the X-File-Path
+        QByteArray data;
+        QMap<QByteArray, QByteArray> headers;
+    };
+
+    explicit PutMultiFileJob(AccountPtr account, const QUrl &url, QVector<File> files, QObject *parent = nullptr);
+
+    void start() override;
+    bool finished() override;
+
+    /// The outcome of each file by remote path, empty if the reply was not understood
+    QJsonObject results() const { return _results; }
+
+signals:
+    void finishedSignal();
+    void uploadProgress(qint64, qint64);
+
+private:
+    QUrl _url;
+    QVector<File> _files;
+    QJsonObject _results;
+};
+
+/**
+ * @brief Propagation job uploading many new small files with one request
+ *
+ * Created by PropagatorCompositeJob from the tasks of a directory for which
+ * OwncloudPropagator::isBulkUploadCandidate() holds, when the server has the
+ * bulkupload capability. The files are read and checksummed on a worker
+ * thread and sent with a PutMultiFileJob.
+ *
+ * Files the server did not accept are handed back to the composite job as
+ * regular upload jobs, so that the usual PUT error handling applies to them.
+ * If the request fails as a whole, all of them are.
+ *
+ * @ingroup libsync
+ */
+class PropagateUploadBulk : public PropagatorJob
+{
+    Q_OBJECT
+public:
+    PropagateUploadBulk(OwncloudPropagator *propagator, const QVector<SyncFileItemPtr> &items);
+    ~PropagateUploadBulk();
+
+    bool scheduleSelfOrChild() override;
+    JobLane lane() const override { return SmallFileLane; }
+
+    // The content of a file, read on the worker thread
+    struct FileContent
+    {
+        QByteArray data;
+        QVector<QByteArray> checksums; // in the order of the requested types
+        QByteArray md5; // for X-File-MD5, always computed
+        QString error;
+    };
+
+public slots:
+    void abort(PropagatorJob::AbortType abortType) override;
+
+private slots:
+    void start();
+    void slotFilesRead();
+    void slotPutFinished();
+    void slotUploadProgress(qint64 sent, qint64 total);
+
+private:
+    QByteArray remotePath(const SyncFileItem &item) const;
+
+    // Leaves the item to a job of its own
+    void uploadOneByOne(const SyncFileItemPtr &item);
+    void itemDone(const SyncFileItemPtr &item, SyncFileItem::Status status, const QString &errorString = QString());
+    void finalizeItem(const SyncFileItemPtr &item, const QJsonObject &result, const QByteArray &responseTimestamp);
+    void done();
+
+    QVector<SyncFileItemPtr> _items;
+
+    // The content checksum type and the transmission checksum type
+    QVector<QByteArray> _checksumTypes;
+
+    // The items that are read and then sent, with the checksum header sent for each
+    QVector<SyncFileItemPtr> _uploading;
+    QVector<QByteArray> _transmissionChecksumHeaders;
+
+    QPointer<PutMultiFileJob> _job;
+    SyncFileItem::Status _hasError = SyncFileItem::NoStatus;
+};
+}
@@ -70,6 +70,10 @@ QUrl PropagateUploadFileNG::chunkUrl(int chunk)
     +---->  startNextChunk()  ---finished?  --+
                   ^               |          |
                   +---------------+          |
+                  (several PUTs in flight    |
+                   if parallel chunk upload  |
+                   is enabled; the MOVE      |
+                   waits for all of them)    |
                                              |
     +----------------------------------------+
     |
@@ -78,6 +82,16 @@ QUrl PropagateUploadFileNG::chunkUrl(int chunk)
 
  */
 
+bool PropagateUploadFileNG::parallelChunksEnabled() const
+{
+    // With dynamic chunk sizing every chunk gets the size that the previous
+    // ones suggest, see slotPutFinished(). That only works one after another.
+    const auto &options = propagator()->syncOptions();
+    const bool fixedChunkSize = options._targetChunkUploadDuration.count() == 0
+        || options._minChunkSize == options._maxChunkSize;
+    return fixedChunkSize && parallelChunkUploadEnabled();
+}
+
 void PropagateUploadFileNG::doStartUpload()
 {
     propagator()->_activeJobList.append(this);
@@ -86,6 +100,7 @@ void PropagateUploadFileNG::doStartUpload()
     if (progressInfo._valid && progressInfo.isChunked() && progressInfo._modtime == _item->_modtime
             && progressInfo._size == qint64(_item->_size)) {
         _transferId = progressInfo._transferid;
+        _fixedChunkSize = progressInfo._chunkSize;
         auto url = chunkUrl();
         auto job = new LsColJob(propagator()->account(), url, this);
         _jobs.append(job);
@@ -130,13 +145,49 @@ void PropagateUploadFileNG::slotPropfindFinished()
     slotJobDestroyed(job); // remove it from the _jobs list
     propagator()->_activeJobList.removeOne(this);
 
+    // The size chunk n must have if the chunks have a fixed size, 0 if it is past the end
+    const quint64 fileSize = _fileToUpload._size;
+    auto expectedChunkSize = [this, fileSize](int chunk) -> quint64 {
+        const quint64 offset = quint64(chunk) * _fixedChunkSize;
+        return offset < fileSize ? qMin(_fixedChunkSize, fileSize - offset) : 0;
+    };
+
     _currentChunk = 0;
     _sent = 0;
-    while (_serverChunks.contains(_currentChunk)) {
+    while (_serverChunks.contains(_currentChunk)
+        && (_fixedChunkSize == 0 || _serverChunks[_currentChunk].size == expectedChunkSize(_currentChunk))) {
         _sent += _serverChunks[_currentChunk].size;
         _serverChunks.remove(_currentChunk);
         ++_currentChunk;
     }
+    _confirmed = _sent;
+
+    if (_fixedChunkSize > 0 && !parallelChunksEnabled()) {
+        // Parallel chunk upload was turned off since the upload started: go on with
+        // one chunk at a time after the first hole, the chunks behind it are removed
+        qCInfo(lcPropagateUpload) << "Parallel chunk upload is disabled, resuming" << _item->_file << "sequentially";
+        _fixedChunkSize = 0;
+        SyncJournalDb::UploadInfo pi = propagator()->_journal->getUploadInfo(_item->_file);
+        pi._chunkSize = 0;
+        propagator()->_journal->setUploadInfo(_item->_file, pi);
+        propagator()->_journal->commitBatched("Upload info");
+    }
+
+    _chunksOnServer.clear();
+    if (_fixedChunkSize > 0) {
+        // Chunks sent in parallel may have completed out of order. Each one
+        // has a known place, so keep the complete ones after the hole too.
+        for (auto it = _serverChunks.begin(); it != _serverChunks.end();) {
+            const quint64 expectedSize = expectedChunkSize(it.key());
+            if (expectedSize > 0 && it.value().size == expectedSize) {
+                _chunksOnServer.insert(it.key());
+                _confirmed += expectedSize;
+                it = _serverChunks.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
 
     if (_sent > _fileToUpload._size) {
         // Normally this can't happen because the size is xor'ed with the transfer id, and it is
@@ -154,7 +205,8 @@ void PropagateUploadFileNG::slotPropfindFinished()
         return;
     }
 
-    qCInfo(lcPropagateUpload) << "Resuming " << _item->_file << " from chunk " << _currentChunk << "; sent =" << _sent;
+    qCInfo(lcPropagateUpload) << "Resuming " << _item->_file << " from chunk " << _currentChunk << "; sent =" << _sent
+                              << "; later chunks already uploaded =" << _chunksOnServer.size();
 
     if (!_serverChunks.isEmpty()) {
         qCInfo(lcPropagateUpload) << "To Delete" << _serverChunks.keys();
@@ -229,7 +281,13 @@ void PropagateUploadFileNG::startNewUpload()
     ASSERT(propagator()->_activeJobList.count(this) == 1);
     _transferId = qrand() ^ _item->_modtime ^ (_fileToUpload._size << 16) ^ qHash(_fileToUpload._file);
     _sent = 0;
+    _confirmed = 0;
     _currentChunk = 0;
+    _chunksOnServer.clear();
+
+    // Chunks sent in parallel can't be sized dynamically: on resume their
+    // offset has to follow from their number.
+    _fixedChunkSize = parallelChunksEnabled() ? propagator()->_chunkSize : 0;
 
     propagator()->reportProgress(*_item, 0);
 
@@ -239,8 +297,9 @@ void PropagateUploadFileNG::startNewUpload()
     pi._modtime = _item->_modtime;
     pi._contentChecksum = _item->_checksumHeader;
     pi._size = _item->_size;
+    pi._chunkSize = _fixedChunkSize;
     propagator()->_journal->setUploadInfo(_item->_file, pi);
-    propagator()->_journal->commit("Upload info");
+    propagator()->_journal->commitBatched("Upload info");
     QMap<QByteArray, QByteArray> headers;
 
     // But we should send the temporary (or something) one.
@@ -278,10 +337,21 @@ void PropagateUploadFileNG::startNextChunk()
     quint64 fileSize = _fileToUpload._size;
     ENFORCE(fileSize >= _sent, "Sent data exceeds file size");
 
+    // Skip the chunks that a previous attempt already got onto the server
+    while (_chunksOnServer.remove(_currentChunk)) {
+        _sent += qMin(_fixedChunkSize, fileSize - _sent);
+        ++_currentChunk;
+    }
+
     // prevent situation that chunk size is bigger then required one to send
-    _currentChunkSize = qMin(propagator()->_chunkSize, fileSize - _sent);
+    const quint64 chunkSize = _fixedChunkSize > 0 ? _fixedChunkSize : propagator()->_chunkSize;
+    _currentChunkSize = qMin(chunkSize, fileSize - _sent);
 
     if (_currentChunkSize == 0) {
+        if (!_chunksInFlight.isEmpty()) {
+            // The server can only assemble the file once it has all chunks
+            return;
+        }
         Q_ASSERT(_jobs.isEmpty()); // There should be no running job anymore
         _finished = true;
 
@@ -332,6 +402,7 @@ void PropagateUploadFileNG::startNextChunk()
     QMap<QByteArray, QByteArray> headers;
     headers["OC-Chunk-Offset"] = QByteArray::number(_sent);
 
+    _chunksInFlight.insert(_currentChunk, { _currentChunkSize, 0 });
     _sent += _currentChunkSize;
     QUrl url = chunkUrl(_currentChunk);
 
@@ -348,6 +419,13 @@ void PropagateUploadFileNG::startNextChunk()
     job->start();
     propagator()->_activeJobList.append(this);
     _currentChunk++;
+
+    // The server assembles the chunks by name, so with a fixed chunk size
+    // more of them can be on their way at the same time
+    if (_fixedChunkSize > 0 && _sent < fileSize
+        && propagator()->laneHasCapacity(lane())) {
+        startNextChunk();
+    }
 }
 
 void PropagateUploadFileNG::slotPutFinished()
@@ -372,7 +450,9 @@ void PropagateUploadFileNG::slotPutFinished()
         return;
     }
 
-    ENFORCE(_sent <= _fileToUpload._size, "can't send more than size");
+    const quint64 chunkSize = _chunksInFlight.take(job->_chunk).size;
+    _confirmed += chunkSize;
+    ENFORCE(_confirmed <= _fileToUpload._size, "can't send more than size");
 
     // Adjust the chunk size for the time taken.
     //
@@ -381,7 +461,7 @@ void PropagateUploadFileNG::slotPutFinished()
     auto targetDuration = propagator()->syncOptions()._targetChunkUploadDuration;
     if (targetDuration.count() > 0) {
         auto uploadTime = ++job->msSinceStart(); // add one to avoid div-by-zero
-        qint64 predictedGoodSize = (_currentChunkSize * targetDuration) / uploadTime;
+        qint64 predictedGoodSize = (chunkSize * targetDuration) / uploadTime;
 
         // The whole targeting is heuristic. The predictedGoodSize will fluctuate
         // quite a bit because of external factors (like available bandwidth)
@@ -397,13 +477,13 @@ void PropagateUploadFileNG::slotPutFinished()
             targetSize,
             propagator()->syncOptions()._maxChunkSize);
 
-        qCInfo(lcPropagateUpload) << "Chunked upload of" << _currentChunkSize << "bytes took" << uploadTime.count()
+        qCInfo(lcPropagateUpload) << "Chunked upload of" << chunkSize << "bytes took" << uploadTime.count()
                                   << "ms, desired is" << targetDuration.count() << "ms, expected good chunk size is"
                                   << predictedGoodSize << "bytes and nudged next chunk size to "
                                   << propagator()->_chunkSize << "bytes";
     }
 
-    _finished = _sent == _item->_size;
+    _finished = _sent == _item->_size && _chunksInFlight.isEmpty();
 
     // Check if the file still exists
     const QString fullFilePath(propagator()->getFilePath(_item->_file));
@@ -436,7 +516,7 @@ void PropagateUploadFileNG::slotPutFinished()
         auto uploadInfo = propagator()->_journal->getUploadInfo(_item->_file);
         uploadInfo._errorCount = 0;
         propagator()->_journal->setUploadInfo(_item->_file, uploadInfo);
-        propagator()->_journal->commit("Upload info");
+        propagator()->_journal->commitBatched("Upload info");
     }
     startNextChunk();
 }
@@ -491,7 +571,19 @@ void PropagateUploadFileNG::slotUploadProgress(qint64 sent, qint64 total)
     if (sent == 0 && total == 0) {
         return;
     }
-    propagator()->reportProgress(*_item, _sent + sent - total);
+    auto *job = qobject_cast<PUTFileJob *>(sender());
+    ASSERT(job);
+    auto chunk = _chunksInFlight.find(job->_chunk);
+    if (chunk == _chunksInFlight.end()) {
+        return;
+    }
+    chunk->sent = sent;
+
+    qint64 inFlight = 0;
+    for (const auto &c : qAsConst(_chunksInFlight)) {
+        inFlight += c.sent;
+    }
+    propagator()->reportProgress(*_item, _confirmed + inFlight);
 }
 
 void PropagateUploadFileNG::abort(PropagatorJob::AbortType abortType)
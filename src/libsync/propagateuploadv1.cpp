@@ -61,7 +61,7 @@ void PropagateUploadFileV1::doStartUpload()
         pi._contentChecksum = _item->_checksumHeader;
         pi._size = _item->_size;
         propagator()->_journal->setUploadInfo(_item->_file, pi);
-        propagator()->_journal->commit("Upload info");
+        propagator()->_journal->commitBatched("Upload info");
     }
 
     _currentChunk = 0;
@@ -152,24 +152,7 @@ void PropagateUploadFileV1::startNextChunk()
     propagator()->_activeJobList.append(this);
     _currentChunk++;
 
-    bool parallelChunkUpload = true;
-
-    if (propagator()->account()->capabilities().chunkingParallelUploadDisabled()) {
-        // Server may also disable parallel chunked upload for any higher version
-        parallelChunkUpload = false;
-    } else {
-        QByteArray env = qgetenv("OWNCLOUD_PARALLEL_CHUNK");
-        if (!env.isEmpty()) {
-            parallelChunkUpload = env != "false" && env != "0";
-        } else {
-            int versionNum = propagator()->account()->serverVersionInt();
-            if (versionNum < Account::makeServerVersion(8, 0, 3)) {
-                // Disable parallel chunk upload severs older than 8.0.3 to avoid too many
-                // internal sever errors (#2743, #2938)
-                parallelChunkUpload = false;
-            }
-        }
-    }
+    bool parallelChunkUpload = parallelChunkUploadEnabled();
 
     if (_currentChunk + _startChunk >= _chunkCount - 1) {
         // Don't do parallel upload of chunk if this might be the last chunk because the server cannot handle that
@@ -177,7 +160,7 @@ void PropagateUploadFileV1::startNextChunk()
         parallelChunkUpload = false;
     }
 
-    if (parallelChunkUpload && (propagator()->_activeJobList.count() < propagator()->maximumActiveTransferJob())
+    if (parallelChunkUpload && propagator()->laneHasCapacity(lane())
         && _currentChunk < _chunkCount) {
         startNextChunk();
     }
@@ -289,7 +272,7 @@ void PropagateUploadFileV1::slotPutFinished()
         pi._contentChecksum = _item->_checksumHeader;
         pi._size = _item->_size;
         propagator()->_journal->setUploadInfo(_item->_file, pi);
-        propagator()->_journal->commit("Upload info");
+        propagator()->_journal->commitBatched("Upload info");
         startNextChunk();
         return;
     }
@@ -127,7 +127,7 @@ void PropagateLocalRemove::start()
     }
     propagator()->reportProgress(*_item, 0);
     propagator()->_journal->deleteFileRecord(_item->_originalFile, _item->isDirectory());
-    propagator()->_journal->commit("Local remove");
+    propagator()->_journal->commitBatched("Local remove");
     done(SyncFileItem::Success);
 }
 
@@ -217,7 +217,7 @@ void PropagateLocalMkdir::startLocalMkdir()
         done(SyncFileItem::FatalError, tr("Error writing metadata to the database"));
         return;
     }
-    propagator()->_journal->commit("localMkdir");
+    propagator()->_journal->commitBatched("localMkdir");
 
     auto resultStatus = _item->_instruction == CSYNC_INSTRUCTION_CONFLICT
         ? SyncFileItem::Conflict
@@ -306,7 +306,7 @@ void PropagateLocalRename::start()
         }
     }
 
-    propagator()->_journal->commit("localRename");
+    propagator()->_journal->commitBatched("localRename");
 
     done(SyncFileItem::Success);
 }
@@ -90,6 +90,5 @@ public:
     {
     }
     void start() override;
-    JobParallelism parallelism() override { return _item->isDirectory() ? WaitForFinished : FullParallelism; }
 };
 }
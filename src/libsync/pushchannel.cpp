@@ -0,0 +1,129 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#include "pushchannel.h"
+#include "networkjobs.h"
+
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLoggingCategory>
+#include <QNetworkReply>
+#include <QUrlQuery>
+
+using namespace std::chrono;
+
+namespace OCC {
+
+Q_LOGGING_CATEGORY(lcPushChannel, "nextcloud.sync.pushchannel", QtInfoMsg)
+
+static const milliseconds maximumRetryDelay = minutes(5);
+
+PushChannel::PushChannel(AccountPtr account, const QUrl &endpoint, QObject *parent)
+    : QObject(parent)
+    , _account(account)
+    , _endpoint(endpoint)
+    , _minimumRetryDelay(seconds(5))
+    , _retryDelay(_minimumRetryDelay)
+{
+    _retryTimer.setSingleShot(true);
+    connect(&_retryTimer, &QTimer::timeout, this, &PushChannel::poll);
+}
+
+PushChannel::~PushChannel() = default;
+
+void PushChannel::setMinimumRetryDelay(milliseconds delay)
+{
+    _minimumRetryDelay = delay;
+    _retryDelay = delay;
+}
+
+void PushChannel::start()
+{
+    if (_running)
+        return;
+    qCInfo(lcPushChannel) << "Listening for remote changes at" << _endpoint.toString();
+    _running = true;
+    _retryDelay = _minimumRetryDelay;
+    poll();
+}
+
+void PushChannel::stop()
+{
+    _running = false;
+    _retryTimer.stop();
+    // Deleting the job aborts the request
+    delete _job;
+    setConnected(false);
+}
+
+void PushChannel::poll()
+{
+    if (!_running || _job)
+        return;
+
+    QUrl url = _endpoint;
+    if (!_cursor.isEmpty()) {
+        QUrlQuery query(url);
+        query.addQueryItem(QStringLiteral("cursor"), _cursor);
+        url.setQuery(query);
+    }
+    _job = new SimpleNetworkJob(_account, this);
+    connect(_job.data(), &SimpleNetworkJob::finishedSignal, this, &PushChannel::slotPollFinished);
+    _job->startRequest("GET", url);
+}
+
+void PushChannel::slotPollFinished(QNetworkReply *reply)
+{
+    // The job deletes itself
+    _job.clear();
+    if (!_running)
+        return;
+
+    int httpStatus = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    QJsonParseError error;
+    auto json = QJsonDocument::fromJson(reply->readAll(), &error).object();
+    auto cursor = json.value(QStringLiteral("cursor")).toString();
+    if (reply->error() != QNetworkReply::NoError || httpStatus != 200
+        || error.error != QJsonParseError::NoError || cursor.isEmpty()) {
+        qCWarning(lcPushChannel) << "Request failed, retrying in" << _retryDelay.count() << "ms:"
+                                 << httpStatus << reply->errorString() << error.errorString();
+        setConnected(false);
+        _retryTimer.start(_retryDelay.count());
+        _retryDelay = qMin(_retryDelay * 2, maximumRetryDelay);
+        return;
+    }
+
+    _retryDelay = _minimumRetryDelay;
+    _cursor = cursor;
+    setConnected(true);
+
+    QStringList paths;
+    for (const auto &path : json.value(QStringLiteral("changes")).toArray())
+        paths.append(path.toString());
+    if (!paths.isEmpty()) {
+        qCInfo(lcPushChannel) << "Remote changes below" << paths;
+        emit filesChanged(paths);
+    }
+
+    QMetaObject::invokeMethod(this, &PushChannel::poll, Qt::QueuedConnection);
+}
+
+void PushChannel::setConnected(bool connected)
+{
+    if (_connected == connected)
+        return;
+    _connected = connected;
+    emit connectedChanged(connected);
+}
+
+}
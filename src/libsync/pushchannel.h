@@ -0,0 +1,89 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#ifndef PUSHCHANNEL_H
+#define PUSHCHANNEL_H
+
+#include <QObject>
+#include <QPointer>
+#include <QStringList>
+#include <QTimer>
+#include <QUrl>
+#include <chrono>
+
+#include "accountfwd.h"
+#include "owncloudlib.h"
+
+class QNetworkReply;
+
+namespace OCC {
+
+class SimpleNetworkJob;
+
+/**
+ * @brief Long-polls the server for changes of remote files
+ * @ingroup libsync
+ *
+ * Each request to the endpoint carries the cursor of the previous answer.
+ * The server holds the request until files changed after that cursor, or
+ * until shortly before the network timeout, and then answers with
+ *
+ *     { "cursor": "<opaque>", "changes": [ "/path/of/changed/file", ... ] }
+ *
+ * The paths are relative to the user's WebDAV root. A request without a
+ * cursor is answered right away with the current cursor.
+ *
+ * While requests fail, the channel is disconnected and retries with a
+ * growing delay. Users are expected to poll for changes in the meantime.
+ */
+class OWNCLOUDSYNC_EXPORT PushChannel : public QObject
+{
+    Q_OBJECT
+public:
+    PushChannel(AccountPtr account, const QUrl &endpoint, QObject *parent = nullptr);
+    ~PushChannel() override;
+
+    void start();
+    void stop();
+
+    /** Whether the last request was answered, so that changes are pushed */
+    bool isConnected() const { return _connected; }
+
+    /** The delay before the first retry after a failed request, doubled for
+     * each further one. Five seconds unless changed, for tests.
+     */
+    void setMinimumRetryDelay(std::chrono::milliseconds delay);
+
+signals:
+    void connectedChanged(bool connected);
+
+    /** Files at or below these paths changed on the server */
+    void filesChanged(const QStringList &paths);
+
+private:
+    void poll();
+    void slotPollFinished(QNetworkReply *reply);
+    void setConnected(bool connected);
+
+    AccountPtr _account;
+    QUrl _endpoint;
+    QString _cursor;
+    QPointer<SimpleNetworkJob> _job;
+    QTimer _retryTimer;
+    std::chrono::milliseconds _minimumRetryDelay;
+    std::chrono::milliseconds _retryDelay;
+    bool _running = false;
+    bool _connected = false;
+};
+}
+
+#endif // PUSHCHANNEL_H
@@ -58,7 +58,6 @@ namespace OCC {
 Q_LOGGING_CATEGORY(lcEngine, "nextcloud.sync.engine", QtInfoMsg)
 
 static const int s_touchedFilesMaxAgeMs = 15 * 1000;
-bool SyncEngine::s_anySyncRunning = false;
 
 qint64 SyncEngine::minimumFileAgeForUpload = 2000;
 
@@ -774,12 +773,11 @@ void SyncEngine::startSync()
         }
     }
 
-    if (s_anySyncRunning || _syncRunning) {
+    if (_syncRunning) {
         ASSERT(false);
         return;
     }
 
-    s_anySyncRunning = true;
     _syncRunning = true;
     _anotherSyncNeeded = NoFollowUpSync;
     _clearTouchedFilesTimer.stop();
@@ -852,11 +850,18 @@ void SyncEngine::startSync()
     _excludedFiles->setExcludeConflictFiles(!_account->capabilities().uploadConflictFiles());
 
     _csync_ctx->read_remote_from_db = true;
+    _csync_ctx->parallel_update = _syncOptions._parallelUpdateDetection;
+    _csync_ctx->local_walk_threads = _syncOptions._localDiscoveryThreads;
+    if (_csync_ctx->local_walk_threads < 0) {
+        // Beyond a few threads the disk is the limit, not the cores
+        _csync_ctx->local_walk_threads = qBound(2, QThread::idealThreadCount(), 8);
+    }
 
     _lastLocalDiscoveryStyle = _localDiscoveryStyle;
     _csync_ctx->should_discover_locally_fn = [this](const QByteArray &path) {
         return shouldDiscoverLocally(path);
     };
+    _csync_ctx->remote_discovery_paths = remoteDirectoriesToList();
 
     // If needed, make sure we have up to date E2E information before the
     // discovery phase, otherwise we start right away
@@ -951,8 +956,10 @@ void SyncEngine::slotStartDiscovery()
     // be interacting with at the time.
     _thread.start(QThread::LowPriority);
 
-    _discoveryMainThread = new DiscoveryMainThread(account());
+    _discoveryMainThread = new DiscoveryMainThread(account(), _journal, _syncOptions);
     _discoveryMainThread->setParent(this);
+    // The root listing carries the data fingerprint, without one it is unchanged
+    _discoveryMainThread->_dataFingerprint = _journal->dataFingerprint();
     connect(this, &SyncEngine::finished, _discoveryMainThread.data(), &QObject::deleteLater);
     qCInfo(lcEngine) << "Server" << account()->serverVersion()
                      << (account()->isHttp2Supported() ? "Using HTTP/2" : "");
@@ -1200,6 +1207,7 @@ void SyncEngine::slotDiscoveryJobFinished(int discoveryResult)
     // Re-init the csync context to free memory
     _csync_ctx->reinitialize();
     _localDiscoveryPaths.clear();
+    _remoteDiscoveryPaths.clear();
 
     // To announce the beginning of the sync
     emit aboutToPropagate(syncItems);
@@ -1246,6 +1254,10 @@ void SyncEngine::slotDiscoveryJobFinished(int discoveryResult)
     deleteStaleErrorBlacklistEntries(syncItems);
     _journal->commit("post stale entry removal");
 
+    // Per item commits of the propagation are grouped from now on
+    _journal->setCommitBatching(_syncOptions._journalCommitBatchSize, _syncOptions._journalCommitBatchDelay);
+    _journal->takeCommitStatistics();
+
     // Emit the started signal only after the propagator has been set up.
     if (_needsUpdate)
         emit(started());
@@ -1310,6 +1322,11 @@ void SyncEngine::slotFinished(bool success)
 
     _journal->commit("All Finished.", false);
 
+    auto commitStatistics = _journal->takeCommitStatistics();
+    qCInfo(lcEngine) << "Journal commits during propagation:" << commitStatistics.commits
+                     << "for" << commitStatistics.requests << "requests, largest batch" << commitStatistics.largestBatch
+                     << "," << commitStatistics.commitsPerSecond << "commits/s";
+
     // Send final progress information even if no
     // files needed propagation, but clear the lastCompletedItem
     // so we don't count this twice (like Recent Files)
@@ -1326,12 +1343,12 @@ void SyncEngine::finalize(bool success)
     _thread.wait();
 
     _csync_ctx->reinitialize();
+    _journal->setCommitBatching(1, std::chrono::milliseconds(0));
     _journal->close();
 
     qCInfo(lcEngine) << "CSync run took " << _stopWatch.addLapTime(QLatin1String("Sync Finished")) << "ms";
     _stopWatch.stop();
 
-    s_anySyncRunning = false;
     _syncRunning = false;
     emit finished(success);
 
@@ -1343,6 +1360,7 @@ void SyncEngine::finalize(bool success)
     _uniqueErrors.clear();
     _localDiscoveryPaths.clear();
     _localDiscoveryStyle = LocalDiscoveryStyle::FilesystemOnly;
+    _remoteDiscoveryPaths.clear();
 
     _clearTouchedFilesTimer.start();
 }
@@ -1757,6 +1775,12 @@ bool SyncEngine::shouldDiscoverLocally(const QByteArray &path) const
     if (_localDiscoveryStyle == LocalDiscoveryStyle::FilesystemOnly)
         return true;
 
+    // inside a subtree that is discovered as a whole?
+    for (int i = path.indexOf('/'); i != -1; i = path.indexOf('/', i + 1)) {
+        if (_localDiscoveryPaths.count(path.left(i + 1)))
+            return true;
+    }
+
     auto it = _localDiscoveryPaths.lower_bound(path);
     if (it == _localDiscoveryPaths.end() || !it->startsWith(path))
         return false;
@@ -1776,6 +1800,45 @@ bool SyncEngine::shouldDiscoverLocally(const QByteArray &path) const
     return false;
 }
 
+void SyncEngine::setRemoteDiscoveryPaths(std::set<QByteArray> paths)
+{
+    _remoteDiscoveryPaths = std::move(paths);
+}
+
+/* The directories to list on the server for the changed remote paths: the
+ * parent directory of each, or the closest ancestor the journal knows as a
+ * directory when the parent is new. Empty if that takes a full discovery. */
+std::set<QByteArray> SyncEngine::remoteDirectoriesToList() const
+{
+    std::set<QByteArray> directories;
+    for (const auto &path : _remoteDiscoveryPaths) {
+        QByteArray directory = path;
+        forever {
+            const int slash = directory.lastIndexOf('/');
+            directory = slash < 0 ? QByteArray() : directory.left(slash);
+            if (directory.isEmpty())
+                break;
+            SyncJournalFileRecord rec;
+            if (!_journal->getFileRecord(directory, &rec))
+                return {};
+            if (rec.isValid() && rec._type == ItemTypeDirectory) {
+                // The listing of encrypted folders is by mangled names
+                if (rec._isE2eEncrypted || !rec._e2eMangledName.isEmpty())
+                    return {};
+                break;
+            }
+        }
+        // Listing the root is where a full discovery starts anyway
+        if (directory.isEmpty())
+            return {};
+        directories.insert(directory);
+    }
+    if (!directories.empty()) {
+        qCInfo(lcEngine) << "Remote discovery limited to" << directories.size() << "changed directories";
+    }
+    return directories;
+}
+
 void SyncEngine::abort()
 {
     if (_propagator)
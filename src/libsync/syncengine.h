@@ -105,7 +105,8 @@ public:
      *
      * If style is DatabaseAndFilesystem, paths a set of file paths relative to
      * the synced folder. All the parent directories of these paths will not
-     * be read from the db and scanned on the filesystem.
+     * be read from the db and scanned on the filesystem. A path ending with
+     * a '/' stands for the directory and everything below it.
      *
      * Note, the style and paths are only retained for the next sync and
      * revert afterwards. Use _lastLocalDiscoveryStyle to discover the last
@@ -118,10 +119,21 @@ public:
      * given the local discovery options.
      *
      * Example: If path is 'foo/bar' and style is DatabaseAndFilesystem and dirs contains
-     *     'foo/bar/touched_file', then the result will be true.
+     *     'foo/bar/touched_file' or 'foo/', then the result will be true.
      */
     bool shouldDiscoverLocally(const QByteArray &path) const;
 
+    /**
+     * Restrict the next remote discovery to the given changed paths, relative
+     * to the synced folder, like the ones the server pushes. Only the
+     * directories containing them are listed on the server, the rest of the
+     * remote tree is read from the db. An empty set means a full discovery.
+     *
+     * Like the local discovery options, the paths are only retained for the
+     * next sync.
+     */
+    void setRemoteDiscoveryPaths(std::set<QByteArray> paths);
+
     /** Access the last sync run's local discovery style */
     LocalDiscoveryStyle lastLocalDiscoveryStyle() const { return _lastLocalDiscoveryStyle; }
 
@@ -225,8 +237,6 @@ private:
     // cleanup and emit the finished signal
     void finalize(bool success);
 
-    static bool s_anySyncRunning; //true when one sync is running somewhere (for debugging)
-
     // Must only be acessed during update and reconcile
     QMap<QString, SyncFileItemPtr> _syncItemMap;
 
@@ -314,6 +324,10 @@ private:
     LocalDiscoveryStyle _lastLocalDiscoveryStyle = LocalDiscoveryStyle::FilesystemOnly;
     LocalDiscoveryStyle _localDiscoveryStyle = LocalDiscoveryStyle::FilesystemOnly;
     std::set<QByteArray> _localDiscoveryPaths;
+
+    // Changed remote paths for the next sync, see setRemoteDiscoveryPaths()
+    std::set<QByteArray> _remoteDiscoveryPaths;
+    std::set<QByteArray> remoteDirectoriesToList() const;
 };
 }
 
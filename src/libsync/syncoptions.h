@@ -59,6 +59,42 @@ struct SyncOptions
 
     /** Whether parallel network jobs are allowed. */
     bool _parallelNetworkJobs = true;
+
+    /** Maximum number of directory listings the remote discovery keeps in flight.
+     *
+     * Child directories are prefetched as soon as the listing of their parent arrives.
+     * Set to 1 to disable prefetching, -1 picks a default depending on HTTP/2 support.
+     */
+    int _maxParallelDiscoveryJobs = -1;
+
+    /** Whether the local file system is walked while the remote discovery runs,
+     * instead of one after the other. */
+    bool _parallelUpdateDetection = true;
+
+    /** Number of threads listing local directories ahead of the local walk.
+     *
+     * Set to 0 to list each directory only when the walk reaches it,
+     * -1 picks a default depending on the number of cores.
+     */
+    int _localDiscoveryThreads = -1;
+
+    /** How many journal commits of finished items may be grouped into one
+     * transaction during propagation, see SyncJournalDb::commitBatched().
+     *
+     * Set to 1 to commit after each item.
+     */
+    int _journalCommitBatchSize = 100;
+
+    /** The longest time a journal commit is held back for batching. */
+    std::chrono::milliseconds _journalCommitBatchDelay = std::chrono::seconds(1);
+
+    /** Whether disk space for a download is reserved before it starts,
+     * see FileSystem::preallocate(). */
+    bool _preallocateDownloads = true;
+
+    /** Whether downloads that aren't bandwidth limited are read in large
+     * chunks, see GETFileJob::readBufferSize(). */
+    bool _largeDownloadBuffers = true;
 };
 
 
@@ -0,0 +1,145 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include "syncenginetestutils.h"
+#include <syncengine.h>
+
+#include <QLoggingCategory>
+#include <QNetworkProxy>
+#include <QTcpServer>
+#include <QTcpSocket>
+
+using namespace OCC;
+
+// Download a few large files and report the throughput of the read and write
+// path: with the small buffers that were used for all downloads before, with
+// large buffers, and with large buffers and preallocation. The first argument
+// overrides the number of files, the second their size in MB.
+//
+// The files are served over HTTP on a local port rather than by FakeGetReply,
+// which has all data available at once and ignores setReadBufferSize().
+
+// Serves the files of the fake server. The body is written in segments and
+// only as fast as the socket takes it, like a server with a fast network.
+class LocalHttpServer
+{
+public:
+    explicit LocalHttpServer(FileInfo &remoteRootFileInfo)
+        : _remoteRootFileInfo(remoteRootFileInfo)
+    {
+        QObject::connect(&_server, &QTcpServer::newConnection, [this] {
+            while (auto socket = _server.nextPendingConnection())
+                serve(socket);
+        });
+        if (!_server.listen(QHostAddress::LocalHost))
+            qFatal("Cannot listen on a local port: %s", qPrintable(_server.errorString()));
+    }
+
+    QUrl url(const QString &path) const
+    {
+        return QUrl(QStringLiteral("http://127.0.0.1:%1/%2").arg(_server.serverPort()).arg(path));
+    }
+
+private:
+    struct Connection
+    {
+        QByteArray request;
+        char contentChar = 'W';
+        qint64 remaining = 0;
+    };
+
+    void serve(QTcpSocket *socket)
+    {
+        auto connection = QSharedPointer<Connection>::create();
+
+        auto sendBody = [socket, connection] {
+            static const qint64 segmentSize = 64 * 1024;
+            static const qint64 maximumPending = 1024 * 1024;
+            while (connection->remaining > 0 && socket->bytesToWrite() < maximumPending) {
+                const qint64 size = qMin(segmentSize, connection->remaining);
+                socket->write(QByteArray(int(size), connection->contentChar));
+                connection->remaining -= size;
+            }
+        };
+
+        QObject::connect(socket, &QTcpSocket::readyRead, socket, [this, socket, connection, sendBody] {
+            connection->request += socket->readAll();
+            // The client sends the next request on this connection after the reply
+            while (connection->remaining == 0) {
+                const int end = connection->request.indexOf("\r\n\r\n");
+                if (end < 0)
+                    return;
+                const QByteArray requestLine = connection->request.left(connection->request.indexOf("\r\n"));
+                connection->request.remove(0, end + 4);
+
+                const QString path = QUrl::fromPercentEncoding(requestLine.split(' ').value(1).mid(1));
+                const FileInfo *fileInfo = _remoteRootFileInfo.find(path);
+                if (!fileInfo) {
+                    socket->write("HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n");
+                    continue;
+                }
+                const QByteArray header = "HTTP/1.1 200 OK\r\n"
+                                          "Content-Length: " + QByteArray::number(fileInfo->size) + "\r\n"
+                                          "ETag: " + fileInfo->etag.toLatin1() + "\r\n"
+                                          "OC-ETag: " + fileInfo->etag.toLatin1() + "\r\n"
+                                          "OC-FileId: " + fileInfo->fileId + "\r\n\r\n";
+                socket->write(header);
+                connection->contentChar = fileInfo->contentChar;
+                connection->remaining = fileInfo->size;
+                sendBody();
+            }
+        });
+        QObject::connect(socket, &QTcpSocket::bytesWritten, socket, sendBody);
+        QObject::connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+    }
+
+    FileInfo &_remoteRootFileInfo;
+    QTcpServer _server;
+};
+
+static bool downloadAll(int files, qint64 size, bool largeBuffers, bool preallocate)
+{
+    FakeFolder fakeFolder{ FileInfo{} };
+    SyncOptions options;
+    options._largeDownloadBuffers = largeBuffers;
+    options._preallocateDownloads = preallocate;
+    fakeFolder.syncEngine().setSyncOptions(options);
+    for (int i = 0; i < files; ++i)
+        fakeFolder.remoteModifier().insert(QStringLiteral("file%1").arg(i), size);
+
+    LocalHttpServer server(fakeFolder.remoteModifier());
+    QNetworkAccessManager qnam;
+    qnam.setProxy(QNetworkProxy::NoProxy);
+    fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+        if (op != QNetworkAccessManager::GetOperation)
+            return nullptr;
+        return qnam.get(QNetworkRequest(server.url(getFilePathFromUrl(request.url()))));
+    });
+
+    QElapsedTimer timer;
+    timer.start();
+    bool result = fakeFolder.syncOnce();
+    qint64 elapsed = qMax<qint64>(timer.elapsed(), 1);
+    qDebug() << (largeBuffers ? "LARGE BUFFERS" : "SMALL BUFFERS") << (preallocate ? "PREALLOCATED:" : "NOT PREALLOCATED:")
+             << result << elapsed << "ms" << (files * size * 1000.0 / elapsed / (1024 * 1024)) << "MB/s";
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QLoggingCategory::setFilterRules(QStringLiteral("nextcloud.sync.*.debug=false"));
+
+    const int files = argc > 1 ? QByteArray(argv[1]).toInt() : 8;
+    const qint64 size = (argc > 2 ? QByteArray(argv[2]).toLongLong() : 100) * 1024 * 1024;
+    qDebug() << "DOWNLOADING" << files << "FILES OF" << size << "BYTES";
+
+    bool result1 = downloadAll(files, size, false, false);
+    bool result2 = downloadAll(files, size, true, false);
+    bool result3 = downloadAll(files, size, true, true);
+    return (result1 && result2 && result3) ? 0 : -1;
+}
@@ -0,0 +1,101 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include "folderwatcher.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QLoggingCategory>
+#include <QTemporaryDir>
+#include <QThread>
+#include <QTimer>
+#include <QDebug>
+
+using namespace OCC;
+
+// Create many files in a watched tree from another thread, the way a
+// "git checkout" or "tar x" would, and report how late the event loop of the
+// watcher got and how many notifications made it out. The first argument
+// overrides the number of files, the default is 100000.
+
+static const int tickMs = 5;
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QLoggingCategory::setFilterRules(QStringLiteral("nextcloud.gui.folderwatcher.info=false"));
+
+    const int files = argc > 1 ? QByteArray(argv[1]).toInt() : 100000;
+    const int directories = 100;
+
+    QTemporaryDir tmp;
+    const QString root = tmp.path();
+    for (int i = 0; i < directories; ++i)
+        QDir(root).mkdir(QStringLiteral("dir%1").arg(i));
+
+    FolderWatcher watcher;
+    int paths = 0;
+    int subtrees = 0;
+    int lostChanges = 0;
+    QElapsedTimer sinceLastSignal;
+    sinceLastSignal.start();
+    QObject::connect(&watcher, &FolderWatcher::pathChanged, [&] { ++paths; sinceLastSignal.restart(); });
+    QObject::connect(&watcher, &FolderWatcher::subtreeChanged, [&] { ++subtrees; sinceLastSignal.restart(); });
+    QObject::connect(&watcher, &FolderWatcher::lostChanges, [&] { ++lostChanges; sinceLastSignal.restart(); });
+    watcher.init(root);
+
+    // Let the watches of the subdirectories be registered
+    QElapsedTimer timer;
+    timer.start();
+    while (timer.elapsed() < 1000)
+        app.processEvents(QEventLoop::AllEvents, 100);
+
+    // Half the files in the watched directories, half in a new subtree
+    QThread *writer = QThread::create([&] {
+        for (int i = 0; i < files / 2; ++i) {
+            QFile f(root + QStringLiteral("/dir%1/file%2").arg(i % directories).arg(i));
+            f.open(QFile::WriteOnly);
+        }
+        QDir(root).mkpath(QStringLiteral("new/sub"));
+        for (int i = files / 2; i < files; ++i) {
+            QFile f(root + QStringLiteral("/new/sub/file%1").arg(i));
+            f.open(QFile::WriteOnly);
+        }
+    });
+
+    qint64 maxLatency = 0;
+    QElapsedTimer sinceTick;
+    QTimer ticker;
+    ticker.setInterval(tickMs);
+    QObject::connect(&ticker, &QTimer::timeout, [&] {
+        maxLatency = qMax(maxLatency, sinceTick.elapsed() - tickMs);
+        sinceTick.restart();
+    });
+
+    timer.restart();
+    sinceTick.start();
+    ticker.start();
+    writer->start();
+    while (!writer->isFinished())
+        app.processEvents(QEventLoop::AllEvents, 100);
+    const qint64 writeTime = timer.elapsed();
+
+    // Until things have been quiet for a while
+    sinceLastSignal.restart();
+    while (sinceLastSignal.elapsed() < 1000)
+        app.processEvents(QEventLoop::AllEvents, 100);
+    ticker.stop();
+    delete writer;
+
+    qDebug() << "CREATED" << files << "FILES IN" << writeTime << "ms";
+    qDebug() << "REPORTED:" << paths << "paths," << subtrees << "subtrees," << lostChanges << "lost changes";
+    qDebug() << "MAX EVENT LOOP LATENCY:" << maxLatency << "ms";
+
+    return paths + subtrees + lostChanges > 0 ? 0 : -1;
+}
@@ -0,0 +1,105 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include "csync_private.h"
+#include "vio/csync_vio_local.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QLoggingCategory>
+#include <QTemporaryDir>
+#include <QThread>
+#include <QDebug>
+
+#include <unistd.h>
+
+// Walk a generated local tree depth first the way the update phase does,
+// once listing every directory when it is reached and once with threads
+// listing ahead. Pass an existing directory as third argument to walk a real
+// tree. Run as root, the page cache is dropped before each walk to measure
+// cold walks. Otherwise a first walk warms the caches for all of them. The
+// order of the two kinds of walk alternates between the rounds.
+
+static void createTree(const QString &path, int depth, int directories, int files)
+{
+    QDir().mkpath(path);
+    for (int i = 0; i < files; ++i) {
+        QFile f(path + QStringLiteral("/file%1").arg(i));
+        f.open(QFile::WriteOnly);
+    }
+    if (depth == 0)
+        return;
+    for (int i = 0; i < directories; ++i) {
+        createTree(path + QStringLiteral("/dir%1").arg(i), depth - 1, directories, files);
+    }
+}
+
+// Needs root
+static bool dropCaches()
+{
+    ::sync();
+    QFile dropCaches(QStringLiteral("/proc/sys/vm/drop_caches"));
+    return dropCaches.open(QFile::WriteOnly) && dropCaches.write("3") == 1;
+}
+
+static int walk(const QByteArray &path, csync_vio_local_prefetch_s *prefetch)
+{
+    csync_vio_handle_t *dh = csync_vio_local_opendir(path.constData(), prefetch);
+    if (!dh)
+        return 0;
+    int count = 0;
+    while (auto fs = csync_vio_local_readdir(dh)) {
+        ++count;
+        if (fs->type == ItemTypeDirectory)
+            count += walk(path + '/' + fs->path, prefetch);
+    }
+    csync_vio_local_closedir(dh);
+    return count;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QLoggingCategory::setFilterRules(QStringLiteral("nextcloud.sync.csync.*.info=false"));
+
+    const int threads = argc > 1 ? QByteArray(argv[1]).toInt() : qBound(2, QThread::idealThreadCount(), 8);
+    QTemporaryDir tmp;
+    QByteArray root = argc > 2 ? QByteArray(argv[2]) : tmp.path().toLocal8Bit();
+    if (argc <= 2) {
+        // 4 levels of 8 directories with 20 files each: ~4700 directories, ~94000 files
+        createTree(tmp.path(), 4, 8, 20);
+    }
+
+    const bool cold = dropCaches();
+    if (!cold) {
+        walk(root, nullptr);
+    }
+
+    int serialCount = -1;
+    int prefetchCount = -1;
+    for (int round = 0; round < 4; ++round) {
+        for (bool prefetched : { round % 2 == 0, round % 2 != 0 }) {
+            if (cold)
+                dropCaches();
+            QElapsedTimer timer;
+            timer.start();
+            if (prefetched) {
+                auto prefetch = csync_vio_local_prefetch_start(root.constData(), threads, nullptr);
+                prefetchCount = walk(root, prefetch);
+                csync_vio_local_prefetch_stop(prefetch);
+                qDebug() << (cold ? "COLD" : "WARM") << "PREFETCHED WALK" << threads << "THREADS:" << prefetchCount << "entries in" << timer.elapsed() << "ms";
+            } else {
+                serialCount = walk(root, nullptr);
+                qDebug() << (cold ? "COLD" : "WARM") << "SERIAL WALK:" << serialCount << "entries in" << timer.elapsed() << "ms";
+            }
+        }
+    }
+
+    return serialCount == prefetchCount ? 0 : -1;
+}
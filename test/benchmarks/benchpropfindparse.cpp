@@ -0,0 +1,193 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include "account.h"
+#include "common/checksums.h"
+#include "common/utility.h"
+#include "discoveryphase.h"
+#include "networkjobs.h"
+#include "csync.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QDebug>
+
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+using namespace OCC;
+
+// Parses a large PROPFIND reply the way the discovery used to: buffered and
+// then parsed at once into a QMap of properties per entry, which was then
+// converted. Then with the discovery parser, which fills the entries directly,
+// once buffered and once while the data arrives. The XML is generated piece
+// by piece like a network reply delivers it, so only the buffered runs hold
+// all of it. Each run is done in a process of its own to report its peak
+// memory. The first argument overrides the number of entries.
+
+enum class Mode {
+    PropertyMap,
+    Buffered,
+    Incremental
+};
+
+static const char listingPath[] = "/remote.php/webdav/bench";
+static const int chunkSize = 16 * 1024; // About what a QNetworkReply delivers per readyRead
+
+static QByteArray responseXml(int i)
+{
+    const QByteArray name = i == 0 ? QByteArray() : "/file" + QByteArray::number(i);
+    return "<d:response><d:href>" + QByteArray(listingPath) + name + "</d:href>"
+           "<d:propstat><d:prop>"
+           "<d:resourcetype/>"
+           "<d:getlastmodified>Fri, 06 Feb 2015 13:49:55 GMT</d:getlastmodified>"
+           "<d:getcontentlength>121780</d:getcontentlength>"
+           "<d:getetag>\"5527beb0400b0" + QByteArray::number(i) + "\"</d:getetag>"
+           "<oc:id>" + QByteArray::number(i) + "ocobzus5kn6s</oc:id>"
+           "<oc:permissions>RDNVW</oc:permissions>"
+           "<oc:checksums><oc:checksum>SHA1:c3499c2729730a7f807efb8676a92dcb6f8a3f8f</oc:checksum></oc:checksums>"
+           "</d:prop><d:status>HTTP/1.1 200 OK</d:status></d:propstat>"
+           "<d:propstat><d:prop><oc:downloadURL/><oc:dDC/></d:prop>"
+           "<d:status>HTTP/1.1 404 Not Found</d:status></d:propstat>"
+           "</d:response>";
+}
+
+// Calls deliver() with pieces of the multistatus reply for the entries
+template <typename Deliver>
+static void generateReply(int entries, Deliver deliver)
+{
+    QByteArray chunk = "<?xml version='1.0' encoding='utf-8'?>"
+                       "<d:multistatus xmlns:d=\"DAV:\" xmlns:s=\"http://sabredav.org/ns\" xmlns:oc=\"http://owncloud.org/ns\">";
+    for (int i = 0; i < entries; ++i) {
+        chunk += responseXml(i);
+        if (chunk.size() >= chunkSize) {
+            deliver(chunk);
+            chunk.clear();
+        }
+    }
+    chunk += "</d:multistatus>";
+    deliver(chunk);
+}
+
+// How the discovery converted the properties of an entry before it had a parser of its own
+static void propertyMapToFileStat(const QMap<QString, QString> &map, csync_file_stat_t *file_stat)
+{
+    for (auto it = map.constBegin(); it != map.constEnd(); ++it) {
+        const QString &property = it.key();
+        const QString &value = it.value();
+        if (property == "resourcetype") {
+            file_stat->type = value.contains("collection") ? ItemTypeDirectory : ItemTypeFile;
+        } else if (property == "getlastmodified") {
+            file_stat->modtime = oc_httpdate_parse(value.toUtf8());
+        } else if (property == "getcontentlength") {
+            bool ok = false;
+            qlonglong ll = value.toLongLong(&ok);
+            file_stat->size = (ok && ll >= 0) ? ll : 0;
+        } else if (property == "getetag") {
+            file_stat->etag = Utility::normalizeEtag(value.toUtf8());
+        } else if (property == "id") {
+            file_stat->file_id = value.toUtf8();
+        } else if (property == "downloadURL") {
+            file_stat->directDownloadUrl = value.toUtf8();
+        } else if (property == "dDC") {
+            file_stat->directDownloadCookies = value.toUtf8();
+        } else if (property == "permissions") {
+            file_stat->remotePerm = RemotePermissions(value);
+        } else if (property == "checksums") {
+            file_stat->checksumHeader = findBestChecksum(value.toUtf8());
+        } else if (property == "share-types" && !value.isEmpty()) {
+            file_stat->remotePerm.setPermission(RemotePermissions::IsShared);
+        }
+    }
+}
+
+static bool parseWithPropertyMap(int entries)
+{
+    LsColXMLParser parser;
+    std::vector<std::unique_ptr<csync_file_stat_t>> results;
+    bool first = true;
+    QObject::connect(&parser, &LsColXMLParser::directoryListingIterated,
+        [&](const QString &name, const QMap<QString, QString> &properties) {
+            if (first) {
+                first = false; // the directory itself
+                return;
+            }
+            std::unique_ptr<csync_file_stat_t> file_stat(new csync_file_stat_t);
+            file_stat->size = -1;
+            file_stat->path = name.mid(int(qstrlen(listingPath)) + 1).toUtf8();
+            propertyMapToFileStat(properties, file_stat.get());
+            results.push_back(std::move(file_stat));
+        });
+
+    QByteArray reply;
+    generateReply(entries, [&](const QByteArray &data) { reply += data; });
+    const bool ok = parser.parse(reply, nullptr, QString::fromLatin1(listingPath));
+    return ok && int(results.size()) == entries - 1;
+}
+
+static bool parseReply(int entries, Mode mode)
+{
+    QElapsedTimer timer;
+    timer.start();
+    bool result = false;
+    if (mode == Mode::PropertyMap) {
+        result = parseWithPropertyMap(entries);
+    } else {
+        DiscoverySingleDirectoryJob job(Account::create(), QStringLiteral("bench"));
+        QScopedPointer<LsColXMLParser> parser(job.createParser());
+        bool ok = true;
+        if (mode == Mode::Buffered) {
+            QByteArray reply;
+            generateReply(entries, [&](const QByteArray &data) { reply += data; });
+            ok = parser->parse(reply, nullptr, QString::fromLatin1(listingPath));
+        } else {
+            parser->start(nullptr, QString::fromLatin1(listingPath));
+            generateReply(entries, [&](const QByteArray &data) { ok = parser->addData(data) && ok; });
+            ok = ok && parser->finish();
+        }
+        result = ok && int(job.takeResults().size()) == entries - 1;
+    }
+    static const char *const names[] = { "PROPERTY MAP PARSE:", "BUFFERED PARSE:", "INCREMENTAL PARSE:" };
+    qDebug() << names[int(mode)] << result << "in" << timer.elapsed() << "ms";
+    return result;
+}
+
+// Runs the parse in a child process and reports its peak resident set size
+static bool run(int entries, Mode mode)
+{
+#ifdef Q_OS_UNIX
+    fflush(nullptr);
+    const pid_t pid = fork();
+    if (pid == 0) {
+        _exit(parseReply(entries, mode) ? 0 : 1);
+    }
+    int status = 0;
+    struct rusage usage;
+    if (pid < 0 || wait4(pid, &status, 0, &usage) != pid) {
+        return false;
+    }
+    qDebug() << "    PEAK RSS (KiB)" << usage.ru_maxrss;
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+#else
+    return parseReply(entries, mode);
+#endif
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    const int entries = argc > 1 ? QByteArray(argv[1]).toInt() : 100000;
+    qDebug() << "ENTRIES" << entries;
+
+    bool result1 = run(entries, Mode::PropertyMap);
+    bool result2 = run(entries, Mode::Buffered);
+    bool result3 = run(entries, Mode::Incremental);
+    return (result1 && result2 && result3) ? 0 : -1;
+}
@@ -0,0 +1,60 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include "csync_private.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QLoggingCategory>
+#include <QDebug>
+
+// Reconcile a populated local tree against many new remote files.
+// Every remote file without local counterpart is also looked up by mangled name.
+
+static std::unique_ptr<csync_file_stat_t> makeFile(const QByteArray &path, const QByteArray &mangledName = QByteArray())
+{
+    std::unique_ptr<csync_file_stat_t> fs(new csync_file_stat_t);
+    fs->path = path;
+    fs->type = ItemTypeFile;
+    fs->instruction = CSYNC_INSTRUCTION_EVAL;
+    fs->e2eMangledName = mangledName;
+    return fs;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QLoggingCategory::setFilterRules(QStringLiteral("nextcloud.sync.csync.*.info=false"));
+
+    const int localFiles = argc > 1 ? QByteArray(argv[1]).toInt() : 100000;
+    const int newRemoteFiles = argc > 2 ? QByteArray(argv[2]).toInt() : 100000;
+
+    csync_s ctx("/tmp/benchreconcile", nullptr);
+    for (int i = 0; i < localFiles; ++i) {
+        QByteArray path = "local/file" + QByteArray::number(i);
+        // Part of the local tree is in an encrypted folder
+        QByteArray mangledName = i % 10 == 0 ? "local/" + QByteArray::number(i, 16).rightJustified(32, '0') : QByteArray();
+        ctx.local.files.insertFile(path, makeFile(path, mangledName));
+    }
+    for (int i = 0; i < newRemoteFiles; ++i) {
+        QByteArray path = "remote/new" + QByteArray::number(i);
+        ctx.remote.files.insertFile(path, makeFile(path));
+    }
+    qDebug() << "LOCAL FILES" << localFiles << "NEW REMOTE FILES" << newRemoteFiles;
+
+    QElapsedTimer timer;
+    timer.start();
+    csync_reconcile(&ctx);
+    qDebug() << "RECONCILE:" << timer.elapsed() << "ms";
+
+    int newFiles = 0;
+    for (const auto &pair : ctx.remote.files) {
+        if (pair.second->instruction == CSYNC_INSTRUCTION_NEW)
+            ++newFiles;
+    }
+    return newFiles == newRemoteFiles ? 0 : -1;
+}
@@ -0,0 +1,98 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include "syncenginetestutils.h"
+#include <syncengine.h>
+
+#include <QLoggingCategory>
+
+using namespace OCC;
+
+// Upload a few large files together with many small ones and one file the
+// user just touched, through a fake server with a round trip time and a link
+// of limited bandwidth. Reports when the recently touched file, the small
+// files and everything were done. The first argument overrides the round
+// trip time in ms, the second the bandwidth in MB/s.
+
+static const int largeFiles = 4;
+static const qint64 largeFileSize = 2 * 1000 * 1000;
+static const int smallFiles = 500;
+static const qint64 smallFileSize = 1000;
+
+static bool uploadAll(qint64 roundTrip, qint64 bytesPerMsec)
+{
+    FakeFolder fakeFolder{ FileInfo{} };
+    auto &local = fakeFolder.localModifier();
+    const auto yesterday = QDateTime::currentDateTimeUtc().addDays(-1);
+    local.mkdir("files");
+    for (int i = 0; i < largeFiles; ++i) {
+        const auto name = QStringLiteral("files/a_large%1").arg(i);
+        local.insert(name, largeFileSize);
+        local.setModTime(name, yesterday);
+    }
+    for (int i = 0; i < smallFiles; ++i) {
+        const auto name = QStringLiteral("files/file%1").arg(i);
+        local.insert(name, smallFileSize);
+        local.setModTime(name, yesterday);
+    }
+    local.insert("files/zz_recent", smallFileSize);
+
+    QElapsedTimer clock;
+    qint64 linkFreeAt = 0;
+    int inFlight = 0;
+    int maxInFlight = 0;
+    fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *outgoingData) -> QNetworkReply * {
+        QNetworkReply *reply = nullptr;
+        if (op == QNetworkAccessManager::PutOperation) {
+            const auto payload = outgoingData->readAll();
+            // The transfers share the link, each gets it in turn
+            linkFreeAt = qMax(linkFreeAt, clock.elapsed()) + payload.size() / bytesPerMsec;
+            reply = new DelayedReply<FakePutReply>(linkFreeAt - clock.elapsed() + roundTrip,
+                fakeFolder.remoteModifier(), op, request, payload, &fakeFolder.syncEngine());
+        } else if (request.attribute(QNetworkRequest::CustomVerbAttribute) == "MKCOL") {
+            reply = new DelayedReply<FakeMkcolReply>(roundTrip, fakeFolder.remoteModifier(), op, request, &fakeFolder.syncEngine());
+        }
+        if (reply) {
+            maxInFlight = qMax(maxInFlight, ++inFlight);
+            QObject::connect(reply, &QNetworkReply::finished, [&]() { --inFlight; });
+        }
+        return reply;
+    });
+
+    qint64 recentDone = -1;
+    qint64 smallDone = -1;
+    QObject::connect(&fakeFolder.syncEngine(), &SyncEngine::itemCompleted, [&](const SyncFileItemPtr &item) {
+        if (item->_file == QLatin1String("files/zz_recent"))
+            recentDone = clock.elapsed();
+        if (item->_size == smallFileSize)
+            smallDone = clock.elapsed();
+    });
+
+    clock.start();
+    bool result = fakeFolder.syncOnce();
+    qDebug() << "ROUND TRIP" << roundTrip << "ms, BANDWIDTH" << bytesPerMsec / 1000 << "MB/s:" << result
+             << "recent file after" << recentDone << "ms, small files after" << smallDone << "ms, all after"
+             << clock.elapsed() << "ms, at most" << maxInFlight << "requests in flight";
+    return result && fakeFolder.currentLocalState() == fakeFolder.currentRemoteState();
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QLoggingCategory::setFilterRules(QStringLiteral("nextcloud.sync.*.debug=false\nnextcloud.sync.*.info=false"));
+
+    if (argc > 1) {
+        const qint64 roundTrip = QByteArray(argv[1]).toLongLong();
+        const qint64 bandwidth = argc > 2 ? QByteArray(argv[2]).toLongLong() : 10;
+        return uploadAll(roundTrip, bandwidth * 1000) ? 0 : -1;
+    }
+
+    // A local network, then a slow link far away
+    bool result1 = uploadAll(1, 100 * 1000);
+    bool result2 = uploadAll(50, 2 * 1000);
+    return (result1 && result2) ? 0 : -1;
+}
@@ -205,9 +205,11 @@ static std::unique_ptr<csync_file_stat_t> create_fstat(const char *name,
 }
 
 static int failing_fn(CSYNC *ctx,
+                      csync_walk_s *walk,
                       std::unique_ptr<csync_file_stat_t> fs)
 {
   (void) ctx;
+  (void) walk;
   (void) fs;
 
   return -1;
@@ -223,7 +225,8 @@ static void check_csync_detect_update(void **state)
 
     fs = create_fstat("file.txt", 0, 1217597845);
 
-    rc = _csync_detect_update(csync, std::move(fs));
+    csync_walk_s walk(LOCAL_REPLICA);
+    rc = _csync_detect_update(csync, &walk, std::move(fs));
     assert_int_equal(rc, 0);
 
     /* the instruction should be set to new  */
@@ -246,7 +249,8 @@ static void check_csync_detect_update_db_none(void **state)
 
     fs = create_fstat("file.txt", 0, 1217597845);
 
-    rc = _csync_detect_update(csync, std::move(fs));
+    csync_walk_s walk(LOCAL_REPLICA);
+    rc = _csync_detect_update(csync, &walk, std::move(fs));
     assert_int_equal(rc, 0);
 
     /* the instruction should be set to new  */
@@ -267,7 +271,8 @@ static void check_csync_detect_update_db_eval(void **state)
 
     fs = create_fstat("file.txt", 0, 42);
 
-    rc = _csync_detect_update(csync, std::move(fs));
+    csync_walk_s walk(LOCAL_REPLICA);
+    rc = _csync_detect_update(csync, &walk, std::move(fs));
     assert_int_equal(rc, 0);
 
     /* the instruction should be set to new  */
@@ -289,7 +294,8 @@ static void check_csync_detect_update_db_rename(void **state)
 
     fs = create_fstat("wurst.txt", 0, 42);
 
-    rc = _csync_detect_update(csync, std::move(fs));
+    csync_walk_s walk(LOCAL_REPLICA);
+    rc = _csync_detect_update(csync, &walk, std::move(fs));
     assert_int_equal(rc, 0);
 
     /* the instruction should be set to rename */
@@ -313,7 +319,8 @@ static void check_csync_detect_update_db_new(void **state)
 
     fs = create_fstat("file.txt", 42000, 0);
 
-    rc = _csync_detect_update(csync, std::move(fs));
+    csync_walk_s walk(LOCAL_REPLICA);
+    rc = _csync_detect_update(csync, &walk, std::move(fs));
     assert_int_equal(rc, 0);
 
     /* the instruction should be set to new  */
@@ -330,7 +337,8 @@ static void check_csync_ftw(void **state)
     auto *csync = (CSYNC*)*state;
     int rc = 0;
 
-    rc = csync_ftw(csync, "/tmp", csync_walker, MAX_DEPTH);
+    csync_walk_s walk(LOCAL_REPLICA);
+    rc = csync_ftw(csync, &walk, "/tmp", csync_walker, MAX_DEPTH);
     assert_int_equal(rc, 0);
 }
 
@@ -339,7 +347,8 @@ static void check_csync_ftw_empty_uri(void **state)
     auto *csync = (CSYNC*)*state;
     int rc = 0;
 
-    rc = csync_ftw(csync, "", csync_walker, MAX_DEPTH);
+    csync_walk_s walk(LOCAL_REPLICA);
+    rc = csync_ftw(csync, &walk, "", csync_walker, MAX_DEPTH);
     assert_int_equal(rc, -1);
 }
 
@@ -348,7 +357,8 @@ static void check_csync_ftw_failing_fn(void **state)
     auto *csync = (CSYNC*)*state;
     int rc = 0;
 
-    rc = csync_ftw(csync, "/tmp", failing_fn, MAX_DEPTH);
+    csync_walk_s walk(LOCAL_REPLICA);
+    rc = csync_ftw(csync, &walk, "/tmp", failing_fn, MAX_DEPTH);
     assert_int_equal(rc, -1);
 }
 
@@ -103,10 +103,10 @@ static void check_csync_vio_opendir(void **state)
     csync_vio_handle_t *dh = nullptr;
     int rc = 0;
 
-    dh = csync_vio_opendir(csync, CSYNC_TEST_DIR);
+    dh = csync_vio_opendir(csync, LOCAL_REPLICA, CSYNC_TEST_DIR);
     assert_non_null(dh);
 
-    rc = csync_vio_closedir(csync, dh);
+    rc = csync_vio_closedir(csync, LOCAL_REPLICA, dh);
     assert_int_equal(rc, 0);
 }
 
@@ -122,7 +122,7 @@ static void check_csync_vio_opendir_perm(void **state)
     rc = _tmkdir(dir, (S_IWUSR|S_IXUSR));
     assert_int_equal(rc, 0);
 
-    dh = csync_vio_opendir(csync, CSYNC_TEST_DIR);
+    dh = csync_vio_opendir(csync, LOCAL_REPLICA, CSYNC_TEST_DIR);
     assert_null(dh);
     assert_int_equal(errno, EACCES);
 
@@ -135,7 +135,7 @@ static void check_csync_vio_closedir_null(void **state)
     auto *csync = (CSYNC*)*state;
     int rc = 0;
 
-    rc = csync_vio_closedir(csync, nullptr);
+    rc = csync_vio_closedir(csync, LOCAL_REPLICA, nullptr);
     assert_int_equal(rc, -1);
 }
 
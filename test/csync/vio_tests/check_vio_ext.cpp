@@ -27,6 +27,7 @@
 #include "csync_private.h"
 #include "std/c_utf8.h"
 #include "vio/csync_vio.h"
+#include "vio/csync_vio_local.h"
 
 #ifdef _WIN32
 #include <windows.h>
@@ -202,10 +203,10 @@ static void traverse_dir(void **state, const char *dir, int *cnt)
     const char *format_str = "%s C:%s";
 #endif
 
-    dh = csync_vio_opendir(csync, dir);
+    dh = csync_vio_opendir(csync, LOCAL_REPLICA, dir);
     assert_non_null(dh);
 
-    while( (dirent = csync_vio_readdir(csync, dh)) ) {
+    while( (dirent = csync_vio_readdir(csync, LOCAL_REPLICA, dh)) ) {
         assert_non_null(dirent.get());
         if (!dirent->original_path.isEmpty()) {
             sv->ignored_dir = c_strdup(dirent->original_path);
@@ -250,7 +251,7 @@ static void traverse_dir(void **state, const char *dir, int *cnt)
         SAFE_FREE(subdir_out);
     }
 
-    rc = csync_vio_closedir(csync, dh);
+    rc = csync_vio_closedir(csync, LOCAL_REPLICA, dh);
     assert_int_equal(rc, 0);
 
 }
@@ -453,6 +454,38 @@ static void check_readdir_bigunicode(void **state)
     assert_int_equal(files_cnt, 0);
 }
 
+static void check_readdir_prefetch(void **state)
+{
+    auto *sv = (statevar*) *state;
+    CSYNC *csync = sv->csync;
+
+    create_dirs("eins/zwei/drei/");
+    create_dirs("eins/vier/");
+    create_dirs("fuenf/sechs/sieben/acht/");
+    create_dirs("neun/");
+    create_file("eins/zwei/", "a.txt", "a");
+    create_file("eins/vier/", "b.txt", "b");
+    create_file("fuenf/sechs/sieben/", "c.txt", "c");
+    create_file("neun/", "d.txt", "d");
+
+    int files_cnt = 0;
+    traverse_dir(state, CSYNC_TEST_DIR, &files_cnt);
+    char *expected_result = sv->result;
+    sv->result = nullptr;
+
+    // Listing ahead must not change what is seen, nor its order
+    int prefetched_cnt = 0;
+    csync->local.prefetch = csync_vio_local_prefetch_start(CSYNC_TEST_DIR, 3, nullptr);
+    traverse_dir(state, CSYNC_TEST_DIR, &prefetched_cnt);
+    csync_vio_local_prefetch_stop(csync->local.prefetch);
+    csync->local.prefetch = nullptr;
+
+    assert_string_equal(sv->result, expected_result);
+    assert_int_equal(prefetched_cnt, files_cnt);
+    assert_int_equal(files_cnt, 4);
+    SAFE_FREE(expected_result);
+}
+
 int torture_run_tests(void)
 {
     const struct CMUnitTest tests[] = {
@@ -460,6 +493,7 @@ int torture_run_tests(void)
         cmocka_unit_test_setup_teardown(check_readdir_with_content, setup_testenv, teardown),
         cmocka_unit_test_setup_teardown(check_readdir_longtree, setup_testenv, teardown),
         cmocka_unit_test_setup_teardown(check_readdir_bigunicode, setup_testenv, teardown),
+        cmocka_unit_test_setup_teardown(check_readdir_prefetch, setup_testenv, teardown),
     };
 
     return cmocka_run_group_tests(tests, nullptr, nullptr);
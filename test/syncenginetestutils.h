@@ -13,7 +13,10 @@
 #include "syncengine.h"
 #include "common/syncjournaldb.h"
 
+#include <QCryptographicHash>
 #include <QDir>
+#include <QJsonDocument>
+#include <QJsonObject>
 #include <QNetworkReply>
 #include <QMap>
 #include <QtTest>
@@ -29,6 +32,7 @@
 static const QUrl sRootUrl("owncloud://somehost/owncloud/remote.php/webdav/");
 static const QUrl sRootUrl2("owncloud://somehost/owncloud/remote.php/dav/files/admin/");
 static const QUrl sUploadUrl("owncloud://somehost/owncloud/remote.php/dav/uploads/admin/");
+static const QUrl sBulkUploadUrl("owncloud://somehost/owncloud/remote.php/dav/bulk");
 
 inline QString getFilePathFromUrl(const QUrl &url) {
     QString path = url.path();
@@ -375,8 +379,15 @@ public:
         };
 
         writeFileResponse(*fileInfo);
-        foreach(const FileInfo &childFileInfo, fileInfo->children)
-           writeFileResponse(childFileInfo);
+        const bool depthInfinity = request.rawHeader("Depth") == "infinity";
+        std::function<void(const FileInfo &)> writeChildren = [&](const FileInfo &dir) {
+            foreach (const FileInfo &childFileInfo, dir.children) {
+                writeFileResponse(childFileInfo);
+                if (depthInfinity)
+                    writeChildren(childFileInfo);
+            }
+        };
+        writeChildren(*fileInfo);
         xml.writeEndElement(); // multistatus
         xml.writeEndDocument();
 
@@ -462,6 +473,128 @@ public:
     qint64 readData(char *, qint64) override { return 0; }
 };
 
+// Reply to a multipart/related POST of several files, see OCC::PutMultiFileJob
+class FakeBulkUploadReply : public QNetworkReply
+{
+    Q_OBJECT
+    bool _badRequest = false;
+public:
+    QByteArray payload;
+
+    FakeBulkUploadReply(FileInfo &remoteRootFileInfo, const QHash<QString, int> &errorPaths,
+        QNetworkAccessManager::Operation op, const QNetworkRequest &request, const QByteArray &body, QObject *parent)
+    : QNetworkReply{parent} {
+        setRequest(request);
+        setUrl(request.url());
+        setOperation(op);
+        open(QIODevice::ReadOnly);
+
+        const auto contentType = request.header(QNetworkRequest::ContentTypeHeader).toByteArray();
+        Q_ASSERT(contentType.startsWith("multipart/related; boundary="));
+        const QByteArray delimiter = "--" + contentType.mid(contentType.indexOf('=') + 1);
+
+        // Like the server, parse all parts before storing any
+        QVector<QPair<QMap<QByteArray, QByteArray>, QByteArray>> parts;
+        int pos = body.indexOf(delimiter) + delimiter.size();
+        Q_ASSERT(pos >= delimiter.size());
+        while (body.mid(pos, 2) != "--") {
+            pos += 2; // CRLF after the delimiter
+
+            QMap<QByteArray, QByteArray> headers;
+            forever {
+                const int end = body.indexOf("\r\n", pos);
+                Q_ASSERT(end >= 0);
+                const QByteArray line = body.mid(pos, end - pos);
+                pos = end + 2;
+                if (line.isEmpty())
+                    break;
+                const int colon = line.indexOf(':');
+                headers[line.left(colon).toLower()] = line.mid(colon + 1).trimmed();
+            }
+            const QByteArray data = body.mid(pos, headers["content-length"].toInt());
+            pos += data.size() + 2;
+            Q_ASSERT(body.mid(pos, delimiter.size()) == delimiter);
+            pos += delimiter.size();
+
+            // The server rejects the whole request for a part without a matching MD5
+            if (headers["x-file-md5"] != QCryptographicHash::hash(data, QCryptographicHash::Md5).toHex()) {
+                _badRequest = true;
+                QMetaObject::invokeMethod(this, "respond", Qt::QueuedConnection);
+                return;
+            }
+            parts.append({ headers, data });
+        }
+
+        QJsonObject results;
+        for (const auto &part : qAsConst(parts)) {
+            const auto &headers = part.first;
+            const auto &data = part.second;
+            const QString remotePath = QString::fromUtf8(headers["x-file-path"]);
+            const QString fileName = remotePath.mid(1);
+            QJsonObject result;
+            if (errorPaths.contains(fileName)) {
+                result[QStringLiteral("error")] = true;
+                result[QStringLiteral("message")] = QStringLiteral("Internal Server Fake Error");
+                results[remotePath] = result;
+                continue;
+            }
+
+            const char contentChar = data.isEmpty() ? 'W' : data.at(0);
+            FileInfo *fileInfo = remoteRootFileInfo.find(fileName);
+            if (fileInfo) {
+                fileInfo->size = data.size();
+                fileInfo->contentChar = contentChar;
+            } else {
+                fileInfo = remoteRootFileInfo.create(fileName, data.size(), contentChar);
+            }
+            fileInfo->lastModified = OCC::Utility::qDateTimeFromTime_t(headers["x-file-mtime"].toLongLong());
+            remoteRootFileInfo.find(fileName, /*invalidateEtags=*/true);
+
+            result[QStringLiteral("error")] = false;
+            result[QStringLiteral("etag")] = fileInfo->etag;
+            result[QStringLiteral("fileid")] = QString::fromUtf8(fileInfo->fileId);
+            result[QStringLiteral("checksum")] = QString::fromUtf8(headers["oc-checksum"]);
+            results[remotePath] = result;
+        }
+        payload = QJsonDocument(results).toJson();
+
+        QMetaObject::invokeMethod(this, "respond", Qt::QueuedConnection);
+    }
+
+    Q_INVOKABLE void respond() {
+        if (_badRequest) {
+            setAttribute(QNetworkRequest::HttpStatusCodeAttribute, 400);
+            setError(ProtocolInvalidOperationError, "Bad Request");
+            setFinished(true);
+            emit metaDataChanged();
+            emit finished();
+            return;
+        }
+        setHeader(QNetworkRequest::ContentLengthHeader, payload.size());
+        setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
+        setAttribute(QNetworkRequest::HttpStatusCodeAttribute, 200);
+        setFinished(true);
+        emit metaDataChanged();
+        if (bytesAvailable())
+            emit readyRead();
+        emit finished();
+    }
+
+    void abort() override
+    {
+        setError(OperationCanceledError, "abort");
+        emit finished();
+    }
+
+    qint64 bytesAvailable() const override { return payload.size() + QIODevice::bytesAvailable(); }
+    qint64 readData(char *data, qint64 maxlen) override {
+        qint64 len = std::min(qint64{payload.size()}, maxlen);
+        std::copy(payload.cbegin(), payload.cbegin() + len, data);
+        payload.remove(0, len);
+        return len;
+    }
+};
+
 class FakeMkcolReply : public QNetworkReply
 {
     Q_OBJECT
@@ -485,7 +618,7 @@ public:
         QMetaObject::invokeMethod(this, "respond", Qt::QueuedConnection);
     }
 
-    Q_INVOKABLE void respond() {
+    Q_INVOKABLE virtual void respond() {
         setRawHeader("OC-FileId", fileInfo->fileId);
         setAttribute(QNetworkRequest::HttpStatusCodeAttribute, 201);
         emit metaDataChanged();
@@ -542,7 +675,7 @@ public:
         QMetaObject::invokeMethod(this, "respond", Qt::QueuedConnection);
     }
 
-    Q_INVOKABLE void respond() {
+    Q_INVOKABLE virtual void respond() {
         setAttribute(QNetworkRequest::HttpStatusCodeAttribute, 201);
         emit metaDataChanged();
         emit finished();
@@ -821,6 +954,9 @@ protected:
             if (auto reply = _override(op, request, outgoingData))
                 return reply;
         }
+        if (op == QNetworkAccessManager::PostOperation && request.url().path() == sBulkUploadUrl.path())
+            return new FakeBulkUploadReply{_remoteRootFileInfo, _errorPaths, op, request, outgoingData->readAll(), this};
+
         const QString fileName = getFilePathFromUrl(request.url());
         Q_ASSERT(!fileName.isNull());
         if (_errorPaths.contains(fileName))
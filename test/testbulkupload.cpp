@@ -0,0 +1,177 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QtTest>
+#include "syncenginetestutils.h"
+#include <syncengine.h>
+
+using namespace OCC;
+
+class TestBulkUpload : public QObject
+{
+    Q_OBJECT
+
+    int _bulkRequests = 0;
+    QStringList _puts;
+
+    void countRequests(FakeFolder &fakeFolder)
+    {
+        _bulkRequests = 0;
+        _puts.clear();
+        fakeFolder.setServerOverride([this](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (op == QNetworkAccessManager::PostOperation)
+                ++_bulkRequests;
+            if (op == QNetworkAccessManager::PutOperation)
+                _puts.append(getFilePathFromUrl(request.url()));
+            return nullptr;
+        });
+    }
+
+    static void insertSmallFiles(FakeFolder &fakeFolder, const QString &dir, int count)
+    {
+        for (int i = 0; i < count; ++i)
+            fakeFolder.localModifier().insert(QStringLiteral("%1/bulk%2").arg(dir).arg(i), 10 + i);
+    }
+
+private slots:
+
+    void testBulkUpload()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        fakeFolder.syncEngine().account()->setCapabilities({ { "dav", QVariantMap{ { "bulkupload", "1.0" } } } });
+        countRequests(fakeFolder);
+
+        insertSmallFiles(fakeFolder, "A", 10);
+        insertSmallFiles(fakeFolder, "B", 5);
+        fakeFolder.localModifier().insert("A/big", 200 * 1000);
+        fakeFolder.localModifier().appendByte("C/c1");
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+
+        // One request per directory, the large file and the changed one are PUT
+        QCOMPARE(_bulkRequests, 2);
+        _puts.sort();
+        QCOMPARE(_puts, QStringList({ "A/big", "C/c1" }));
+
+        // The journal has what the server replied
+        SyncJournalFileRecord record;
+        QVERIFY(fakeFolder.syncJournal().getFileRecord(QByteArray("A/bulk3"), &record));
+        QVERIFY(record.isValid());
+        QCOMPARE(record._fileId, fakeFolder.currentRemoteState().find("A/bulk3")->fileId);
+        QCOMPARE(record._etag, fakeFolder.currentRemoteState().find("A/bulk3")->etag.toUtf8());
+        QVERIFY(record._checksumHeader.startsWith("SHA1:"));
+
+        // Nothing left to do
+        countRequests(fakeFolder);
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(_bulkRequests, 0);
+        QVERIFY(_puts.isEmpty());
+    }
+
+    // Files the server did not accept are uploaded with a PUT of their own
+    void testPartialFailure()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        fakeFolder.syncEngine().account()->setCapabilities({ { "dav", QVariantMap{ { "bulkupload", "1.0" } } } });
+        countRequests(fakeFolder);
+
+        insertSmallFiles(fakeFolder, "A", 5);
+        fakeFolder.serverErrorPaths().append("A/bulk2");
+        QVERIFY(!fakeFolder.syncOnce());
+
+        QCOMPARE(_bulkRequests, 1);
+        QCOMPARE(_puts, QStringList({ "A/bulk2" }));
+        QVERIFY(fakeFolder.currentRemoteState().find("A/bulk1"));
+        QVERIFY(!fakeFolder.currentRemoteState().find("A/bulk2"));
+
+        // A single file left is not worth a bulk request
+        fakeFolder.serverErrorPaths().clear();
+        fakeFolder.syncJournal().wipeErrorBlacklist();
+        countRequests(fakeFolder);
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(_bulkRequests, 0);
+        QCOMPARE(_puts, QStringList({ "A/bulk2" }));
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+    }
+
+    // A server that fails the request as a whole gets individual PUTs
+    void testRequestFailure()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        fakeFolder.syncEngine().account()->setCapabilities({ { "dav", QVariantMap{ { "bulkupload", "1.0" } } } });
+
+        int bulkRequests = 0;
+        int puts = 0;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (op == QNetworkAccessManager::PostOperation) {
+                ++bulkRequests;
+                return new FakeErrorReply(op, request, this, 404);
+            }
+            if (op == QNetworkAccessManager::PutOperation)
+                ++puts;
+            return nullptr;
+        });
+
+        insertSmallFiles(fakeFolder, "A", 5);
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(bulkRequests, 1);
+        QCOMPARE(puts, 5);
+    }
+
+    // A file the server stored with another checksum than the one sent gets a PUT of its own
+    void testChecksumMismatch()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        fakeFolder.syncEngine().account()->setCapabilities({ { "dav", QVariantMap{ { "bulkupload", "1.0" } } },
+            { "checksums", QVariantMap{ { "supportedTypes", QStringList{ "SHA1" } } } } });
+
+        int bulkRequests = 0;
+        QStringList puts;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *outgoingData) -> QNetworkReply * {
+            if (op == QNetworkAccessManager::PostOperation) {
+                ++bulkRequests;
+                auto reply = new FakeBulkUploadReply(fakeFolder.remoteModifier(), {}, op, request, outgoingData->readAll(), this);
+                auto results = QJsonDocument::fromJson(reply->payload).object();
+                auto result = results.value("/A/bulk1").toObject();
+                result["checksum"] = QStringLiteral("SHA1:0000000000000000000000000000000000000000");
+                results["/A/bulk1"] = result;
+                reply->payload = QJsonDocument(results).toJson();
+                return reply;
+            }
+            if (op == QNetworkAccessManager::PutOperation)
+                puts.append(getFilePathFromUrl(request.url()));
+            return nullptr;
+        });
+
+        insertSmallFiles(fakeFolder, "A", 5);
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(bulkRequests, 1);
+        QCOMPARE(puts, QStringList({ "A/bulk1" }));
+
+        SyncJournalFileRecord record;
+        QVERIFY(fakeFolder.syncJournal().getFileRecord(QByteArray("A/bulk1"), &record));
+        QVERIFY(record.isValid());
+        QCOMPARE(record._etag, fakeFolder.currentRemoteState().find("A/bulk1")->etag.toUtf8());
+    }
+
+    void testNoCapability()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        countRequests(fakeFolder);
+
+        insertSmallFiles(fakeFolder, "A", 5);
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(_bulkRequests, 0);
+        QCOMPARE(_puts.size(), 5);
+    }
+};
+
+QTEST_GUILESS_MAIN(TestBulkUpload)
+#include "testbulkupload.moc"
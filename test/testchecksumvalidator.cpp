@@ -116,6 +116,103 @@ using namespace OCC;
         delete vali;
     }
 
+    void testUploadChecksummingMultiple() {
+        QFile file(_testfile);
+        QVERIFY(file.open(QIODevice::ReadOnly));
+        const QByteArray expectedSha256 = QCryptographicHash::hash(file.readAll(), QCryptographicHash::Sha256).toHex();
+
+        // All types in one pass, unknown ones stay null
+        QVector<QByteArray> types = { checkSumMD5C, checkSumSHA1C, checkSumSHA2C, "Klaas32" };
+        auto checksums = ComputeChecksum::computeNow(_testfile, types);
+        QCOMPARE(checksums.size(), types.size());
+        QCOMPARE(checksums[0], FileSystem::calcMd5(_testfile));
+        QCOMPARE(checksums[1], FileSystem::calcSha1(_testfile));
+        QCOMPARE(checksums[2], expectedSha256);
+        QVERIFY(checksums[3].isNull());
+#ifdef ZLIB_FOUND
+        QCOMPARE(ComputeChecksum::computeNow(_testfile, checkSumAdlerC), FileSystem::calcAdler32(_testfile));
+#endif
+
+        // The additional types of an asynchronous run
+        auto *vali = new ComputeChecksum(this);
+        _expectedType = OCC::checkSumSHA1C;
+        _expected = FileSystem::calcSha1(_testfile);
+        vali->setChecksumType(_expectedType);
+        vali->setAdditionalChecksumTypes({ checkSumMD5C, checkSumSHA2C });
+        connect(vali, SIGNAL(done(QByteArray,QByteArray)), this, SLOT(slotUpValidated(QByteArray,QByteArray)));
+        vali->start(_testfile);
+
+        QEventLoop loop;
+        connect(vali, SIGNAL(done(QByteArray,QByteArray)), &loop, SLOT(quit()), Qt::QueuedConnection);
+        loop.exec();
+
+        QCOMPARE(vali->checksum(checkSumSHA1C), _expected);
+        QCOMPARE(vali->checksum(checkSumMD5C), FileSystem::calcMd5(_testfile));
+        QCOMPARE(vali->checksum(checkSumSHA2C), expectedSha256);
+        QVERIFY(vali->checksum(checkSumAdlerC).isNull());
+
+        delete vali;
+    }
+
+    void testDownloadChecksummingAdditional() {
+        QByteArray sha1 = checkSumSHA1C;
+        sha1.append(":");
+        sha1.append(FileSystem::calcSha1(_testfile));
+        _successDown = false;
+
+        auto *vali = new ValidateChecksumHeader(this);
+        vali->setAdditionalChecksumType(checkSumMD5C);
+        connect(vali, SIGNAL(validated(QByteArray,QByteArray)), this, SLOT(slotDownValidated()));
+        vali->start(_testfile, sha1);
+
+        QTRY_VERIFY(_successDown);
+        QCOMPARE(vali->additionalChecksum(), FileSystem::calcMd5(_testfile));
+
+        // Nothing is read when there is nothing to validate
+        _successDown = false;
+        vali->start(_testfile, QByteArray());
+        QVERIFY(_successDown);
+        QVERIFY(vali->additionalChecksum().isNull());
+
+        delete vali;
+    }
+
+    void testDownloadChecksummingComputed() {
+        QFile file(_testfile);
+        QVERIFY(file.open(QIODevice::ReadOnly));
+        const QByteArray data = file.readAll();
+
+        // Fed piecewise, as while downloading
+        IncrementalChecksums checksums({ checkSumSHA1C, checkSumMD5C, "Klaas32" });
+        QVERIFY(!checksums.isEmpty());
+        for (int i = 0; i < data.size(); i += 1000) {
+            checksums.addData(data.constData() + i, qMin(1000, data.size() - i));
+        }
+        QCOMPARE(checksums.result(checkSumSHA1C), FileSystem::calcSha1(_testfile));
+        QCOMPARE(checksums.result(checkSumMD5C), FileSystem::calcMd5(_testfile));
+        QVERIFY(checksums.result("Klaas32").isNull());
+        QVERIFY(IncrementalChecksums({ QByteArray(), "Klaas32" }).isEmpty());
+
+        // The validation uses the computed checksums and doesn't need the file
+        const QString missingFile = _root + "/doesNotExist";
+        auto *vali = new ValidateChecksumHeader(this);
+        vali->setAdditionalChecksumType(checkSumMD5C);
+        connect(vali, SIGNAL(validated(QByteArray,QByteArray)), this, SLOT(slotDownValidated()));
+        connect(vali, SIGNAL(validationFailed(QString)), this, SLOT(slotDownError(QString)));
+
+        _successDown = false;
+        vali->start(missingFile, QByteArray(checkSumSHA1C) + ":" + checksums.result(checkSumSHA1C), &checksums);
+        QVERIFY(_successDown);
+        QCOMPARE(vali->additionalChecksum(), FileSystem::calcMd5(_testfile));
+
+        _expectedError = QLatin1String("The downloaded file does not match the checksum, it will be resumed.");
+        _errorSeen = false;
+        vali->start(missingFile, "SHA1:543345", &checksums);
+        QVERIFY(_errorSeen);
+
+        delete vali;
+    }
+
     void testDownloadChecksummingAdler() {
 #ifndef ZLIB_FOUND
         QSKIP("ZLIB not found.", SkipSingle);
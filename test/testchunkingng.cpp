@@ -8,6 +8,7 @@
 #include <QtTest>
 #include "syncenginetestutils.h"
 #include <syncengine.h>
+#include <common/syncjournaldb.h>
 
 using namespace OCC;
 
@@ -512,6 +513,171 @@ private slots:
         QVERIFY(fakeFolder.uploadState().children.first().name != chunkingId);
     }
 
+    // Several chunks of one file are uploaded at once and may complete in any order
+    void testParallelChunks() {
+        FakeFolder fakeFolder{FileInfo::A12_B12_C12_S12()};
+        fakeFolder.syncEngine().account()->setCapabilities({ { "dav", QVariantMap{ {"chunking", "1.0"} } } });
+        fakeFolder.syncEngine().account()->setServerVersion("10.0.0");
+        setChunkSize(fakeFolder.syncEngine(), 1 * 1000 * 1000);
+        const int size = 10 * 1000 * 1000; // 10 MB
+
+        // Later chunks get a quicker reply, so they finish before the earlier ones
+        int putsInFlight = 0;
+        int maxPutsInFlight = 0;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *outgoingData) -> QNetworkReply * {
+            if (op == QNetworkAccessManager::PutOperation) {
+                const int chunk = request.url().path().mid(request.url().path().lastIndexOf('/') + 1).toInt();
+                auto reply = new DelayedReply<FakePutReply>(10 * (10 - chunk), fakeFolder.uploadState(), op, request, outgoingData->readAll(), &fakeFolder.syncEngine());
+                maxPutsInFlight = qMax(maxPutsInFlight, ++putsInFlight);
+                QObject::connect(reply, &QNetworkReply::finished, [&]() { --putsInFlight; });
+                return reply;
+            } else if (request.attribute(QNetworkRequest::CustomVerbAttribute) == "MOVE") {
+                // All chunks must be on the server
+                Q_ASSERT(putsInFlight == 0);
+            }
+            return nullptr;
+        });
+
+        fakeFolder.localModifier().insert("A/a0", size);
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(fakeFolder.currentRemoteState().find("A/a0")->size, size);
+        QCOMPARE(fakeFolder.uploadState().children.count(), 1); // the transfer was done with chunking
+        QCOMPARE(fakeFolder.uploadState().children.first().children.count(), 10);
+        QVERIFY(maxPutsInFlight > 1);
+        QVERIFY(maxPutsInFlight <= 3); // OwncloudPropagator::maximumActiveTransferJob()
+    }
+
+    // Chunks that are sized dynamically are uploaded one after another
+    void testParallelChunksDynamicSize() {
+        FakeFolder fakeFolder{FileInfo::A12_B12_C12_S12()};
+        fakeFolder.syncEngine().account()->setCapabilities({ { "dav", QVariantMap{ {"chunking", "1.0"} } } });
+        fakeFolder.syncEngine().account()->setServerVersion("10.0.0");
+        SyncOptions options;
+        options._initialChunkSize = 1 * 1000 * 1000;
+        options._minChunkSize = 500 * 1000;
+        options._maxChunkSize = 2 * 1000 * 1000;
+        options._targetChunkUploadDuration = std::chrono::milliseconds(1000);
+        fakeFolder.syncEngine().setSyncOptions(options);
+        const int size = 5 * 1000 * 1000; // 5 MB
+
+        int putsInFlight = 0;
+        int maxPutsInFlight = 0;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *outgoingData) -> QNetworkReply * {
+            if (op == QNetworkAccessManager::PutOperation) {
+                auto reply = new DelayedReply<FakePutReply>(10, fakeFolder.uploadState(), op, request, outgoingData->readAll(), &fakeFolder.syncEngine());
+                maxPutsInFlight = qMax(maxPutsInFlight, ++putsInFlight);
+                QObject::connect(reply, &QNetworkReply::finished, [&]() { --putsInFlight; });
+                return reply;
+            }
+            return nullptr;
+        });
+
+        fakeFolder.localModifier().insert("A/a0", size);
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(fakeFolder.uploadState().children.count(), 1); // the transfer was done with chunking
+        QCOMPARE(maxPutsInFlight, 1);
+
+        // The chunk size followed the quick replies
+        QVERIFY(fakeFolder.uploadState().children.first().children.count() < 5);
+    }
+
+    // Resuming a parallel upload keeps the chunks that completed past a missing one
+    void testParallelChunksResume() {
+        FakeFolder fakeFolder{FileInfo::A12_B12_C12_S12()};
+        fakeFolder.syncEngine().account()->setCapabilities({ { "dav", QVariantMap{ {"chunking", "1.0"} } } });
+        fakeFolder.syncEngine().account()->setServerVersion("10.0.0");
+        setChunkSize(fakeFolder.syncEngine(), 1 * 1000 * 1000);
+        const int size = 10 * 1000 * 1000; // 10 MB
+
+        // The first chunk fails, the ones sent alongside it make it to the server
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (op == QNetworkAccessManager::PutOperation && request.url().path().endsWith("/00000000"))
+                return new FakeErrorReply(op, request, &fakeFolder.syncEngine(), 500);
+            return nullptr;
+        });
+
+        fakeFolder.localModifier().insert("A/a0", size);
+        QVERIFY(!fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.syncEngine().journal()->getUploadInfo("A/a0")._chunkSize, quint64(1 * 1000 * 1000));
+        QCOMPARE(fakeFolder.uploadState().children.count(), 1);
+        auto chunkingId = fakeFolder.uploadState().children.first().name;
+        const auto uploadedChunks = fakeFolder.uploadState().children.first().children.keys();
+        QVERIFY(!uploadedChunks.isEmpty());
+        QVERIFY(!uploadedChunks.contains("00000000"));
+
+        QStringList sentChunks;
+        bool sawDelete = false;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (op == QNetworkAccessManager::PutOperation) {
+                sentChunks.append(request.url().path().mid(request.url().path().lastIndexOf('/') + 1));
+            } else if (op == QNetworkAccessManager::DeleteOperation) {
+                sawDelete = true;
+            }
+            return nullptr;
+        });
+
+        fakeFolder.syncEngine().journal()->wipeErrorBlacklist();
+        QVERIFY(fakeFolder.syncOnce());
+        QVERIFY(!sawDelete);
+        QVERIFY(sentChunks.contains("00000000"));
+        for (const auto &chunk : uploadedChunks) {
+            QVERIFY(!sentChunks.contains(chunk));
+        }
+
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(fakeFolder.currentRemoteState().find("A/a0")->size, size);
+        // The same chunk id was re-used
+        QCOMPARE(fakeFolder.uploadState().children.count(), 1);
+        QCOMPARE(fakeFolder.uploadState().children.first().name, chunkingId);
+    }
+
+    // Resuming a parallel upload after parallel chunk upload was turned off sends one chunk at a time
+    void testParallelChunksResumeDisabled() {
+        FakeFolder fakeFolder{FileInfo::A12_B12_C12_S12()};
+        fakeFolder.syncEngine().account()->setCapabilities({ { "dav", QVariantMap{ {"chunking", "1.0"} } } });
+        fakeFolder.syncEngine().account()->setServerVersion("10.0.0");
+        setChunkSize(fakeFolder.syncEngine(), 1 * 1000 * 1000);
+        const int size = 10 * 1000 * 1000; // 10 MB
+
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (op == QNetworkAccessManager::PutOperation && request.url().path().endsWith("/00000000"))
+                return new FakeErrorReply(op, request, &fakeFolder.syncEngine(), 500);
+            return nullptr;
+        });
+
+        fakeFolder.localModifier().insert("A/a0", size);
+        QVERIFY(!fakeFolder.syncOnce());
+        QVERIFY(!fakeFolder.uploadState().children.first().children.isEmpty());
+
+        qputenv("OWNCLOUD_PARALLEL_CHUNK", "false");
+        int putsInFlight = 0;
+        int maxPutsInFlight = 0;
+        bool sawDelete = false;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *outgoingData) -> QNetworkReply * {
+            if (op == QNetworkAccessManager::PutOperation) {
+                auto reply = new DelayedReply<FakePutReply>(10, fakeFolder.uploadState(), op, request, outgoingData->readAll(), &fakeFolder.syncEngine());
+                maxPutsInFlight = qMax(maxPutsInFlight, ++putsInFlight);
+                QObject::connect(reply, &QNetworkReply::finished, [&]() { --putsInFlight; });
+                return reply;
+            } else if (op == QNetworkAccessManager::DeleteOperation) {
+                sawDelete = true;
+            }
+            return nullptr;
+        });
+
+        fakeFolder.syncEngine().journal()->wipeErrorBlacklist();
+        const bool result = fakeFolder.syncOnce();
+        qunsetenv("OWNCLOUD_PARALLEL_CHUNK");
+        QVERIFY(result);
+        // The chunks behind the failed first one can't be placed anymore
+        QVERIFY(sawDelete);
+        QCOMPARE(maxPutsInFlight, 1);
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(fakeFolder.currentRemoteState().find("A/a0")->size, size);
+    }
+
     // Check what happens when the connection is dropped on the PUT (non-chunking) or MOVE (chunking)
     // for on the issue #5106
     void connectionDroppedBeforeEtagRecieved_data()
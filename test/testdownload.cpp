@@ -9,6 +9,7 @@
 #include "syncenginetestutils.h"
 #include <syncengine.h>
 #include <owncloudpropagator.h>
+#include <propagatedownload.h>
 
 using namespace OCC;
 
@@ -242,6 +243,68 @@ private slots:
         QCOMPARE(getItem(completeSpy, "A/resendme")->_status, SyncFileItem::NormalError);
         QVERIFY(getItem(completeSpy, "A/resendme")->_errorString.contains(serverMessage));
     }
+
+    void testReadBufferSize()
+    {
+        const qint64 smallSize = 16 * 1024;
+        const qint64 largeSize = 4 * 1024 * 1024;
+
+        FakeFolder fakeFolder{ FileInfo{} };
+        QFile file(fakeFolder.localPath() + "download");
+        GETFileJob job(fakeFolder.syncEngine().account(), QStringLiteral("download"), &file, {}, {}, 0);
+        QCOMPARE(job.readBufferSize(), largeSize);
+
+        // A limited or choked download reads in small steps
+        job.setBandwidthLimited(true);
+        QCOMPARE(job.readBufferSize(), smallSize);
+        job.setChoked(true);
+        QCOMPARE(job.readBufferSize(), smallSize);
+        job.setBandwidthLimited(false);
+        QCOMPARE(job.readBufferSize(), smallSize);
+        job.setChoked(false);
+        QCOMPARE(job.readBufferSize(), largeSize);
+
+        job.setLargeBuffers(false);
+        QCOMPARE(job.readBufferSize(), smallSize);
+    }
+
+    // The reply of a download gets the buffer size of the options
+    void testReplyReadBufferSize_data()
+    {
+        QTest::addColumn<bool>("largeBuffers");
+        QTest::addColumn<qint64>("expected");
+
+        QTest::newRow("large") << true << qint64(4 * 1024 * 1024);
+        QTest::newRow("small") << false << qint64(16 * 1024);
+    }
+
+    void testReplyReadBufferSize()
+    {
+        QFETCH(bool, largeBuffers);
+        QFETCH(qint64, expected);
+
+        FakeFolder fakeFolder{ FileInfo{} };
+        SyncOptions options;
+        options._largeDownloadBuffers = largeBuffers;
+        fakeFolder.syncEngine().setSyncOptions(options);
+        fakeFolder.remoteModifier().insert("download", 1000);
+
+        qint64 readBufferSize = -1;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (op != QNetworkAccessManager::GetOperation)
+                return nullptr;
+            auto reply = new FakeGetReply(fakeFolder.remoteModifier(), op, request, this);
+            // The job sets the size right after the request is sent
+            connect(reply, &QNetworkReply::metaDataChanged, this, [&readBufferSize, reply] {
+                readBufferSize = reply->readBufferSize();
+            });
+            return reply;
+        });
+
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(readBufferSize, expected);
+    }
 };
 
 QTEST_GUILESS_MAIN(TestDownload)
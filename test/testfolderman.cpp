@@ -186,6 +186,60 @@ private slots:
         QCOMPARE(folderman->findGoodPathForNewSyncFolder(dirPath + "/ownCloud2", url),
             QString(dirPath + "/ownCloud22"));
     }
+
+    void testConcurrentSyncLimits()
+    {
+        QTemporaryDir dir;
+        ConfigFile::setConfDir(dir.path()); // we don't want to pollute the user's config file
+        QVERIFY(dir.isValid());
+        QDir dir2(dir.path());
+        for (auto sub : { "a1", "a2", "a3", "b1", "b2", "c1" })
+            QVERIFY(dir2.mkpath(sub));
+        QString dirPath = dir2.canonicalPath();
+
+        auto makeAccountState = [](const QString &url) {
+            AccountPtr account = Account::create();
+            account->setCredentials(new HttpCredentialsTest("testuser", "secret"));
+            account->setUrl(QUrl(url));
+            return AccountStatePtr(new AccountState(account));
+        };
+        auto accountA = makeAccountState("http://a.example.de");
+        auto accountB = makeAccountState("http://b.example.de");
+        auto accountC = makeAccountState("http://c.example.de");
+
+        FolderMan *folderman = FolderMan::instance();
+        QCOMPARE(folderman, &_fm);
+        auto a1 = folderman->addFolder(accountA.data(), folderDefinition(dirPath + "/a1"));
+        auto a2 = folderman->addFolder(accountA.data(), folderDefinition(dirPath + "/a2"));
+        auto a3 = folderman->addFolder(accountA.data(), folderDefinition(dirPath + "/a3"));
+        auto b1 = folderman->addFolder(accountB.data(), folderDefinition(dirPath + "/b1"));
+        auto b2 = folderman->addFolder(accountB.data(), folderDefinition(dirPath + "/b2"));
+        auto c1 = folderman->addFolder(accountC.data(), folderDefinition(dirPath + "/c1"));
+        QVERIFY(a1 && a2 && a3 && b1 && b2 && c1);
+
+        // By default two folders per account and four in total sync at once
+        _fm._currentSyncFolders = { a1 };
+        QCOMPARE(folderman->syncBlocking(a1), a1);
+        QVERIFY(!folderman->syncBlocking(a2));
+        _fm._currentSyncFolders = { a1, a2 };
+        QCOMPARE(folderman->syncBlocking(a3), a1);
+        QVERIFY(!folderman->syncBlocking(b1));
+        _fm._currentSyncFolders = { a1, a2, b1, b2 };
+        QCOMPARE(folderman->syncBlocking(c1), a1);
+
+        // Folders with local changes go first, blocked ones are skipped
+        _fm._currentSyncFolders = { a1, a2 };
+        _fm._scheduledFolders.clear();
+        _fm._scheduledFolders << a3 << b1 << b2;
+        QCOMPARE(_fm.nextFolderToSync(), b1);
+        QFile(dirPath + "/b2/file").open(QFile::WriteOnly);
+        b2->slotWatchedPathChanged(dirPath + "/b2/file");
+        QVERIFY(b2->hasLocalChanges());
+        QCOMPARE(_fm.nextFolderToSync(), b2);
+
+        _fm._currentSyncFolders.clear();
+        _fm._scheduledFolders.clear();
+    }
 };
 
 QTEST_APPLESS_MAIN(TestFolderMan)
@@ -5,6 +5,7 @@
  *          */
 
 #include <QtTest>
+#include <algorithm>
 
 #include "folderwatcher_linux.h"
 #include "common/utility.h"
@@ -62,6 +63,50 @@ private slots:
         QVERIFY2(ok, "findFoldersBelow failed.");
     }
 
+    // Test that the walk neither enters skipped directories nor follows symlinks
+    void testWalkFoldersBelow() {
+        QVERIFY(QFile::link(_root + "/a2", _root + "/a1/b1/link"));
+
+        QStringList dirs;
+        const std::atomic<bool> abort{ false };
+        bool ok = walkFoldersBelow(_root.toUtf8(), [&dirs](const QByteArray &path) {
+            dirs.append(QString::fromUtf8(path));
+            return !path.endsWith("/b1");
+        }, abort);
+        QVERIFY(ok);
+
+        QVERIFY(dirs.contains(_root + "/a1/b1"));
+        QVERIFY(!dirs.contains(_root + "/a1/b1/c1"));
+        QVERIFY(!dirs.contains(_root + "/a1/b1/link"));
+        QVERIFY(dirs.contains(_root + "/a1/b3/c3"));
+        QCOMPARE(dirs.count(), 9);
+
+        dirs.clear();
+        ok = walkFoldersBelow(_root.toUtf8(), [&dirs](const QByteArray &path) {
+            dirs.append(QString::fromUtf8(path));
+            return true;
+        }, abort);
+        QVERIFY(ok);
+        QVERIFY(!dirs.contains(_root + "/a1/b1/link"));
+        QCOMPARE(dirs.count(), 11);
+    }
+
+    // The directories below the root are watched in the background
+    void testRegistration() {
+        FolderWatcher watcher;
+        QSignalSpy registeredSpy(&watcher, &FolderWatcher::registrationFinished);
+        QSignalSpy changedSpy(&watcher, &FolderWatcher::pathChanged);
+        watcher.init(_root);
+        QVERIFY(registeredSpy.wait());
+        QCOMPARE(registeredSpy.first().first().toString(), _root);
+
+        // Without waiting, this change could come before its directory is watched
+        const QString file = _root + "/a1/b1/c1/registered.dat";
+        QVERIFY(Utility::writeRandomFile(file));
+        QTRY_VERIFY(std::any_of(changedSpy.cbegin(), changedSpy.cend(),
+            [&file](const QList<QVariant> &args) { return args.first().toString() == file; }));
+    }
+
     void cleanupTestCase() {
         if( _root.startsWith(QDir::tempPath() )) {
            system( QString("rm -rf %1").arg(_root).toLocal8Bit() );
@@ -69,5 +114,5 @@ private slots:
     }
 };
 
-QTEST_APPLESS_MAIN(TestInotifyWatcher)
+QTEST_GUILESS_MAIN(TestInotifyWatcher)
 #include "testinotifywatcher.moc"
@@ -0,0 +1,179 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QtTest>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include "syncenginetestutils.h"
+#include "pushchannel.h"
+
+using namespace OCC;
+
+static const QUrl sPushEndpoint("http://localhost/owncloud/push/poll");
+
+// A long-poll request that is held until the fake server answers it
+class FakePollReply : public QNetworkReply
+{
+    Q_OBJECT
+public:
+    QByteArray body;
+
+    FakePollReply(QNetworkAccessManager::Operation op, const QNetworkRequest &request, QObject *parent)
+        : QNetworkReply{ parent }
+    {
+        setRequest(request);
+        setUrl(request.url());
+        setOperation(op);
+        open(QIODevice::ReadOnly);
+    }
+
+    void answer(int httpCode, const QByteArray &answerBody)
+    {
+        body = answerBody;
+        setAttribute(QNetworkRequest::HttpStatusCodeAttribute, httpCode);
+        if (httpCode != 200)
+            setError(InternalServerError, "Fake push error");
+        emit metaDataChanged();
+        if (bytesAvailable())
+            emit readyRead();
+        setFinished(true);
+        emit finished();
+    }
+
+    void abort() override {}
+    qint64 bytesAvailable() const override { return body.size() + QIODevice::bytesAvailable(); }
+    qint64 readData(char *data, qint64 maxlen) override
+    {
+        qint64 len = std::min(qint64{ body.size() }, maxlen);
+        std::copy(body.cbegin(), body.cbegin() + len, data);
+        body.remove(0, static_cast<int>(len));
+        return len;
+    }
+};
+
+// Stands in for the server's push endpoint
+class FakePushServer : public QObject
+{
+    Q_OBJECT
+public:
+    int cursor = 1;
+    int errorCode = 0;
+    QStringList requestedCursors;
+    QPointer<FakePollReply> heldPoll;
+
+    QNetworkReply *handle(QNetworkAccessManager::Operation op, const QNetworkRequest &request)
+    {
+        if (request.url().path() != sPushEndpoint.path())
+            return nullptr;
+        auto requestCursor = QUrlQuery(request.url()).queryItemValue(QStringLiteral("cursor"));
+        requestedCursors.append(requestCursor);
+        auto reply = new FakePollReply(op, request, this);
+        if (errorCode) {
+            QTimer::singleShot(0, reply, [this, reply] { reply->answer(errorCode, QByteArray()); });
+        } else if (requestCursor.isEmpty()) {
+            QTimer::singleShot(0, reply, [this, reply] { reply->answer(200, changes({})); });
+        } else {
+            heldPoll = reply;
+        }
+        return reply;
+    }
+
+    void push(const QStringList &paths)
+    {
+        ++cursor;
+        heldPoll->answer(200, changes(paths));
+    }
+
+    void fail(int httpCode)
+    {
+        errorCode = httpCode;
+        heldPoll->answer(httpCode, QByteArray());
+    }
+
+private:
+    QByteArray changes(const QStringList &paths) const
+    {
+        QJsonObject json;
+        json.insert(QStringLiteral("cursor"), QString::number(cursor));
+        json.insert(QStringLiteral("changes"), QJsonArray::fromStringList(paths));
+        return QJsonDocument(json).toJson();
+    }
+};
+
+class TestPushChannel : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testPushedChanges()
+    {
+        FakeFolder fakeFolder{ FileInfo{} };
+        FakePushServer server;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) {
+            return server.handle(op, request);
+        });
+
+        PushChannel channel(fakeFolder.syncEngine().account(), sPushEndpoint);
+        QSignalSpy connectedSpy(&channel, &PushChannel::connectedChanged);
+        QSignalSpy changesSpy(&channel, &PushChannel::filesChanged);
+        channel.start();
+        QVERIFY(connectedSpy.wait());
+        QVERIFY(channel.isConnected());
+
+        // The next request waits for changes after the cursor it got
+        QTRY_VERIFY(server.heldPoll);
+        QCOMPARE(server.requestedCursors, QStringList({ "", "1" }));
+        QCOMPARE(changesSpy.count(), 0);
+
+        server.push({ "/A/a1", "/B" });
+        QCOMPARE(changesSpy.count(), 1);
+        QCOMPARE(changesSpy[0][0].toStringList(), QStringList({ "/A/a1", "/B" }));
+        QTRY_COMPARE(server.requestedCursors.last(), QString("2"));
+        QVERIFY(server.heldPoll);
+        QCOMPARE(connectedSpy.count(), 1);
+
+        // Stopping aborts the held request
+        channel.stop();
+        QVERIFY(!server.heldPoll);
+        QCOMPARE(connectedSpy.count(), 2);
+        QVERIFY(!channel.isConnected());
+    }
+
+    void testReconnect()
+    {
+        FakeFolder fakeFolder{ FileInfo{} };
+        FakePushServer server;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) {
+            return server.handle(op, request);
+        });
+
+        PushChannel channel(fakeFolder.syncEngine().account(), sPushEndpoint);
+        channel.setMinimumRetryDelay(std::chrono::milliseconds(50));
+        QSignalSpy connectedSpy(&channel, &PushChannel::connectedChanged);
+        channel.start();
+        QTRY_VERIFY(server.heldPoll);
+        QVERIFY(channel.isConnected());
+
+        // The channel drops, users poll until it is back
+        server.fail(503);
+        QVERIFY(!channel.isConnected());
+        QCOMPARE(connectedSpy.count(), 2);
+
+        // It retries after a delay, asking for what changed in the meantime
+        server.errorCode = 0;
+        QTRY_COMPARE(server.requestedCursors.count(), 3);
+        QCOMPARE(server.requestedCursors.last(), QString("1"));
+        QVERIFY(server.heldPoll);
+        server.push({ "/C" });
+        QVERIFY(channel.isConnected());
+        QCOMPARE(connectedSpy.count(), 3);
+    }
+};
+
+QTEST_GUILESS_MAIN(TestPushChannel)
+#include "testpushchannel.moc"
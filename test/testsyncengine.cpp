@@ -636,6 +636,37 @@ private slots:
             {});
 
         QVERIFY(!engine.shouldDiscoverLocally(""));
+
+        // A trailing slash stands for the whole subtree
+        fakeFolder.syncEngine().setLocalDiscoveryOptions(
+            LocalDiscoveryStyle::DatabaseAndFilesystem,
+            { "A/X/" });
+
+        QVERIFY(engine.shouldDiscoverLocally(""));
+        QVERIFY(engine.shouldDiscoverLocally("A"));
+        QVERIFY(engine.shouldDiscoverLocally("A/X"));
+        QVERIFY(engine.shouldDiscoverLocally("A/X/Y"));
+        QVERIFY(engine.shouldDiscoverLocally("A/X/Y/Z"));
+        QVERIFY(!engine.shouldDiscoverLocally("A/XY"));
+        QVERIFY(!engine.shouldDiscoverLocally("B"));
+    }
+
+    void testLocalDiscoverySubtree()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+
+        // A directory moved in with contents, as the folder watcher reports it
+        fakeFolder.localModifier().mkdir("A/N");
+        fakeFolder.localModifier().mkdir("A/N/sub");
+        fakeFolder.localModifier().insert("A/N/n1");
+        fakeFolder.localModifier().insert("A/N/sub/n2");
+        fakeFolder.localModifier().insert("B/b3");
+
+        fakeFolder.syncEngine().setLocalDiscoveryOptions(LocalDiscoveryStyle::DatabaseAndFilesystem, { "A/N/" });
+        QVERIFY(fakeFolder.syncOnce());
+        QVERIFY(fakeFolder.currentRemoteState().find("A/N/n1"));
+        QVERIFY(fakeFolder.currentRemoteState().find("A/N/sub/n2"));
+        QVERIFY(!fakeFolder.currentRemoteState().find("B/b3"));
     }
 
     void testDiscoveryHiddenFile()
@@ -664,6 +695,317 @@ private slots:
         QVERIFY(fakeFolder.currentRemoteState().find("B/.hidden"));
     }
 
+    /**
+     * Checks that prefetching directory listings during remote discovery
+     * produces the same result and never lists a directory twice.
+     */
+    void testParallelRemoteDiscovery_data()
+    {
+        QTest::addColumn<int>("maxParallelDiscoveryJobs");
+
+        QTest::newRow("serial") << 1;
+        QTest::newRow("parallel") << 4;
+    }
+
+    void testParallelRemoteDiscovery()
+    {
+        QFETCH(int, maxParallelDiscoveryJobs);
+
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        SyncOptions syncOptions;
+        syncOptions._maxParallelDiscoveryJobs = maxParallelDiscoveryJobs;
+        fakeFolder.syncEngine().setSyncOptions(syncOptions);
+
+        for (const QString &dir : { "A/x", "A/x/y", "A/x/y/z", "B/x", "B/x/y", "C/x" }) {
+            fakeFolder.remoteModifier().mkdir(dir);
+            fakeFolder.remoteModifier().insert(dir + "/file");
+        }
+
+        QStringList propfinds;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (request.attribute(QNetworkRequest::CustomVerbAttribute) == "PROPFIND")
+                propfinds.append(request.url().path());
+            return nullptr;
+        });
+
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(propfinds.size(), propfinds.toSet().size());
+
+        // Only the changed chain is listed, unchanged directories come from the db
+        propfinds.clear();
+        fakeFolder.remoteModifier().insert("A/x/y/z/file2");
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(propfinds.size(), 5); // root, A, A/x, A/x/y, A/x/y/z
+    }
+
+    /**
+     * Checks that new remote subtrees are listed with a single "Depth: infinity"
+     * PROPFIND when the server advertises it.
+     */
+    void testDepthInfinityDiscovery()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        fakeFolder.syncEngine().account()->setCapabilities({ { "dav", QVariantMap{ { "propfind", QVariantMap{ { "depth_infinity", true } } } } } });
+        QVERIFY(fakeFolder.syncOnce());
+
+        for (const QString &dir : { "N", "N/x", "N/x/y", "N/x/y/z", "N/empty" }) {
+            fakeFolder.remoteModifier().mkdir(dir);
+            fakeFolder.remoteModifier().insert(dir + "/file");
+        }
+        fakeFolder.remoteModifier().mkdir("N/empty/sub");
+
+        QList<QByteArray> depths;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (request.attribute(QNetworkRequest::CustomVerbAttribute) == "PROPFIND")
+                depths.append(request.rawHeader("Depth"));
+            return nullptr;
+        });
+
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        // The root with Depth 1, then the new subtree at once
+        QCOMPARE(depths, QList<QByteArray>() << "1" << "infinity");
+
+        // Known directories are listed one by one again
+        depths.clear();
+        fakeFolder.remoteModifier().insert("N/x/file2");
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(depths, QList<QByteArray>() << "1" << "1" << "1");
+    }
+
+    /**
+     * Checks that when the changed remote paths are known, only the directories
+     * containing them are listed and the rest comes from the db.
+     */
+    void testTargetedRemoteDiscovery()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        for (const QString &dir : { "A/x", "A/x/y", "A/x/y/z" }) {
+            fakeFolder.remoteModifier().mkdir(dir);
+            fakeFolder.remoteModifier().insert(dir + "/file");
+        }
+        QVERIFY(fakeFolder.syncOnce());
+
+        QStringList propfinds;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (request.attribute(QNetworkRequest::CustomVerbAttribute) == "PROPFIND")
+                propfinds.append(request.url().path());
+            return nullptr;
+        });
+        auto rootListed = [&] {
+            for (auto root : { sRootUrl.path(), sRootUrl2.path() }) {
+                if (propfinds.contains(root) || propfinds.contains(root.chopped(1)))
+                    return true;
+            }
+            return false;
+        };
+
+        fakeFolder.remoteModifier().appendByte("A/x/y/z/file");
+        fakeFolder.remoteModifier().insert("A/x/y/z/file2");
+        fakeFolder.remoteModifier().remove("A/x/y/file");
+        fakeFolder.remoteModifier().mkdir("A/x/y/new");
+        fakeFolder.remoteModifier().insert("A/x/y/new/file");
+        // Not reported, so not seen yet
+        fakeFolder.remoteModifier().insert("B/b3");
+
+        fakeFolder.syncEngine().setRemoteDiscoveryPaths({ "A/x/y/z/file", "A/x/y/z/file2", "A/x/y/file", "A/x/y/new" });
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(propfinds.size(), 3); // A/x/y, A/x/y/new, A/x/y/z
+        QVERIFY(!rootListed());
+        QCOMPARE(fakeFolder.currentLocalState().find("A/x/y/z/file")->size, fakeFolder.currentRemoteState().find("A/x/y/z/file")->size);
+        QVERIFY(fakeFolder.currentLocalState().find("A/x/y/z/file2"));
+        QVERIFY(!fakeFolder.currentLocalState().find("A/x/y/file"));
+        QVERIFY(fakeFolder.currentLocalState().find("A/x/y/new/file"));
+        QVERIFY(fakeFolder.currentLocalState().find("A/a1"));
+        QVERIFY(fakeFolder.currentLocalState().find("C/c1"));
+        QVERIFY(!fakeFolder.currentLocalState().find("B/b3"));
+
+        // The paths are only used once, the next sync discovers everything
+        propfinds.clear();
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QVERIFY(rootListed());
+
+        // A change in a directory the db doesn't know lists its closest known parent
+        propfinds.clear();
+        fakeFolder.remoteModifier().mkdir("C/n");
+        fakeFolder.remoteModifier().mkdir("C/n/m");
+        fakeFolder.remoteModifier().insert("C/n/m/file");
+        fakeFolder.syncEngine().setRemoteDiscoveryPaths({ "C/n/m/file" });
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(propfinds.size(), 3); // C, C/n, C/n/m
+
+        // Without valid etags in the db everything is listed again
+        propfinds.clear();
+        fakeFolder.remoteModifier().insert("S/s3");
+        fakeFolder.syncJournal().forceRemoteDiscoveryNextSync();
+        fakeFolder.syncEngine().setRemoteDiscoveryPaths({ "S/s3" });
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QVERIFY(rootListed());
+    }
+
+    /**
+     * Checks that walking the local tree while the remote one is discovered
+     * gives the same result as walking them one after the other.
+     */
+    void testParallelUpdateDetection_data()
+    {
+        QTest::addColumn<bool>("parallelUpdateDetection");
+        QTest::addColumn<int>("localDiscoveryThreads");
+
+        QTest::newRow("serial") << false << 0;
+        QTest::newRow("parallel") << true << 0;
+        QTest::newRow("serial prefetch") << false << 4;
+        QTest::newRow("parallel prefetch") << true << 4;
+    }
+
+    void testParallelUpdateDetection()
+    {
+        QFETCH(bool, parallelUpdateDetection);
+        QFETCH(int, localDiscoveryThreads);
+
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        SyncOptions syncOptions;
+        syncOptions._parallelUpdateDetection = parallelUpdateDetection;
+        syncOptions._localDiscoveryThreads = localDiscoveryThreads;
+        fakeFolder.syncEngine().setSyncOptions(syncOptions);
+
+        fakeFolder.localModifier().rename("A", "A2");
+        fakeFolder.localModifier().insert("B/local");
+        fakeFolder.localModifier().remove("C/c1");
+        fakeFolder.remoteModifier().rename("S", "S2");
+        fakeFolder.remoteModifier().insert("B/remote");
+        fakeFolder.remoteModifier().appendByte("C/c2");
+        fakeFolder.remoteModifier().mkdir("N");
+        fakeFolder.remoteModifier().insert("N/file");
+
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QVERIFY(fakeFolder.currentRemoteState().find("A2/a1"));
+        QVERIFY(fakeFolder.currentLocalState().find("S2/s1"));
+        QVERIFY(fakeFolder.currentRemoteState().find("B/local"));
+        QVERIFY(fakeFolder.currentLocalState().find("B/remote"));
+        QVERIFY(!fakeFolder.currentRemoteState().find("C/c1"));
+        QVERIFY(fakeFolder.currentLocalState().find("N/file"));
+    }
+
+    /**
+     * Checks that a folder renamed differently on both sides ends up the same
+     * way whether the walks run one after the other or at the same time.
+     */
+    void testParallelUpdateDetectionConflictingRenames()
+    {
+        auto syncConflictingRenames = [](bool parallelUpdateDetection) {
+            FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+            SyncOptions syncOptions;
+            syncOptions._parallelUpdateDetection = parallelUpdateDetection;
+            fakeFolder.syncEngine().setSyncOptions(syncOptions);
+
+            fakeFolder.localModifier().rename("A", "A_local");
+            fakeFolder.remoteModifier().rename("A", "A_remote");
+
+            fakeFolder.syncOnce();
+            fakeFolder.syncOnce();
+            return qMakePair(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        };
+
+        const auto serial = syncConflictingRenames(false);
+        QCOMPARE(serial.first, serial.second);
+        QVERIFY(serial.second.find("A_local") || serial.second.find("A_remote"));
+        for (int i = 0; i < 5; ++i) {
+            const auto parallel = syncConflictingRenames(true);
+            QCOMPARE(parallel.first, serial.first);
+            QCOMPARE(parallel.second, serial.second);
+        }
+    }
+
+    /**
+     * Checks that large transfers don't take all slots and that recently
+     * touched files are propagated first.
+     */
+    void testPropagationLanes()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        const auto yesterday = QDateTime::currentDateTimeUtc().addDays(-1);
+        for (int i = 0; i < 6; ++i) {
+            fakeFolder.localModifier().insert(QStringLiteral("A/large%1").arg(i), 200 * 1000);
+            fakeFolder.localModifier().setModTime(QStringLiteral("A/large%1").arg(i), yesterday);
+            fakeFolder.localModifier().insert(QStringLiteral("A/small%1").arg(i), 100);
+            fakeFolder.localModifier().setModTime(QStringLiteral("A/small%1").arg(i), yesterday);
+        }
+        fakeFolder.localModifier().insert("A/zz_recent", 100);
+
+        QStringList puts;
+        int largeInFlight = 0;
+        int maxLargeInFlight = 0;
+        int maxInFlight = 0;
+        int inFlight = 0;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *outgoingData) -> QNetworkReply * {
+            if (op != QNetworkAccessManager::PutOperation)
+                return nullptr;
+            puts.append(getFilePathFromUrl(request.url()));
+            const bool large = puts.last().contains("large");
+            auto reply = new DelayedReply<FakePutReply>(large ? 200 : 10, fakeFolder.remoteModifier(), op, request, outgoingData->readAll(), &fakeFolder.syncEngine());
+            maxInFlight = qMax(maxInFlight, ++inFlight);
+            if (large)
+                maxLargeInFlight = qMax(maxLargeInFlight, ++largeInFlight);
+            QObject::connect(reply, &QNetworkReply::finished, [&, large]() {
+                --inFlight;
+                if (large)
+                    --largeInFlight;
+            });
+            return reply;
+        });
+
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(puts.size(), 13);
+        QVERIFY(puts.indexOf("A/zz_recent") < puts.indexOf("A/small5"));
+        QVERIFY(maxLargeInFlight <= 3); // OwncloudPropagator::maximumActiveTransferJob()
+        QVERIFY(maxInFlight > maxLargeInFlight);
+        QVERIFY(maxInFlight <= 6); // OwncloudPropagator::hardMaximumActiveJob()
+    }
+
+    // A new remote file with the content of a synced local file is copied, not downloaded
+    void testDownloadLocalDuplicate()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        fakeFolder.localModifier().insert("A/photo", 100 * 1000, 'P');
+        QVERIFY(fakeFolder.syncOnce());
+        SyncJournalFileRecord record;
+        QVERIFY(fakeFolder.syncJournal().getFileRecord(QByteArray("A/photo"), &record));
+        QVERIFY(record._checksumHeader.startsWith("SHA1:"));
+
+        int gets = 0;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &, QIODevice *) -> QNetworkReply * {
+            if (op == QNetworkAccessManager::GetOperation)
+                ++gets;
+            return nullptr;
+        });
+
+        fakeFolder.remoteModifier().insert("B/photo", 100 * 1000, 'P');
+        fakeFolder.remoteModifier().find("B/photo")->checksums = record._checksumHeader;
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(gets, 0);
+
+        // The local files changed since they were synced, download
+        for (const auto &path : { QStringLiteral("A/photo"), QStringLiteral("B/photo") }) {
+            fakeFolder.localModifier().setContents(path, 'Q');
+            fakeFolder.localModifier().setModTime(path, QDateTime::currentDateTimeUtc().addDays(-1));
+        }
+        fakeFolder.remoteModifier().insert("C/photo", 100 * 1000, 'P');
+        fakeFolder.remoteModifier().find("C/photo")->checksums = record._checksumHeader;
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(gets, 1);
+    }
+
     void testNoLocalEncoding()
     {
         auto utf8Locale = QTextCodec::codecForLocale();
@@ -8,6 +8,7 @@
 
 #include <sqlite3.h>
 
+#include "common/ownsql.h"
 #include "common/syncjournaldb.h"
 #include "common/syncjournalfilerecord.h"
 
@@ -128,6 +129,166 @@ private slots:
         }
     }
 
+    void testSnapshot()
+    {
+        auto makeRecord = [](const QByteArray &path, quint64 inode, const QByteArray &fileId) {
+            SyncJournalFileRecord record;
+            record._path = path;
+            record._inode = inode;
+            record._modtime = dropMsecs(QDateTime::currentDateTime());
+            record._type = ItemTypeFile;
+            record._etag = "etag" + path;
+            record._fileId = fileId;
+            record._remotePerm = RemotePermissions("RW");
+            record._fileSize = 42;
+            record._checksumHeader = "MD5:mychecksum";
+            return record;
+        };
+        auto a = makeRecord("snap/a", 1001, "id1");
+        auto b = makeRecord("snap/b", 1002, "id2");
+        // Same file id as a, as for a file shared twice into the sync folder
+        auto c = makeRecord("snap/c", 1003, "id1");
+        auto encrypted = makeRecord("snap/encrypted", 1004, "id4");
+        encrypted._e2eMangledName = "snap/0123456789abcdef";
+        encrypted._isE2eEncrypted = true;
+        for (const auto &record : { a, b, c, encrypted })
+            QVERIFY(_db.setFileRecord(record));
+
+        auto snapshot = _db.loadSnapshot();
+        QVERIFY(snapshot);
+
+        // Every lookup gives the same answer as the database
+        SyncJournalFileRecord stored;
+        SyncJournalFileRecord fromSnapshot;
+        for (const auto &path : { "snap/a", "snap/b", "snap/c", "snap/encrypted", "snap/nonexistant", "" }) {
+            QVERIFY(_db.getFileRecord(QByteArray(path), &stored));
+            snapshot->getFileRecord(path, &fromSnapshot);
+            QVERIFY(fromSnapshot == stored);
+        }
+        snapshot->getFileRecord("snap/a", &fromSnapshot);
+        QVERIFY(fromSnapshot == a);
+
+        QVERIFY(_db.getFileRecordByInode(1002, &stored));
+        snapshot->getFileRecordByInode(1002, &fromSnapshot);
+        QVERIFY(fromSnapshot == b);
+        QVERIFY(fromSnapshot == stored);
+        snapshot->getFileRecordByInode(0, &fromSnapshot);
+        QVERIFY(!fromSnapshot.isValid());
+
+        QVERIFY(_db.getFileRecordByE2eMangledName(QStringLiteral("snap/0123456789abcdef"), &stored));
+        snapshot->getFileRecordByE2eMangledName("snap/0123456789abcdef", &fromSnapshot);
+        QVERIFY(fromSnapshot == encrypted);
+        QVERIFY(fromSnapshot == stored);
+        snapshot->getFileRecordByE2eMangledName("snap/encrypted", &fromSnapshot);
+        QVERIFY(!fromSnapshot.isValid());
+
+        QList<QByteArray> dbPaths;
+        QList<QByteArray> snapshotPaths;
+        QVERIFY(_db.getFileRecordsByFileId("id1", [&](const SyncJournalFileRecord &rec) { dbPaths.append(rec._path); }));
+        snapshot->getFileRecordsByFileId("id1", [&](const SyncJournalFileRecord &rec) { snapshotPaths.append(rec._path); });
+        std::sort(dbPaths.begin(), dbPaths.end());
+        QCOMPARE(snapshotPaths, dbPaths);
+        QCOMPARE(snapshotPaths, QList<QByteArray>({ "snap/a", "snap/c" }));
+
+        // The snapshot doesn't see later changes
+        QVERIFY(_db.deleteFileRecord("snap/a"));
+        snapshot->getFileRecord("snap/a", &fromSnapshot);
+        QVERIFY(fromSnapshot == a);
+        snapshot = _db.loadSnapshot();
+        snapshot->getFileRecord("snap/a", &fromSnapshot);
+        QVERIFY(!fromSnapshot.isValid());
+
+        for (const auto &path : { "snap/b", "snap/c", "snap/encrypted" })
+            QVERIFY(_db.deleteFileRecord(path));
+    }
+
+    void testFilesBelowPath()
+    {
+        auto makeRecord = [](const QByteArray &path, const QByteArray &mangledName = QByteArray()) {
+            SyncJournalFileRecord record;
+            record._path = path;
+            record._type = ItemTypeFile;
+            record._etag = "etag";
+            record._e2eMangledName = mangledName;
+            return record;
+        };
+        const QList<QByteArray> paths = { "below/foo", "below/foo-2", "below/foo/file", "below/foo/sub/file", "below/foobar", "below/foo.txt" };
+        for (const auto &path : paths)
+            QVERIFY(_db.setFileRecord(makeRecord(path)));
+        // Below below/foo by its mangled name only
+        QVERIFY(_db.setFileRecord(makeRecord("below/foo-3/secret", "below/foo/0123456789abcdef")));
+
+        auto filesBelow = [this](const QByteArray &path) {
+            QList<QByteArray> result;
+            _db.getFilesBelowPath(path, [&](const SyncJournalFileRecord &rec) { result.append(rec._path); });
+            return result;
+        };
+        // Directory contents follow the directory directly
+        QCOMPARE(filesBelow("below"), QList<QByteArray>({ "below/foo-2", "below/foo-3/secret", "below/foo.txt",
+                                          "below/foo", "below/foo/file", "below/foo/sub/file", "below/foobar" }));
+        QCOMPARE(filesBelow("below/foo"), QList<QByteArray>({ "below/foo-3/secret", "below/foo/file", "below/foo/sub/file" }));
+        QCOMPARE(filesBelow("below/foo/sub"), QList<QByteArray>({ "below/foo/sub/file" }));
+        auto all = filesBelow("");
+        QVERIFY(all.indexOf("below/foo-2") < all.indexOf("below/foo"));
+        QCOMPARE(all.indexOf("below/foo") + 1, all.indexOf("below/foo/file"));
+
+        // The subtree is read from the index, without sorting
+        _db.commit("check plan");
+        SqlDatabase db;
+        QVERIFY(db.openReadOnly(_db.databaseFilePath()));
+        SqlQuery plan("EXPLAIN QUERY PLAN SELECT path FROM metadata"
+                      " WHERE path||'/' > (?1||'/') AND path||'/' < (?1||'0') ORDER BY path||'/' ASC",
+            db);
+        plan.bindValue(1, QByteArray("below"));
+        QVERIFY(plan.exec());
+        QString details;
+        while (plan.next())
+            details += plan.stringValue(3);
+        QVERIFY2(details.contains("metadata_path_sort"), qPrintable(details));
+        QVERIFY2(!details.contains("TEMP B-TREE"), qPrintable(details));
+
+        for (const auto &path : paths)
+            QVERIFY(_db.deleteFileRecord(QString::fromUtf8(path)));
+        QVERIFY(_db.deleteFileRecord("below/foo-3/secret"));
+    }
+
+    void testCommitBatching()
+    {
+        _db.commit("start");
+        _db.takeCommitStatistics();
+        _db.setCommitBatching(3, std::chrono::hours(1));
+
+        _db.commitBatched("one");
+        _db.commitBatched("two");
+        auto statistics = _db.takeCommitStatistics();
+        QCOMPARE(statistics.requests, qint64(2));
+        QCOMPARE(statistics.commits, qint64(0));
+
+        // The batch is full
+        _db.commitBatched("three");
+        _db.commitBatched("four");
+        statistics = _db.takeCommitStatistics();
+        QCOMPARE(statistics.requests, qint64(2));
+        QCOMPARE(statistics.commits, qint64(1));
+        QCOMPARE(statistics.largestBatch, 3);
+
+        // A normal commit includes what is pending
+        _db.commit("five");
+        statistics = _db.takeCommitStatistics();
+        QCOMPARE(statistics.commits, qint64(1));
+        QCOMPARE(statistics.largestBatch, 2);
+
+        // A batch is committed after the delay at the latest
+        _db.setCommitBatching(100, std::chrono::milliseconds(10));
+        _db.commitBatched("six");
+        qint64 commits = 0;
+        QTRY_VERIFY((commits += _db.takeCommitStatistics().commits) == 1);
+
+        _db.setCommitBatching(1, std::chrono::milliseconds(0));
+        _db.commitBatched("seven");
+        QCOMPARE(_db.takeCommitStatistics().commits, qint64(1));
+    }
+
     void testDownloadInfo()
     {
         using Info = SyncJournalDb::DownloadInfo;
@@ -158,6 +319,7 @@ private slots:
         record._chunk = 12;
         record._transferid = 812974891;
         record._size = 12894789147;
+        record._chunkSize = 10 * 1000 * 1000;
         record._modtime = dropMsecs(QDateTime::currentDateTime());
         record._valid = true;
         _db.setUploadInfo("foo", record);
@@ -621,6 +621,117 @@ private slots:
 
         QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
     }
+
+    // A directory rename only holds up what is below its old or new name
+    void testDirectoryRenameDependencies()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        fakeFolder.remoteModifier().mkdir("A/x");
+        fakeFolder.remoteModifier().insert("A/x/f1");
+        fakeFolder.remoteModifier().insert("A/x/f2");
+        QVERIFY(fakeFolder.syncOnce());
+
+        fakeFolder.localModifier().rename("A/x", "A/y");
+        fakeFolder.localModifier().rename("A/y/f1", "C/f1");
+        fakeFolder.localModifier().insert("C/new");
+
+        bool renameDone = false;
+        bool putDuringRename = false;
+        bool moveBeforeRename = false;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            const bool isMove = request.attribute(QNetworkRequest::CustomVerbAttribute) == "MOVE";
+            if (isMove && getFilePathFromUrl(request.url()) == "A/x") {
+                auto reply = new DelayedReply<FakeMoveReply>(200, fakeFolder.remoteModifier(), op, request, &fakeFolder.syncEngine());
+                QObject::connect(reply, &QNetworkReply::finished, [&]() { renameDone = true; });
+                return reply;
+            }
+            if (isMove && !renameDone)
+                moveBeforeRename = true;
+            if (op == QNetworkAccessManager::PutOperation && !renameDone)
+                putDuringRename = true;
+            return nullptr;
+        });
+
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QVERIFY(renameDone);
+        // C/new is independent of the rename, C/f1 comes from the renamed directory
+        QVERIFY(putDuringRename);
+        QVERIFY(!moveBeforeRename);
+    }
+
+    // A rename below a directory that could not be created does not hold up the sync
+    void testDirectoryRenameBelowFailedMkdir()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        fakeFolder.remoteModifier().mkdir("A/x");
+        fakeFolder.remoteModifier().insert("A/x/f1");
+        fakeFolder.remoteModifier().insert("A/x/f2");
+        QVERIFY(fakeFolder.syncOnce());
+
+        fakeFolder.localModifier().mkdir("N");
+        fakeFolder.localModifier().rename("A/x", "N/x");
+        fakeFolder.localModifier().rename("N/x/f1", "C/f1");
+        fakeFolder.localModifier().insert("C/new");
+
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (request.attribute(QNetworkRequest::CustomVerbAttribute) == "MKCOL" && getFilePathFromUrl(request.url()) == "N")
+                return new FakeErrorReply(op, request, this, 403);
+            return nullptr;
+        });
+
+        // Finishes, with an error for the directory
+        QVERIFY(!fakeFolder.syncOnce());
+        QVERIFY(!fakeFolder.currentRemoteState().find("N"));
+        QVERIFY(fakeFolder.currentRemoteState().find("C/new"));
+    }
+
+    // What is moved out of a deleted directory is moved before the directory is removed
+    void testRenameOutOfDeletedDirectory_data()
+    {
+        QTest::addColumn<bool>("local");
+        QTest::newRow("local") << true;
+        QTest::newRow("remote") << false;
+    }
+    void testRenameOutOfDeletedDirectory()
+    {
+        QFETCH(bool, local);
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        fakeFolder.remoteModifier().mkdir("A/x");
+        fakeFolder.remoteModifier().insert("A/x/f1");
+        QVERIFY(fakeFolder.syncOnce());
+
+        FileModifier &modifier = local ? static_cast<FileModifier &>(fakeFolder.localModifier()) : fakeFolder.remoteModifier();
+        modifier.rename("A/x", "B/x");
+        modifier.rename("A/a1", "C/a1");
+        modifier.remove("A");
+
+        int movesInFlight = 0;
+        bool deleteDuringMove = false;
+        int nGET = 0;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (request.attribute(QNetworkRequest::CustomVerbAttribute) == "MOVE") {
+                auto reply = new DelayedReply<FakeMoveReply>(100, fakeFolder.remoteModifier(), op, request, &fakeFolder.syncEngine());
+                ++movesInFlight;
+                QObject::connect(reply, &QNetworkReply::finished, [&]() { --movesInFlight; });
+                return reply;
+            }
+            if (op == QNetworkAccessManager::DeleteOperation && movesInFlight > 0)
+                deleteDuringMove = true;
+            if (op == QNetworkAccessManager::GetOperation)
+                ++nGET;
+            return nullptr;
+        });
+
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QVERIFY(!deleteDuringMove);
+        // Nothing was lost with the directory and had to be downloaded again
+        QCOMPARE(nGET, 0);
+        QVERIFY(fakeFolder.currentLocalState().find("B/x/f1"));
+        QVERIFY(fakeFolder.currentLocalState().find("C/a1"));
+        QVERIFY(!fakeFolder.currentLocalState().find("A"));
+    }
 };
 
 QTEST_GUILESS_MAIN(TestSyncMove)
@@ -0,0 +1,145 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QtTest>
+
+#include "account.h"
+#include "owncloudpropagator.h"
+#include "propagateupload.h"
+
+using namespace OCC;
+
+// The read-ahead buffer of UploadDevice::fillBuffer()
+static const qint64 bufferSize = 1024 * 1024;
+
+class TestUploadDevice : public QObject
+{
+    Q_OBJECT
+
+    QTemporaryDir _tempDir;
+    QString _fileName;
+    QByteArray _data;
+    QScopedPointer<OwncloudPropagator> _propagator;
+
+    // Like QIODevice::read(), but goes on after a short read
+    static QByteArray readFully(QIODevice &device, qint64 size)
+    {
+        QByteArray result;
+        while (result.size() < size) {
+            const QByteArray data = device.read(size - result.size());
+            if (data.isEmpty())
+                break;
+            result += data;
+        }
+        return result;
+    }
+
+private slots:
+    void initTestCase()
+    {
+        QVERIFY(_tempDir.isValid());
+        _fileName = _tempDir.path() + "/data";
+        _propagator.reset(new OwncloudPropagator(Account::create(), _tempDir.path(), QStringLiteral("/"), nullptr));
+    }
+
+    void init()
+    {
+        // Every byte tells its position, so a read from the wrong place shows
+        _data.resize(3 * bufferSize + 1000);
+        for (int i = 0; i < _data.size(); ++i)
+            _data[i] = char(i % 251);
+        QFile file(_fileName);
+        QVERIFY(file.open(QFile::WriteOnly | QFile::Truncate));
+        QCOMPARE(file.write(_data), qint64(_data.size()));
+    }
+
+    void testReadAcrossBufferBoundary()
+    {
+        UploadDevice device(&_propagator->_bandwidthManager);
+        const qint64 start = 1000;
+        const qint64 size = 2 * bufferSize + 500;
+        QVERIFY(device.prepareAndOpen(_fileName, start, size));
+        QCOMPARE(device.size(), size);
+
+        // Reads that end past the end of the buffered data get the rest from the next fill
+        QByteArray result;
+        while (!device.atEnd()) {
+            const QByteArray data = readFully(device, 300 * 1000);
+            QVERIFY(!data.isEmpty());
+            result += data;
+        }
+        QCOMPARE(result.size(), int(size));
+        QVERIFY(result == _data.mid(start, size));
+
+        // A single read across the boundary
+        QVERIFY(device.seek(bufferSize - 10));
+        QVERIFY(readFully(device, 20) == _data.mid(start + bufferSize - 10, 20));
+    }
+
+    void testSeekBackOutsideBuffer()
+    {
+        UploadDevice device(&_propagator->_bandwidthManager);
+        const qint64 start = 100;
+        const qint64 size = 3 * bufferSize;
+        QVERIFY(device.prepareAndOpen(_fileName, start, size));
+
+        // The buffer now holds the data past the first block
+        QVERIFY(readFully(device, 2 * bufferSize + 10) == _data.mid(start, 2 * bufferSize + 10));
+
+        // Like a retry of the request
+        QVERIFY(device.seek(0));
+        QVERIFY(readFully(device, 1000) == _data.mid(start, 1000));
+        QVERIFY(device.seek(bufferSize + 5));
+        QVERIFY(readFully(device, 1000) == _data.mid(start + bufferSize + 5, 1000));
+
+        QVERIFY(!device.seek(size + 1));
+    }
+
+    void testBandwidthQuota()
+    {
+        UploadDevice device(&_propagator->_bandwidthManager);
+        QVERIFY(device.prepareAndOpen(_fileName, 0, 2 * bufferSize));
+
+        device.setBandwidthLimited(true);
+        device.giveBandwidthQuota(1000);
+        QCOMPARE(device.read(5000), _data.mid(0, 1000));
+        QCOMPARE(device.read(5000), QByteArray());
+
+        // The quota may end past the buffered data
+        QVERIFY(device.seek(bufferSize - 100));
+        device.giveBandwidthQuota(300);
+        QVERIFY(readFully(device, 5000) == _data.mid(bufferSize - 100, 300));
+
+        device.giveBandwidthQuota(300);
+        device.setChoked(true);
+        QCOMPARE(device.read(5000), QByteArray());
+        device.setChoked(false);
+        QVERIFY(readFully(device, 5000) == _data.mid(bufferSize + 200, 300));
+    }
+
+    void testFileShrinks()
+    {
+        UploadDevice device(&_propagator->_bandwidthManager);
+        const qint64 size = 3 * bufferSize;
+        QVERIFY(device.prepareAndOpen(_fileName, 0, size));
+        QVERIFY(readFully(device, bufferSize + 10) == _data.mid(0, bufferSize + 10));
+
+        // The data that is buffered is still sent, then the device fails
+        QVERIFY(QFile(_fileName).resize(bufferSize + 100));
+        QByteArray buffer(64 * 1024, 0);
+        qint64 total = bufferSize + 10;
+        qint64 read = 0;
+        while ((read = device.read(buffer.data(), buffer.size())) > 0)
+            total += read;
+        QCOMPARE(read, qint64(-1));
+        QCOMPARE(total, 2 * bufferSize);
+        QVERIFY(!device.errorString().isEmpty());
+    }
+};
+
+QTEST_GUILESS_MAIN(TestUploadDevice)
+#include "testuploaddevice.moc"
@@ -123,6 +123,68 @@ private slots:
         QVERIFY(_subdirs.size() == 1);
     }
 
+    void testParserIncremental() {
+        const QByteArray testXml = "<?xml version='1.0' encoding='utf-8'?>"
+              "<d:multistatus xmlns:d=\"DAV:\" xmlns:s=\"http://sabredav.org/ns\" xmlns:oc=\"http://owncloud.org/ns\">"
+              "<d:response>"
+              "<d:href>/oc/remote.php/webdav/sharefolder/</d:href>"
+              "<d:propstat>"
+              "<d:prop>"
+              "<oc:id>00004213ocobzus5kn6s</oc:id>"
+              "<oc:permissions>RDNVCK</oc:permissions>"
+              "<d:getetag>\"5527beb0400b0\"</d:getetag>"
+              "<d:resourcetype>"
+              "<d:collection/>"
+              "</d:resourcetype>"
+              "</d:prop>"
+              "<d:status>HTTP/1.1 200 OK</d:status>"
+              "</d:propstat>"
+              "</d:response>"
+              "<d:response>"
+              "<d:href>/oc/remote.php/webdav/sharefolder/quitte.pdf</d:href>"
+              "<d:propstat>"
+              "<d:prop>"
+              "<oc:id>00004215ocobzus5kn6s</oc:id>"
+              "<d:getetag>\"2fa2f0d9ed49ea0c3e409d49e652dea0\"</d:getetag>"
+              "<d:resourcetype/>"
+              "<d:getcontentlength>121780</d:getcontentlength>"
+              "</d:prop>"
+              "<d:status>HTTP/1.1 200 OK</d:status>"
+              "</d:propstat>"
+              "</d:response>"
+              "</d:multistatus>";
+
+        LsColXMLParser parser;
+        QMap<QString, QString> lastProperties;
+        connect(&parser, &LsColXMLParser::directoryListingSubfolders, this, &TestXmlParse::slotDirectoryListingSubFolders);
+        connect(&parser, &LsColXMLParser::directoryListingIterated, this, &TestXmlParse::slotDirectoryListingIterated);
+        connect(&parser, &LsColXMLParser::directoryListingIterated,
+            [&](const QString &, const QMap<QString, QString> &properties) { lastProperties = properties; });
+        connect(&parser, &LsColXMLParser::finishedWithoutError, this, &TestXmlParse::slotFinishedSuccessfully);
+
+        // Feed the data byte by byte, as a slow network would
+        QHash<QString, ExtraFolderInfo> sizes;
+        parser.start(&sizes, "/oc/remote.php/webdav/sharefolder");
+        const int secondResponse = testXml.indexOf("<d:response>", testXml.indexOf("</d:response>"));
+        for (int i = 0; i < testXml.size(); ++i) {
+            QVERIFY(parser.addData(testXml.mid(i, 1)));
+            if (i == secondResponse) {
+                // The first response was reported before the end of the reply
+                QCOMPARE(_items, QStringList{ "/oc/remote.php/webdav/sharefolder" });
+                QCOMPARE(lastProperties.value("permissions"), QString("RDNVCK"));
+            }
+        }
+        QVERIFY(!_success);
+        QVERIFY(parser.finish());
+        QVERIFY(_success);
+
+        QCOMPARE(_items.size(), 2);
+        QVERIFY(_items.contains("/oc/remote.php/webdav/sharefolder/quitte.pdf"));
+        QCOMPARE(lastProperties.value("getcontentlength"), QString("121780"));
+        QCOMPARE(lastProperties.value("getetag"), QString("\"2fa2f0d9ed49ea0c3e409d49e652dea0\""));
+        QCOMPARE(_subdirs, QStringList{ "/oc/remote.php/webdav/sharefolder/" });
+    }
+
     void testParserBrokenXml() {
         const QByteArray testXml = "X<?xml version='1.0' encoding='utf-8'?>"
               "<d:multistatus xmlns:d=\"DAV:\" xmlns:s=\"http://sabredav.org/ns\" xmlns:oc=\"http://owncloud.org/ns\">"